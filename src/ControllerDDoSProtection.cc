@@ -7,99 +7,375 @@
 #include "api/PacketMissHandler.hh"
 #include "api/TraceablePacket.hh"
 #include "types/ethaddr.hh"
+#include "types/IPv6Addr.hh"
 #include "oxm/openflow_basic.hh"
 
-REGISTER_APPLICATION(ControllerDDoSProtection, {"controller", "switch-manager", ""})
+#include <algorithm>
+#include <type_traits>
+#include <unordered_map>
+
+#include <arpa/inet.h>
+
+REGISTER_APPLICATION(ControllerDDoSProtection, {"controller", "switch-manager", "host-manager", "rest-listener", ""})
 
-bool ControllerDDoSProtection::isDDoS = false;
-size_t ControllerDDoSProtection::detectNotDDoScounter = 0;
 Users ControllerDDoSProtection::users;
 Params ControllerDDoSProtection::params;
 ControllerDDoSProtection::SPRTdetection ControllerDDoSProtection::detection;
+ControllerDDoSProtection::AclTable ControllerDDoSProtection::aclTable;
+TableOccupancy ControllerDDoSProtection::tableOccupancy;
+StatsCheck ControllerDDoSProtection::statsCheck;
+FlowRemovedQueue ControllerDDoSProtection::flowRemovedQueue;
+Entropy ControllerDDoSProtection::entropy;
+HeavyHitters ControllerDDoSProtection::packetInHitters;
+HeavyHitters ControllerDDoSProtection::packetHitters;
+FanIn ControllerDDoSProtection::fanIn;
+bool ControllerDDoSProtection::isL2FloodEnabled = false;
+L2Flood ControllerDDoSProtection::l2Flood;
+Replication ControllerDDoSProtection::replication;
+Journal ControllerDDoSProtection::journal;
+Classifier ControllerDDoSProtection::classifier(fanIn, packetInHitters);
+bool ControllerDDoSProtection::isIPv6Prefix64 = false;
 
 
 class DecisionHandler {
 public:
     static Decision setNormalTimeouts (Decision decision)
     {
+        Metrics::count(Metrics::Outcomes::Normal);
         return decision.idle_timeout(std::chrono::seconds(NORMAL_IDLE_TIMEOUT))
                 .hard_timeout(std::chrono::minutes(NORMAL_HARD_TIMEOUT));
     }
 
     static Decision setShortTimeouts (Decision decision)
     {
+        Metrics::count(Metrics::Outcomes::Short);
         return decision.idle_timeout(std::chrono::seconds(SHORT_IDLE_TIMEOUT))
                 .hard_timeout(std::chrono::minutes(SHORT_HARD_TIMEOUT));
     }
+
+    static Decision setTightTimeouts (Decision decision)
+    {
+        Metrics::count(Metrics::Outcomes::Tight);
+        return decision.idle_timeout(std::chrono::seconds(TIGHT_IDLE_TIMEOUT))
+                .hard_timeout(std::chrono::minutes(TIGHT_HARD_TIMEOUT));
+    }
+
+    // Flow table of the switch overrides the users' timeouts
+    static Decision setTimeouts (Decision decision, bool isShort, TableOccupancy::Levels level)
+    {
+        switch (level)
+        {
+        case TableOccupancy::Levels::Exhausted:
+            return setTightTimeouts(decision);
+        case TableOccupancy::Levels::NearCapacity:
+            return setShortTimeouts(decision);
+        default:
+            return isShort ? setShortTimeouts(decision) : setNormalTimeouts(decision);
+        }
+    }
     static Decision drop (Decision decision)
     {
+        Metrics::count(Metrics::Outcomes::Drop);
         return decision.drop()
                 .idle_timeout(std::chrono::seconds(std::chrono::seconds::zero()))
                 .hard_timeout(std::chrono::seconds(60))
                 .return_();
     }
+    // The blocking entry is kept in the ACL table, the forwarding table gets a short-lived drop
+    static Decision dropPacket (Decision decision)
+    {
+        Metrics::count(Metrics::Outcomes::Drop);
+        return decision.drop()
+                .idle_timeout(std::chrono::seconds(std::chrono::seconds::zero()))
+                .hard_timeout(std::chrono::seconds(1))
+                .return_();
+    }
+    // Non-IP packet-ins: the drop entry matches the traced eth_src or in_port
+    static Decision dropFor (Decision decision, time_t hardTimeout)
+    {
+        Metrics::count(Metrics::Outcomes::Drop);
+        return decision.drop()
+                .idle_timeout(std::chrono::seconds(std::chrono::seconds::zero()))
+                .hard_timeout(std::chrono::seconds(hardTimeout))
+                .return_();
+    }
 private:
     static const uint16_t NORMAL_HARD_TIMEOUT;
     static const uint16_t NORMAL_IDLE_TIMEOUT;
     static const uint16_t SHORT_HARD_TIMEOUT;
     static const uint16_t SHORT_IDLE_TIMEOUT;
+    static const uint16_t TIGHT_HARD_TIMEOUT;
+    static const uint16_t TIGHT_IDLE_TIMEOUT;
+};
+
+// Flow-mods to one switch, a barrier closes every batch
+class FlowModBatch {
+public:
+    FlowModBatch (SwitchConnectionPtr conn_, size_t batchSize_ = BATCH_SIZE)
+        : conn(conn_), batchSize(batchSize_), sent(0) {}
+    ~FlowModBatch()
+    {
+        if (sent % batchSize != 0)
+            barrier();
+    }
+    void send (of13::FlowMod& fm)
+    {
+        conn->send(fm);
+        if (++sent % batchSize == 0)
+            barrier();
+    }
+    size_t size() { return sent; }
+
+    static const size_t BATCH_SIZE = 512;
+private:
+    void barrier()
+    {
+        of13::BarrierRequest br;
+        conn->send(br);
+    }
+    SwitchConnectionPtr conn;
+    size_t batchSize;
+    size_t sent;
 };
 
 const uint16_t DecisionHandler::NORMAL_HARD_TIMEOUT = 30;   // minutes
 const uint16_t DecisionHandler::NORMAL_IDLE_TIMEOUT = 60;   // seconds
 const uint16_t DecisionHandler::SHORT_HARD_TIMEOUT = 5;     // minutes
 const uint16_t DecisionHandler::SHORT_IDLE_TIMEOUT = 10;    // seconds
+const uint16_t DecisionHandler::TIGHT_HARD_TIMEOUT = 1;     // minutes
+const uint16_t DecisionHandler::TIGHT_IDLE_TIMEOUT = 2;     // seconds
+
+void ControllerDDoSProtection::configurePolicy (const Config& ddosConfig)
+{
+    std::string policy = config_get(ddosConfig, "policy", std::string(ActivePolicy::name()));
+    const auto& policyParams = ddosConfig["policy-params"].object_items();
+    if (!std::is_same<ActivePolicy, RuntimePolicy>::value)
+    {
+        // the thresholds are compiled in
+        if (policy != ActivePolicy::name() || !policyParams.empty())
+            LOG(WARNING) << "The " << ActivePolicy::name() << " policy is built in, policy " << policy
+                         << " and policy-params need DDOS_POLICY=runtime";
+        return;
+    }
+    if (policy != RuntimePolicy::name() && !RuntimePolicy::load(policy))
+        LOG(WARNING) << "Unknown policy " << policy << ", the " << RuntimePolicy::getProfile() << " profile is used";
+    for (auto& param : policyParams)
+    {
+        if (!RuntimePolicy::set(param.first, param.second.number_value()))
+            LOG(WARNING) << "Unknown policy param " << param.first;
+    }
+    LOG(INFO) << "Runtime policy: the " << RuntimePolicy::getProfile() << " profile, "
+              << policyParams.size() << " params overridden";
+    // created with the thresholds of the defaults
+    params = Params();
+    detection = SPRTdetection();
+    l2Flood.resetDetection();
+}
 
 void ControllerDDoSProtection::init(Loader *loader, const Config& config)
 {
     LOG(INFO) << "ControllerDDoSProtection::init()";
 
-    qRegisterMetaType<IPAddressV4>("IPAddressV4");
+    qRegisterMetaType<UserAddress>("UserAddress");
+
+    auto ddosConfig = config_cd(config, "controller-ddos-protection");
+    configurePolicy(ddosConfig);
+    users.setMaxInvalidUsers(config_get(ddosConfig, "max-invalid-users", (int) Users::MAX_INVALID_USERS));
+    if (config_get(ddosConfig, "users-layout", std::string("map")) == "columns")
+    {
+        users.setLayout(Users::Layouts::Columns);
+        int maintenanceThreads = config_get(ddosConfig, "maintenance-threads", 0);
+        if (maintenanceThreads > 0)
+        {
+            maintenancePool.reset(new WorkerPool(maintenanceThreads));
+            users.setWorkerPool(maintenancePool.get());
+        }
+    }
+    // maple installs its flows in table 0, not in forwarding-table-id: the users'
+    // flows would sit in the ACL table, above its goto, and be never checked
+    if (config_get(ddosConfig, "pipeline-mode", std::string("single-table")) == "multi-table")
+        LOG(ERROR) << "pipeline-mode multi-table needs maple flows in forwarding-table-id, single-table is used";
+    aclTable.configure(false,
+                       config_get(ddosConfig, "acl-table-id", (int) AclTable::ACL_TABLE_ID),
+                       config_get(ddosConfig, "forwarding-table-id", (int) AclTable::FORWARDING_TABLE_ID));
+    aclTable.configureMeters(config_get(ddosConfig, "meter-mode", false));
+    if (config_get(ddosConfig, "meter-mode", false) && !aclTable.isMetering())
+        LOG(WARNING) << "meter-mode needs the ACL table of the multi-table mode, sources are not metered";
+    tableOccupancy.setCapacity(config_get(ddosConfig, "flow-table-capacity", (int) TableOccupancy::CAPACITY));
+    fanIn.setAlarmSourcesNumber(config_get(ddosConfig, "victim-sources-number", (int) FanIn::ALARM_SOURCES_NUMBER));
+    isIPv6Prefix64 = config_get(ddosConfig, "ipv6-prefix-64", false);
+    isL2FloodEnabled = config_get(ddosConfig, "l2-flood", false);
+    l2Flood.setRates(config_get(ddosConfig, "l2-mac-rate", (int) L2Flood::MAC_RATE),
+                     config_get(ddosConfig, "l2-port-rate", (int) L2Flood::PORT_RATE));
+    aclTable.sizeL2Meter(l2Flood.getPortRate());
+    StatsCheck::Modes statsCheckMode;
+    std::string statsCheckModeName = config_get(ddosConfig, "stats-check-mode", std::string("flows"));
+    if (StatsCheck::parseMode(statsCheckModeName, statsCheckMode))
+        statsCheck.setMode(statsCheckMode);
+    else
+        LOG(WARNING) << "Unknown stats-check-mode " << statsCheckModeName << ", flow stats are used";
+    statsCheck.setBucketsBits(config_get(ddosConfig, "stats-check-buckets-bits", 4));
+    flowRemovedQueue.setCapacity(config_get(ddosConfig, "flow-removed-queue", (int) FlowRemovedQueue::CAPACITY));
+    partitionMode = config_get(ddosConfig, "partition-mode", std::string("shared")) == "switch"
+            ? PartitionModes::Switch : PartitionModes::Shared;
+
+    std::string journalDir = config_get(ddosConfig, "journal-dir", std::string(""));
+    if (!journalDir.empty() && journal.open(journalDir))
+        users.onTransition(journalTransition);
+
+    std::string replicationRole = config_get(ddosConfig, "replication-role", std::string("none"));
+    std::string replicationSocket = config_get(ddosConfig, "replication-socket", std::string("/tmp/runos-ddos.sock"));
+    if (replicationRole == "publisher")
+    {
+        if (replication.openPublisher(replicationSocket,
+                [this](std::vector<Replication::Update>& state) { getReplicationSnapshot(state); }))
+            users.onTransition(publishTransition);
+    }
+    else if (replicationRole == "subscriber")
+    {
+        if (partitionMode == PartitionModes::Switch)
+        {
+            LOG(WARNING) << "Replication: a subscriber applies the shared users, partition-mode is shared";
+            partitionMode = PartitionModes::Shared;
+        }
+        replication.openSubscriber(replicationSocket,
+                config_get(ddosConfig, "replication-publisher", std::string("/tmp/runos-ddos-publisher.sock")),
+                [this](const Replication::Update& update) { applyReplicated(update); });
+    }
+    // hits are counted into the users by the thread of the cache, the owner of
+    // the users in the switch partitions only
+    bool isVerdictCache = config_get(ddosConfig, "verdict-cache", false);
+    if (isVerdictCache && partitionMode != PartitionModes::Switch)
+        LOG(WARNING) << "verdict-cache needs partition-mode switch, it is disabled";
+    VerdictCache::setEnabled(isVerdictCache && partitionMode == PartitionModes::Switch);
 
     detectDDoSTimer = new QTimer(this);
     updateValidAvgConnTimer = new QTimer(this);
     clearInvalidUsersTimer = new QTimer(this);
+    aclFlushTimer = new QTimer(this);
+    flowRemovedTimer = new QTimer(this);
+    tableStatsTimer = new QTimer(this);
+    entropyTimer = new QTimer(this);
+    partitionMergeTimer = new QTimer(this);
+    replicationTimer = new QTimer(this);
+    replicationNotifier = nullptr;
+    if (replication.getRole() != Replication::Roles::None)
+    {
+        replicationNotifier = new QSocketNotifier(replication.getFd(), QSocketNotifier::Read, this);
+        QObject::connect(replicationNotifier, &QSocketNotifier::activated,
+                         this, &ControllerDDoSProtection::replicationReadable);
+    }
 
     Controller* ctrl = Controller::get(loader);
     host_manager = HostManager::get(loader);
+    // before host-manager: a flood of random MACs is dropped before it is learned
+    ctrl->registerHandler("ddos-l2-protection",
+        [=](SwitchConnectionPtr conn)
+        {
+        const auto ofb_eth_type = oxm::eth_type();
+        const auto ofb_eth_src = oxm::eth_src();
+        const auto ofb_in_port = oxm::in_port();
+
+            return [=](Packet& pkt, FlowPtr, Decision decision)
+            {
+                if (!isL2FloodEnabled)
+                    return decision;
+                // IP packet-ins are checked by ddos-protection
+                if (pkt.test(ofb_eth_type == IPv4_TYPE) || pkt.test(ofb_eth_type == IPv6_TYPE))
+                    return decision;
+                uint16_t ethType = pkt.load(ofb_eth_type);
+                // link discovery
+                if (ethType == LLDP_TYPE)
+                    return decision;
+                auto tpkt = packet_cast<TraceablePacket>(pkt);
+                // loaded, not watched: a drop entry matches only the field of its
+                // verdict, one entry per port instead of one per random MAC
+                ethaddr srcMac = pkt.load(ofb_eth_src);
+                InPort inPort = pkt.load(ofb_in_port);
+                L2Flood::Verdicts verdict = l2Flood.update(conn->dpid(), inPort, srcMac.to_number());
+                if (verdict == L2Flood::Verdicts::DropMac) {
+                    pkt.test(ofb_eth_src == srcMac);
+                } else if (verdict != L2Flood::Verdicts::Forward) {
+                    pkt.test(ofb_in_port == inPort);
+                } else {
+                    tpkt.watch(ofb_eth_src);
+                    tpkt.watch(ofb_in_port);
+                }
+                return processL2Miss(conn, verdict, inPort, ethType, decision);
+            };
+        }
+    );
     ctrl->registerHandler("ddos-protection",
         [=](SwitchConnectionPtr conn)
         {
         const auto ofb_eth_type = oxm::eth_type();
         const auto ofb_ipv4_src = oxm::ipv4_src();
         const auto ofb_ipv4_dst = oxm::ipv4_dst();
+        const auto ofb_ipv6_src = oxm::ipv6_src();
+        const auto ofb_ipv6_dst = oxm::ipv6_dst();
+        // the handler runs on the thread serving the switch
+        Partition* partition = partitionMode == PartitionModes::Switch ? getPartition(conn->dpid()) : nullptr;
 
             return [=](Packet& pkt, FlowPtr, Decision decision) mutable
             {
+                if (partition != nullptr)
+                {
+                    partition->serve();
+                    // changed by the connections flushed from partitionMergeTimeout
+                    for (UserAddress ipAddr : partition->typeChanged)
+                        emit UsersTypeChanged(conn, ipAddr);
+                    partition->typeChanged.clear();
+                }
                 auto tpkt = packet_cast<TraceablePacket>(pkt);
+                UserAddress srcIPAddr;
+                UserAddress dstIPAddr;
                 if (pkt.test(ofb_eth_type == IPv4_TYPE)) {
-                    IPv4Addr srcIPAddr = tpkt.watch(ofb_ipv4_src);
-                    IPAddressV4 srcIPAddrV4 = srcIPAddr.to_number();
-
-                    IPv4Addr dstIPAddr = tpkt.watch(ofb_ipv4_dst);
-                    IPAddressV4 dstIPAddrV4 = dstIPAddr.to_number();
-
-                    if (srcIPAddrV4 == IPAddress("0.0.0.0").getIPv4() || dstIPAddrV4 == IPAddress("0.0.0.0").getIPv4())
-                    {
+                    IPv4Addr srcIPAddrV4 = tpkt.watch(ofb_ipv4_src);
+                    IPv4Addr dstIPAddrV4 = tpkt.watch(ofb_ipv4_dst);
+                    srcIPAddr = (IPAddressV4) srcIPAddrV4.to_number();
+                    dstIPAddr = (IPAddressV4) dstIPAddrV4.to_number();
+                } else if (pkt.test(ofb_eth_type == IPv6_TYPE)) {
+                    // loaded, not watched: flows of IPv6 users match ipv6_src, the
+                    // stats requests and flow-removed find the user by it
+                    IPv6Addr srcIPAddrV6 = pkt.load(ofb_ipv6_src);
+                    IPv6Addr dstIPAddrV6 = tpkt.watch(ofb_ipv6_dst);
+                    srcIPAddr = UserAddress::fromOctets(srcIPAddrV6.to_octets().data(), isIPv6Prefix64);
+                    dstIPAddr = UserAddress::fromOctets(dstIPAddrV6.to_octets().data());
+                    // neighbor discovery and MLD are not connections of users
+                    if (dstIPAddr.isMulticast())
                         return decision;
-                    }
+                } else {
+                    return decision;
+                }
+
+                if (srcIPAddr == 0 || dstIPAddr == 0)
+                {
+                    return decision;
+                }
 
 //                    LOG(INFO) << "processMiss";
-                    LOG(INFO) << AppObject::uint32_t_ip_to_string(srcIPAddrV4) << "\t-->\t" <<AppObject::uint32_t_ip_to_string(dstIPAddrV4);
+                LOG(INFO) << srcIPAddr.toString() << "\t-->\t" << dstIPAddr.toString();
+                entropy.update(srcIPAddr, dstIPAddr);
+                (partition != nullptr ? partition->packetInHitters : packetInHitters).update(srcIPAddr);
 
-                    return processMiss(conn, srcIPAddrV4, decision);
-                }
-                return decision;
+                return processMiss(conn, srcIPAddr, dstIPAddr, decision, partition);
             };
         }
     );
     params.init();
+    aclTable.sizeMeters(params.getValidPacketNumber().cur);
 
     QObject::connect(detectDDoSTimer, SIGNAL(timeout()), this, SLOT(detectDDoSTimeout()));
     QObject::connect(updateValidAvgConnTimer, SIGNAL(timeout()), this, SLOT(updateValidAvgConnTimeout()));
     QObject::connect(clearInvalidUsersTimer, SIGNAL(timeout()), this, SLOT(clearInvalidUsersTimeout()));
-    QObject::connect(this, SIGNAL(UsersTypeChanged(SwitchConnectionPtr, IPAddressV4)), this,
-                     SLOT(getUsersStatistics(SwitchConnectionPtr, IPAddressV4)));
+    QObject::connect(aclFlushTimer, SIGNAL(timeout()), this, SLOT(aclFlushTimeout()));
+    QObject::connect(flowRemovedTimer, SIGNAL(timeout()), this, SLOT(flowRemovedTimeout()));
+    QObject::connect(tableStatsTimer, SIGNAL(timeout()), this, SLOT(tableStatsTimeout()));
+    QObject::connect(entropyTimer, SIGNAL(timeout()), this, SLOT(entropyTimeout()));
+    QObject::connect(partitionMergeTimer, SIGNAL(timeout()), this, SLOT(partitionMergeTimeout()));
+    QObject::connect(replicationTimer, SIGNAL(timeout()), this, SLOT(replicationTimeout()));
+    QObject::connect(this, SIGNAL(UsersTypeChanged(SwitchConnectionPtr, UserAddress)), this,
+                     SLOT(getUsersStatistics(SwitchConnectionPtr, UserAddress)));
 
     // Регистрация приложения для статического обмена пакетами с коммутаторами.
     oftran = ctrl->registerStaticTransaction(this);
@@ -113,6 +389,11 @@ void ControllerDDoSProtection::init(Loader *loader, const Config& config)
         of13::Error& error = msg->error;
         LOG(ERROR) << "Switch reports error for OFPT_MULTIPART_REQUEST: "
             << "type " << (int) error.type() << " code " << error.code();
+        // a bucket of a user's aggregate check: its reply is not coming
+        const uint8_t* request = static_cast<const uint8_t*>(error.data());
+        if (error.data_len() >= 10 && request[1] == of13::OFPT_MULTIPART_REQUEST
+                && (request[8] << 8 | request[9]) == of13::OFPMP_AGGREGATE)
+            statsCheck.aggregateFailed(conn->dpid());
         // Send request again
         // Switch.cc 91 FIXME: use switch-generate ofmsg and limit retry count
         // conn->send(error.data(), error.data_len());
@@ -120,6 +401,14 @@ void ControllerDDoSProtection::init(Loader *loader, const Config& config)
 
     // Коммутатор сообщил об удалении потока.
     QObject::connect(ctrl, &Controller::flowRemoved, this, &ControllerDDoSProtection::flowRemoved);
+
+    QObject::connect(ctrl, &Controller::switchUp, this, &ControllerDDoSProtection::switchUp);
+    QObject::connect(ctrl, &Controller::switchDown, this, &ControllerDDoSProtection::switchDown);
+    QObject::connect(this, SIGNAL(DDoSDetected()), this, SLOT(mitigate()));
+
+    RestListener::get(loader)->registerRestHandler(this);
+    acceptPath(Method::GET, "metrics");
+    acceptPath(Method::GET, "top-sources");
 }
 
 
@@ -128,59 +417,290 @@ void ControllerDDoSProtection::startUp (Loader *loader)
 //    detectDDoSTimer->start (DETECT_DDOS_TIMER_INTERVAL * 1000);
     updateValidAvgConnTimer->start (Users::UPDATE_VALID_AVG_CONN_TIMER_INTERVAL * 1000);
     clearInvalidUsersTimer->start (Users::CLEAR_INVALID_USERS_TIMER_INTERVAL * 1000);
+    if (aclTable.isEnabled())
+        aclFlushTimer->start (ACL_FLUSH_TIMER_INTERVAL);
+    flowRemovedTimer->start (FLOW_REMOVED_TIMER_INTERVAL);
+    tableStatsTimer->start (TABLE_STATS_TIMER_INTERVAL * 1000);
+    entropyTimer->start (ENTROPY_TIMER_INTERVAL * 1000);
+    if (partitionMode == PartitionModes::Switch)
+        partitionMergeTimer->start (PARTITION_MERGE_TIMER_INTERVAL * 1000);
+    if (replication.getRole() != Replication::Roles::None)
+        replicationTimer->start (Replication::FLUSH_INTERVAL);
 }
 
 
 void ControllerDDoSProtection::detectDDoSTimeout()
 {
 //    LOG(INFO) << "ControllerDDoSProtection::detectDDoSTimeout()";
+    Metrics::Timer timer(Metrics::Stages::DetectDDoS);
     users.update();
-    Users::Statistics statistics = users.getStatistics();
-    bool isDetectedDDoS = statistics.handle();
+    Users::Statistics& statistics = users.getStatistics();
+    bool isDetectedDDoS = statistics.handle(entropy.isAnomalous()) || tableOccupancy.isUnderPressure();
     setDDoS(isDetectedDDoS);
-    users.resetStatistics();
+}
+
+
+void ControllerDDoSProtection::entropyTimeout()
+{
+    bool isAnomalous = entropy.evaluate();
+    // partitions weigh the entropy at the next merge
+    if (partitionMode == PartitionModes::Switch)
+        return;
+    // packet-in entropy is checked between the users' statistics
+    if (isAnomalous && users.getStatistics().handle(true))
+        setDDoS(true);
 }
 
 
 void ControllerDDoSProtection::updateValidAvgConnTimeout()
 {
     LOG(INFO) << "ControllerDDoSProtection::updateValidAvgConnTimeout()";
-    params.updateValidAvgConnNumber(users);
+    // partitions are merged by partitionMergeTimeout()
+    if (partitionMode == PartitionModes::Shared)
+        params.updateValidAvgConnNumber(users);
+    packetInHitters.decay();
+    packetHitters.decay();
+    {
+        std::lock_guard<std::mutex> guard(partitionsLock);
+        for (auto& p : partitions)
+            p.second->packetInHitters.decay();
+    }
+    if (aclTable.isMetering() && aclTable.sizeMeters(params.getValidPacketNumber().cur))
+    {
+        for (auto& sw : switches)
+            aclTable.installMeters(sw.second, of13::OFPMC_MODIFY);
+    }
 }
 
 
 void ControllerDDoSProtection::clearInvalidUsersTimeout()
 {
 //    LOG(INFO) << "ControllerDDoSProtection::clearInvalidUsersTimeout()";
-    /* todo */
+    // partitions are cleared by their owners before publishing
+    if (partitionMode == PartitionModes::Switch)
+        return;
+    users.update();
+    Users::EvictedNumbers evicted = users.getEvictedNumbers();
+    if (evicted.ddos != 0 || evicted.malicious != 0)
+    {
+        LOG(WARNING) << "Invalid users are evicted (max " << users.getMaxInvalidUsers() << "): "
+                     << evicted.ddos << " DDoS, " << evicted.malicious << " Malicious";
+    }
 }
 
 
-void ControllerDDoSProtection::getUsersStatistics (SwitchConnectionPtr conn, IPAddressV4 ipAddr)
+void ControllerDDoSProtection::switchUp (SwitchConnectionPtr conn, of13::FeaturesReply fr)
 {
-    LOG(INFO) << "ControllerDDoSProtection::getUsersStatistics (" << AppObject::uint32_t_ip_to_string(ipAddr) << ")";
+    switches[conn->dpid()] = conn;
+    if (aclTable.isEnabled())
+        aclTable.install(conn);
+}
+
+
+void ControllerDDoSProtection::switchDown (SwitchConnectionPtr conn)
+{
+    switches.erase(conn->dpid());
+    aclTable.remove(conn->dpid());
+    tableOccupancy.remove(conn->dpid());
+    if (partitionMode == PartitionModes::Switch)
+        getPartition(conn->dpid())->setOccupancyLevel(TableOccupancy::Normal);
+    statsCheck.remove(conn->dpid());
+}
+
+
+void ControllerDDoSProtection::tableStatsTimeout()
+{
+    for (auto& sw : switches)
+    {
+        of13::MultipartRequestTable mprt;
+        oftran->request(sw.second, mprt);
+    }
+}
+
+
+void ControllerDDoSProtection::tableStatsArrived (SwitchConnectionPtr conn, std::shared_ptr<OFMsgUnion> reply)
+{
+    of13::MultipartReplyTable& stats = reply->multipartReplyTable;
+    size_t activeCount = 0;
+    uint64_t lookupCount = 0;
+    uint64_t matchedCount = 0;
+    for (of13::TableStats& t : stats.table_stats())
+    {
+        // users' flows are in the forwarding table only
+        if (aclTable.isEnabled() && t.table_id() != aclTable.getForwardingTableId())
+            continue;
+        activeCount += t.active_count();
+        lookupCount += t.lookup_count();
+        matchedCount += t.matched_count();
+    }
+    tableOccupancy.update(conn->dpid(), activeCount, lookupCount, matchedCount);
+    if (partitionMode == PartitionModes::Switch)
+        getPartition(conn->dpid())->setOccupancyLevel(tableOccupancy.getLevel(conn->dpid()));
+    if (tableOccupancy.isUnderPressure())
+        setDDoS(true);
+}
+
+
+template <class Message>
+void ControllerDDoSProtection::addUserMatch (Message& message, const UserAddress& ipAddr)
+{
+    if (ipAddr.isV4())
+    {
+        message.add_oxm_field(new of13::EthType(IPv4_TYPE));
+        message.add_oxm_field(new of13::IPv4Src(ipAddr.getV4()));
+        return;
+    }
+    uint8_t octets[16];
+    uint8_t mask[16];
+    ipAddr.toOctets(octets);
+    ipAddr.maskOctets(mask);
+    message.add_oxm_field(new of13::EthType(IPv6_TYPE));
+    if (ipAddr.isPrefix64())
+        message.add_oxm_field(new of13::IPv6Src(IPAddress(octets), IPAddress(mask)));
+    else
+        message.add_oxm_field(new of13::IPv6Src(IPAddress(octets)));
+}
+
+
+void ControllerDDoSProtection::mitigate()
+{
+    Metrics::Timer timer(Metrics::Stages::Mitigation);
+    auto start = std::chrono::steady_clock::now();
+
+    // one set of flow-mods for all switches
+    std::vector<UserAddress> tightened;
+    std::vector<of13::FlowMod> flowMods;
+    if (partitionMode == PartitionModes::Switch)
+    {
+        // a user blocked on one switch is blocked on all of them
+        for (UserAddress ipAddr : mergedView.blocked)
+            flowMods.push_back(aclTable.blockFlowMod(ipAddr));
+        tightened = mergedView.unchecked;
+    } else {
+        users.forEachInvalidUser([&](UserAddress ipAddr, Users::InvalidUsersParams& userParams)
+        {
+            if (userParams.isBlocked())
+            {
+                flowMods.push_back(aclTable.blockFlowMod(ipAddr));
+            }
+            else if (!userParams.typeIsChecked())
+            {
+                tightened.push_back(ipAddr);
+            }
+        });
+    }
+    size_t blockedNumber = flowMods.size();
+    size_t unknownHostsNumber = 0;
+    for (UserAddress ipAddr : tightened)
+    {
+        // flows are installed again with short timeouts on the next packet-in
+        of13::FlowMod fm;
+        fm.command(of13::OFPFC_DELETE);
+        fm.table_id(aclTable.isEnabled() ? aclTable.getForwardingTableId() : (uint8_t) of13::OFPTT_ALL);
+        fm.out_port(of13::OFPP_ANY);
+        fm.out_group(of13::OFPG_ANY);
+        fm.buffer_id(of13::OFP_NO_BUFFER);
+        // flows of IPv4 users match the MAC of their host, as in getUsersStatistics
+        if (ipAddr.isV4())
+        {
+            Host* host = host_manager->getHost(ipAddr.getV4());
+            if (host == nullptr)
+            {
+                ++unknownHostsNumber;
+                continue;
+            }
+            fm.add_oxm_field(new of13::EthSrc(host->mac()));
+        }
+        else
+            addUserMatch(fm, ipAddr);
+        flowMods.push_back(fm);
+    }
+    if (unknownHostsNumber > 0)
+        LOG(WARNING) << "Mitigation: " << unknownHostsNumber << " users are not tightened, their hosts are unknown";
+
+    for (auto& sw : switches)
+    {
+        FlowModBatch batch(sw.second);
+        for (of13::FlowMod& fm : flowMods)
+            batch.send(fm);
+    }
+
+    // the flow-mods are queued to the connections, the switches apply them later
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    LOG(INFO) << "Mitigation: " << blockedNumber << " users are blocked, "
+              << flowMods.size() - blockedNumber << " users are tightened on " << switches.size()
+              << " switches, flow-mods are queued in " << duration.count() << " ms";
+}
+
+
+void ControllerDDoSProtection::aclFlushTimeout()
+{
+    aclTable.flush();
+}
+
+
+void ControllerDDoSProtection::getUsersStatistics (SwitchConnectionPtr conn, UserAddress ipAddr)
+{
+    LOG(INFO) << "ControllerDDoSProtection::getUsersStatistics (" << ipAddr.toString() << ")";
     of13::MultipartRequestFlow mprf;
-    mprf.table_id(of13::OFPTT_ALL);
+    // users' flows are in the forwarding table only
+    mprf.table_id(aclTable.isEnabled() ? aclTable.getForwardingTableId() : (uint8_t) of13::OFPTT_ALL);
     mprf.out_port(of13::OFPP_ANY);
     mprf.out_group(of13::OFPG_ANY);
 //    of13::IPv4Src* oxm = new of13::IPv4Src(ipAddr);
-    Host* host = host_manager->getHost(ipAddr);
-    if (host == nullptr)
+    // IPv4 users by the MAC of their host, IPv6 users by ipv6_src: HostManager knows IPv4 hosts only
+    Host* host = nullptr;
+    if (ipAddr.isV4())
     {
-        LOG(WARNING) << "Cannot get host by IP: " << AppObject::uint32_t_ip_to_string(ipAddr) << " from HostManager";
+        host = host_manager->getHost(ipAddr.getV4());
+        if (host == nullptr)
+        {
+            LOG(WARNING) << "Cannot get host by IP: " << ipAddr.toString() << " from HostManager";
+            return;
+        }
+    }
+    if (statsCheck.getMode() == StatsCheck::Modes::Aggregate)
+    {
+        // a request per bucket of the low bits of eth_dst, the switch replies in order:
+        // maple flows do not match ipv4_dst or ipv6_dst, the L2 forwarding ones match eth_dst
+        statsCheck.aggregateRequested(conn->dpid(), ipAddr);
+        for (uint32_t bucket = 0; bucket < statsCheck.getBucketsNumber(); ++bucket)
+        {
+            of13::MultipartRequestAggregate mpra;
+            mpra.table_id(mprf.table_id());
+            mpra.out_port(of13::OFPP_ANY);
+            mpra.out_group(of13::OFPG_ANY);
+            if (host == nullptr)
+                addUserMatch(mpra, ipAddr);
+            else
+                mpra.add_oxm_field(new of13::EthSrc(host->mac()));
+            if (statsCheck.getBucketMask() != 0)
+            {
+                uint8_t bucketOctets[6] = {};
+                uint8_t maskOctets[6] = {};
+                bucketOctets[5] = bucket;
+                maskOctets[5] = statsCheck.getBucketMask();
+                mpra.add_oxm_field(new of13::EthDst(EthAddress(bucketOctets), EthAddress(maskOctets)));
+            }
+            oftran->request(conn, mpra);
+        }
         return;
     }
-    of13::EthSrc* oxm = new of13::EthSrc(host->mac());
-    mprf.add_oxm_field(oxm);
+    if (host == nullptr)
+        addUserMatch(mprf, ipAddr);
+    else
+        mprf.add_oxm_field(new of13::EthSrc(host->mac()));
 //    mprf.cookie(0x0);  // match: cookie & mask == field.cookie & mask
 //    mprf.cookie_mask(0x0);
 //    mprf.flags(0);
+    statsCheck.flowsRequested();
     oftran->request(conn, mprf);
 }
 
 
 void ControllerDDoSProtection::usersStatisticsArrived(SwitchConnectionPtr conn, std::shared_ptr<OFMsgUnion> reply)
 {
+    Metrics::Timer timer(Metrics::Stages::UsersStatisticsArrived);
     auto type = reply->base()->type();
     if (type != of13::OFPT_MULTIPART_REPLY)
     {
@@ -189,361 +709,1185 @@ void ControllerDDoSProtection::usersStatisticsArrived(SwitchConnectionPtr conn,
         return;
     }
 
-    of13::MultipartReplyFlow stats = reply->multipartReplyFlow;
-    std::vector<of13::FlowStats> s = stats.flow_stats();
-
-    if (s.size() == 0) {
-        LOG(INFO) << "No flow stats";
+    if (static_cast<of13::MultipartReply*>(reply->base())->mpart_type() == of13::OFPMP_TABLE)
+    {
+        tableStatsArrived(conn, reply);
         return;
     }
-
-//    of13::IPv4Src* addrPtr = s[0].match().ipv4_src();
-    of13::EthSrc* addrPtr = s[0].match().eth_src();
-    if (addrPtr == nullptr)
+    if (static_cast<of13::MultipartReply*>(reply->base())->mpart_type() == of13::OFPMP_AGGREGATE)
     {
-        LOG(WARNING) << "Cannot get ETH_SRC from Multipart Reply Message";
+        aggregateStatsArrived(conn, reply);
         return;
     }
 
-    EthAddress ethAddr = addrPtr->value();
-    Host* host = host_manager->getHost(ethAddr.to_string());
-    if (host == nullptr)
+    // A large reply is split into segments with REPLY_MORE, every segment is
+    // processed as it arrives: nothing is kept between segments and the
+    // flow stats of a segment (copied by libfluid) are released with it
+    of13::MultipartReplyFlow& stats = reply->multipartReplyFlow;
+    bool isLastSegment = !(stats.flags() & of13::OFPMPF_REPLY_MORE);
+    std::vector<of13::FlowStats> s = stats.flow_stats();
+    statsCheck.flowsReplied(s.size(), stats.length());
+
+    // entries of a user come in runs: the request matches one user's eth_src or ipv6_src
+    UserAddress runIPAddr = 0;
+    std::vector<uint64_t> packetNumbers;
+    auto finishRun = [&]()
     {
-        LOG(WARNING) << "Cannot get host by MAC: " << ethAddr.to_string() << " from HostManager";
-        return;
+        if (runIPAddr != 0 && !packetNumbers.empty())
+        {
+            LOG(INFO) << "ControllerDDoSProtection::usersStatisticsArrived ("
+                      << runIPAddr.toString() << "): " << packetNumbers.size() << " flows";
+            if (partitionMode == PartitionModes::Switch)
+            {
+                Partition::PacketNumbers event {runIPAddr, 0, false, packetNumbers};
+                getPartition(conn->dpid())->post(event);
+            } else {
+                try
+                {
+                    Classifier::checkUser(users, params, runIPAddr, packetNumbers);
+                }
+                catch (Users::UsersExceptionTypes)
+                {
+                    LOG(WARNING) << "Unknown user " << runIPAddr.toString() << " of flow stats";
+                }
+            }
+        }
+        packetNumbers.clear();
+    };
+
+    // MAC of the last entry without ipv4_src, HostManager is asked once per run
+    EthAddress lastEthAddr;
+    UserAddress lastEthIPAddr = 0;
+    size_t unattributed = 0;
+    for (of13::FlowStats& flowStats : s)
+    {
+        uint64_t packetNumber = flowStats.packet_count();
+        if (packetNumber == 0)
+            continue; // useless stats
+        of13::Match match = flowStats.match();
+        of13::EthType* ethTypePtr = match.eth_type();
+        if (ethTypePtr == nullptr || (ethTypePtr->value() != IPv4_TYPE && ethTypePtr->value() != IPv6_TYPE))
+            continue;
+
+        // the user of the entry: ipv4_src, ipv6_src, or the host of eth_src
+        UserAddress ipAddr = 0;
+        if (of13::IPv4Src* ipv4SrcPtr = match.ipv4_src())
+            ipAddr = ipv4SrcPtr->value().getIPv4();
+        else if (of13::IPv6Src* ipv6SrcPtr = match.ipv6_src())
+            ipAddr = UserAddress::fromOctets(ipv6SrcPtr->value().getIPv6(), isIPv6Prefix64);
+        // HostManager knows IPv4 hosts only
+        else if (of13::EthSrc* ethSrcPtr = ethTypePtr->value() == IPv4_TYPE ? match.eth_src() : nullptr)
+        {
+            EthAddress ethAddr = ethSrcPtr->value();
+            if (lastEthIPAddr == 0 || !(ethAddr == lastEthAddr))
+            {
+                Host* host = host_manager->getHost(ethAddr.to_string());
+                lastEthAddr = ethAddr;
+                lastEthIPAddr = host != nullptr ? host->ip().getIPv4() : 0;
+            }
+            ipAddr = lastEthIPAddr;
+        }
+        if (ipAddr == 0)
+        {
+            ++unattributed;
+            continue;
+        }
+        if (ipAddr != runIPAddr)
+        {
+            finishRun();
+            runIPAddr = ipAddr;
+        }
+        packetNumbers.push_back(packetNumber);
     }
+    finishRun();
+    if (unattributed > 0)
+        LOG(WARNING) << unattributed << " flow stats without a known user (no IPV4_SRC, IPV6_SRC or host of ETH_SRC)";
 
-    IPAddress ipAddr = host->ip();
-    IPAddressV4 ipAddrV4 = ipAddr.getIPv4();
+    if (isLastSegment && partitionMode != PartitionModes::Switch)
+        detectDDoSTimeout();
+}
 
-    LOG(INFO) << "ControllerDDoSProtection::usersStatisticsArrived (" << AppObject::uint32_t_ip_to_string(ipAddrV4) << ")";
 
-    std::map<IPAddressV4, Users::ValidUsersParams>::iterator validUser;
-    std::map<IPAddressV4, Users::InvalidUsersParams>::iterator invalidUser;
-    Users::UsersTypes userType = users.get(ipAddrV4, validUser, invalidUser);
+void ControllerDDoSProtection::aggregateStatsArrived (SwitchConnectionPtr conn, std::shared_ptr<OFMsgUnion> reply)
+{
+    // a bucket of the oldest aggregate check of the switch, the user is checked after the last one
+    of13::MultipartReplyAggregate& stats = reply->multipartReplyAggregate;
+    StatsCheck::Result result;
+    if (!statsCheck.aggregateReplied(conn->dpid(), stats.flow_count(), stats.packet_count(),
+                                     params.getValidPacketNumber().cur, stats.length(), result))
+        return;
 
-    for (auto& i : s)
+    if (result.flows > 0)
     {
-        uint64_t packetNumber = i.packet_count();
-        of13::EthType* eth_type_ptr = i.match().eth_type();
-        if (eth_type_ptr == nullptr)
+        LOG(INFO) << "ControllerDDoSProtection::aggregateStatsArrived ("
+                  << result.ipAddr.toString() << "): " << result.flows << " flows, "
+                  << result.lowPacketFlows << " low-packet flows";
+        if (partitionMode == PartitionModes::Switch)
         {
-            LOG(WARNING) << "Cannot get ETH_TYPE from Flow Stats Message";
-            continue;
-        }
-
-        if (packetNumber != 0 && eth_type_ptr->value() == IPv4_TYPE) {
-            switch (userType)
+            Partition::PacketNumbers event {result.ipAddr, 0, false, {}, result.flows, result.lowPacketFlows};
+            getPartition(conn->dpid())->post(event);
+        } else {
+            try
+            {
+                Classifier::checkUser(users, params, result.ipAddr, result.flows, result.lowPacketFlows);
+            }
+            catch (Users::UsersExceptionTypes)
             {
-            case Users::UsersTypes::Invalid:
-                invalidUser->second.updatePacketNumber(params, packetNumber);
-                break;
-            case Users::UsersTypes::Valid:
-                validUser->second.updatePacketNumber(params, packetNumber);
-                break;
-            case Users::UsersTypes::Unknown:
-                throw Users::UsersExceptionTypes::IsUnknown;
+                LOG(WARNING) << "Unknown user " << result.ipAddr.toString() << " of aggregate stats";
             }
-        } // else useless stats
+        }
     }
 
-    switch (userType)
+    if (partitionMode != PartitionModes::Switch)
+        detectDDoSTimeout();
+}
+
+
+json11::Json ControllerDDoSProtection::handleGET (std::vector<std::string> params, std::string body)
+{
+    if (params[0] == "metrics")
     {
-    case Users::UsersTypes::Invalid:
-        try
+        auto replicationToJson = []()
+        {
+            static const char* roles[] = {"none", "publisher", "subscriber"};
+            Replication::Counters c = replication.getCounters();
+            return json11::Json::object {
+                {"role", roles[replication.getRole()]},
+                {"updates", (double) c.updates},
+                {"datagrams", (double) c.datagrams},
+                {"bytes", (double) c.bytes},
+                {"bytes_per_update", c.updates ? (double) c.bytes / c.updates : 0.},
+                {"gaps", (double) c.gaps},
+                {"snapshots", (double) c.snapshots},
+                {"peers", (double) c.peers},
+                {"last_seq", (double) c.lastSeq}
+            };
+        };
+
+        Metrics::Snapshot snapshot = Metrics::snapshot();
+
+        json11::Json::object stages;
+        for (size_t s = 0; s < Metrics::Stages::STAGES_NUMBER; ++s)
         {
-            invalidUser->second.updateIsChecked(params);
+            const Metrics::Histogram& h = snapshot.stages[s];
+            json11::Json::array buckets;
+            for (size_t b = 0; b < Metrics::BUCKETS_NUMBER; ++b)
+                buckets.push_back((double) h.buckets[b]);
+            stages[Metrics::stageName((Metrics::Stages) s)] = json11::Json::object {
+                {"count", (double) h.count},
+                {"mean_ns", h.count ? (double) h.sum / h.count : 0.},
+                {"p50_ns", (double) h.percentile(.5)},
+                {"p99_ns", (double) h.percentile(.99)},
+                {"p999_ns", (double) h.percentile(.999)},
+                {"log2_ns_buckets", buckets}
+            };
         }
-        catch (Users::UsersExceptionTypes)
+
+        json11::Json::object flowTables;
+        for (auto& t : tableOccupancy.getTables())
         {
-            users.validate(invalidUser);
+            flowTables[std::to_string(t.first)] = json11::Json::object {
+                {"active_count", (double) t.second.activeCount},
+                {"occupancy", tableOccupancy.getOccupancy(t.first)},
+                {"lookup_rate", t.second.lookupRate},
+                {"match_rate", t.second.matchRate}
+            };
         }
-        break;
-    case Users::UsersTypes::Valid:
-        try
+
+        Entropy::Values entropyValues = entropy.get();
+        Entropy::Values entropyBaseline = entropy.getBaseline();
+        json11::Json::object entropyObject {
+            {"src", entropyValues.src},
+            {"dst", entropyValues.dst},
+            {"packet_ins", (double) entropyValues.packetIns},
+            {"baseline_src", entropyBaseline.src},
+            {"baseline_dst", entropyBaseline.dst},
+            {"is_anomalous", entropy.isAnomalous()}
+        };
+
+        json11::Json::array victims;
+        for (const FanIn::Victim& v : partitionMode == PartitionModes::Switch ? mergedView.victims : fanIn.getVictims())
         {
-            validUser->second.updateIsChecked(params);
+            victims.push_back(json11::Json::object {
+                {"ip", v.ipAddr.toString()},
+                {"sources", v.sourcesNumber},
+                {"is_attacked", v.isAttacked}
+            });
         }
-        catch (Users::UsersExceptionTypes)
+
+        json11::Json::object outcomes;
+        for (size_t o = 0; o < Metrics::Outcomes::OUTCOMES_NUMBER; ++o)
+            outcomes[Metrics::outcomeName((Metrics::Outcomes) o)] = (double) snapshot.outcomes[o];
+
+        VerdictCache::Counters cacheCounters = VerdictCache::getCounters();
+        uint64_t lookups = cacheCounters.hits + cacheCounters.misses;
+        StatsCheck::Counters checkCounters = statsCheck.getCounters();
+        FlowRemovedQueue::Counters queueCounters = flowRemovedQueue.getCounters();
+        L2Flood::Counters l2Counters = l2Flood.getCounters();
+        json11::Json::array l2BlockedPorts;
+        for (auto& port : l2Flood.getBlockedPorts())
         {
-            users.invalidate(validUser);
+            l2BlockedPorts.push_back(json11::Json::object {
+                {"dpid", (double) port.first},
+                {"in_port", (double) port.second}
+            });
         }
-        break;
-    case Users::UsersTypes::Unknown:
-        throw Users::UsersExceptionTypes::IsUnknown;
+
+        return json11::Json::object {
+            {"stages", stages},
+            {"decisions", outcomes},
+            {"valid_users", (double) (partitionMode == PartitionModes::Switch ? mergedView.validUsersNumber : users.getValidUsersNumber())},
+            {"invalid_users", (double) (partitionMode == PartitionModes::Switch ? mergedView.invalidUsersNumber : users.getInvalidUsersNumber())},
+            {"replication", replicationToJson()},
+            {"journal", json11::Json::object {
+                {"is_open", journal.isOpen()},
+                {"written", (double) journal.getWritten()},
+                {"dropped", (double) journal.getDropped()},
+                {"segment", (double) journal.getSegment()}
+            }},
+            {"partitions", json11::Json::object {
+                {"number", (double) mergedView.partitionsNumber},
+                {"users_on_several_switches", (double) mergedView.sharedUsersNumber}
+            }},
+            {"verdict_cache", json11::Json::object {
+                {"is_enabled", VerdictCache::isEnabled()},
+                {"hits", (double) cacheCounters.hits},
+                {"misses", (double) cacheCounters.misses},
+                {"hit_rate", lookups ? (double) cacheCounters.hits / lookups : 0.},
+                {"flushes", (double) cacheCounters.flushes},
+                {"flushed_connections", (double) cacheCounters.flushedConns}
+            }},
+            {"stats_check", json11::Json::object {
+                {"mode", StatsCheck::modeName(statsCheck.getMode())},
+                {"buckets", (double) (statsCheck.getMode() == StatsCheck::Modes::Aggregate ? statsCheck.getBucketsNumber() : 0)},
+                {"checks", (double) checkCounters.checks},
+                {"replies", (double) checkCounters.replies},
+                {"reply_bytes", (double) checkCounters.replyBytes},
+                {"bytes_per_check", checkCounters.checks ? (double) checkCounters.replyBytes / checkCounters.checks : 0.},
+                {"flows", (double) checkCounters.flows},
+                // the same checks by flow stats
+                {"flows_mode_bytes", (double) StatsCheck::flowsModeBytes(checkCounters)},
+                {"failed", (double) checkCounters.failed}
+            }},
+            {"flow_removed_queue", json11::Json::object {
+                {"capacity", (double) flowRemovedQueue.getCapacity()},
+                {"pushed", (double) queueCounters.pushed},
+                {"batches", (double) queueCounters.batches},
+                {"events_per_batch", queueCounters.batches ? (double) queueCounters.pushed / queueCounters.batches : 0.},
+                {"max_depth", (double) queueCounters.maxDepth},
+                {"host_lookups", (double) queueCounters.hostLookups},
+                // taken by flowRemoved of a full queue
+                {"full_batches", (double) queueCounters.fullBatches}
+            }},
+            {"l2_flood", json11::Json::object {
+                {"is_enabled", isL2FloodEnabled},
+                {"packet_ins", (double) l2Counters.packetIns},
+                {"new_macs", (double) l2Counters.newMacs},
+                {"replaced_macs", (double) l2Counters.replacedMacs},
+                {"untracked_macs", (double) l2Counters.untrackedMacs},
+                {"samples", (double) l2Counters.samples},
+                {"low_samples", (double) l2Counters.lowSamples},
+                {"mac_drops", (double) l2Counters.macDrops},
+                {"port_limits", (double) l2Counters.portLimits},
+                {"port_drops", (double) l2Counters.portDrops},
+                {"compromised_ports", (double) l2Counters.compromisedPorts},
+                {"blocked_ports", l2BlockedPorts}
+            }},
+            {"policy", json11::Json::object {
+                {"name", ActivePolicy::name()},
+                {"profile", std::is_same<ActivePolicy, RuntimePolicy>::value ? RuntimePolicy::getProfile() : ActivePolicy::name()}
+            }},
+            {"is_ddos", classifier.isDDoS()},
+            {"flow_tables", flowTables},
+            {"entropy", entropyObject},
+            {"victims", victims}
+        };
     }
-    detectDDoSTimeout();
+    if (params[0] == "top-sources")
+    {
+        auto toJson = [](const std::vector<HeavyHitters::Counter>& top)
+        {
+            json11::Json::array ret;
+            for (const HeavyHitters::Counter& c : top)
+            {
+                ret.push_back(json11::Json::object {
+                    {"ip", c.ipAddr.toString()},
+                    {"count", (double) c.count},
+                    {"error", (double) c.error}
+                });
+            }
+            return ret;
+        };
+        return json11::Json::object {
+            // the switches count packet-ins of their own in partition-mode switch
+            {"packet_ins", toJson(partitionMode == PartitionModes::Switch
+                                  ? mergedView.packetInSources : packetInHitters.top(TOP_SOURCES_NUMBER))},
+            {"packet_ins_total", (double) (partitionMode == PartitionModes::Switch
+                                           ? mergedView.packetInsTotal : packetInHitters.getTotal())},
+            {"packets", toJson(packetHitters.top(TOP_SOURCES_NUMBER))},
+            {"packets_total", (double) packetHitters.getTotal()}
+        };
+    }
+    return json11::Json::object {};
 }
 
-Decision ControllerDDoSProtection::processMiss (SwitchConnectionPtr conn, IPAddressV4 ipAddr, Decision decision)
+
+Decision ControllerDDoSProtection::processMiss (SwitchConnectionPtr conn, UserAddress ipAddr, UserAddress dstIPAddr, Decision decision,
+                                                Partition* partition)
 {
 //    params.print();
-
-    std::map<IPAddressV4, Users::ValidUsersParams>::iterator validUser;
-    std::map<IPAddressV4, Users::InvalidUsersParams>::iterator invalidUser;
-    Users::UsersTypes type = users.get(ipAddr, validUser, invalidUser);
+    Metrics::Timer timer(Metrics::Stages::ProcessMiss);
 
 //    LOG(INFO) << "ControllerDDoSProtection::processMiss (" << AppObject::uint32_t_ip_to_string(ipAddr) << ")";
 
-    switch (type)
+    // no lock shared by switches in partition-mode switch
+    Classifier& classifier_ = partition != nullptr ? partition->classifier : classifier;
+    Classifier::Verdict verdict = partition != nullptr
+            ? classifier_.processMiss(partition->users, partition->params, ipAddr, dstIPAddr)
+            : classifier_.processMiss(users, params, ipAddr, dstIPAddr);
+    if (verdict.isTypeChanged)
+        emit UsersTypeChanged(conn, ipAddr);
+    for (UserAddress flushedIPAddr : verdict.flushedTypeChanged)
+        emit UsersTypeChanged(conn, flushedIPAddr);
+
+    AclTable::SwitchState* acl = nullptr;
+    if (aclTable.isEnabled())
+        acl = partition != nullptr ? partition->acl : aclTable.getSwitchState(conn->dpid());
+    switch (verdict.verdict)
     {
-    case Users::UsersTypes::Valid:
-    {
-        LOG(INFO) << "Users::UsersTypes::Valid";
-        Users::ValidUsersParams& userParams = validUser->second;
-        try
+    case Classifier::Verdicts::Block:
+        if (aclTable.isEnabled())
         {
-            userParams.increaseConnCounter(params);
+            aclTable.block(*acl, conn, ipAddr);
+            return DecisionHandler::dropPacket(decision);
         }
-        catch (Users::UsersExceptionTypes)
-        {
-            LOG(INFO) << "Valid --> Valid or Malicious";
-            emit UsersTypeChanged(conn, ipAddr);
-        }
-        decision = DecisionHandler::setNormalTimeouts(decision);
+        return DecisionHandler::drop(decision);
+    case Classifier::Verdicts::LimitUnknown:
+        if (aclTable.isMetering())
+            aclTable.rateLimit(*acl, conn, ipAddr, AclTable::UNKNOWN_METER_ID);
+        break;
+    case Classifier::Verdicts::LimitDDoS:
+    case Classifier::Verdicts::LimitHeavyHitter:
+        if (aclTable.isMetering())
+            aclTable.rateLimit(*acl, conn, ipAddr, AclTable::DDOS_METER_ID);
+        break;
+    case Classifier::Verdicts::Forward:
+        // a valid user during DDoS
+        if (aclTable.isMetering() && classifier_.isDDoS())
+            aclTable.bypass(*acl, conn, ipAddr);
+        break;
+    default:
         break;
     }
-    case Users::UsersTypes::Invalid:
-    {
-        LOG(INFO) << "Users::UsersTypes::Invalid";
-        Users::InvalidUsersParams& userParams = invalidUser->second;
-        try
-        {
-            userParams.increaseConnCounter(params);
-        }
-        catch (Users::UsersExceptionTypes)
-        {
-            LOG(INFO) << "Malicious --> Valid or Malicious";
-            emit UsersTypeChanged(conn, ipAddr);
-        }
-
-//        invalidUser->second.print();
+    return DecisionHandler::setTimeouts(decision, verdict.verdict != Classifier::Verdicts::Forward,
+            partition != nullptr ? partition->getOccupancyLevel() : tableOccupancy.getLevel(conn->dpid()));
+}
 
-        Users::InvalidUsersParams::InvalidUsersTypes invalidType = userParams.getType();
-        bool invalidTypeIsChecked = userParams.typeIsChecked();
-        if (invalidType == Users::InvalidUsersParams::InvalidUsersTypes::Malicious
-                && invalidTypeIsChecked == 1) //
-        {
-            // Block
-            return DecisionHandler::drop(decision);
-        }
 
-        decision = isDDoS ? DecisionHandler::setShortTimeouts(decision) : DecisionHandler::setNormalTimeouts(decision);
-        break;
-    }
-    case Users::UsersTypes::Unknown:
-        LOG(INFO) << "Users::UsersTypes::Unknown";
-        users.insert(ipAddr);
-        decision = isDDoS ? DecisionHandler::setShortTimeouts(decision) : DecisionHandler::setNormalTimeouts(decision);
-        break;
+Decision ControllerDDoSProtection::processL2Miss (SwitchConnectionPtr conn, L2Flood::Verdicts verdict, InPort inPort,
+                                                  uint16_t ethType, Decision decision)
+{
+    switch (verdict)
+    {
+    case L2Flood::Verdicts::DropMac:
+        return DecisionHandler::dropFor(decision, L2Flood::MAC_BLOCK_TIME);
+    case L2Flood::Verdicts::LimitPort:
+        // the switch meters the in_port, the excess is dropped meanwhile
+        if (aclTable.isMetering())
+            aclTable.rateLimitPort(conn, inPort, ethType);
+        return DecisionHandler::dropPacket(decision);
+    case L2Flood::Verdicts::DropPort:
+        return DecisionHandler::dropFor(decision, L2Flood::PORT_BLOCK_TIME);
+    default:
+        return decision;
     }
-    return decision;
 }
 
 
 void ControllerDDoSProtection::flowRemoved (SwitchConnectionPtr conn, of13::FlowRemoved fr) {
 //    LOG(INFO) << "ControllerDDoSProtection::flowRemoved()";
-    Dpid dpid = conn->dpid();
-//    LOG(INFO) << "dpid = " << dpid;
+    Metrics::Timer timer(Metrics::Stages::FlowRemoved);
 
+    // flows deleted by mitigate() are not expired: their low packet counts are not samples
+    if (fr.reason() == of13::OFPRR_DELETE)
+        return;
     uint64_t packet_count = fr.packet_count();
     if (packet_count == 0)
         return; // useless
 //    LOG(INFO) << "packet_count = " << packet_count;
 
-    of13::InPort* in_port_ptr = fr.match().in_port();
-    InPort in_port;
-    if (in_port_ptr == nullptr)
+    // in_port, eth_src and the user are resolved in the batch
+    FlowRemovedQueue::Event event {conn->dpid(), 0, false, false, false, 0, packet_count, false, 0};
+    of13::Match match = fr.match();
+    if (of13::InPort* in_port_ptr = match.in_port())
     {
-        LOG(WARNING) << "Cannot get IN_PORT from Flow Removed Message";
-        of13::EthSrc* eth_addr_ptr = fr.match().eth_src();
-        if (eth_addr_ptr == nullptr)
-        {
-            LOG(WARNING) << "Cannot get ETH_SRC from Flow Removed Message";
-            return;
-        }
-
-        EthAddress eth_addr = eth_addr_ptr->value();
-        Host* host = host_manager->getHost(eth_addr.to_string());
-        if (host == nullptr)
-        {
-            LOG(WARNING) << "Cannot get host by MAC: " << eth_addr.to_string() << " from HostManager";
-            return;
-        }
-
-        in_port = host->switchPort();
-    } else {
-        in_port = in_port_ptr->value();
+        event.inPort = in_port_ptr->value();
+        event.hasInPort = true;
+    }
+    of13::EthType* eth_type_ptr = match.eth_type();
+    event.isIPv4 = eth_type_ptr != nullptr && eth_type_ptr->value() == IPv4_TYPE;
+    if (of13::IPv6Src* ipv6_src_ptr = match.ipv6_src())
+    {
+        event.ipAddr = UserAddress::fromOctets(ipv6_src_ptr->value().getIPv6(), isIPv6Prefix64);
+        event.isIPv6 = true;
+    }
+    if (of13::EthSrc* eth_addr_ptr = match.eth_src())
+    {
+        EthAddress ethAddr = eth_addr_ptr->value();
+        const uint8_t* octets = ethAddr.get_data();
+        for (size_t i = 0; i < 6; ++i)
+            event.ethSrc = event.ethSrc << 8 | octets[i];
+        event.hasEthSrc = true;
     }
-//    LOG(INFO) << "in_port = " << in_port;
 
-    SPRTdetection::InPortTypes in_port_type = detection.isCompromisedInPort(dpid, in_port, packet_count, params.getValidPacketNumber().cur);
-    if (in_port_type == SPRTdetection::InPortTypes::Compromised)
+    if (!flowRemovedQueue.push(event))
     {
-        LOG(INFO) << "Switch ID: " << dpid << ", in_port: " << in_port << " is compromised!";
-        setDDoS (detection.isDDoS());
+        // back-pressure: the full queue is processed by the producer
+        processFlowRemoved(true);
+        flowRemovedQueue.push(event);
     }
+}
 
-    // Users check
-    of13::EthType* eth_type_ptr = fr.match().eth_type();
-    if (eth_type_ptr == nullptr || eth_type_ptr->value() != IPv4_TYPE)
-        return; // useless
 
-    of13::EthSrc* addrPtr = fr.match().eth_src();
-    if (addrPtr == nullptr)
+void ControllerDDoSProtection::flowRemovedTimeout()
+{
+    if (!flowRemovedQueue.isEmpty())
+        processFlowRemoved(false);
+}
+
+
+void ControllerDDoSProtection::processFlowRemoved (bool isFull)
+{
+    Metrics::Timer timer(Metrics::Stages::FlowRemovedBatch);
+    FlowRemovedQueue::Batch batch = flowRemovedQueue.take(params.getValidPacketNumber().cur,
+        [this](uint64_t ethSrc)
+        {
+            uint8_t octets[6];
+            for (size_t i = 0; i < 6; ++i)
+                octets[5 - i] = ethSrc >> (8 * i);
+            EthAddress ethAddr(octets);
+            Host* host = host_manager->getHost(ethAddr.to_string());
+            if (host == nullptr)
+            {
+                LOG(WARNING) << "Cannot get host by MAC: " << ethAddr.to_string() << " from HostManager";
+                return FlowRemovedQueue::Host {false, 0, 0};
+            }
+            return FlowRemovedQueue::Host {true, host->ip().getIPv4(), host->switchPort()};
+        }, isFull);
+    if (batch.unresolved > 0)
+        LOG(WARNING) << batch.unresolved << " of " << batch.events << " flow-removed without IN_PORT or a known host";
+
+    for (const FlowRemovedQueue::UserFlows& user : batch.users)
     {
-        LOG(WARNING) << "Cannot get ETH_SRC from Flow Removed Message";
-        return;
+        packetHitters.update(user.ipAddr, user.packets);
+        LOG(INFO) << "IP: " << user.ipAddr.toString() << ", flows: " << user.flows
+                  << ", packet_count: " << user.packets;
     }
 
-    EthAddress ethAddr = addrPtr->value();
-    Host* host = host_manager->getHost(ethAddr.to_string());
-    if (host == nullptr)
+    if (partitionMode == PartitionModes::Switch)
     {
-        LOG(WARNING) << "Cannot get host by MAC: " << ethAddr.to_string() << " from HostManager";
+        for (const FlowRemovedQueue::PortSamples& port : batch.ports)
+        {
+            Partition::PacketNumbers event {0, port.inPort, true, {}, port.samples, port.lowSamples};
+            getPartition(port.dpid)->post(event);
+        }
+        for (const FlowRemovedQueue::UserFlows& user : batch.users)
+        {
+            Partition::PacketNumbers event {user.ipAddr, 0, false, {}, user.flows, user.invalidFlows};
+            getPartition(user.dpid)->post(event);
+        }
         return;
     }
 
-    IPAddress ipAddr = host->ip();
-    IPAddressV4 ipAddrV4 = ipAddr.getIPv4();
+    bool isCompromised = false;
+    for (const FlowRemovedQueue::PortSamples& port : batch.ports)
+    {
+        if (detection.updateInPort(port.dpid, port.inPort, port.samples, port.lowSamples)
+                == SPRTdetection::InPortTypes::Compromised)
+        {
+            LOG(INFO) << "Switch ID: " << port.dpid << ", in_port: " << port.inPort << " is compromised!";
+            replication.publish(Replication::Update(Replication::PortCompromised, 0, port.dpid, port.inPort));
+            journal.write(JournalFormat::PortCompromised, 0, port.dpid, port.inPort);
+            isCompromised = true;
+        }
+    }
+    if (isCompromised)
+        setDDoS (detection.isDDoS());
 
-    std::map<IPAddressV4, Users::ValidUsersParams>::iterator validUser;
-    std::map<IPAddressV4, Users::InvalidUsersParams>::iterator invalidUser;
-    Users::UsersTypes userType = users.get(ipAddrV4, validUser, invalidUser);
-    LOG(INFO) << "IP: " << AppObject::uint32_t_ip_to_string(ipAddrV4) << ", packet_count: " << packet_count;
-    switch (userType)
+    for (const FlowRemovedQueue::UserFlows& user : batch.users)
     {
-    case Users::UsersTypes::Invalid:
         try
         {
-            Users::InvalidUsersParams& userParams = invalidUser->second;
-            userParams.updatePacketNumber(params, packet_count);
-            userParams.updateIsChecked(params);
+            Classifier::checkUser(users, params, user.ipAddr, user.flows, user.invalidFlows);
         }
         catch (Users::UsersExceptionTypes)
         {
-            users.validate(invalidUser);
+            LOG(WARNING) << "Unknown user " << user.ipAddr.toString() << " of flow-removed";
+        }
+    }
+}
+
+
+// ControllerDDoSProtection::Partition
+ControllerDDoSProtection::Partition::Partition (Dpid dpid_, Users::Layouts layout, size_t maxInvalidUsers,
+                                                size_t victimSourcesNumber)
+    : fanIn(victimSourcesNumber), classifier(fanIn, packetInHitters), acl(nullptr), dpid(dpid_), isCompromised(false),
+      hasWork(false), occupancyLevel(TableOccupancy::Normal), isMergeRequested(false), isEntropyAnomalous(false),
+      isDDoSAssigned(false), isDDoS(false)
+{
+    users.setLayout(layout);
+    users.setMaxInvalidUsers(maxInvalidUsers);
+    params.init();
+}
+
+
+void ControllerDDoSProtection::Partition::post (PacketNumbers event)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    inbox.push_back(std::move(event));
+    hasWork.store(true, std::memory_order_release);
+}
+
+
+void ControllerDDoSProtection::Partition::requestMerge (const Params& merged_, bool isEntropyAnomalous_)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    merged.assign(merged_);
+    isEntropyAnomalous = isEntropyAnomalous_;
+    isMergeRequested = true;
+    hasWork.store(true, std::memory_order_release);
+}
+
+
+void ControllerDDoSProtection::Partition::assignDDoS (bool isDDoS_)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    isDDoS = isDDoS_;
+    isDDoSAssigned = true;
+    hasWork.store(true, std::memory_order_release);
+}
+
+
+ControllerDDoSProtection::Partition::Summary ControllerDDoSProtection::Partition::getSummary()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return summary;
+}
+
+
+void ControllerDDoSProtection::Partition::drain()
+{
+    std::vector<PacketNumbers> events;
+    bool isMerge;
+    bool isAnomalous;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (isDDoSAssigned)
+            classifier.assignDDoS(isDDoS);
+        isDDoSAssigned = false;
+        events.swap(inbox);
+        isMerge = isMergeRequested;
+        isMergeRequested = false;
+        isAnomalous = isEntropyAnomalous;
+        if (isMerge)
+            params.assign(merged);
+        hasWork.store(false, std::memory_order_relaxed);
+    }
+
+    for (PacketNumbers& event : events)
+    {
+        if (event.hasInPort
+                && (event.packetNumbers.empty()
+                    ? detection.updateInPort(dpid, event.inPort, event.flows, event.lowPacketFlows)
+                    : detection.isCompromisedInPort(dpid, event.inPort, event.packetNumbers[0], params.getValidPacketNumber().cur))
+                    == SPRTdetection::InPortTypes::Compromised)
+        {
+            LOG(INFO) << "Switch ID: " << dpid << ", in_port: " << event.inPort << " is compromised!";
+            replication.publish(Replication::Update(Replication::PortCompromised, 0, dpid, event.inPort));
+            journal.write(JournalFormat::PortCompromised, 0, dpid, event.inPort);
+            isCompromised = true;
+        }
+        if (event.ipAddr == 0)
+            continue;
+        if (event.connections > 0)
+        {
+            if (Classifier::countConnections(users, params, event.ipAddr, event.connections))
+            {
+                VerdictCache::invalidate(event.ipAddr);
+                typeChanged.push_back(event.ipAddr);
+            }
+            continue;
         }
-        break;
-    case Users::UsersTypes::Valid:
         try
         {
-            Users::ValidUsersParams& userParams = validUser->second;
-            userParams.updatePacketNumber(params, packet_count);
-            userParams.updateIsChecked(params);
+            if (event.packetNumbers.empty())
+                Classifier::checkUser(users, params, event.ipAddr, event.flows, event.lowPacketFlows);
+            else
+                Classifier::checkUser(users, params, event.ipAddr, event.packetNumbers);
         }
         catch (Users::UsersExceptionTypes)
         {
-            users.invalidate(validUser);
+            LOG(WARNING) << "Unknown user " << event.ipAddr.toString() << " on switch " << dpid;
         }
+    }
 
-        break;
-    case Users::UsersTypes::Unknown:
-        throw Users::UsersExceptionTypes::IsUnknown;
+    if (isMerge)
+        publish(isAnomalous);
+}
+
+
+void ControllerDDoSProtection::Partition::publish (bool isEntropyAnomalous_)
+{
+    users.update();
+
+    Summary s;
+    s.avgConnNumberSum = Params::sumValidAvgConnNumber(users, s.validUsersNumber);
+    s.invalidUsersNumber = users.getInvalidUsersNumber();
+    s.isDDoS = users.getStatistics().handle(isEntropyAnomalous_);
+    s.isCompromised = isCompromised;
+    isCompromised = false;
+
+    s.users.reserve(s.validUsersNumber + s.invalidUsersNumber);
+    users.forEachValidUser([&](UserAddress ipAddr, Users::ValidUsersParams&)
+    {
+        s.users.push_back(UserState {ipAddr, Valid});
+    });
+    users.forEachInvalidUser([&](UserAddress ipAddr, Users::InvalidUsersParams& userParams)
+    {
+        UserStates state = userParams.isBlocked() ? Blocked : (userParams.typeIsChecked() ? Checked : Unchecked);
+        s.users.push_back(UserState {ipAddr, state});
+    });
+
+    std::lock_guard<std::mutex> guard(lock);
+    summary = std::move(s);
+}
+
+
+ControllerDDoSProtection::Partition* ControllerDDoSProtection::getPartition (Dpid dpid)
+{
+    std::lock_guard<std::mutex> guard(partitionsLock);
+    std::unique_ptr<Partition>& partition = partitions[dpid];
+    if (!partition)
+    {
+        partition.reset(new Partition(dpid, users.getLayout(), users.getMaxInvalidUsers(),
+                                      fanIn.getAlarmSourcesNumber()));
+        partition->acl = aclTable.getSwitchState(dpid);
+        if (replication.getRole() == Replication::Roles::Publisher)
+            partition->users.onTransition(publishTransition);
+        if (journal.isOpen())
+            partition->users.onTransition(journalTransition);
     }
+    return partition.get();
 }
 
 
-// ControllerDDoSProtection::SPRTdetection
-bool ControllerDDoSProtection::SPRTdetection::isDDoS() {
-    return true;
+void ControllerDDoSProtection::partitionMergeTimeout()
+{
+    Metrics::Timer timer(Metrics::Stages::DetectDDoS);
+    std::vector<Partition*> current;
+    {
+        std::lock_guard<std::mutex> guard(partitionsLock);
+        for (auto& p : partitions)
+            current.push_back(p.second.get());
+    }
+
+    // summaries published since the previous request
+    size_t avgConnNumberSum = 0;
+    MergedView view;
+    view.partitionsNumber = current.size();
+    bool isDetectedDDoS = false;
+    std::unordered_map<UserAddress, std::pair<size_t, Partition::UserStates>> seen;
+    std::unordered_map<UserAddress, FanIn::Victim> victims;
+    std::unordered_map<UserAddress, HeavyHitters::Counter> sources;
+    for (Partition* partition : current)
+    {
+        // the sketches are read under their own locks, not the owner's state
+        for (const FanIn::Victim& v : partition->fanIn.getVictims())
+        {
+            auto ret = victims.insert(std::make_pair(v.ipAddr, v));
+            ret.first->second.sourcesNumber = std::max(ret.first->second.sourcesNumber, v.sourcesNumber);
+            ret.first->second.isAttacked = ret.first->second.isAttacked || v.isAttacked;
+        }
+        for (const HeavyHitters::Counter& c : partition->packetInHitters.top(TOP_SOURCES_NUMBER))
+        {
+            HeavyHitters::Counter& sum = sources.insert(std::make_pair(c.ipAddr, HeavyHitters::Counter(c.ipAddr))).first->second;
+            sum.count += c.count;
+            sum.error += c.error;
+        }
+        view.packetInsTotal += partition->packetInHitters.getTotal();
+
+        Partition::Summary summary = partition->getSummary();
+        avgConnNumberSum += summary.avgConnNumberSum;
+        view.validUsersNumber += summary.validUsersNumber;
+        view.invalidUsersNumber += summary.invalidUsersNumber;
+        isDetectedDDoS = isDetectedDDoS || summary.isDDoS || summary.isCompromised;
+        for (const Partition::UserState& user : summary.users)
+        {
+            auto ret = seen.insert(std::make_pair(user.ipAddr, std::make_pair((size_t) 0, user.state)));
+            ++ret.first->second.first;
+            if (user.state > ret.first->second.second)
+                ret.first->second.second = user.state;
+        }
+    }
+    for (auto& user : seen)
+    {
+        if (user.second.first > 1)
+            ++view.sharedUsersNumber;
+        if (user.second.second == Partition::UserStates::Blocked)
+            view.blocked.push_back(user.first);
+        else if (user.second.second == Partition::UserStates::Unchecked)
+            view.unchecked.push_back(user.first);
+    }
+    for (auto& v : victims)
+        view.victims.push_back(v.second);
+    for (auto& c : sources)
+        view.packetInSources.push_back(c.second);
+    size_t k = std::min((size_t) TOP_SOURCES_NUMBER, view.packetInSources.size());
+    std::partial_sort(view.packetInSources.begin(), view.packetInSources.begin() + k, view.packetInSources.end(),
+                      [](const HeavyHitters::Counter& a, const HeavyHitters::Counter& b) { return a.count > b.count; });
+    view.packetInSources.resize(k);
+    std::swap(mergedView, view);
+
+    // pending connections of the caches of threads without packet-ins, to the owners of their users
+    if (VerdictCache::isEnabled())
+    {
+        std::unordered_map<const Users*, Partition*> owners;
+        for (Partition* partition : current)
+            owners[&partition->users] = partition;
+        VerdictCache::sweepAll(Clock::now(), [&](VerdictCache::Entry& entry)
+        {
+            auto owner = owners.find(entry.users);
+            if (owner != owners.end())
+            {
+                Partition::PacketNumbers event {entry.ipAddr, 0, false, {}, 0, 0, entry.pendingConns};
+                owner->second->post(std::move(event));
+            }
+            entry.pendingConns = 0;
+        });
+    }
+
+    params.updateValidAvgConnNumber(avgConnNumberSum, mergedView.validUsersNumber);
+    for (Partition* partition : current)
+    {
+        partition->requestMerge(params, entropy.isAnomalous());
+        // new partitions start without DDoS
+        partition->assignDDoS(classifier.isDDoS());
+    }
+
+    setDDoS(isDetectedDDoS || tableOccupancy.isUnderPressure());
 }
 
 
-ControllerDDoSProtection::SPRTdetection::InPortTypes
-ControllerDDoSProtection::SPRTdetection::isCompromisedInPort (Dpid dpid, InPort in_port, uint64_t packet_count, size_t packet_count_max)
+// ControllerDDoSProtection::AclTable
+void ControllerDDoSProtection::AclTable::install (SwitchConnectionPtr conn)
 {
-    Imap::iterator dn;
-    getDi(dpid, in_port, dn);
-    countDin(dn, packet_count, packet_count_max);
-    return checkDin(dn);
+    LOG(INFO) << "ACL table " << (int) tableId << " --> forwarding table " << (int) forwardingTableId
+              << " on switch " << conn->dpid();
+    of13::FlowMod fm;
+    fm.command(of13::OFPFC_ADD);
+    fm.table_id(tableId);
+    fm.priority(0); // table-miss
+    fm.buffer_id(of13::OFP_NO_BUFFER);
+    fm.add_instruction(new of13::GoToTable(forwardingTableId));
+    conn->send(fm);
+
+    // the ACL table took the switch's table-miss: new flows of the forwarding
+    // table go to the controller, maple installs them there
+    of13::FlowMod miss;
+    miss.command(of13::OFPFC_ADD);
+    miss.table_id(forwardingTableId);
+    miss.priority(0); // table-miss
+    miss.buffer_id(of13::OFP_NO_BUFFER);
+    of13::ApplyActions* actions = new of13::ApplyActions();
+    actions->add_action(new of13::OutputAction(of13::OFPP_CONTROLLER, of13::OFPCML_NO_BUFFER));
+    miss.add_instruction(actions);
+    conn->send(miss);
+
+    if (metering)
+        installMeters(conn, of13::OFPMC_ADD);
 }
 
 
-ControllerDDoSProtection::SPRTdetection::InPortTypes
-ControllerDDoSProtection::SPRTdetection::checkDin (Imap::iterator& dn)
+UserAddress ControllerDDoSProtection::AclTable::getMeteredPrefix (const UserAddress& ipAddr)
 {
-    double din = dn->second.din;
-    if (din <= b)
-        return InPortTypes::Uncompromised;
-    if (din >= a)
-        return InPortTypes::Compromised;
-    // else
-    return InPortTypes::Unknown;
+    if (ipAddr.isV4())
+        return UserAddress(ipAddr.hi, ipAddr.lo & (UserAddress::V4_MAPPED | htonl(METERED_IPV4_MASK)));
+    return UserAddress(ipAddr.hi & METERED_IPV6_MASK, 0);
 }
 
 
-bool ControllerDDoSProtection::SPRTdetection::getDi (Dpid dpid, InPort i, Imap::iterator& dn)
+void ControllerDDoSProtection::AclTable::addPrefixMatch (of13::FlowMod& fm, const UserAddress& prefix)
 {
-    Dmap::iterator di;
-    if (searchDpid(dpid, di))
+    if (prefix.isV4())
     {
-        if (searchInPort(i, di, dn))
-            return true;
-        // or insert one level (InPort)
-        insertInPort(i, di, dn);
+        fm.add_oxm_field(new of13::EthType(IPv4_TYPE));
+        fm.add_oxm_field(new of13::IPv4Src(IPAddress(prefix.getV4()), IPAddress(htonl(METERED_IPV4_MASK))));
+        return;
+    }
+    uint8_t octets[16];
+    uint8_t mask[16] = {};
+    prefix.toOctets(octets);
+    for (size_t i = 0; i < 8; ++i)
+        mask[i] = METERED_IPV6_MASK >> (56 - 8 * i);
+    fm.add_oxm_field(new of13::EthType(IPv6_TYPE));
+    fm.add_oxm_field(new of13::IPv6Src(IPAddress(octets), IPAddress(mask)));
+}
+
+
+bool ControllerDDoSProtection::AclTable::Metered::isMetered (const UserAddress& prefix, time_t now)
+{
+    return now < classUntil(prefix) || isActive(prefixes, prefix, now);
+}
+
+
+ControllerDDoSProtection::AclTable::SwitchState* ControllerDDoSProtection::AclTable::getSwitchState (Dpid dpid)
+{
+    std::lock_guard<std::mutex> lock(switchesLock);
+    std::unique_ptr<SwitchState>& state = switches[dpid];
+    if (!state)
+        state.reset(new SwitchState);
+    return state.get();
+}
+
+
+void ControllerDDoSProtection::AclTable::rateLimit (SwitchState& state, SwitchConnectionPtr conn, UserAddress ipAddr,
+                                                    uint32_t meterId)
+{
+    // a spoofed flood is new sources of a few prefixes: an entry per prefix
+    // meters its next sources too, the table does not grow with the flood
+    UserAddress prefix = getMeteredPrefix(ipAddr);
+    time_t now = Clock::now();
+    std::lock_guard<std::mutex> lock(state.lock);
+    Metered& m = state.metered;
+    if (m.isMetered(prefix, now))
+        return;
+    Pending& p = state.pending;
+    p.conn = conn;
+    if (m.prefixes.size() >= MAX_METERED_PREFIXES)
+    {
+        // expired prefixes are purged by flush(), meanwhile the whole family is metered
+        m.classUntil(prefix) = now + METERED_HARD_TIMEOUT;
+        p.meteredClasses.insert(prefix.isV4() ? IPv4_TYPE : IPv6_TYPE);
+        return;
+    }
+    m.prefixes[prefix] = now + METERED_HARD_TIMEOUT;
+    p.rateLimited[prefix] = meterId;
+}
+
+
+void ControllerDDoSProtection::AclTable::bypass (SwitchState& state, SwitchConnectionPtr conn, UserAddress ipAddr)
+{
+    time_t now = Clock::now();
+    std::lock_guard<std::mutex> lock(state.lock);
+    Metered& m = state.metered;
+    if (!m.isMetered(getMeteredPrefix(ipAddr), now) || isActive(m.bypassed, ipAddr, now))
+        return;
+    m.bypassed[ipAddr] = now + METERED_HARD_TIMEOUT;
+    Pending& p = state.pending;
+    p.conn = conn;
+    p.bypassed.insert(ipAddr);
+}
+
+
+void ControllerDDoSProtection::AclTable::remove (Dpid dpid)
+{
+    SwitchState* state = getSwitchState(dpid);
+    std::lock_guard<std::mutex> lock(state->lock);
+    state->pending = Pending();
+    state->metered = Metered();
+}
+
+
+void ControllerDDoSProtection::AclTable::rateLimitPort (SwitchConnectionPtr conn, InPort inPort, uint16_t ethType)
+{
+    SwitchState* state = getSwitchState(conn->dpid());
+    std::lock_guard<std::mutex> lock(state->lock);
+    Pending& p = state->pending;
+    p.conn = conn;
+    p.rateLimitedPorts.insert(std::make_pair(inPort, ethType));
+}
+
+
+bool ControllerDDoSProtection::AclTable::sizeMeters (size_t validPacketNumber)
+{
+    // a class may start METER_FLOWS_RATE valid flows per second
+    uint32_t rate = validPacketNumber * METER_FLOWS_RATE;
+    if (rate == meterRate)
         return false;
+    meterRate = rate;
+    return true;
+}
+
+
+void ControllerDDoSProtection::AclTable::installMeters (SwitchConnectionPtr conn, uint16_t command)
+{
+    for (uint32_t meterId : {UNKNOWN_METER_ID, DDOS_METER_ID, L2_METER_ID})
+    {
+        uint32_t rate = meterId == L2_METER_ID ? l2MeterRate : meterRate;
+        of13::MeterMod mm;
+        mm.command(command);
+        mm.flags(of13::OFPMF_PKTPS | of13::OFPMF_BURST);
+        mm.meter_id(meterId);
+        mm.add_band(new of13::MeterBandDrop(rate, rate));
+        conn->send(mm);
     }
-    // or insert two levels (Dpid & InPort)
-    insertDpid(dpid, di);
-    insertInPort(i, di, dn);
-    return false;
+    LOG(INFO) << "Meters are sized to " << meterRate << " packets per second (L2: " << l2MeterRate
+              << ") on switch " << conn->dpid();
 }
 
 
-bool ControllerDDoSProtection::SPRTdetection::searchDpid (Dpid dpid, Dmap::iterator& di)
+void ControllerDDoSProtection::AclTable::block (SwitchState& state, SwitchConnectionPtr conn, UserAddress ipAddr)
 {
-    Dmap::iterator it = d.find(dpid);
-    if (it != d.end())
+    std::lock_guard<std::mutex> lock(state.lock);
+    Pending& p = state.pending;
+    p.conn = conn;
+    p.blocked.insert(ipAddr);
+}
+
+
+void ControllerDDoSProtection::AclTable::flush()
+{
+    std::vector<std::pair<Dpid, SwitchState*>> states;
+    {
+        std::lock_guard<std::mutex> lock(switchesLock);
+        for (auto& s : switches)
+            states.push_back(std::make_pair(s.first, s.second.get()));
+    }
+    std::map<Dpid, Pending> toSend;
+    time_t now = Clock::now();
+    auto purge = [now](std::map<UserAddress, time_t>& entries)
+    {
+        for (auto it = entries.begin(); it != entries.end(); )
+            it = now < it->second ? std::next(it) : entries.erase(it);
+    };
+    for (auto& s : states)
+    {
+        std::lock_guard<std::mutex> lock(s.second->lock);
+        if (s.second->pending.conn)
+            std::swap(toSend[s.first], s.second->pending);
+        purge(s.second->metered.prefixes);
+        purge(s.second->metered.bypassed);
+    }
+
+    for (auto& p : toSend)
+    {
+        FlowModBatch batch(p.second.conn);
+        for (UserAddress ipAddr : p.second.blocked)
+        {
+            of13::FlowMod fm = blockFlowMod(ipAddr);
+            batch.send(fm);
+        }
+        // no idle timeout: the entries live as long as their Metered records
+        for (auto& r : p.second.rateLimited)
+        {
+            of13::FlowMod fm;
+            fm.command(of13::OFPFC_ADD);
+            fm.table_id(tableId);
+            fm.priority(RATE_LIMIT_PRIORITY);
+            fm.hard_timeout(METERED_HARD_TIMEOUT);
+            fm.buffer_id(of13::OFP_NO_BUFFER);
+            addPrefixMatch(fm, r.first);
+            fm.add_instruction(new of13::Meter(r.second));
+            fm.add_instruction(new of13::GoToTable(forwardingTableId));
+            batch.send(fm);
+        }
+        // the prefixes are too many: sources of the family without an entry share the Unknown meter
+        for (uint16_t ethType : p.second.meteredClasses)
+        {
+            of13::FlowMod fm;
+            fm.command(of13::OFPFC_ADD);
+            fm.table_id(tableId);
+            fm.priority(RATE_LIMIT_PRIORITY - 1);
+            fm.hard_timeout(METERED_HARD_TIMEOUT);
+            fm.buffer_id(of13::OFP_NO_BUFFER);
+            fm.add_oxm_field(new of13::EthType(ethType));
+            fm.add_instruction(new of13::Meter(UNKNOWN_METER_ID));
+            fm.add_instruction(new of13::GoToTable(forwardingTableId));
+            batch.send(fm);
+        }
+        for (UserAddress ipAddr : p.second.bypassed)
+        {
+            if (p.second.blocked.count(ipAddr))
+                continue;
+            of13::FlowMod fm;
+            fm.command(of13::OFPFC_ADD);
+            fm.table_id(tableId);
+            fm.priority(RATE_LIMIT_PRIORITY + 1);
+            fm.hard_timeout(METERED_HARD_TIMEOUT);
+            fm.buffer_id(of13::OFP_NO_BUFFER);
+            addUserMatch(fm, ipAddr);
+            fm.add_instruction(new of13::GoToTable(forwardingTableId));
+            batch.send(fm);
+        }
+        for (auto& port : p.second.rateLimitedPorts)
+        {
+            of13::FlowMod fm;
+            fm.command(of13::OFPFC_ADD);
+            fm.table_id(tableId);
+            fm.priority(RATE_LIMIT_PRIORITY);
+            fm.idle_timeout(RATE_LIMIT_IDLE_TIMEOUT);
+            fm.hard_timeout(RATE_LIMIT_HARD_TIMEOUT);
+            fm.buffer_id(of13::OFP_NO_BUFFER);
+            fm.add_oxm_field(new of13::InPort(port.first));
+            fm.add_oxm_field(new of13::EthType(port.second));
+            fm.add_instruction(new of13::Meter(L2_METER_ID));
+            fm.add_instruction(new of13::GoToTable(forwardingTableId));
+            batch.send(fm);
+        }
+        LOG(INFO) << "ACL table: " << p.second.blocked.size() << " users are blocked, "
+                  << p.second.rateLimited.size() << " prefixes, " << p.second.meteredClasses.size()
+                  << " address families and " << p.second.rateLimitedPorts.size()
+                  << " in_ports are rate limited, " << p.second.bypassed.size()
+                  << " valid users bypass the meters on switch " << p.first;
+    }
+}
+
+
+of13::FlowMod ControllerDDoSProtection::AclTable::blockFlowMod (UserAddress ipAddr) const
+{
+    // ACL table in the multi-table mode, the only table otherwise
+    of13::FlowMod fm;
+    fm.command(of13::OFPFC_ADD);
+    fm.table_id(enabled ? tableId : 0);
+    fm.priority(BLOCK_PRIORITY);
+    fm.idle_timeout(0);
+    fm.hard_timeout(BLOCK_HARD_TIMEOUT);
+    fm.buffer_id(of13::OFP_NO_BUFFER);
+    addUserMatch(fm, ipAddr);
+    // no instructions: drop
+    return fm;
+}
+
+
+// Replication
+void ControllerDDoSProtection::publishTransition (UserAddress ipAddr, Users::Transitions transition)
+{
+    static const Replication::Operations operations[] = {
+        Replication::Insert,        // Users::Transitions::Insert
+        Replication::Invalidate,
+        Replication::Validate,
+        Replication::Block,
+        Replication::Remove,
+        Replication::Evict,
+        Replication::Reset
+    };
+    replication.publish(Replication::Update(operations[transition], ipAddr));
+}
+
+
+// Journal
+void ControllerDDoSProtection::journalTransition (UserAddress ipAddr, Users::Transitions transition)
+{
+    static const JournalFormat::Types types[] = {
+        JournalFormat::Insert,      // Users::Transitions::Insert
+        JournalFormat::Invalidate,
+        JournalFormat::Validate,
+        JournalFormat::Block,
+        JournalFormat::Remove,
+        JournalFormat::Evict,
+        JournalFormat::Reset
+    };
+    journal.write(types[transition], ipAddr);
+}
+
+
+void ControllerDDoSProtection::applyReplicated (const Replication::Update& update)
+{
+    switch (update.op)
     {
-        di = it;
-        return true;
+    case Replication::Insert:
+        users.apply(update.ipAddr, Users::Transitions::Insert);
+        break;
+    case Replication::Invalidate:
+        users.apply(update.ipAddr, Users::Transitions::Invalidate);
+        break;
+    case Replication::Validate:
+        users.apply(update.ipAddr, Users::Transitions::Validate);
+        break;
+    case Replication::Block:
+        users.apply(update.ipAddr, Users::Transitions::Block);
+        break;
+    case Replication::Remove:
+        users.apply(update.ipAddr, Users::Transitions::Remove);
+        break;
+    case Replication::Evict:
+        users.apply(update.ipAddr, Users::Transitions::Evict);
+        break;
+    case Replication::Reset:
+        users.apply(update.ipAddr, Users::Transitions::Reset);
+        break;
+    case Replication::PortCompromised:
+        detection.setCompromised(update.dpid, update.inPort);
+        break;
+    case Replication::DDoSDetected:
+        // the publisher mitigates, the verdict is kept for a failover
+        classifier.assignDDoS(true);
+        break;
+    case Replication::DDoSFinished:
+        classifier.assignDDoS(false);
+        break;
     }
-    return false;
 }
 
 
-bool ControllerDDoSProtection::SPRTdetection::searchInPort (InPort i, Dmap::iterator di, Imap::iterator& dn)
+void ControllerDDoSProtection::getReplicationSnapshot (std::vector<Replication::Update>& state)
 {
-    Imap::iterator it = di->second.find(i);
-    if (it != di->second.end())
+    if (partitionMode == PartitionModes::Switch)
     {
-        dn = it;
-        return true;
+        // users of the partitions are owned by their threads: blocks of the last merge
+        for (UserAddress ipAddr : mergedView.blocked)
+            state.push_back(Replication::Update(Replication::Block, ipAddr));
+    } else {
+        users.forEachValidUser([&](UserAddress ipAddr, Users::ValidUsersParams&)
+        {
+            state.push_back(Replication::Update(Replication::Validate, ipAddr));
+        });
+        users.forEachInvalidUser([&](UserAddress ipAddr, Users::InvalidUsersParams& userParams)
+        {
+            Replication::Operations op = Replication::Insert;
+            if (userParams.isBlocked())
+                op = Replication::Block;
+            else if (userParams.getType() == Users::InvalidUsersParams::InvalidUsersTypes::Malicious)
+                op = Replication::Invalidate;
+            state.push_back(Replication::Update(op, ipAddr));
+        });
+        for (auto& port : detection.getCompromisedInPorts())
+            state.push_back(Replication::Update(Replication::PortCompromised, 0, port.first, port.second));
     }
-    return false;
+    state.push_back(Replication::Update(classifier.isDDoS() ? Replication::DDoSDetected : Replication::DDoSFinished));
 }
 
 
-bool ControllerDDoSProtection::SPRTdetection::insertDpid (Dpid dpid, Dmap::iterator& di)
+void ControllerDDoSProtection::replicationReadable()
 {
-    Imap imap;
-    std::pair<Dmap::iterator, bool> ret = d.insert(std::pair<Dpid, Imap>(dpid, imap));
-    di = ret.first;
-    return ret.second;
+    replication.receive();
 }
 
 
-bool ControllerDDoSProtection::SPRTdetection::insertInPort(InPort i, Dmap::iterator di, Imap::iterator& dn)
+void ControllerDDoSProtection::replicationTimeout()
 {
-    Dn d0;
-    std::pair<Imap::iterator, bool> ret = di->second.insert(std::pair<InPort, Dn>(i, d0));
-    dn = ret.first;
-    return ret.second;
+    replication.flush();
+    replication.resume();
 }
 
 void ControllerDDoSProtection::setDDoS (bool value)
 {
-    if (!isDDoS && value)
-    {
-        isDDoS = true;
-        detectNotDDoScounter = 0;
-        LOG(INFO) << "DDoS is detected";
+    if (!classifier.setDDoS(value))
         return;
+    {
+        std::lock_guard<std::mutex> guard(partitionsLock);
+        for (auto& p : partitions)
+            p.second->assignDDoS(classifier.isDDoS());
     }
-    if (isDDoS && !value && ++detectNotDDoScounter >= DETECT_NOT_DDOS_NUMBER)
+    if (classifier.isDDoS())
     {
-        isDDoS = false;
-        LOG(INFO) << "No DDoS is detected";
+        LOG(INFO) << "DDoS is detected";
+        replication.publish(Replication::Update(Replication::DDoSDetected));
+        journal.write(JournalFormat::DDoSDetected);
+        emit DDoSDetected();
+        return;
     }
+    LOG(INFO) << "No DDoS is detected";
+    replication.publish(Replication::Update(Replication::DDoSFinished));
+    journal.write(JournalFormat::DDoSFinished);
 }
@@ -1,21 +1,44 @@
 #pragma once
 
 #include <mutex>
+#include <atomic>
 #include <cmath>
+#include <set>
+#include <vector>
+#include <memory>
+
+#include <QSocketNotifier>
 
 #include "Application.hh"
 #include "Loader.hh"
 #include "Switch.hh"
 #include "HostManager.hh"
+#include "RestListener.hh"
 
 #include "ddos/Users.hh"
 #include "ddos/Params.hh"
+#include "ddos/Metrics.hh"
+#include "ddos/TableOccupancy.hh"
+#include "ddos/Entropy.hh"
+#include "ddos/HeavyHitters.hh"
+#include "ddos/FanIn.hh"
+#include "ddos/WorkerPool.hh"
+#include "ddos/Replication.hh"
+#include "ddos/Journal.hh"
+#include "ddos/SPRTdetection.hh"
+#include "ddos/Classifier.hh"
+#include "ddos/VerdictCache.hh"
+#include "ddos/StatsCheck.hh"
+#include "ddos/FlowRemovedQueue.hh"
+#include "ddos/UserAddress.hh"
+#include "ddos/L2Flood.hh"
 
 // EtherType
 #define IPv4_TYPE 0x0800
 #define IPv6_TYPE 0x86DD
+#define LLDP_TYPE 0x88CC
 
-class ControllerDDoSProtection : public Application {
+class ControllerDDoSProtection : public Application, RestHandler {
 SIMPLE_APPLICATION (ControllerDDoSProtection, "controller-ddos-protection")
 Q_OBJECT
 
@@ -27,14 +50,32 @@ public:
     void init (Loader* loader, const Config& config) override;
     void startUp (Loader* loader) override;
 
+    // rest
+    std::string restName() override { return "controller-ddos-protection"; }
+    bool eventable() override { return false; }
+    std::string displayedName() override { return "Controller DDoS Protection"; }
+    std::string page() override { return "none"; }
+    AppType type() override { return AppType::Service; }
+    json11::Json handleGET (std::vector<std::string> params, std::string body) override;
+
 private:
 
-    Decision processMiss (SwitchConnectionPtr conn, IPAddressV4 ipAddr, Decision decision);
+    class Partition;
+    // partition: of the switch in partition-mode switch, nullptr: the shared users
+    Decision processMiss (SwitchConnectionPtr conn, UserAddress ipAddr, UserAddress dstIPAddr, Decision decision,
+                          Partition* partition);
+
+    // IPv6 users are /64 prefixes: the temporary addresses of a host are one user
+    static bool isIPv6Prefix64;
+    // eth_type and the source of the user: ipv4_src, ipv6_src or its /64 prefix
+    template <class Message>
+    static void addUserMatch (Message& message, const UserAddress& ipAddr);
 
-    static bool isDDoS;
-    static size_t detectNotDDoScounter;
-    static const size_t DETECT_NOT_DDOS_NUMBER = 10;
-    static void setDDoS(bool);
+    // verdicts of packet-ins and the DDoS state
+    static Classifier classifier;
+    void setDDoS(bool);
+
+    std::map<Dpid, SwitchConnectionPtr> switches;
 
     QTimer* detectDDoSTimer;
     static const time_t DETECT_DDOS_TIMER_INTERVAL = 30;
@@ -43,84 +84,303 @@ private:
 
     QTimer* clearInvalidUsersTimer; // Users::CLEAR_INVALID_USERS_TIMER_INTERVAL
 
+    QTimer* aclFlushTimer;
+    static const time_t ACL_FLUSH_TIMER_INTERVAL = 500; // milliseconds
+
+    // flow-removed events are processed in batches
+    QTimer* flowRemovedTimer;
+    static const time_t FLOW_REMOVED_TIMER_INTERVAL = 100; // milliseconds
+    static FlowRemovedQueue flowRemovedQueue;
+    void processFlowRemoved (bool isFull);
+
+    QTimer* tableStatsTimer;
+    static const time_t TABLE_STATS_TIMER_INTERVAL = 10; // seconds
+    static TableOccupancy tableOccupancy;
+
+    // users' checks by flow stats or by aggregate stats
+    static StatsCheck statsCheck;
+
+    QTimer* entropyTimer;
+    static const time_t ENTROPY_TIMER_INTERVAL = 2; // seconds
+    static Entropy entropy;
+
+    // top sources by packet-ins and by packets of removed flows
+    static HeavyHitters packetInHitters;
+    static HeavyHitters packetHitters;
+    static const size_t TOP_SOURCES_NUMBER = 20;
+
+    // destinations under attack
+    static FanIn fanIn;
+
+    // non-IP packet-ins by source MAC and in_port, the ddos-l2-protection stage
+    // ahead of the host manager
+    static bool isL2FloodEnabled;
+    static L2Flood l2Flood;
+    Decision processL2Miss (SwitchConnectionPtr conn, L2Flood::Verdicts verdict, InPort inPort, uint16_t ethType,
+                            Decision decision);
+
     OFTransaction* oftran;
     HostManager* host_manager;
 
     static Users users;
     static Params params;
+    // thresholds of a runtime policy (DDOS_POLICY=runtime) from "policy" and "policy-params"
+    static void configurePolicy (const Config& ddosConfig);
+
+    // sweeps of the columns layout
+    std::unique_ptr<WorkerPool> maintenancePool;
+
+    // users' transitions, SPRT verdicts and DDoS flips of the publisher are applied by subscribers
+    static Replication replication;
+    QSocketNotifier* replicationNotifier;
+    QTimer* replicationTimer; // Replication::FLUSH_INTERVAL
+    static void publishTransition (UserAddress ipAddr, Users::Transitions transition);
+    void applyReplicated (const Replication::Update& update);
+    void getReplicationSnapshot (std::vector<Replication::Update>& state);
+
+    // users' transitions, SPRT verdicts and DDoS flips for the offline analysis
+    static Journal journal;
+    static void journalTransition (UserAddress ipAddr, Users::Transitions transition);
 
     // Detection using SPRT
-    class SPRTdetection {
+    static SPRTdetection detection;
+
+    // Multi-table pipeline: early ACL table with blocking entries only,
+    // table-miss goes to the forwarding table, its table-miss to the controller.
+    // Not enabled until maple installs its flows in forwarding-table-id.
+    class AclTable {
     public:
-        struct Dn {
-            size_t n;
-            double din;
-            size_t ip_count;
-            Dn (size_t n_ = 0, double din_ = 1.0, size_t ip_count_ = 0) : n(n_), din(din_), ip_count(ip_count_) {}
-        };
-        typedef std::map<InPort, Dn> Imap;
-        typedef std::map<Dpid, Imap> Dmap;
+        AclTable (): enabled(false), metering(false), tableId(ACL_TABLE_ID), forwardingTableId(FORWARDING_TABLE_ID),
+                     meterRate(0), l2MeterRate(L2Flood::PORT_RATE) {}
+        void configure (bool enabled_, uint8_t tableId_, uint8_t forwardingTableId_)
+        {
+            enabled = enabled_;
+            tableId = tableId_;
+            forwardingTableId = forwardingTableId_;
+        }
+        // Unknown and DDoS users are forwarded through per-class meters (needs the ACL table)
+        void configureMeters (bool metering_) { metering = metering_ && enabled; }
+        bool isEnabled() const { return enabled; }
+        bool isMetering() const { return metering; }
+        uint8_t getForwardingTableId() const { return forwardingTableId; }
 
-        enum InPortTypes {
-            Uncompromised,
-            Compromised,
-            Unknown
-        };
+        struct SwitchState;
+        // not erased: a partition keeps the state of its switch
+        SwitchState* getSwitchState (Dpid dpid);
+
+        void install (SwitchConnectionPtr conn);
+        void block (SwitchState& state, SwitchConnectionPtr conn, UserAddress ipAddr);
+        // the prefix of the source through the class meter, every source of
+        // the family once MAX_METERED_PREFIXES prefixes are metered
+        void rateLimit (SwitchState& state, SwitchConnectionPtr conn, UserAddress ipAddr, uint32_t meterId);
+        // a valid user of a metered prefix skips the meter
+        void bypass (SwitchState& state, SwitchConnectionPtr conn, UserAddress ipAddr);
+        void remove (Dpid dpid);
+        // non-IP packet-ins of eth_type from the in_port through the L2 meter
+        void rateLimitPort (SwitchConnectionPtr conn, InPort inPort, uint16_t ethType);
+        void flush();
+        of13::FlowMod blockFlowMod (UserAddress ipAddr) const;
 
-        SPRTdetection (): a(countA()), b(countB()) {}
-        bool isDDoS();
-        InPortTypes isCompromisedInPort (Dpid dpid, InPort in_port, uint64_t packet_count, size_t packet_count_max = C_MAX);
-
-        struct SPRTconfig {
-            const double alpha;
-            const double beta;
-            double lambda0;
-            double lambda1;
-            SPRTconfig (double alpha_ = ALPHA, double beta_ = BETA,
-                        double lambda0_ = LAMBDA_0, double lambda1_ = LAMBDA_1) :
-                alpha(alpha_), beta(beta_), lambda0(lambda0_), lambda1(lambda1_) {}
-            static constexpr double ALPHA = 0.01;
-            static constexpr double BETA = 0.02;
-            static constexpr double LAMBDA_0 = 0.33;
-            static constexpr double LAMBDA_1 = 0.5;
+        bool sizeMeters (size_t validPacketNumber);
+        void sizeL2Meter (uint32_t l2MeterRate_) { l2MeterRate = l2MeterRate_; }
+        void installMeters (SwitchConnectionPtr conn, uint16_t command);
+
+        enum MeterIds {
+            UNKNOWN_METER_ID = 1,
+            DDOS_METER_ID = 2,
+            L2_METER_ID = 3
         };
 
+        static const uint8_t ACL_TABLE_ID = 0;
+        static const uint8_t FORWARDING_TABLE_ID = 1;
+        static const uint16_t BLOCK_PRIORITY = 100;
+        static const uint16_t BLOCK_HARD_TIMEOUT = 60;  // seconds
+        static const uint16_t RATE_LIMIT_PRIORITY = 50;
+        static const uint16_t RATE_LIMIT_IDLE_TIMEOUT = 10;     // seconds
+        static const uint16_t RATE_LIMIT_HARD_TIMEOUT = 300;    // seconds
+        static const uint32_t METER_FLOWS_RATE = 100;   // valid flows per second for a class
+        static const uint16_t METERED_HARD_TIMEOUT = 60;    // seconds, of prefixes, classes and bypasses
+        static const size_t MAX_METERED_PREFIXES = 4096;    // of a switch
+        static const uint32_t METERED_IPV4_MASK = 0xffffff00;   // /24
+        static const uint64_t METERED_IPV6_MASK = 0xffffffffffff0000ULL; // /48 of the high word
 
     private:
-        SPRTconfig config;
-        const double a;
-        const double b;
+        struct Pending {
+            SwitchConnectionPtr conn;
+            std::set<UserAddress> blocked;
+            std::map<UserAddress, uint32_t> rateLimited; // prefixes
+            std::set<UserAddress> bypassed;
+            std::set<uint16_t> meteredClasses; // eth_type
+            std::set<std::pair<InPort, uint16_t>> rateLimitedPorts; // in_port, eth_type
+        };
+        // installed entries of a switch by their expiry, the packet-in path
+        // skips these, flush() purges them
+        struct Metered {
+            std::map<UserAddress, time_t> prefixes;
+            std::map<UserAddress, time_t> bypassed;
+            time_t ipv4Until;
+            time_t ipv6Until;
+            Metered(): ipv4Until(0), ipv6Until(0) {}
+            time_t& classUntil (const UserAddress& ipAddr) { return ipAddr.isV4() ? ipv4Until : ipv6Until; }
+            bool isMetered (const UserAddress& prefix, time_t now);
+        };
+    public:
+        // of a switch, its lock is taken by the packet-ins of the switch and by flush()
+        struct SwitchState {
+            std::mutex lock;
+            Pending pending;
+            Metered metered;
+        };
+    private:
+        static UserAddress getMeteredPrefix (const UserAddress& ipAddr);
+        static void addPrefixMatch (of13::FlowMod& fm, const UserAddress& prefix);
+        static bool isActive (const std::map<UserAddress, time_t>& entries, const UserAddress& key, time_t now)
+        {
+            auto it = entries.find(key);
+            return it != entries.end() && now < it->second;
+        }
+        bool enabled;
+        bool metering;
+        uint8_t tableId;
+        uint8_t forwardingTableId;
+        uint32_t meterRate; // packets per second
+        uint32_t l2MeterRate; // packet-ins per second of an in_port
+        std::mutex switchesLock;
+        std::map<Dpid, std::unique_ptr<SwitchState>> switches;
+    } static aclTable;
 
-        Dmap d;
+    // Switch partitioning: users, params and SPRT of a switch are owned by
+    // the thread serving its packet-ins, the main thread posts events to the
+    // partition and merges the published summaries
+    enum PartitionModes {
+        Shared,
+        Switch
+    };
+    class Partition {
+    public:
+        Partition (Dpid dpid_, Users::Layouts layout, size_t maxInvalidUsers, size_t victimSourcesNumber);
 
-        void countDin(Imap::iterator& dn, size_t c, size_t cMax = C_MAX)
-        {
+        // flow-removed (SPRT sample and user), flow stats or aggregate stats (user)
+        struct PacketNumbers {
+            UserAddress ipAddr; // 0 (::): no user
+            InPort inPort;
+            bool hasInPort;
+            std::vector<uint64_t> packetNumbers;
+            // aggregate stats or a flow-removed batch: counts instead of packetNumbers,
+            // SPRT samples of the in_port (<= validPacketNumber) or flows of the user (<)
+            size_t flows;
+            size_t lowPacketFlows;
+            // pending connections of a cached verdict of the user instead of a check
+            size_t connections;
+        };
+
+        enum UserStates : uint8_t {
+            Valid,
+            Unchecked,
+            Checked,
+            Blocked
+        };
+        struct UserState {
+            UserAddress ipAddr;
+            UserStates state;
+        };
+        struct Summary {
+            size_t avgConnNumberSum;
+            size_t validUsersNumber;
+            size_t invalidUsersNumber;
+            bool isDDoS;
+            bool isCompromised;
+            std::vector<UserState> users;
+            Summary(): avgConnNumberSum(0), validUsersNumber(0), invalidUsersNumber(0),
+                       isDDoS(false), isCompromised(false) {}
+        };
 
-            ++(dn->second.n);
-            dn->second.din += (c <= cMax) ? log( config.lambda1 / config.lambda0 ) :
-                                     log( (1 - config.lambda1) / (1 - config.lambda0) );
+        // main thread
+        void post (PacketNumbers event);
+        void requestMerge (const Params& merged_, bool isEntropyAnomalous_);
+        void assignDDoS (bool isDDoS_);
+        Summary getSummary();
+        void setOccupancyLevel (TableOccupancy::Levels level) { occupancyLevel.store(level, std::memory_order_relaxed); }
+        TableOccupancy::Levels getOccupancyLevel() const
+        {
+            return (TableOccupancy::Levels) occupancyLevel.load(std::memory_order_relaxed);
         }
-        double countA() { return log ((1 - config.beta) / config.alpha); }
-        double countB() { return log (config.beta / (1 - config.alpha)); }
-        InPortTypes checkDin (Imap::iterator& dn);
 
-        bool getDi (Dpid dpid, InPort i, Imap::iterator& dn);
-        bool searchDpid (Dpid dpid, Dmap::iterator& di);
-        bool searchInPort (InPort i, Dmap::iterator di, Imap::iterator& dn);
-        bool insertDpid (Dpid dpid, Dmap::iterator& di);
-        bool insertInPort(InPort i, Dmap::iterator di, Imap::iterator& dn);
+        // owner thread, no lock while nothing is posted
+        void serve() { if (hasWork.load(std::memory_order_acquire)) drain(); }
+
+        Users users;
+        Params params;
+        SPRTdetection detection;
+        // users changed by posted connections, notified by the owner's next packet-in
+        std::vector<UserAddress> typeChanged;
+        // packet-in state of the switch instead of the global one, merged by partitionMergeTimeout
+        FanIn fanIn;
+        HeavyHitters packetInHitters;
+        Classifier classifier;
+        AclTable::SwitchState* acl;
+
+    private:
+        void drain();
+        void publish (bool isEntropyAnomalous_);
+
+        Dpid dpid;
+        bool isCompromised; // since the last summary
+        std::atomic<bool> hasWork;
+        std::atomic<int> occupancyLevel; // of the last table stats
+        std::mutex lock; // inbox, merge request, DDoS state and summary
+        std::vector<PacketNumbers> inbox;
+        bool isMergeRequested;
+        Params merged;
+        bool isEntropyAnomalous;
+        bool isDDoSAssigned;
+        bool isDDoS;
+        Summary summary;
+    };
 
-        static const size_t C_MAX = 3;
+    // global view of the partitions, main thread
+    struct MergedView {
+        size_t partitionsNumber;
+        size_t validUsersNumber;
+        size_t invalidUsersNumber;
+        size_t sharedUsersNumber; // seen on several switches
+        std::vector<UserAddress> blocked;
+        std::vector<UserAddress> unchecked;
+        std::vector<FanIn::Victim> victims; // the largest estimate of the switches
+        std::vector<HeavyHitters::Counter> packetInSources; // counts of the switches added
+        uint64_t packetInsTotal;
+        MergedView(): partitionsNumber(0), validUsersNumber(0), invalidUsersNumber(0), sharedUsersNumber(0),
+                      packetInsTotal(0) {}
+    };
 
-    } static detection;
+    PartitionModes partitionMode;
+    std::mutex partitionsLock;
+    std::map<Dpid, std::unique_ptr<Partition>> partitions; // not erased: handlers keep the pointers
+    Partition* getPartition (Dpid dpid);
+    MergedView mergedView;
+    QTimer* partitionMergeTimer;
+    static const time_t PARTITION_MERGE_TIMER_INTERVAL = 5; // seconds
 
 signals:
-    void UsersTypeChanged (SwitchConnectionPtr conn, IPAddressV4 ipAddr);
+    void UsersTypeChanged (SwitchConnectionPtr conn, UserAddress ipAddr);
+    void DDoSDetected();
 private slots:
     void detectDDoSTimeout();
     void updateValidAvgConnTimeout();
     void clearInvalidUsersTimeout();
-    void getUsersStatistics (SwitchConnectionPtr conn, IPAddressV4 ipAddr);
+    void getUsersStatistics (SwitchConnectionPtr conn, UserAddress ipAddr);
     void usersStatisticsArrived (SwitchConnectionPtr conn, std::shared_ptr<OFMsgUnion> reply);
     void flowRemoved (SwitchConnectionPtr conn, of13::FlowRemoved fr);
+    void switchUp (SwitchConnectionPtr conn, of13::FeaturesReply fr);
+    void switchDown (SwitchConnectionPtr conn);
+    void aclFlushTimeout();
+    void flowRemovedTimeout();
+    void mitigate();
+    void tableStatsTimeout();
+    void entropyTimeout();
+    void partitionMergeTimeout();
+    void replicationReadable();
+    void replicationTimeout();
+    void tableStatsArrived (SwitchConnectionPtr conn, std::shared_ptr<OFMsgUnion> reply);
+    void aggregateStatsArrived (SwitchConnectionPtr conn, std::shared_ptr<OFMsgUnion> reply);
 };
@@ -0,0 +1,298 @@
+#include "Classifier.hh"
+
+#include <glog/logging.h>
+
+Classifier::Verdict Classifier::processMiss (Users& users, const Params& params, IPAddress ipAddr, IPAddress dstIPAddr)
+{
+    bool isVictimShort = false;
+    if (!VerdictCache::isEnabled())
+    {
+        // flows toward an attacked destination get short timeouts
+        bool isVictim = fanIn.update(ipAddr, dstIPAddr);
+        Users::UsersTypes type;
+        Verdict ret = classify(users, params, ipAddr, type, isVictimShort);
+        if (isVictimShort && isVictim)
+            ret.verdict = ForwardShort;
+        return ret;
+    }
+
+    time_t now = Clock::now();
+    Verdict ret;
+    VerdictCache::Cache& cache = VerdictCache::local();
+    std::lock_guard<std::mutex> guard(cache.lock);
+    cache.sweep(now, [&](VerdictCache::Entry& entry) { flush(cache, entry, ret); });
+
+    VerdictCache::Entry& entry = cache.slot(ipAddr);
+    if (cache.isHit(entry, users, ipAddr, now))
+    {
+        cache.hit();
+        // the sketch of the same destination has the source already
+        bool isVictim = entry.isVictim;
+        if (entry.dstIPAddr != dstIPAddr)
+        {
+            isVictim = fanIn.update(ipAddr, dstIPAddr);
+            entry.dstIPAddr = dstIPAddr;
+            entry.isVictim = isVictim;
+        }
+        ret.verdict = entry.isVictimShort && isVictim ? ForwardShort : (Verdicts) entry.verdict;
+        if (++entry.pendingConns >= VerdictCache::FLUSH_CONNS_NUMBER)
+            flush(cache, entry, ret);
+        return ret;
+    }
+    cache.miss();
+    flush(cache, entry, ret); // of the replaced or stale entry
+
+    // transitions while classifying make the entry stale
+    uint64_t epoch = VerdictCache::getEpoch();
+    uint64_t stripeEpoch = VerdictCache::getStripeEpoch(ipAddr);
+    bool isVictim = fanIn.update(ipAddr, dstIPAddr);
+    Users::UsersTypes type;
+    Verdict classified = classify(users, params, ipAddr, type, isVictimShort);
+    ret.verdict = isVictimShort && isVictim ? ForwardShort : classified.verdict;
+    ret.isTypeChanged = classified.isTypeChanged;
+    if (ret.isTypeChanged)
+        VerdictCache::invalidate(ipAddr);
+
+    // Unknown users are inserted by the first miss, their next verdict is of a DDoS user
+    if (!ret.isTypeChanged && type != Users::UsersTypes::Unknown)
+    {
+        entry.ipAddr = ipAddr;
+        entry.dstIPAddr = dstIPAddr;
+        entry.users = &users;
+        entry.params = &params;
+        entry.epoch = epoch;
+        entry.stripeEpoch = stripeEpoch;
+        entry.time = now;
+        entry.verdict = classified.verdict;
+        entry.isVictimShort = isVictimShort;
+        entry.isVictim = isVictim;
+        entry.pendingConns = 0;
+    }
+    else
+        entry.ipAddr = 0;
+    return ret;
+}
+
+
+void Classifier::flush (VerdictCache::Cache& cache, VerdictCache::Entry& entry, Verdict& ret)
+{
+    if (entry.pendingConns == 0)
+        return;
+    cache.flushed(entry.pendingConns);
+    if (countConnections(*entry.users, *entry.params, entry.ipAddr, entry.pendingConns))
+    {
+        ret.flushedTypeChanged.push_back(entry.ipAddr);
+        entry.ipAddr = 0;
+    }
+    entry.pendingConns = 0;
+}
+
+
+bool Classifier::countConnections (Users& users, const Params& params, IPAddress ipAddr, size_t number)
+{
+    std::map<IPAddress, Users::ValidUsersParams>::iterator validUser;
+    std::map<IPAddress, Users::InvalidUsersParams>::iterator invalidUser;
+    bool isTypeChanged = false;
+    switch (users.get(ipAddr, validUser, invalidUser))
+    {
+    case Users::UsersTypes::Valid:
+        for (size_t i = 0; i < number; ++i)
+        {
+            try
+            {
+                validUser->second.increaseConnCounter(users, params);
+            }
+            catch (Users::UsersExceptionTypes)
+            {
+                isTypeChanged = true;
+            }
+        }
+        break;
+    case Users::UsersTypes::Invalid:
+    {
+        bool isReset = invalidUser->second.isObsolete();
+        for (size_t i = 0; i < number; ++i)
+        {
+            try
+            {
+                invalidUser->second.increaseConnCounter(users, params);
+            }
+            catch (Users::UsersExceptionTypes)
+            {
+                isTypeChanged = true;
+            }
+        }
+        if (isReset)
+            users.notifyTransition(ipAddr, Users::Transitions::Reset);
+        break;
+    }
+    case Users::UsersTypes::Unknown:
+        break; // removed since the verdict was cached
+    }
+    return isTypeChanged;
+}
+
+
+Classifier::Verdict Classifier::classify (Users& users, const Params& params, IPAddress ipAddr,
+                                          Users::UsersTypes& type, bool& isVictimShort)
+{
+    std::map<IPAddress, Users::ValidUsersParams>::iterator validUser;
+    std::map<IPAddress, Users::InvalidUsersParams>::iterator invalidUser;
+    type = users.get(ipAddr, validUser, invalidUser);
+
+    Verdict ret;
+    switch (type)
+    {
+    case Users::UsersTypes::Valid:
+    {
+        LOG(INFO) << "Users::UsersTypes::Valid";
+        Users::ValidUsersParams& userParams = validUser->second;
+        try
+        {
+            userParams.increaseConnCounter(users, params);
+        }
+        catch (Users::UsersExceptionTypes)
+        {
+            LOG(INFO) << "Valid --> Valid or Malicious";
+            ret.isTypeChanged = true;
+        }
+        ret.verdict = Forward;
+        break;
+    }
+    case Users::UsersTypes::Invalid:
+    {
+        LOG(INFO) << "Users::UsersTypes::Invalid";
+        Users::InvalidUsersParams& userParams = invalidUser->second;
+        bool isReset = userParams.isObsolete();
+        try
+        {
+            userParams.increaseConnCounter(users, params);
+        }
+        catch (Users::UsersExceptionTypes)
+        {
+            LOG(INFO) << "Malicious --> Valid or Malicious";
+            ret.isTypeChanged = true;
+        }
+        if (isReset)
+            users.notifyTransition(ipAddr, Users::Transitions::Reset);
+
+        Users::InvalidUsersParams::InvalidUsersTypes invalidType = userParams.getType();
+        bool invalidTypeIsChecked = userParams.typeIsChecked();
+        if (invalidType == Users::InvalidUsersParams::InvalidUsersTypes::Malicious && invalidTypeIsChecked)
+        {
+            ret.verdict = Block;
+            break;
+        }
+        if (ddos && !invalidTypeIsChecked && packetInHitters.isHeavyHitter(ipAddr, HEAVY_HITTER_SHARE))
+        {
+            // top unchecked sources are limited during DDoS, their flows decide a block
+            LOG(INFO) << "Heavy hitter: " << ipAddr.toString();
+            ret.verdict = LimitHeavyHitter;
+            break;
+        }
+        if (ddos && invalidType == Users::InvalidUsersParams::InvalidUsersTypes::DDoS && !invalidTypeIsChecked)
+            ret.verdict = LimitDDoS;
+        else
+        {
+            ret.verdict = ddos ? ForwardShort : Forward;
+            isVictimShort = true;
+        }
+        break;
+    }
+    case Users::UsersTypes::Unknown:
+        LOG(INFO) << "Users::UsersTypes::Unknown";
+        users.insert(ipAddr);
+        if (ddos)
+            ret.verdict = LimitUnknown;
+        else
+        {
+            ret.verdict = Forward;
+            isVictimShort = true;
+        }
+        break;
+    }
+    return ret;
+}
+
+
+void Classifier::checkUser (Users& users, const Params& params, IPAddress ipAddr,
+                            const std::vector<uint64_t>& packetNumbers)
+{
+    size_t invalidFlows = 0;
+    for (uint64_t packetNumber : packetNumbers)
+        invalidFlows += params.isInvalidPacketNumber(packetNumber);
+    checkUser(users, params, ipAddr, packetNumbers.size(), invalidFlows);
+}
+
+
+void Classifier::checkUser (Users& users, const Params& params, IPAddress ipAddr, size_t flows, size_t invalidFlows)
+{
+    std::map<IPAddress, Users::ValidUsersParams>::iterator validUser;
+    std::map<IPAddress, Users::InvalidUsersParams>::iterator invalidUser;
+    Users::UsersTypes userType = users.get(ipAddr, validUser, invalidUser);
+
+    switch (userType)
+    {
+    case Users::UsersTypes::Invalid:
+        try
+        {
+            Users::InvalidUsersParams& userParams = invalidUser->second;
+            bool isBlocked = userParams.isBlocked();
+            Users::InvalidUsersParams::InvalidUsersTypes invalidType = userParams.getType();
+            bool isChecked = userParams.typeIsChecked();
+            userParams.updateFlowsNumber(flows, invalidFlows);
+            userParams.updateIsChecked(users, params);
+            if (!isBlocked && userParams.isBlocked())
+                users.notifyTransition(ipAddr, Users::Transitions::Block);
+            else if (invalidType != userParams.getType() || isChecked != userParams.typeIsChecked())
+                VerdictCache::invalidate(ipAddr); // the verdict is changed without a transition
+        }
+        catch (Users::UsersExceptionTypes)
+        {
+            users.validate(invalidUser);
+        }
+        break;
+    case Users::UsersTypes::Valid:
+        try
+        {
+            Users::ValidUsersParams& userParams = validUser->second;
+            userParams.updateFlowsNumber(flows, invalidFlows);
+            userParams.updateIsChecked(users, params);
+        }
+        catch (Users::UsersExceptionTypes)
+        {
+            users.invalidate(validUser);
+        }
+        break;
+    case Users::UsersTypes::Unknown:
+        throw Users::UsersExceptionTypes::IsUnknown;
+    }
+}
+
+
+bool Classifier::setDDoS (bool value)
+{
+    if (!ddos && value)
+    {
+        ddos = true;
+        notDDoSCounter = 0;
+        VerdictCache::invalidate();
+        return true;
+    }
+    if (ddos && !value && ++notDDoSCounter >= DETECT_NOT_DDOS_NUMBER)
+    {
+        ddos = false;
+        VerdictCache::invalidate();
+        return true;
+    }
+    return false;
+}
+
+
+const char* Classifier::verdictName (Verdicts verdict)
+{
+    static const char* names[] = {
+        "forward", "forward_short", "limit_unknown", "limit_ddos", "block", "limit_heavy_hitter"
+    };
+    return verdict < VERDICTS_NUMBER ? names[verdict] : "unknown";
+}
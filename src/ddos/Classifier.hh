@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Users.hh"
+#include "Params.hh"
+#include "FanIn.hh"
+#include "HeavyHitters.hh"
+#include "VerdictCache.hh"
+
+// Classification of packet-ins and users' packet numbers without RUNOS:
+// the app turns the verdicts into decisions and flow-mods, ddos-replay
+// drives it with the flows of a capture
+class Classifier {
+public:
+    typedef UserAddress IPAddress;
+
+    enum Verdicts {
+        Forward,            // normal timeouts
+        ForwardShort,       // short timeouts: DDoS or an attacked destination
+        LimitUnknown,       // short timeouts and the meter of Unknown users during DDoS
+        LimitDDoS,          // short timeouts and the meter of unchecked DDoS users during DDoS
+        Block,              // checked Malicious
+        LimitHeavyHitter,   // unchecked top source during DDoS: short timeouts and the DDoS meter
+        VERDICTS_NUMBER
+    };
+    struct Verdict {
+        Verdicts verdict;
+        bool isTypeChanged; // flows of the user are to be checked
+        std::vector<IPAddress> flushedTypeChanged; // users changed by the connections of their cached verdicts
+        Verdict (Verdicts verdict_ = Forward): verdict(verdict_), isTypeChanged(false) {}
+    };
+
+    Classifier (FanIn& fanIn_, HeavyHitters& packetInHitters_)
+        : fanIn(fanIn_), packetInHitters(packetInHitters_), ddos(false), notDDoSCounter(0) {}
+
+    // packet-in of a new flow, repeat sources are served by VerdictCache if enabled
+    Verdict processMiss (Users& users, const Params& params, IPAddress ipAddr, IPAddress dstIPAddr);
+    // packet numbers of the user's flows, Block is notified by checking
+    static void checkUser (Users& users, const Params& params, IPAddress ipAddr, const std::vector<uint64_t>& packetNumbers);
+    // flows of the user and how many of them have less than validPacketNumber packets
+    static void checkUser (Users& users, const Params& params, IPAddress ipAddr, size_t flows, size_t invalidFlows);
+    // connections of a cached verdict, true when the type of the user is changed
+    static bool countConnections (Users& users, const Params& params, IPAddress ipAddr, size_t number);
+
+    // DETECT_NOT_DDOS_NUMBER negative checks finish DDoS, true when the state is changed
+    bool setDDoS (bool value);
+    // state of a peer
+    void assignDDoS (bool value)
+    {
+        if (ddos != value)
+            VerdictCache::invalidate();
+        ddos = value;
+        notDDoSCounter = 0;
+    }
+    bool isDDoS() const { return ddos; }
+
+    static const char* verdictName (Verdicts verdict);
+
+    static const size_t DETECT_NOT_DDOS_NUMBER = 10;
+    static constexpr double HEAVY_HITTER_SHARE = 0.05;  // of all packet-ins
+
+private:
+    // verdict of the user, isVictimShort: ForwardShort toward an attacked destination instead of Forward
+    Verdict classify (Users& users, const Params& params, IPAddress ipAddr, Users::UsersTypes& type, bool& isVictimShort);
+    // pending connections of a cached verdict
+    static void flush (VerdictCache::Cache& cache, VerdictCache::Entry& entry, Verdict& ret);
+
+    FanIn& fanIn;
+    HeavyHitters& packetInHitters;
+    bool ddos;
+    size_t notDDoSCounter;
+};
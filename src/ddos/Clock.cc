@@ -0,0 +1,3 @@
+#include "Clock.hh"
+
+std::atomic<time_t> Clock::virtualTime(0);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <atomic>
+#include <ctime>
+
+// Time of the users' and detectors' windows: the wall clock, or the
+// virtual time set by an offline driver (ddos-replay)
+class Clock {
+public:
+    static time_t now()
+    {
+        time_t t = virtualTime.load(std::memory_order_relaxed);
+        return t != 0 ? t : time(NULL);
+    }
+    // 0 returns to the wall clock
+    static void setVirtualTime (time_t t) { virtualTime.store(t, std::memory_order_relaxed); }
+    static bool isVirtual() { return virtualTime.load(std::memory_order_relaxed) != 0; }
+
+private:
+    static std::atomic<time_t> virtualTime;
+};
@@ -0,0 +1,108 @@
+#include "Entropy.hh"
+#include "Clock.hh"
+
+#include <cmath>
+
+#include <glog/logging.h>
+
+Entropy::Bucket::Bucket()
+{
+    clear();
+    epoch.store(0);
+}
+
+void Entropy::Bucket::clear()
+{
+    for (size_t i = 0; i < SKETCH_SIZE; ++i)
+    {
+        src[i].store(0, std::memory_order_relaxed);
+        dst[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+Entropy::Bucket& Entropy::current (time_t epoch)
+{
+    Bucket& bucket = buckets[epoch % WINDOW_BUCKETS];
+    time_t bucketEpoch = bucket.epoch.load(std::memory_order_acquire);
+    // the first thread in a new interval clears the bucket
+    if (bucketEpoch != epoch && bucket.epoch.compare_exchange_strong(bucketEpoch, epoch))
+    {
+        bucket.clear();
+    }
+    return bucket;
+}
+
+void Entropy::update (IPAddress src, IPAddress dst)
+{
+    Bucket& bucket = current(Clock::now() / BUCKET_INTERVAL);
+    bucket.src[hash(src)].fetch_add(1, std::memory_order_relaxed);
+    bucket.dst[hash(dst)].fetch_add(1, std::memory_order_relaxed);
+}
+
+Entropy::Values Entropy::get()
+{
+    uint32_t src[SKETCH_SIZE] = {};
+    uint32_t dst[SKETCH_SIZE] = {};
+    size_t total = 0;
+    time_t epoch = Clock::now() / BUCKET_INTERVAL;
+    for (Bucket& bucket : buckets)
+    {
+        time_t bucketEpoch = bucket.epoch.load(std::memory_order_acquire);
+        if (epoch - bucketEpoch >= (time_t) WINDOW_BUCKETS)
+            continue; // out of the window
+        for (size_t i = 0; i < SKETCH_SIZE; ++i)
+        {
+            src[i] += bucket.src[i].load(std::memory_order_relaxed);
+            dst[i] += bucket.dst[i].load(std::memory_order_relaxed);
+        }
+    }
+    for (size_t i = 0; i < SKETCH_SIZE; ++i)
+        total += src[i];
+    return Values(count(src, total), count(dst, total), total);
+}
+
+double Entropy::count (const uint32_t* counters, size_t total)
+{
+    // H / log(min(total, SKETCH_SIZE))
+    if (total < 2)
+        return 0.;
+    double h = 0.;
+    for (size_t i = 0; i < SKETCH_SIZE; ++i)
+    {
+        if (counters[i] == 0)
+            continue;
+        double p = counters[i] / (double) total;
+        h -= p * std::log(p);
+    }
+    double hMax = std::log((double) (total < SKETCH_SIZE ? total : SKETCH_SIZE));
+    return h / hMax;
+}
+
+bool Entropy::evaluate()
+{
+    Values values = get();
+    if (values.packetIns < MIN_PACKET_INS)
+    {
+        anomalous = false;
+        return anomalous;
+    }
+    if (!baselineIsSet)
+    {
+        baseline = values;
+        baselineIsSet = true;
+    }
+
+    // spoofed sources: src entropy grows, dst entropy does not drop as for a flash crowd
+    anomalous = values.src - baseline.src >= SRC_DEVIATION
+            && baseline.dst - values.dst < DST_DEVIATION;
+    if (anomalous)
+    {
+        LOG(INFO) << "Entropy: src " << values.src << " (baseline " << baseline.src << "), dst "
+                  << values.dst << " (baseline " << baseline.dst << "), packet-ins " << values.packetIns;
+    } else {
+        baseline.src += BASELINE_WEIGHT * (values.src - baseline.src);
+        baseline.dst += BASELINE_WEIGHT * (values.dst - baseline.dst);
+        baseline.packetIns = values.packetIns;
+    }
+    return anomalous;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include "UserAddress.hh"
+
+// Entropy of packet-in source and destination addresses over a
+// sliding window of time buckets, each bucket is a fixed hashed histogram
+class Entropy {
+    typedef UserAddress IPAddress;
+
+public:
+    static const size_t SKETCH_SIZE = 1024;     // counters per address, power of 2
+    static const size_t WINDOW_BUCKETS = 10;
+    static const time_t BUCKET_INTERVAL = 1;    // seconds
+
+    struct Values {
+        double src;         // normalized to [0, 1]
+        double dst;
+        size_t packetIns;
+        Values (double src_ = 0., double dst_ = 0., size_t packetIns_ = 0) : src(src_), dst(dst_), packetIns(packetIns_) {}
+    };
+
+    Entropy(): baseline(), anomalous(false), baselineIsSet(false) {}
+
+    void update (IPAddress src, IPAddress dst);
+    Values get();
+    bool evaluate();
+    bool isAnomalous() { return anomalous; }
+    Values getBaseline() { return baseline; }
+
+    static const size_t MIN_PACKET_INS = 100;           // per window
+    static constexpr double SRC_DEVIATION = 0.2;        // growth of src entropy
+    static constexpr double DST_DEVIATION = 0.2;        // drop of dst entropy: flash crowd
+    static constexpr double BASELINE_WEIGHT = 0.1;      // EWMA
+
+private:
+    struct Bucket {
+        std::atomic<uint32_t> src[SKETCH_SIZE];
+        std::atomic<uint32_t> dst[SKETCH_SIZE];
+        std::atomic<time_t> epoch;
+        Bucket();
+        void clear();
+    };
+
+    static size_t hash (IPAddress ipAddr)
+    {
+        return (uint32_t) (ipAddr.fold() * 2654435761u) >> 22; // 32 - log2(SKETCH_SIZE)
+    }
+    static double count (const uint32_t* counters, size_t total);
+    Bucket& current (time_t epoch);
+
+    Bucket buckets[WINDOW_BUCKETS];
+    Values baseline;
+    bool anomalous;
+    bool baselineIsSet;
+};
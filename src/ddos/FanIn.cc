@@ -0,0 +1,119 @@
+#include "FanIn.hh"
+#include "Clock.hh"
+
+#include <cmath>
+#include <cstring>
+
+#include <glog/logging.h>
+
+FanIn::FanIn (size_t alarmSourcesNumber_)
+    : alarmSourcesNumber(alarmSourcesNumber_), skipped(0)
+{
+    destinations.reserve(MAX_DESTINATIONS);
+    clockHand = destinations.end();
+}
+
+bool FanIn::update (IPAddress src, IPAddress dst)
+{
+    time_t now = Clock::now();
+    std::lock_guard<std::mutex> lock(destinationsLock);
+    auto it = destinations.find(dst);
+    if (it == destinations.end())
+    {
+        // a scan of destinations costs O(1) per packet-in
+        if (destinations.size() >= MAX_DESTINATIONS && !evictStale(now))
+        {
+            ++skipped;
+            return false;
+        }
+        it = destinations.insert(std::make_pair(dst, Sketch())).first;
+        it->second.windowStart = now;
+    }
+
+    Sketch& sketch = it->second;
+    if (now - sketch.windowStart >= WINDOW)
+    {
+        // the alarm lasts while the previous window is over the threshold
+        sketch.isAttacked = sketch.estimate() >= alarmSourcesNumber;
+        sketch.restart(now);
+    }
+    // the estimate is changed only with a register
+    if (sketch.add(hash(src)) && !sketch.isAttacked && sketch.estimate() >= alarmSourcesNumber)
+    {
+        sketch.isAttacked = true;
+        LOG(WARNING) << "Destination " << dst.toString() << " is attacked: "
+                     << sketch.estimate() << " sources in " << WINDOW << " s";
+    }
+    return sketch.isAttacked;
+}
+
+std::vector<FanIn::Victim> FanIn::getVictims()
+{
+    std::vector<Victim> ret;
+    std::lock_guard<std::mutex> lock(destinationsLock);
+    for (auto& it : destinations)
+    {
+        double sourcesNumber = it.second.estimate();
+        if (it.second.isAttacked || sourcesNumber >= alarmSourcesNumber / 2.)
+        {
+            Victim victim;
+            victim.ipAddr = it.first;
+            victim.sourcesNumber = sourcesNumber;
+            victim.isAttacked = it.second.isAttacked;
+            ret.push_back(victim);
+        }
+    }
+    return ret;
+}
+
+bool FanIn::evictStale (time_t now)
+{
+    for (size_t i = 0; i < EVICTION_STEPS; ++i)
+    {
+        if (clockHand == destinations.end())
+            clockHand = destinations.begin();
+        if (!clockHand->second.isAttacked && now - clockHand->second.windowStart >= WINDOW)
+        {
+            clockHand = destinations.erase(clockHand);
+            return true;
+        }
+        ++clockHand;
+    }
+    return false;
+}
+
+
+// FanIn::Sketch
+bool FanIn::Sketch::add (uint64_t hash)
+{
+    size_t i = hash >> (64 - REGISTERS_BITS);
+    uint64_t rest = (hash << REGISTERS_BITS) | (1ULL << (REGISTERS_BITS - 1)); // rank <= 64 - REGISTERS_BITS + 1
+    uint8_t rank = __builtin_clzll(rest) + 1;
+    if (rank <= registers[i])
+        return false;
+    registers[i] = rank;
+    return true;
+}
+
+double FanIn::Sketch::estimate() const
+{
+    const double m = REGISTERS_NUMBER;
+    const double alpha = 0.7213 / (1. + 1.079 / m);
+    double sum = 0.;
+    size_t zeros = 0;
+    for (size_t i = 0; i < REGISTERS_NUMBER; ++i)
+    {
+        sum += std::ldexp(1., -registers[i]);
+        zeros += registers[i] == 0;
+    }
+    double e = alpha * m * m / sum;
+    if (e <= 2.5 * m && zeros != 0)
+        e = m * std::log(m / zeros); // linear counting
+    return e;
+}
+
+void FanIn::Sketch::restart (time_t now)
+{
+    std::memset(registers, 0, sizeof(registers));
+    windowStart = now;
+}
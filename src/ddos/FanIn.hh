@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "UserAddress.hh"
+
+// Distinct sources per destination with HyperLogLog sketches,
+// destinations with a large fan-in are considered attacked
+class FanIn {
+    typedef UserAddress IPAddress;
+
+public:
+    struct Victim {
+        IPAddress ipAddr;
+        double sourcesNumber; // estimate
+        bool isAttacked;
+    };
+
+    FanIn (size_t alarmSourcesNumber_ = ALARM_SOURCES_NUMBER);
+    void setAlarmSourcesNumber (size_t alarmSourcesNumber_) { alarmSourcesNumber = alarmSourcesNumber_; }
+    size_t getAlarmSourcesNumber() const { return alarmSourcesNumber; }
+
+    bool update (IPAddress src, IPAddress dst); // true if dst is attacked
+    std::vector<Victim> getVictims();
+    size_t getSkipped() { return skipped; }
+
+    static const size_t REGISTERS_BITS = 8;
+    static const size_t REGISTERS_NUMBER = 1 << REGISTERS_BITS;  // ~6.5% error
+    static const size_t MAX_DESTINATIONS = 4096;
+    static const size_t EVICTION_STEPS = 8; // destinations looked at by a new one of a full table
+    static const time_t WINDOW = 60;    // seconds
+    static const size_t ALARM_SOURCES_NUMBER = 500;
+
+private:
+    struct Sketch {
+        uint8_t registers[REGISTERS_NUMBER];
+        time_t windowStart;
+        bool isAttacked;
+        Sketch(): registers(), windowStart(0), isAttacked(false) { }
+        bool add (uint64_t hash);
+        double estimate() const;
+        void restart (time_t now);
+    };
+
+    static uint64_t hash (IPAddress ipAddr)
+    {
+        // splitmix64 finalizer
+        uint64_t x = ipAddr.fold() + 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+    // a stale destination of the next EVICTION_STEPS after the hand (CLOCK)
+    bool evictStale (time_t now);
+
+    size_t alarmSourcesNumber;
+    size_t skipped; // packet-ins to untracked destinations
+    std::mutex destinationsLock;
+    // reserved for MAX_DESTINATIONS: no rehash, the hand stays valid
+    std::unordered_map<IPAddress, Sketch> destinations;
+    std::unordered_map<IPAddress, Sketch>::iterator clockHand;
+};
@@ -0,0 +1,23 @@
+#include "FlowRemovedQueue.hh"
+
+bool FlowRemovedQueue::push (const Event& event)
+{
+    if (events.size() >= capacity)
+        return false;
+    events.push_back(event);
+    increase(pushed);
+    if (events.size() > maxDepth.load(std::memory_order_relaxed))
+        maxDepth.store(events.size(), std::memory_order_relaxed);
+    return true;
+}
+
+FlowRemovedQueue::Counters FlowRemovedQueue::getCounters() const
+{
+    Counters ret;
+    ret.pushed = pushed.load(std::memory_order_relaxed);
+    ret.batches = batches.load(std::memory_order_relaxed);
+    ret.fullBatches = fullBatches.load(std::memory_order_relaxed);
+    ret.maxDepth = maxDepth.load(std::memory_order_relaxed);
+    ret.hostLookups = hostLookups.load(std::memory_order_relaxed);
+    return ret;
+}
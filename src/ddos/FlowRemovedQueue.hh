@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "UserAddress.hh"
+
+// Bounded queue of flow-removed events taken in batches: the samples of a
+// batch are grouped by (dpid, in_port) for a single SPRT update and by user
+// for a single check, hosts are resolved once per MAC of a batch. A full queue is taken
+// by the producer at once (back-pressure), nothing is dropped. IPv4 users are
+// the hosts of eth_src, IPv6 users are the sources of the matches.
+class FlowRemovedQueue {
+public:
+    typedef uint64_t Dpid;
+    typedef uint32_t InPort;
+    typedef UserAddress IPAddress;
+
+    struct Event {
+        Dpid dpid;
+        InPort inPort;
+        bool hasInPort;     // or the port of the host of ethSrc
+        bool isIPv4;        // the user is the host of ethSrc
+        bool hasEthSrc;
+        uint64_t ethSrc;    // 48 bits
+        uint64_t packetCount;
+        bool isIPv6;        // the user is ipAddr
+        IPAddress ipAddr;   // ipv6_src, or its /64 prefix
+    };
+
+    // of the host manager
+    struct Host {
+        bool isFound;
+        IPAddress ipAddr;
+        InPort inPort;
+    };
+
+    struct PortSamples {
+        Dpid dpid;
+        InPort inPort;
+        size_t samples;
+        size_t lowSamples;  // packet_count <= validPacketNumber (SPRT)
+    };
+
+    struct UserFlows {
+        Dpid dpid;
+        IPAddress ipAddr;
+        size_t flows;
+        size_t invalidFlows; // packet_count < validPacketNumber (the user's check)
+        uint64_t packets;
+    };
+
+    struct Batch {
+        std::vector<PortSamples> ports;
+        std::vector<UserFlows> users; // by switch and user
+        size_t events;
+        size_t unresolved;  // without in_port or host
+        Batch(): events(0), unresolved(0) {}
+    };
+
+    struct Counters {
+        uint64_t pushed;
+        uint64_t batches;
+        uint64_t fullBatches; // taken by the producer of a full queue
+        uint64_t maxDepth;
+        uint64_t hostLookups;
+        Counters(): pushed(0), batches(0), fullBatches(0), maxDepth(0), hostLookups(0) {}
+    };
+
+    static const size_t CAPACITY = 65536;
+
+    FlowRemovedQueue (size_t capacity_ = CAPACITY): capacity(capacity_ > 0 ? capacity_ : 1),
+        pushed(0), batches(0), fullBatches(0), maxDepth(0), hostLookups(0) {}
+    void setCapacity (size_t capacity_) { capacity = capacity_ > 0 ? capacity_ : 1; }
+    size_t getCapacity() const { return capacity; }
+
+    // false when full: the batch is to be taken before the event is pushed again
+    bool push (const Event& event);
+    bool isEmpty() const { return events.empty(); }
+    size_t size() const { return events.size(); }
+
+    // groups the queued events, resolve (ethSrc) -> Host is called once per MAC
+    template <class Resolve>
+    Batch take (size_t validPacketNumber, Resolve resolve, bool isFull = false);
+
+    // any thread
+    Counters getCounters() const;
+
+private:
+    // adjacent equal groups of sorted ones are added up
+    template <class T, class Equal, class Add>
+    static void merge (std::vector<T>& groups, Equal isEqual, Add add);
+
+    static void increase (std::atomic<uint64_t>& counter, uint64_t value = 1)
+    {
+        // the owner thread is the only writer
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    size_t capacity;
+    std::vector<Event> events;
+    std::atomic<uint64_t> pushed;
+    std::atomic<uint64_t> batches;
+    std::atomic<uint64_t> fullBatches;
+    std::atomic<uint64_t> maxDepth;
+    std::atomic<uint64_t> hostLookups;
+};
+
+
+template <class Resolve>
+FlowRemovedQueue::Batch FlowRemovedQueue::take (size_t validPacketNumber, Resolve resolve, bool isFull)
+{
+    Batch batch;
+    batch.events = events.size();
+    increase(batches);
+    if (isFull)
+        increase(fullBatches);
+
+    // runs of a MAC: its host is resolved once
+    std::sort(events.begin(), events.end(), [](const Event& a, const Event& b)
+    {
+        return a.dpid < b.dpid || (a.dpid == b.dpid && a.ethSrc < b.ethSrc);
+    });
+    for (size_t i = 0; i < events.size(); )
+    {
+        const Event& first = events[i];
+        bool isHostResolved = false;
+        Host host {false, 0, 0};
+        size_t users = batch.users.size();
+        for (; i < events.size() && events[i].dpid == first.dpid && events[i].ethSrc == first.ethSrc; ++i)
+        {
+            const Event& event = events[i];
+            if (!isHostResolved && event.hasEthSrc && (!event.hasInPort || event.isIPv4))
+            {
+                host = resolve(event.ethSrc);
+                isHostResolved = true;
+                increase(hostLookups);
+            }
+            if (!event.hasInPort && !host.isFound)
+            {
+                ++batch.unresolved;
+                continue;
+            }
+            InPort inPort = event.hasInPort ? event.inPort : host.inPort;
+            bool isLow = event.packetCount <= validPacketNumber;
+            if (batch.ports.empty() || batch.ports.back().dpid != event.dpid || batch.ports.back().inPort != inPort)
+                batch.ports.push_back(PortSamples {event.dpid, inPort, 0, 0});
+            ++batch.ports.back().samples;
+            batch.ports.back().lowSamples += isLow;
+
+            IPAddress ipAddr = event.ipAddr;
+            if (!event.isIPv6)
+            {
+                if (!event.isIPv4 || !event.hasEthSrc)
+                    continue;
+                if (!host.isFound)
+                {
+                    ++batch.unresolved;
+                    continue;
+                }
+                ipAddr = host.ipAddr;
+            }
+            // a MAC of several IPv6 users: its runs are merged below
+            if (batch.users.size() == users || batch.users.back().ipAddr != ipAddr)
+                batch.users.push_back(UserFlows {event.dpid, ipAddr, 0, 0, 0});
+            UserFlows& flows = batch.users.back();
+            ++flows.flows;
+            flows.invalidFlows += event.packetCount < validPacketNumber;
+            flows.packets += event.packetCount;
+        }
+    }
+    events.clear();
+
+    // the runs of a port or of a user (several MACs) are merged
+    std::sort(batch.ports.begin(), batch.ports.end(), [](const PortSamples& a, const PortSamples& b)
+    {
+        return a.dpid < b.dpid || (a.dpid == b.dpid && a.inPort < b.inPort);
+    });
+    merge(batch.ports, [](const PortSamples& a, const PortSamples& b) { return a.dpid == b.dpid && a.inPort == b.inPort; },
+          [](PortSamples& to, const PortSamples& from) { to.samples += from.samples; to.lowSamples += from.lowSamples; });
+    std::sort(batch.users.begin(), batch.users.end(), [](const UserFlows& a, const UserFlows& b)
+    {
+        return a.dpid < b.dpid || (a.dpid == b.dpid && a.ipAddr < b.ipAddr);
+    });
+    merge(batch.users, [](const UserFlows& a, const UserFlows& b) { return a.dpid == b.dpid && a.ipAddr == b.ipAddr; },
+          [](UserFlows& to, const UserFlows& from)
+          {
+              to.flows += from.flows;
+              to.invalidFlows += from.invalidFlows;
+              to.packets += from.packets;
+          });
+    return batch;
+}
+
+
+template <class T, class Equal, class Add>
+void FlowRemovedQueue::merge (std::vector<T>& groups, Equal isEqual, Add add)
+{
+    size_t last = 0;
+    for (size_t i = 1; i < groups.size(); ++i)
+    {
+        if (isEqual(groups[last], groups[i]))
+            add(groups[last], groups[i]);
+        else
+            groups[++last] = groups[i];
+    }
+    if (!groups.empty())
+        groups.resize(last + 1);
+}
@@ -0,0 +1,207 @@
+#include "HeavyHitters.hh"
+#include "Clock.hh"
+
+#include <algorithm>
+
+std::atomic<uint64_t> HeavyHitters::nextId(1);
+
+HeavyHitters::HeavyHitters (size_t capacity_)
+    : capacity(capacity_), id(nextId.fetch_add(1)), merged(std::make_shared<Merged>())
+{
+}
+
+HeavyHitters::Sketch& HeavyHitters::local()
+{
+    // ids are not reused: a sketch of a destroyed instance is never looked up again
+    static thread_local std::unordered_map<uint64_t, Sketch*> local;
+    Sketch*& sketch = local[id];
+    if (sketch == nullptr)
+    {
+        sketch = new Sketch(capacity);
+        std::lock_guard<std::mutex> lock(sketchesLock);
+        sketches.emplace_back(sketch);
+    }
+    return *sketch;
+}
+
+void HeavyHitters::update (IPAddress ipAddr, uint64_t weight)
+{
+    Sketch& sketch = local();
+    // uncontended but by a merge
+    std::lock_guard<std::mutex> lock(sketch.lock);
+    sketch.update(ipAddr, weight, capacity);
+}
+
+std::shared_ptr<const HeavyHitters::Merged> HeavyHitters::merge()
+{
+    std::shared_ptr<Merged> ret = std::make_shared<Merged>();
+    ret->time = Clock::now();
+
+    // a source missing in a full sketch has its minimum at most there: the
+    // minimum is added to the count and to the error of the source
+    struct Sum {
+        uint64_t count;
+        uint64_t error;
+        uint64_t presentMin; // of the sketches having the source
+    };
+    std::unordered_map<IPAddress, Sum> sums;
+    uint64_t missing = 0;
+    {
+        std::lock_guard<std::mutex> lock(sketchesLock);
+        for (auto& sketch : sketches)
+        {
+            std::lock_guard<std::mutex> sketchLock(sketch->lock);
+            ret->total += sketch->total;
+            uint64_t min = sketch->heap.size() < capacity ? 0 : sketch->heap[0].count;
+            missing += min;
+            for (const Counter& c : sketch->heap)
+            {
+                Sum& sum = sums.insert(std::make_pair(c.ipAddr, Sum {0, 0, 0})).first->second;
+                sum.count += c.count;
+                sum.error += c.error;
+                sum.presentMin += min;
+            }
+        }
+    }
+    ret->counters.reserve(sums.size());
+    for (auto& sum : sums)
+    {
+        uint64_t absent = missing - sum.second.presentMin;
+        ret->counters.push_back(Counter(sum.first, sum.second.count + absent, sum.second.error + absent));
+    }
+    if (ret->counters.size() > capacity)
+    {
+        std::nth_element(ret->counters.begin(), ret->counters.begin() + capacity, ret->counters.end(),
+                         [](const Counter& a, const Counter& b) { return a.count > b.count; });
+        ret->counters.resize(capacity);
+    }
+    for (const Counter& c : ret->counters)
+        ret->guaranteed[c.ipAddr] = c.count - c.error;
+
+    std::atomic_store(&merged, std::shared_ptr<const Merged>(ret));
+    return ret;
+}
+
+std::vector<HeavyHitters::Counter> HeavyHitters::top (size_t k)
+{
+    std::vector<Counter> ret;
+    {
+        std::lock_guard<std::mutex> guard(mergeLock);
+        ret = merge()->counters;
+    }
+    k = std::min(k, ret.size());
+    std::partial_sort(ret.begin(), ret.begin() + k, ret.end(),
+                      [](const Counter& a, const Counter& b) { return a.count > b.count; });
+    ret.resize(k);
+    return ret;
+}
+
+bool HeavyHitters::isHeavyHitter (IPAddress ipAddr, double share)
+{
+    std::shared_ptr<const Merged> last = std::atomic_load(&merged);
+    // one thread merges, the others use the last merge meanwhile
+    if (Clock::now() - last->time >= MERGE_INTERVAL)
+    {
+        std::unique_lock<std::mutex> guard(mergeLock, std::try_to_lock);
+        if (guard.owns_lock())
+            last = merge();
+    }
+    if (last->total < MIN_TOTAL)
+        return false;
+    auto it = last->guaranteed.find(ipAddr);
+    if (it == last->guaranteed.end())
+        return false;
+    return it->second >= share * last->total;
+}
+
+uint64_t HeavyHitters::getTotal()
+{
+    uint64_t total = 0;
+    std::lock_guard<std::mutex> lock(sketchesLock);
+    for (auto& sketch : sketches)
+    {
+        std::lock_guard<std::mutex> sketchLock(sketch->lock);
+        total += sketch->total;
+    }
+    return total;
+}
+
+void HeavyHitters::decay()
+{
+    // halving keeps the heap order
+    std::lock_guard<std::mutex> lock(sketchesLock);
+    for (auto& sketch : sketches)
+    {
+        std::lock_guard<std::mutex> sketchLock(sketch->lock);
+        for (Counter& c : sketch->heap)
+        {
+            c.count /= 2;
+            c.error /= 2;
+        }
+        sketch->total /= 2;
+    }
+}
+
+// HeavyHitters::Sketch
+void HeavyHitters::Sketch::update (IPAddress ipAddr, uint64_t weight, size_t capacity)
+{
+    total += weight;
+    auto it = index.find(ipAddr);
+    if (it != index.end())
+    {
+        heap[it->second].count += weight;
+        siftDown(it->second);
+        return;
+    }
+    if (heap.size() < capacity)
+    {
+        heap.push_back(Counter(ipAddr, weight, 0));
+        index[ipAddr] = heap.size() - 1;
+        siftUp(heap.size() - 1);
+        return;
+    }
+    // replace the minimum
+    Counter& min = heap[0];
+    index.erase(min.ipAddr);
+    min = Counter(ipAddr, min.count + weight, min.count);
+    index[ipAddr] = 0;
+    siftDown(0);
+}
+
+void HeavyHitters::Sketch::siftUp (size_t i)
+{
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (heap[parent].count <= heap[i].count)
+            break;
+        swapCounters(i, parent);
+        i = parent;
+    }
+}
+
+void HeavyHitters::Sketch::siftDown (size_t i)
+{
+    size_t size = heap.size();
+    for (;;)
+    {
+        size_t min = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < size && heap[left].count < heap[min].count)
+            min = left;
+        if (right < size && heap[right].count < heap[min].count)
+            min = right;
+        if (min == i)
+            break;
+        swapCounters(i, min);
+        i = min;
+    }
+}
+
+void HeavyHitters::Sketch::swapCounters (size_t i, size_t j)
+{
+    std::swap(heap[i], heap[j]);
+    index[heap[i].ipAddr] = i;
+    index[heap[j].ipAddr] = j;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "UserAddress.hh"
+
+// Top sources with the Space-Saving algorithm: CAPACITY monitored
+// counters kept in a min-heap, the minimum is replaced by a new source.
+// Every thread updates a sketch of its own, the sketches are merged on
+// read as Metrics are; isHeavyHitter looks up the last merge, which is
+// MERGE_INTERVAL old at most.
+class HeavyHitters {
+    typedef UserAddress IPAddress;
+
+public:
+    struct Counter {
+        IPAddress ipAddr;
+        uint64_t count;     // overestimated by error at most
+        uint64_t error;
+        Counter (IPAddress ipAddr_ = 0, uint64_t count_ = 0, uint64_t error_ = 0) :
+            ipAddr(ipAddr_), count(count_), error(error_) {}
+    };
+
+    HeavyHitters (size_t capacity_ = CAPACITY);
+
+    void update (IPAddress ipAddr, uint64_t weight = 1);
+    std::vector<Counter> top (size_t k);
+    bool isHeavyHitter (IPAddress ipAddr, double share);
+    uint64_t getTotal();
+    void decay();
+
+    static const size_t CAPACITY = 1024;
+    static const uint64_t MIN_TOTAL = 1000; // no heavy hitters in a quiet stream
+    static const time_t MERGE_INTERVAL = 1; // seconds
+
+private:
+    // written by the owner thread, its lock is taken by merges and decay only
+    struct Sketch {
+        std::mutex lock;
+        uint64_t total;
+        std::vector<Counter> heap;
+        std::unordered_map<IPAddress, size_t> index;  // position in heap
+        Sketch (size_t capacity): total(0) { heap.reserve(capacity); }
+        void update (IPAddress ipAddr, uint64_t weight, size_t capacity);
+        void siftUp (size_t i);
+        void siftDown (size_t i);
+        void swapCounters (size_t i, size_t j);
+    };
+    // guaranteed counts of the monitored sources of all sketches
+    struct Merged {
+        uint64_t total;
+        std::vector<Counter> counters; // capacity at most, the largest counts
+        std::unordered_map<IPAddress, uint64_t> guaranteed;
+        time_t time;
+        Merged(): total(0), time(0) {}
+    };
+
+    Sketch& local();
+    // mergeLock is held
+    std::shared_ptr<const Merged> merge();
+
+    size_t capacity;
+    uint64_t id; // of the thread's sketches
+    std::mutex sketchesLock;
+    std::vector<std::unique_ptr<Sketch>> sketches;
+    std::mutex mergeLock;
+    std::shared_ptr<const Merged> merged; // std::atomic_load and std::atomic_store
+
+    static std::atomic<uint64_t> nextId;
+};
@@ -0,0 +1,214 @@
+#include "Journal.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+const time_t Journal::PREPARE_INTERVAL;
+
+Journal::Journal()
+    : segmentRecords(SEGMENT_RECORDS), startPosition(0), position(0), dropped(0), running(false)
+{
+    for (auto& segment : ring)
+        segment.store(nullptr);
+    for (auto& count : holders)
+        count.store(0);
+}
+
+Journal::~Journal()
+{
+    close();
+}
+
+bool Journal::open (const std::string& dir_, size_t segmentRecords_)
+{
+    dir = dir_;
+    segmentRecords = segmentRecords_ > 0 ? segmentRecords_ : SEGMENT_RECORDS;
+    if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+        LOG(ERROR) << "Journal: cannot create " << dir << ": " << strerror(errno);
+        return false;
+    }
+
+    // segments of the previous runs are kept
+    uint64_t first = 0;
+    if (DIR* d = opendir(dir.c_str()))
+    {
+        while (dirent* entry = readdir(d))
+        {
+            unsigned long long index;
+            if (sscanf(entry->d_name, "journal-%llu.bin", &index) == 1 && index + 1 > first)
+                first = index + 1;
+        }
+        closedir(d);
+    }
+
+    for (uint64_t index = first; index < first + RING_SIZE; ++index)
+    {
+        Segment* segment = map(index);
+        if (segment == nullptr)
+        {
+            close();
+            return false;
+        }
+        ring[index % RING_SIZE].store(segment);
+    }
+    startPosition = first * segmentRecords;
+    position.store(startPosition);
+    dropped.store(0);
+    running.store(true);
+    preparer = std::thread(&Journal::prepare, this);
+    LOG(INFO) << "Journal: " << JournalFormat::segmentName(dir, first);
+    return true;
+}
+
+void Journal::close()
+{
+    if (running.exchange(false))
+    {
+        preparerCondition.notify_one();
+        preparer.join();
+    }
+    uint64_t end = position.load();
+    for (size_t i = 0; i < RING_SIZE; ++i)
+    {
+        Segment* segment = ring[i].exchange(nullptr);
+        if (segment == nullptr)
+            continue;
+        while (holders[i].load() != 0)
+            std::this_thread::yield();
+        uint64_t first = segment->index * segmentRecords;
+        uint64_t recordsNumber = end <= first ? 0 : std::min<uint64_t>(end - first, segmentRecords);
+        std::string name = JournalFormat::segmentName(dir, segment->index);
+        unmap(segment, recordsNumber);
+        // the next segment is not used yet
+        if (recordsNumber == 0)
+            unlink(name.c_str());
+    }
+}
+
+void Journal::write (JournalFormat::Types type, IPAddress ipAddr, Dpid dpid, InPort inPort)
+{
+    if (!running.load(std::memory_order_relaxed))
+        return;
+    uint64_t n = position.fetch_add(1, std::memory_order_relaxed);
+    uint64_t index = n / segmentRecords;
+    size_t slot = n % segmentRecords;
+    if (slot == segmentRecords / 2)
+        preparerCondition.notify_one();
+
+    // the slot is held before the pointer is loaded: a segment replaced
+    // after the load is not freed until the slot is released
+    std::atomic<uint32_t>& holder = holders[index % RING_SIZE];
+    holder.fetch_add(1);
+    Segment* segment = ring[index % RING_SIZE].load();
+    if (segment == nullptr || segment->index != index)
+    {
+        holder.fetch_sub(1, std::memory_order_release);
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    JournalFormat::Record& record = segment->records[slot];
+    record.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    record.dpid = dpid;
+    record.ipAddrHi = ipAddr.hi;
+    record.ipAddrLo = ipAddr.lo;
+    record.inPort = inPort;
+    __atomic_store_n(&record.type, (uint8_t) type, __ATOMIC_RELEASE);
+    holder.fetch_sub(1, std::memory_order_release);
+}
+
+void Journal::prepare()
+{
+    while (running.load())
+    {
+        {
+            std::unique_lock<std::mutex> lock(preparerLock);
+            preparerCondition.wait_for(lock, std::chrono::milliseconds(PREPARE_INTERVAL));
+        }
+        uint64_t current = position.load() / segmentRecords;
+        for (uint64_t index = current; index < current + RING_SIZE; ++index)
+        {
+            Segment* segment = ring[index % RING_SIZE].load();
+            if (segment != nullptr && segment->index == index)
+                continue;
+            Segment* fresh = map(index);
+            if (fresh == nullptr)
+                break;
+            Segment* old = ring[index % RING_SIZE].exchange(fresh);
+            if (old == nullptr)
+                continue;
+            // writers of the fresh segment hold the slot too, they are short
+            while (holders[index % RING_SIZE].load() != 0)
+                std::this_thread::yield();
+            unmap(old, segmentRecords);
+        }
+    }
+}
+
+Journal::Segment* Journal::map (uint64_t index)
+{
+    std::string name = JournalFormat::segmentName(dir, index);
+    int fd = ::open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        LOG(ERROR) << "Journal: cannot open " << name << ": " << strerror(errno);
+        return nullptr;
+    }
+    size_t size = sizeof(JournalFormat::SegmentHeader) + segmentRecords * sizeof(JournalFormat::Record);
+    // sparse: records are zero until written
+    if (ftruncate(fd, size) < 0)
+    {
+        LOG(ERROR) << "Journal: cannot size " << name << ": " << strerror(errno);
+        ::close(fd);
+        return nullptr;
+    }
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        LOG(ERROR) << "Journal: cannot map " << name << ": " << strerror(errno);
+        ::close(fd);
+        return nullptr;
+    }
+
+    Segment* segment = new Segment;
+    segment->index = index;
+    segment->fd = fd;
+    segment->size = size;
+    segment->header = static_cast<JournalFormat::SegmentHeader*>(base);
+    segment->records = reinterpret_cast<JournalFormat::Record*>(static_cast<uint8_t*>(base) + sizeof(JournalFormat::SegmentHeader));
+
+    JournalFormat::SegmentHeader& header = *segment->header;
+    memset(&header, 0, sizeof(header));
+    header.magic = JournalFormat::MAGIC;
+    header.version = JournalFormat::VERSION;
+    header.recordSize = sizeof(JournalFormat::Record);
+    header.index = index;
+    header.firstRecord = index * segmentRecords;
+    header.recordsNumber = segmentRecords;
+    return segment;
+}
+
+void Journal::unmap (Segment* segment, uint64_t recordsNumber)
+{
+    segment->header->recordsNumber = recordsNumber;
+    munmap(segment->header, segment->size);
+    if (recordsNumber < segmentRecords)
+    {
+        if (ftruncate(segment->fd, sizeof(JournalFormat::SegmentHeader) + recordsNumber * sizeof(JournalFormat::Record)) < 0)
+            LOG(WARNING) << "Journal: cannot cut segment " << segment->index << ": " << strerror(errno);
+    }
+    ::close(segment->fd);
+    delete segment;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "JournalFormat.hh"
+#include "UserAddress.hh"
+
+// Append-only journal of users' transitions, SPRT verdicts and DDoS flips.
+// A writer reserves a record with one fetch_add and copies it into the
+// mapped segment. The next segment is mapped ahead by a background thread,
+// a record is dropped instead of waiting when it is not ready.
+class Journal {
+public:
+    typedef UserAddress IPAddress;
+    typedef uint64_t Dpid;
+    typedef uint32_t InPort;
+
+    Journal();
+    ~Journal();
+
+    bool open (const std::string& dir_, size_t segmentRecords_ = SEGMENT_RECORDS);
+    void close();
+    bool isOpen() const { return running; }
+
+    // any thread
+    void write (JournalFormat::Types type, IPAddress ipAddr = IPAddress(), Dpid dpid = 0, InPort inPort = 0);
+
+    uint64_t getWritten() const { return position.load(std::memory_order_relaxed) - startPosition - getDropped(); }
+    uint64_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+    uint64_t getSegment() const { return position.load(std::memory_order_relaxed) / segmentRecords; }
+
+    static const size_t SEGMENT_RECORDS = 1 << 21; // 80 MiB
+    static const size_t RING_SIZE = 2;             // the current segment and the next one
+    static const time_t PREPARE_INTERVAL = 100;    // milliseconds
+
+private:
+    struct Segment {
+        uint64_t index;
+        int fd;
+        size_t size;
+        JournalFormat::SegmentHeader* header;
+        JournalFormat::Record* records;
+        Segment(): index(0), fd(-1), size(0), header(nullptr), records(nullptr) {}
+    };
+
+    Segment* map (uint64_t index);
+    void unmap (Segment* segment, uint64_t recordsNumber);
+    void prepare();
+
+    std::string dir;
+    size_t segmentRecords;
+    uint64_t startPosition;
+    std::atomic<uint64_t> position;
+    std::atomic<Segment*> ring[RING_SIZE];
+    // writers of a ring slot, taken before its pointer is loaded: a replaced
+    // segment is freed once the count of its slot is zero
+    std::atomic<uint32_t> holders[RING_SIZE];
+    std::atomic<uint64_t> dropped;
+
+    std::atomic<bool> running;
+    std::thread preparer;
+    std::mutex preparerLock;
+    std::condition_variable preparerCondition;
+};
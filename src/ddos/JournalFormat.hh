@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// On-disk format of the journal, shared by the writer and the offline
+// reader: segment files of a header and fixed records in the host byte
+// order. A record with type 0 has not been written.
+namespace JournalFormat {
+
+static const uint32_t MAGIC = 0x4e4a4444; // "DDJN"
+static const uint32_t VERSION = 2; // 1: IPv4 users only, records of 32 bytes
+
+enum Types : uint8_t {
+    Empty = 0,
+    Insert,         // Users::Transitions
+    Invalidate,
+    Validate,
+    Block,
+    Remove,
+    Evict,
+    Reset,
+    PortCompromised,
+    DDoSDetected,
+    DDoSFinished,
+    TYPES_NUMBER
+};
+
+struct Record {
+    uint64_t time;      // ns since the epoch
+    uint64_t dpid;      // PortCompromised
+    uint64_t ipAddrHi;  // users' transitions, UserAddress::hi and lo
+    uint64_t ipAddrLo;
+    uint32_t inPort;    // PortCompromised
+    uint8_t type;       // written last
+    uint8_t reserved[3];
+};
+static_assert(sizeof(Record) == 40, "journal record is 40 bytes");
+
+struct SegmentHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved;
+    uint64_t index;
+    uint64_t firstRecord;   // number of the first record in the journal
+    uint64_t recordsNumber; // capacity, the tail is cut on close
+    uint8_t padding[24];
+};
+static_assert(sizeof(SegmentHeader) == 64, "journal segment header is 64 bytes");
+
+inline const char* typeName (uint8_t type)
+{
+    static const char* names[] = {
+        "empty", "insert", "invalidate", "validate", "block", "remove", "evict", "reset",
+        "port-compromised", "ddos-detected", "ddos-finished"
+    };
+    return type < TYPES_NUMBER ? names[type] : "unknown";
+}
+
+inline std::string segmentName (const std::string& dir, uint64_t index)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/journal-%08llu.bin", (unsigned long long) index);
+    return dir + name;
+}
+
+}
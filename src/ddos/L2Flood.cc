@@ -0,0 +1,200 @@
+#include "L2Flood.hh"
+#include "Clock.hh"
+
+#include <algorithm>
+#include <tuple>
+
+#include <glog/logging.h>
+
+const size_t L2Flood::WINDOW_SAMPLES_MAX;
+
+L2Flood::L2Flood (size_t macRate_, size_t portRate_)
+    : macRate(macRate_), portRate(portRate_), macs(MACS_NUMBER), ports(PORTS_NUMBER)
+{
+}
+
+void L2Flood::setRates (size_t macRate_, size_t portRate_)
+{
+    std::lock_guard<std::mutex> lock(tablesLock);
+    macRate = std::max<size_t>(macRate_, 1);
+    portRate = std::max<size_t>(portRate_, 1);
+}
+
+void L2Flood::resetDetection()
+{
+    std::lock_guard<std::mutex> lock(tablesLock);
+    detection = SPRTdetection();
+}
+
+L2Flood::Verdicts L2Flood::update (Dpid dpid, InPort inPort, MacAddress mac)
+{
+    time_t now = Clock::now();
+    std::lock_guard<std::mutex> lock(tablesLock);
+    ++counters.packetIns;
+
+    PortEntry& port = *findPort(dpid, inPort, now, true);
+    if (now - port.windowStart >= WINDOW)
+        closeWindow(port, now);
+
+    ++port.packetIns;
+    // the MACs of a compromised port are not tracked
+    if (now < port.blockedUntil)
+    {
+        ++counters.portDrops;
+        return DropPort;
+    }
+
+    MacEntry* entry = findMac(dpid, inPort, mac, now);
+    if (entry == nullptr)
+    {
+        ++counters.untrackedMacs;
+    }
+    else
+    {
+        if (now - entry->windowStart >= WINDOW)
+        {
+            entry->windowStart = now;
+            entry->packetIns = 0;
+        }
+        entry->lastSeen = now;
+        ++entry->packetIns;
+        ++entry->totalPacketIns;
+        if (entry->packetIns > macRate)
+        {
+            ++counters.macDrops;
+            return DropMac;
+        }
+    }
+    if (port.packetIns > portRate)
+    {
+        ++counters.portLimits;
+        return LimitPort;
+    }
+    return Forward;
+}
+
+L2Flood::PortEntry* L2Flood::findPort (Dpid dpid, InPort inPort, time_t now, bool isInserted)
+{
+    PortEntry* set = portSet(dpid, inPort);
+    PortEntry* victim = &set[0];
+    auto rank = [now](const PortEntry& port) { return std::make_tuple(port.isUsed, now < port.blockedUntil, port.windowStart); };
+    for (size_t i = 0; i < PORT_WAYS; ++i)
+    {
+        PortEntry& port = set[i];
+        if (port.isUsed && port.dpid == dpid && port.inPort == inPort)
+            return &port;
+        if (rank(port) < rank(*victim))
+            victim = &port;
+    }
+    if (!isInserted)
+        return nullptr;
+
+    *victim = PortEntry();
+    victim->dpid = dpid;
+    victim->inPort = inPort;
+    victim->isUsed = true;
+    victim->windowStart = now;
+    return victim;
+}
+
+L2Flood::MacEntry* L2Flood::findMac (Dpid dpid, InPort inPort, MacAddress mac, time_t now)
+{
+    MacEntry* set = macSet(dpid, mac);
+    MacEntry* victim = nullptr;
+    for (size_t i = 0; i < MAC_WAYS; ++i)
+    {
+        MacEntry& entry = set[i];
+        if (entry.mac == mac && entry.dpid == dpid)
+        {
+            if (entry.inPort == inPort && now - entry.lastSeen < MAC_IDLE_TIMEOUT)
+                return &entry;
+            // moved or idle: a new entry of the MAC
+            victim = &entry;
+            break;
+        }
+        if (isReplaceable(entry, now) && (victim == nullptr || entry.lastSeen < victim->lastSeen))
+            victim = &entry;
+    }
+    if (victim == nullptr)
+        return nullptr;
+
+    if (victim->mac != 0)
+    {
+        counters.replacedMacs += victim->mac != mac || victim->dpid != dpid;
+        retire(*victim);
+    }
+    *victim = MacEntry();
+    victim->dpid = dpid;
+    victim->mac = mac;
+    victim->inPort = inPort;
+    victim->windowStart = now;
+    ++counters.newMacs;
+    return victim;
+}
+
+void L2Flood::retire (const MacEntry& entry)
+{
+    // the port's entry may be replaced, then the sample is lost
+    PortEntry* port = findPort(entry.dpid, entry.inPort, entry.lastSeen, false);
+    if (port == nullptr)
+        return;
+    bool isLow = entry.totalPacketIns <= LOW_PACKET_INS;
+    ++port->samples;
+    port->lowSamples += isLow;
+    ++counters.samples;
+    counters.lowSamples += isLow;
+}
+
+void L2Flood::closeWindow (PortEntry& port, time_t now)
+{
+    if (port.samples > 0)
+    {
+        // the share of low samples is kept in a capped batch
+        size_t samples = std::min<size_t>(port.samples, WINDOW_SAMPLES_MAX);
+        size_t lowSamples = (size_t) port.lowSamples * samples / port.samples;
+        switch (detection.updateInPort(port.dpid, port.inPort, samples, lowSamples))
+        {
+        case SPRTdetection::InPortTypes::Compromised:
+            if (now >= port.blockedUntil)
+            {
+                ++counters.compromisedPorts;
+                LOG(WARNING) << "Switch ID: " << port.dpid << ", in_port: " << port.inPort
+                             << " floods non-IP packet-ins: " << port.lowSamples << " of " << port.samples
+                             << " MACs of a single packet-in, " << port.packetIns << " packet-ins in "
+                             << now - port.windowStart << " s";
+            }
+            // the block lasts while the port's MACs are retired as low samples
+            port.blockedUntil = now + PORT_BLOCK_TIME;
+            detection.reset(port.dpid, port.inPort);
+            break;
+        case SPRTdetection::InPortTypes::Uncompromised:
+            detection.reset(port.dpid, port.inPort);
+            break;
+        default:
+            break;
+        }
+    }
+    port.windowStart = now;
+    port.packetIns = 0;
+    port.samples = 0;
+    port.lowSamples = 0;
+}
+
+L2Flood::Counters L2Flood::getCounters()
+{
+    std::lock_guard<std::mutex> lock(tablesLock);
+    return counters;
+}
+
+std::vector<std::pair<L2Flood::Dpid, L2Flood::InPort>> L2Flood::getBlockedPorts()
+{
+    std::vector<std::pair<Dpid, InPort>> ret;
+    time_t now = Clock::now();
+    std::lock_guard<std::mutex> lock(tablesLock);
+    for (const PortEntry& port : ports)
+    {
+        if (port.isUsed && now < port.blockedUntil)
+            ret.push_back(std::make_pair(port.dpid, port.inPort));
+    }
+    return ret;
+}
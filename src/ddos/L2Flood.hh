@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Policy.hh"
+#include "SPRTdetection.hh"
+
+// Non-IP packet-ins (ARP storms, random-MAC floods) by source MAC and by
+// (dpid, in_port) in two fixed set-associative tables, rates are counted in
+// windows of WINDOW seconds. A new MAC takes an empty, idle or single
+// packet-in entry of its set, so hosts seen twice stay through a flood of
+// random MACs; a new port takes the least recent entry, blocked ones the last.
+// A retired MAC entry is a SPRT sample of its in_port as a removed flow is: a
+// MAC of a single packet-in is a low sample. The samples of a port are tested
+// at the end of its window, a compromised port is blocked for PORT_BLOCK_TIME.
+class L2Flood {
+public:
+    typedef uint64_t Dpid;
+    typedef uint32_t InPort;
+    typedef uint64_t MacAddress; // 48 bits
+
+    enum Verdicts {
+        Forward,
+        DropMac,    // the MAC is over macRate
+        LimitPort,  // the in_port is over portRate
+        DropPort    // the in_port is compromised
+    };
+
+    struct Counters {
+        uint64_t packetIns;
+        uint64_t newMacs;
+        uint64_t replacedMacs;  // entries of other MACs
+        uint64_t untrackedMacs; // packet-ins of MACs of a full set
+        uint64_t samples;       // of SPRT, retired MACs
+        uint64_t lowSamples;
+        uint64_t macDrops;
+        uint64_t portLimits;
+        uint64_t portDrops;
+        uint64_t compromisedPorts;
+        Counters(): packetIns(0), newMacs(0), replacedMacs(0), untrackedMacs(0), samples(0), lowSamples(0),
+                    macDrops(0), portLimits(0), portDrops(0), compromisedPorts(0) {}
+    };
+
+    L2Flood (size_t macRate_ = MAC_RATE, size_t portRate_ = PORT_RATE);
+    void setRates (size_t macRate_, size_t portRate_);
+    size_t getPortRate() const { return portRate; }
+    // thresholds of a runtime policy are loaded after the construction
+    void resetDetection();
+
+    Verdicts update (Dpid dpid, InPort inPort, MacAddress mac);
+
+    Counters getCounters();
+    std::vector<std::pair<Dpid, InPort>> getBlockedPorts();
+
+    static const size_t MACS_BITS = 15;
+    static const size_t MACS_NUMBER = 1 << MACS_BITS;
+    static const size_t MAC_WAYS = 2;
+    static const size_t PORTS_BITS = 12;
+    static const size_t PORTS_NUMBER = 1 << PORTS_BITS;
+    static const size_t PORT_WAYS = 4;
+    static const time_t WINDOW = 1;                 // seconds
+    static const time_t MAC_IDLE_TIMEOUT = 300;     // seconds, the MAC is retired
+    static const time_t PORT_BLOCK_TIME = 60;       // seconds
+    static const time_t MAC_BLOCK_TIME = 10;        // seconds, drop entries of a MAC over macRate
+    static const size_t MAC_RATE = 20;              // packet-ins per second
+    static const size_t PORT_RATE = 200;            // packet-ins per second
+    // a storm weighs as much as a busy window, so the test decides in a few windows
+    static const size_t WINDOW_SAMPLES_MAX = 32;
+    static const uint32_t LOW_PACKET_INS = 1;       // of a MAC, a low sample
+
+private:
+    struct MacEntry {
+        Dpid dpid;
+        MacAddress mac;         // 0: empty
+        InPort inPort;
+        time_t windowStart;
+        time_t lastSeen;
+        uint32_t packetIns;     // in the window
+        uint32_t totalPacketIns;
+        MacEntry(): dpid(0), mac(0), inPort(0), windowStart(0), lastSeen(0), packetIns(0), totalPacketIns(0) {}
+    };
+
+    struct PortEntry {
+        Dpid dpid;
+        InPort inPort;
+        bool isUsed;
+        time_t windowStart;
+        time_t blockedUntil;
+        uint32_t packetIns;     // in the window
+        uint32_t samples;       // retired MACs in the window
+        uint32_t lowSamples;
+        PortEntry(): dpid(0), inPort(0), isUsed(false), windowStart(0), blockedUntil(0), packetIns(0),
+                     samples(0), lowSamples(0) {}
+    };
+
+    static uint32_t hash (Dpid dpid, uint64_t key)
+    {
+        uint64_t x = (key ^ (dpid * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+        return x >> 32;
+    }
+    MacEntry* macSet (Dpid dpid, MacAddress mac)
+    {
+        return &macs[(hash(dpid, mac) >> (32 - MACS_BITS)) & ~(MAC_WAYS - 1)];
+    }
+    PortEntry* portSet (Dpid dpid, InPort inPort)
+    {
+        return &ports[(hash(dpid, inPort) >> (32 - PORTS_BITS)) & ~(PORT_WAYS - 1)];
+    }
+    // nullptr if the port is not in the table and not inserted
+    PortEntry* findPort (Dpid dpid, InPort inPort, time_t now, bool isInserted);
+    // nullptr if the set is taken by active hosts
+    MacEntry* findMac (Dpid dpid, InPort inPort, MacAddress mac, time_t now);
+    static bool isReplaceable (const MacEntry& entry, time_t now)
+    {
+        return entry.mac == 0 || entry.totalPacketIns <= LOW_PACKET_INS || now - entry.lastSeen >= MAC_IDLE_TIMEOUT;
+    }
+    void retire (const MacEntry& entry);
+    void closeWindow (PortEntry& port, time_t now);
+
+    size_t macRate;
+    size_t portRate;
+    std::mutex tablesLock;
+    std::vector<MacEntry> macs;
+    std::vector<PortEntry> ports;
+    SPRTdetection detection;
+    Counters counters;
+};
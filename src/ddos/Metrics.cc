@@ -0,0 +1,109 @@
+#include "Metrics.hh"
+
+std::mutex Metrics::slotsLock;
+std::vector<Metrics::ThreadSlot*> Metrics::slots;
+
+Metrics::ThreadSlot::ThreadSlot()
+{
+    for (size_t s = 0; s < STAGES_NUMBER; ++s)
+    {
+        count[s].store(0);
+        sum[s].store(0);
+        for (size_t b = 0; b < BUCKETS_NUMBER; ++b)
+            buckets[s][b].store(0);
+    }
+    for (size_t o = 0; o < OUTCOMES_NUMBER; ++o)
+        outcomes[o].store(0);
+}
+
+Metrics::ThreadSlot& Metrics::local()
+{
+    // slots live as long as the process: RUNOS threads are not recycled
+    static thread_local ThreadSlot* slot = nullptr;
+    if (slot == nullptr)
+    {
+        slot = new ThreadSlot;
+        std::lock_guard<std::mutex> lock(slotsLock);
+        slots.push_back(slot);
+    }
+    return *slot;
+}
+
+void Metrics::record (Stages stage, uint64_t ns)
+{
+    ThreadSlot& slot = local();
+    increase(slot.count[stage]);
+    increase(slot.sum[stage], ns);
+    increase(slot.buckets[stage][bucket(ns)]);
+}
+
+void Metrics::count (Outcomes outcome)
+{
+    increase(local().outcomes[outcome]);
+}
+
+Metrics::Snapshot Metrics::snapshot()
+{
+    Snapshot ret;
+    std::lock_guard<std::mutex> lock(slotsLock);
+    for (ThreadSlot* slot : slots)
+    {
+        for (size_t s = 0; s < STAGES_NUMBER; ++s)
+        {
+            ret.stages[s].count += slot->count[s].load(std::memory_order_relaxed);
+            ret.stages[s].sum += slot->sum[s].load(std::memory_order_relaxed);
+            for (size_t b = 0; b < BUCKETS_NUMBER; ++b)
+                ret.stages[s].buckets[b] += slot->buckets[s][b].load(std::memory_order_relaxed);
+        }
+        for (size_t o = 0; o < OUTCOMES_NUMBER; ++o)
+            ret.outcomes[o] += slot->outcomes[o].load(std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+const char* Metrics::stageName (Stages stage)
+{
+    switch (stage)
+    {
+    case ProcessMiss:               return "processMiss";
+    case FlowRemoved:               return "flowRemoved";
+    case FlowRemovedBatch:          return "flowRemovedBatch";
+    case UsersStatisticsArrived:    return "usersStatisticsArrived";
+    case DetectDDoS:                return "detectDDoSTimeout";
+    case Mitigation:                return "mitigate";
+    case ReplicationPublish:        return "replicationPublish";
+    case Replication:               return "replication";
+    default:                        return "unknown";
+    }
+}
+
+const char* Metrics::outcomeName (Outcomes outcome)
+{
+    switch (outcome)
+    {
+    case Normal:    return "normal";
+    case Short:     return "short";
+    case Tight:     return "tight";
+    case Drop:      return "drop";
+    default:        return "unknown";
+    }
+}
+
+
+// Metrics::Histogram
+uint64_t Metrics::Histogram::percentile (double p) const
+{
+    if (count == 0)
+        return 0;
+    uint64_t rank = p * count + .5;
+    if (rank == 0)
+        rank = 1;
+    uint64_t total = 0;
+    for (size_t b = 0; b < BUCKETS_NUMBER; ++b)
+    {
+        total += buckets[b];
+        if (total >= rank)
+            return (uint64_t) 2 << b;
+    }
+    return (uint64_t) 2 << (BUCKETS_NUMBER - 1);
+}
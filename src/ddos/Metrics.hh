@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Per-thread latency histograms and counters merged on read
+class Metrics {
+public:
+    enum Stages {
+        ProcessMiss,
+        FlowRemoved,
+        FlowRemovedBatch,
+        UsersStatisticsArrived,
+        DetectDDoS,
+        Mitigation,
+        ReplicationPublish, // per update
+        Replication,        // from publishing a batch to applying it on a peer
+        STAGES_NUMBER
+    };
+
+    enum Outcomes {
+        Normal,
+        Short,
+        Tight,
+        Drop,
+        OUTCOMES_NUMBER
+    };
+
+    // bucket i holds latencies in [2^i, 2^(i+1)) ns, the last one is open
+    static const size_t BUCKETS_NUMBER = 32;
+
+    struct Histogram {
+        uint64_t count;
+        uint64_t sum; // ns
+        uint64_t buckets[BUCKETS_NUMBER];
+        Histogram(): count(0), sum(0), buckets() { }
+        uint64_t percentile (double p) const; // upper bound of the bucket, ns
+    };
+
+    struct Snapshot {
+        Histogram stages[STAGES_NUMBER];
+        uint64_t outcomes[OUTCOMES_NUMBER];
+        Snapshot(): stages(), outcomes() { }
+    };
+
+    static void record (Stages stage, uint64_t ns);
+    static void count (Outcomes outcome);
+    static Snapshot snapshot();
+
+    static const char* stageName (Stages stage);
+    static const char* outcomeName (Outcomes outcome);
+
+    class Timer {
+    public:
+        Timer (Stages stage_): stage(stage_), start(std::chrono::steady_clock::now()) { }
+        ~Timer()
+        {
+            record(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start).count());
+        }
+    private:
+        Stages stage;
+        std::chrono::steady_clock::time_point start;
+    };
+
+private:
+    // written by the owner thread only, read by snapshot()
+    struct ThreadSlot {
+        std::atomic<uint64_t> count[STAGES_NUMBER];
+        std::atomic<uint64_t> sum[STAGES_NUMBER];
+        std::atomic<uint64_t> buckets[STAGES_NUMBER][BUCKETS_NUMBER];
+        std::atomic<uint64_t> outcomes[OUTCOMES_NUMBER];
+        ThreadSlot();
+    };
+
+    static ThreadSlot& local();
+    static size_t bucket (uint64_t ns)
+    {
+        size_t i = ns == 0 ? 0 : 63 - __builtin_clzll(ns);
+        return i < BUCKETS_NUMBER ? i : BUCKETS_NUMBER - 1;
+    }
+    static void increase (std::atomic<uint64_t>& counter, uint64_t value = 1)
+    {
+        // single writer: no locked read-modify-write
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    static std::mutex slotsLock;
+    static std::vector<ThreadSlot*> slots;
+};
@@ -1,32 +1,60 @@
 #include "Params.hh"
 #include "Users.hh"
 
-void Params::init()
+template <class Policy>
+void BasicParams<Policy>::init()
 {
-    validAvgConnNumber.min = VALID_AVG_CONN_NUMBER_MIN;
-    validAvgConnNumber.max = VALID_AVG_CONN_NUMBER_MAX;
-    validAvgConnNumber.cur = (VALID_AVG_CONN_NUMBER_MIN + VALID_AVG_CONN_NUMBER_MAX) / 2;
+    validAvgConnNumber.min = Policy::VALID_AVG_CONN_NUMBER_MIN;
+    validAvgConnNumber.max = Policy::VALID_AVG_CONN_NUMBER_MAX;
+    validAvgConnNumber.cur = (Policy::VALID_AVG_CONN_NUMBER_MIN + Policy::VALID_AVG_CONN_NUMBER_MAX) / 2;
     countK1K2();
 
-    validPacketNumber.min = VALID_PACKET_NUMBER_MIN;
-    validPacketNumber.max = VALID_PACKET_NUMBER_MAX;
-    validPacketNumber.cur = (VALID_PACKET_NUMBER_MIN + VALID_PACKET_NUMBER_MAX) / 2;
+    validPacketNumber.min = Policy::VALID_PACKET_NUMBER_MIN;
+    validPacketNumber.max = Policy::VALID_PACKET_NUMBER_MAX;
+    validPacketNumber.cur = (Policy::VALID_PACKET_NUMBER_MIN + Policy::VALID_PACKET_NUMBER_MAX) / 2;
 }
 
-void Params::updateValidAvgConnNumber (const Users& users)
+template <class Policy>
+void BasicParams<Policy>::updateValidAvgConnNumber (const Users& users)
 {
-    size_t avgConnNumber = 0;
-    for (auto it = users.validUsers.begin(), end = users.validUsers.end(); it != end; ++it)
-    {
-        avgConnNumber += it->second.avgConnNumber;
-    }
-    avgConnNumber = avgConnNumber / (float) users.validUsers.size() + .5;
+    size_t validUsersNumber;
+    size_t avgConnNumberSum = sumValidAvgConnNumber(users, validUsersNumber);
+    updateValidAvgConnNumber(avgConnNumberSum, validUsersNumber);
+}
+
+template <class Policy>
+void BasicParams<Policy>::updateValidAvgConnNumber (size_t avgConnNumberSum, size_t validUsersNumber)
+{
+    if (validUsersNumber == 0)
+        return;
+    size_t avgConnNumber = avgConnNumberSum / (float) validUsersNumber + .5;
 
     validAvgConnNumber.cur = validateValidAvgConnNumber(avgConnNumber);
     countK1K2();
 }
 
-size_t Params::validateValidAvgConnNumber(size_t validAvgConnNumber_)
+template <class Policy>
+size_t BasicParams<Policy>::sumValidAvgConnNumber (const Users& users, size_t& validUsersNumber)
+{
+    validUsersNumber = users.validUsers.size();
+    if (users.validUsers.empty())
+        return 0;
+    size_t avgConnNumber = 0;
+    if (users.layout == Users::Layouts::Columns)
+    {
+        size_t columnsValidUsersNumber;
+        avgConnNumber = users.columns.sumAvgConnNumber(columnsValidUsersNumber);
+    } else {
+        for (auto it = users.validUsers.begin(), end = users.validUsers.end(); it != end; ++it)
+        {
+            avgConnNumber += it->second.avgConnNumber;
+        }
+    }
+    return avgConnNumber;
+}
+
+template <class Policy>
+size_t BasicParams<Policy>::validateValidAvgConnNumber(size_t validAvgConnNumber_)
 {
 //    LOG(INFO) << "ControllerDDoSProtectionParams::validateValidAvgConnNumber()";
     if (validAvgConnNumber_ > validAvgConnNumber.min && validAvgConnNumber_ < validAvgConnNumber.max)
@@ -37,15 +65,21 @@ size_t Params::validateValidAvgConnNumber(size_t validAvgConnNumber_)
     return validAvgConnNumber.cur;
 }
 
-void Params::countK1K2()
+template <class Policy>
+void BasicParams<Policy>::countK1K2()
 {
     size_t j = countJ();
     validAvgConnNumber.k1 = validAvgConnNumber.cur - (j/2 + 1/2);
     validAvgConnNumber.k2 = validAvgConnNumber.cur + (j/2 + 1/2);
 }
 
-void Params::print()
+template <class Policy>
+void BasicParams<Policy>::print()
 {
     LOG(INFO) << "k:\t" << validAvgConnNumber.k1 << "\t" << validAvgConnNumber.cur << "\t" << validAvgConnNumber.k2;
     LOG(INFO) << "n:\t" << validPacketNumber.cur;
 }
+
+template class BasicParams<StandardPolicy>;
+template class BasicParams<StrictPolicy>;
+template class BasicParams<RuntimePolicy>;
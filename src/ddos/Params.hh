@@ -6,9 +6,13 @@
 
 #include <glog/logging.h>
 
-class Users;
+#include "Policy.hh"
+
+template <class Policy>
+class BasicParams {
+    // of the policy
+    typedef BasicUsers<Policy> Users;
 
-class Params {
 public:
     struct DynamicNumbers {
         size_t min;
@@ -19,7 +23,7 @@ public:
         size_t k1; // k1 = lambda - i (2j)
         size_t k2; // k2 = lambda + i
     };
-    Params (double x_ = X): x(x_) {}
+    BasicParams (double x_ = Policy::X): x(x_) {}
     void init();
 
     // --> Malicious
@@ -30,6 +34,15 @@ public:
 
     inline bool isInvalidPacketNumber (size_t packetNumber) const { return packetNumber < validPacketNumber.cur; }
     void updateValidAvgConnNumber (const Users& users);
+    // merged from several Users: sum of the users' averages and number of users
+    void updateValidAvgConnNumber (size_t avgConnNumberSum, size_t validUsersNumber);
+    static size_t sumValidAvgConnNumber (const Users& users, size_t& validUsersNumber);
+    // thresholds only, x is kept
+    void assign (const BasicParams& params)
+    {
+        validAvgConnNumber = params.validAvgConnNumber;
+        validPacketNumber = params.validPacketNumber;
+    }
     size_t validateValidAvgConnNumber (size_t validAvgConnNumber_);
     DynamicNumbers getValidPacketNumber() { return validPacketNumber; }
     void print();
@@ -62,12 +75,6 @@ private:
 
     DynamicNumbers2 validAvgConnNumber;  // k
     DynamicNumbers validPacketNumber;   // n
-    const double x; // tolerance for accuracy (percent)
-
-    static constexpr double X = 0.5; // %
-    static const size_t VALID_AVG_CONN_NUMBER_MIN = 3; // test(!) data
-    static const size_t VALID_AVG_CONN_NUMBER_MAX = 7; // test(!) data
-    static const size_t VALID_PACKET_NUMBER_MIN = 3; // value of n is not less than 3
-    static const size_t VALID_PACKET_NUMBER_MAX = 5;
+    double x; // tolerance for accuracy (percent)
 };
 
@@ -0,0 +1,129 @@
+#include "Policy.hh"
+
+#include <functional>
+#include <map>
+
+const char* RuntimePolicy::profile = "standard";
+
+double RuntimePolicy::INVALID_FLOW_PERCENT = StandardPolicy::INVALID_FLOW_PERCENT;
+size_t RuntimePolicy::INVALID_DDOS_AVG_CONN_NUMBER = StandardPolicy::INVALID_DDOS_AVG_CONN_NUMBER;
+time_t RuntimePolicy::HARD_TIMEOUT = StandardPolicy::HARD_TIMEOUT;
+time_t RuntimePolicy::IDLE_TIMEOUT = StandardPolicy::IDLE_TIMEOUT;
+
+size_t RuntimePolicy::IS_DDOS_WEIGHT = StandardPolicy::IS_DDOS_WEIGHT;
+size_t RuntimePolicy::ENTROPY_WEIGHT = StandardPolicy::ENTROPY_WEIGHT;
+size_t RuntimePolicy::INVALID_MALICIOUS_USERS_CHECKED_NUMBER = StandardPolicy::INVALID_MALICIOUS_USERS_CHECKED_NUMBER;
+size_t RuntimePolicy::INVALID_MALICIOUS_USERS_CHECKED_NUMBER_WEIGHT = StandardPolicy::INVALID_MALICIOUS_USERS_CHECKED_NUMBER_WEIGHT;
+size_t RuntimePolicy::INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE = StandardPolicy::INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE;
+size_t RuntimePolicy::INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE_WEIGHT = StandardPolicy::INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE_WEIGHT;
+float RuntimePolicy::IS_STABLE_CRITERIA = StandardPolicy::IS_STABLE_CRITERIA;
+size_t RuntimePolicy::INVALID_DDOS_USERS_NUMBER = StandardPolicy::INVALID_DDOS_USERS_NUMBER;
+size_t RuntimePolicy::INVALID_DDOS_USERS_NUMBER_WEIGHT = StandardPolicy::INVALID_DDOS_USERS_NUMBER_WEIGHT;
+size_t RuntimePolicy::INVALID_DDOS_USERS_NUMBER_OF_INSERT = StandardPolicy::INVALID_DDOS_USERS_NUMBER_OF_INSERT;
+size_t RuntimePolicy::INVALID_DDOS_USERS_NUMBER_OF_INSERT_WEIGHT = StandardPolicy::INVALID_DDOS_USERS_NUMBER_OF_INSERT_WEIGHT;
+float RuntimePolicy::INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER = StandardPolicy::INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER;
+size_t RuntimePolicy::INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER_WEIGHT = StandardPolicy::INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER_WEIGHT;
+
+double RuntimePolicy::X = StandardPolicy::X;
+size_t RuntimePolicy::VALID_AVG_CONN_NUMBER_MIN = StandardPolicy::VALID_AVG_CONN_NUMBER_MIN;
+size_t RuntimePolicy::VALID_AVG_CONN_NUMBER_MAX = StandardPolicy::VALID_AVG_CONN_NUMBER_MAX;
+size_t RuntimePolicy::VALID_PACKET_NUMBER_MIN = StandardPolicy::VALID_PACKET_NUMBER_MIN;
+size_t RuntimePolicy::VALID_PACKET_NUMBER_MAX = StandardPolicy::VALID_PACKET_NUMBER_MAX;
+
+double RuntimePolicy::ALPHA = StandardPolicy::ALPHA;
+double RuntimePolicy::BETA = StandardPolicy::BETA;
+double RuntimePolicy::LAMBDA_0 = StandardPolicy::LAMBDA_0;
+double RuntimePolicy::LAMBDA_1 = StandardPolicy::LAMBDA_1;
+size_t RuntimePolicy::C_MAX = StandardPolicy::C_MAX;
+
+template <class Policy>
+void RuntimePolicy::assign()
+{
+    profile = Policy::name();
+
+    INVALID_FLOW_PERCENT = Policy::INVALID_FLOW_PERCENT;
+    INVALID_DDOS_AVG_CONN_NUMBER = Policy::INVALID_DDOS_AVG_CONN_NUMBER;
+    HARD_TIMEOUT = Policy::HARD_TIMEOUT;
+    IDLE_TIMEOUT = Policy::IDLE_TIMEOUT;
+
+    IS_DDOS_WEIGHT = Policy::IS_DDOS_WEIGHT;
+    ENTROPY_WEIGHT = Policy::ENTROPY_WEIGHT;
+    INVALID_MALICIOUS_USERS_CHECKED_NUMBER = Policy::INVALID_MALICIOUS_USERS_CHECKED_NUMBER;
+    INVALID_MALICIOUS_USERS_CHECKED_NUMBER_WEIGHT = Policy::INVALID_MALICIOUS_USERS_CHECKED_NUMBER_WEIGHT;
+    INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE = Policy::INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE;
+    INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE_WEIGHT = Policy::INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE_WEIGHT;
+    IS_STABLE_CRITERIA = Policy::IS_STABLE_CRITERIA;
+    INVALID_DDOS_USERS_NUMBER = Policy::INVALID_DDOS_USERS_NUMBER;
+    INVALID_DDOS_USERS_NUMBER_WEIGHT = Policy::INVALID_DDOS_USERS_NUMBER_WEIGHT;
+    INVALID_DDOS_USERS_NUMBER_OF_INSERT = Policy::INVALID_DDOS_USERS_NUMBER_OF_INSERT;
+    INVALID_DDOS_USERS_NUMBER_OF_INSERT_WEIGHT = Policy::INVALID_DDOS_USERS_NUMBER_OF_INSERT_WEIGHT;
+    INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER = Policy::INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER;
+    INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER_WEIGHT = Policy::INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER_WEIGHT;
+
+    X = Policy::X;
+    VALID_AVG_CONN_NUMBER_MIN = Policy::VALID_AVG_CONN_NUMBER_MIN;
+    VALID_AVG_CONN_NUMBER_MAX = Policy::VALID_AVG_CONN_NUMBER_MAX;
+    VALID_PACKET_NUMBER_MIN = Policy::VALID_PACKET_NUMBER_MIN;
+    VALID_PACKET_NUMBER_MAX = Policy::VALID_PACKET_NUMBER_MAX;
+
+    ALPHA = Policy::ALPHA;
+    BETA = Policy::BETA;
+    LAMBDA_0 = Policy::LAMBDA_0;
+    LAMBDA_1 = Policy::LAMBDA_1;
+    C_MAX = Policy::C_MAX;
+}
+
+bool RuntimePolicy::load (const std::string& profile_)
+{
+    if (profile_ == StandardPolicy::name())
+        assign<StandardPolicy>();
+    else if (profile_ == StrictPolicy::name())
+        assign<StrictPolicy>();
+    else
+        return false;
+    return true;
+}
+
+bool RuntimePolicy::set (const std::string& param, double value)
+{
+    static const std::map<std::string, std::function<void(double)>> setters = {
+        {"invalid-flow-percent", [](double v) { INVALID_FLOW_PERCENT = v; }},
+        {"invalid-ddos-avg-conn-number", [](double v) { INVALID_DDOS_AVG_CONN_NUMBER = v; }},
+        {"hard-timeout", [](double v) { HARD_TIMEOUT = v; }},
+        {"idle-timeout", [](double v) { IDLE_TIMEOUT = v; }},
+        {"is-ddos-weight", [](double v) { IS_DDOS_WEIGHT = v; }},
+        {"entropy-weight", [](double v) { ENTROPY_WEIGHT = v; }},
+        {"invalid-malicious-users-checked-number", [](double v) { INVALID_MALICIOUS_USERS_CHECKED_NUMBER = v; }},
+        {"invalid-malicious-users-checked-number-weight",
+            [](double v) { INVALID_MALICIOUS_USERS_CHECKED_NUMBER_WEIGHT = v; }},
+        {"invalid-malicious-users-number-of-change-type",
+            [](double v) { INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE = v; }},
+        {"invalid-malicious-users-number-of-change-type-weight",
+            [](double v) { INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE_WEIGHT = v; }},
+        {"is-stable-criteria", [](double v) { IS_STABLE_CRITERIA = v; }},
+        {"invalid-ddos-users-number", [](double v) { INVALID_DDOS_USERS_NUMBER = v; }},
+        {"invalid-ddos-users-number-weight", [](double v) { INVALID_DDOS_USERS_NUMBER_WEIGHT = v; }},
+        {"invalid-ddos-users-number-of-insert", [](double v) { INVALID_DDOS_USERS_NUMBER_OF_INSERT = v; }},
+        {"invalid-ddos-users-number-of-insert-weight",
+            [](double v) { INVALID_DDOS_USERS_NUMBER_OF_INSERT_WEIGHT = v; }},
+        {"invalid-ddos-users-number-of-change-type-number",
+            [](double v) { INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER = v; }},
+        {"invalid-ddos-users-number-of-change-type-number-weight",
+            [](double v) { INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER_WEIGHT = v; }},
+        {"x", [](double v) { X = v; }},
+        {"valid-avg-conn-number-min", [](double v) { VALID_AVG_CONN_NUMBER_MIN = v; }},
+        {"valid-avg-conn-number-max", [](double v) { VALID_AVG_CONN_NUMBER_MAX = v; }},
+        {"valid-packet-number-min", [](double v) { VALID_PACKET_NUMBER_MIN = v; }},
+        {"valid-packet-number-max", [](double v) { VALID_PACKET_NUMBER_MAX = v; }},
+        {"alpha", [](double v) { ALPHA = v; }},
+        {"beta", [](double v) { BETA = v; }},
+        {"lambda-0", [](double v) { LAMBDA_0 = v; }},
+        {"lambda-1", [](double v) { LAMBDA_1 = v; }},
+        {"c-max", [](double v) { C_MAX = v; }}
+    };
+    auto it = setters.find(param);
+    if (it == setters.end())
+        return false;
+    it->second(value);
+    return true;
+}
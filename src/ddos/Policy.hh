@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <ctime>
+#include <string>
+
+// Detection thresholds of Users, Params and SPRTdetection. The classes are
+// parameterized by a policy: the constants of a fixed profile are folded
+// into the checks, RuntimePolicy reads variables set by name or by config.
+
+// the thresholds of the paper's test data
+struct StandardPolicy {
+    static const char* name() { return "standard"; }
+
+    // Users
+    static constexpr double INVALID_FLOW_PERCENT = 0.5;
+    static const size_t INVALID_DDOS_AVG_CONN_NUMBER = 2;
+    static const time_t HARD_TIMEOUT = 6000;    // seconds
+    static const time_t IDLE_TIMEOUT = 600;     // seconds
+
+    // Users::Statistics
+    static const size_t IS_DDOS_WEIGHT = 100;
+    static const size_t ENTROPY_WEIGHT = 70;
+    static const size_t INVALID_MALICIOUS_USERS_CHECKED_NUMBER = 1;
+    static const size_t INVALID_MALICIOUS_USERS_CHECKED_NUMBER_WEIGHT = 100;
+    static const size_t INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE = 5;
+    static const size_t INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE_WEIGHT = 30;
+    static constexpr float IS_STABLE_CRITERIA = 0.2f;
+    static const size_t INVALID_DDOS_USERS_NUMBER = 100;
+    static const size_t INVALID_DDOS_USERS_NUMBER_WEIGHT = 30;
+    static const size_t INVALID_DDOS_USERS_NUMBER_OF_INSERT = 50;
+    static const size_t INVALID_DDOS_USERS_NUMBER_OF_INSERT_WEIGHT = 70;
+    static constexpr float INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER = 0.6f;
+    static const size_t INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER_WEIGHT = 30;
+
+    // Params
+    static constexpr double X = 0.5; // %
+    static const size_t VALID_AVG_CONN_NUMBER_MIN = 3; // test(!) data
+    static const size_t VALID_AVG_CONN_NUMBER_MAX = 7; // test(!) data
+    static const size_t VALID_PACKET_NUMBER_MIN = 3; // value of n is not less than 3
+    static const size_t VALID_PACKET_NUMBER_MAX = 5;
+
+    // SPRTdetection
+    static constexpr double ALPHA = 0.01;
+    static constexpr double BETA = 0.02;
+    static constexpr double LAMBDA_0 = 0.33;
+    static constexpr double LAMBDA_1 = 0.5;
+    static const size_t C_MAX = 3;
+};
+
+// earlier verdicts for more false positives: a lower share of invalid flows,
+// entropy alone is DDoS, half the DDoS users, longer blocking, a laxer SPRT
+struct StrictPolicy : public StandardPolicy {
+    static const char* name() { return "strict"; }
+
+    static constexpr double INVALID_FLOW_PERCENT = 0.4;
+    static const time_t HARD_TIMEOUT = 12000;   // seconds
+    static const time_t IDLE_TIMEOUT = 1200;    // seconds
+
+    static const size_t ENTROPY_WEIGHT = 100;
+    static const size_t INVALID_DDOS_USERS_NUMBER = 50;
+    static const size_t INVALID_DDOS_USERS_NUMBER_OF_INSERT = 25;
+
+    static constexpr double ALPHA = 0.05;
+    static constexpr double BETA = 0.01;
+};
+
+// for experiments: a profile is loaded by name and its thresholds are
+// overridden one by one, before the users, params and SPRT are created
+struct RuntimePolicy {
+    static const char* name() { return "runtime"; }
+
+    // a fixed profile, false if the name is unknown
+    static bool load (const std::string& profile);
+    // a threshold by its lowercase name ("idle-timeout", "alpha"), false if unknown
+    static bool set (const std::string& param, double value);
+    static const char* getProfile() { return profile; }
+
+    static double INVALID_FLOW_PERCENT;
+    static size_t INVALID_DDOS_AVG_CONN_NUMBER;
+    static time_t HARD_TIMEOUT;
+    static time_t IDLE_TIMEOUT;
+
+    static size_t IS_DDOS_WEIGHT;
+    static size_t ENTROPY_WEIGHT;
+    static size_t INVALID_MALICIOUS_USERS_CHECKED_NUMBER;
+    static size_t INVALID_MALICIOUS_USERS_CHECKED_NUMBER_WEIGHT;
+    static size_t INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE;
+    static size_t INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE_WEIGHT;
+    static float IS_STABLE_CRITERIA;
+    static size_t INVALID_DDOS_USERS_NUMBER;
+    static size_t INVALID_DDOS_USERS_NUMBER_WEIGHT;
+    static size_t INVALID_DDOS_USERS_NUMBER_OF_INSERT;
+    static size_t INVALID_DDOS_USERS_NUMBER_OF_INSERT_WEIGHT;
+    static float INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER;
+    static size_t INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER_WEIGHT;
+
+    static double X;
+    static size_t VALID_AVG_CONN_NUMBER_MIN;
+    static size_t VALID_AVG_CONN_NUMBER_MAX;
+    static size_t VALID_PACKET_NUMBER_MIN;
+    static size_t VALID_PACKET_NUMBER_MAX;
+
+    static double ALPHA;
+    static double BETA;
+    static double LAMBDA_0;
+    static double LAMBDA_1;
+    static size_t C_MAX;
+
+private:
+    template <class Policy>
+    static void assign();
+    static const char* profile;
+};
+
+// of the build: -DDDOS_POLICY_STRICT, -DDDOS_POLICY_RUNTIME or the standard one
+#if defined(DDOS_POLICY_STRICT)
+typedef StrictPolicy ActivePolicy;
+#elif defined(DDOS_POLICY_RUNTIME)
+typedef RuntimePolicy ActivePolicy;
+#else
+typedef StandardPolicy ActivePolicy;
+#endif
+
+template <class Policy> class BasicUsers;
+template <class Policy> class BasicParams;
+template <class Policy> class BasicSPRTdetection;
+
+typedef BasicUsers<ActivePolicy> Users;
+typedef BasicParams<ActivePolicy> Params;
+typedef BasicSPRTdetection<ActivePolicy> SPRTdetection;
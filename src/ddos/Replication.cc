@@ -0,0 +1,469 @@
+#include "Replication.hh"
+#include "Metrics.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+Replication::Replication()
+    : role(None), fd(-1), publisherEpoch(0), nextSeq(1), pendingFirstSeq(1), pendingCount(0),
+      isSynced(false), expectedSeq(0), expectedChunk(0), epoch(0), lastReceiveTime(0), lastResumeTime(0),
+      updates(0), datagrams(0), bytes(0), gaps(0), snapshots(0)
+{
+    pending.reserve(DATAGRAM_SIZE);
+}
+
+Replication::~Replication()
+{
+    if (fd < 0)
+        return;
+    close(fd);
+    unlink(path.c_str());
+}
+
+bool Replication::open (const std::string& path_)
+{
+    sockaddr_un addr;
+    if (path_.size() >= sizeof(addr.sun_path))
+    {
+        LOG(ERROR) << "Replication: socket path is too long: " << path_;
+        return false;
+    }
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        LOG(ERROR) << "Replication: cannot create a socket: " << strerror(errno);
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path_.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path_.c_str());
+    if (bind(fd, (sockaddr*) &addr, sizeof(addr)) < 0)
+    {
+        LOG(ERROR) << "Replication: cannot bind " << path_ << ": " << strerror(errno);
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    path = path_;
+    return true;
+}
+
+bool Replication::openPublisher (const std::string& path_, SnapshotFunction snapshot_)
+{
+    if (!open(path_))
+        return false;
+    role = Publisher;
+    snapshot = snapshot_;
+    publisherEpoch = (uint32_t) now() | 1;
+    LOG(INFO) << "Replication: publisher on " << path;
+    return true;
+}
+
+bool Replication::openSubscriber (const std::string& path_, const std::string& publisherPath_, ApplyFunction apply_)
+{
+    if (!open(path_))
+        return false;
+    role = Subscriber;
+    publisherPath = publisherPath_;
+    apply = apply_;
+    LOG(INFO) << "Replication: subscriber on " << path << " of " << publisherPath;
+    resume();
+    return true;
+}
+
+
+// Publisher
+void Replication::publish (const Update& update)
+{
+    if (role != Publisher)
+        return;
+    Metrics::Timer timer(Metrics::Stages::ReplicationPublish);
+    std::lock_guard<std::mutex> lock(pendingLock);
+    if (pendingCount == 0)
+        pendingFirstSeq = nextSeq;
+    uint8_t encoded[MAX_UPDATE_SIZE];
+    size_t size = encode(update, encoded);
+    pending.insert(pending.end(), encoded, encoded + size);
+    ++nextSeq;
+    ++pendingCount;
+    ++updates;
+    if (sizeof(Header) + pending.size() + sizeof(encoded) > DATAGRAM_SIZE)
+        flushPending();
+}
+
+void Replication::flush()
+{
+    if (role != Publisher)
+        return;
+    std::lock_guard<std::mutex> lock(pendingLock);
+    if (pendingCount != 0)
+        flushPending();
+}
+
+void Replication::flushPending()
+{
+    Batch batch;
+    batch.firstSeq = pendingFirstSeq;
+    batch.count = pendingCount;
+    Header h = header(Delta, pendingFirstSeq, pendingCount);
+    batch.datagram.resize(sizeof(Header) + pending.size());
+    memcpy(batch.datagram.data(), &h, sizeof(Header));
+    memcpy(batch.datagram.data() + sizeof(Header), pending.data(), pending.size());
+    pending.clear();
+    pendingCount = 0;
+
+    // sent under the lock: peers get the batches in order
+    for (auto it = peers.begin(); it != peers.end(); )
+    {
+        if (send(*it, batch.datagram))
+        {
+            ++it;
+            continue;
+        }
+        // it resumes on restart
+        LOG(WARNING) << "Replication: peer " << *it << " is gone";
+        it = peers.erase(it);
+    }
+    history.push_back(std::move(batch));
+    if (history.size() > HISTORY_SIZE)
+        history.pop_front();
+}
+
+bool Replication::send (const std::string& peer, const std::vector<uint8_t>& datagram, bool wait)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, peer.c_str(), sizeof(addr.sun_path) - 1);
+    for (size_t retry = 0; ; ++retry)
+    {
+        ssize_t ret = sendto(fd, datagram.data(), datagram.size(), 0, (sockaddr*) &addr, sizeof(addr));
+        if (ret >= 0)
+        {
+            ++datagrams;
+            bytes += ret;
+            return true;
+        }
+        if (errno == ECONNREFUSED || errno == ENOENT)
+            return false;
+        // EAGAIN: deltas are dropped, the subscriber finds a gap and resumes
+        if (!wait || errno != EAGAIN || retry == SEND_RETRIES)
+            return true;
+        usleep(100);
+    }
+}
+
+void Replication::handleResume (const std::string& peer, uint64_t firstSeq)
+{
+    std::vector<std::vector<uint8_t>> resent;
+    bool isSnapshot = true;
+    {
+        std::lock_guard<std::mutex> lock(pendingLock);
+        if (std::find(peers.begin(), peers.end(), peer) == peers.end())
+        {
+            LOG(INFO) << "Replication: new peer " << peer << " from " << firstSeq;
+            peers.push_back(peer);
+        }
+        if (pendingCount != 0)
+            flushPending();
+        if (firstSeq != 0 && firstSeq <= nextSeq && (history.empty() ? firstSeq == nextSeq : firstSeq >= history.front().firstSeq))
+        {
+            isSnapshot = false;
+            for (Batch& batch : history)
+            {
+                if (batch.firstSeq + batch.count > firstSeq)
+                    resent.push_back(batch.datagram);
+            }
+        }
+    }
+    if (isSnapshot)
+    {
+        sendSnapshot(peer);
+        return;
+    }
+    // newer deltas may come first: the subscriber skips them and resumes again
+    for (auto& datagram : resent)
+        send(peer, datagram, true);
+}
+
+
+void Replication::sendSnapshot (const std::string& peer)
+{
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> lock(pendingLock);
+        seq = nextSeq;
+    }
+    // updates after seq may be in the snapshot too: applying them twice is harmless
+    std::vector<Update> state;
+    if (snapshot)
+        snapshot(state);
+
+    std::vector<std::vector<uint8_t>> chunks(1);
+    std::vector<uint16_t> counts(1, 0);
+    for (const Update& update : state)
+    {
+        if (sizeof(Header) + chunks.back().size() + MAX_UPDATE_SIZE > DATAGRAM_SIZE)
+        {
+            chunks.emplace_back();
+            counts.push_back(0);
+        }
+        uint8_t encoded[MAX_UPDATE_SIZE];
+        size_t size = encode(update, encoded);
+        chunks.back().insert(chunks.back().end(), encoded, encoded + size);
+        ++counts.back();
+    }
+
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        Header h = header(Snapshot, seq, counts[i], i, chunks.size());
+        std::vector<uint8_t> datagram(sizeof(Header) + chunks[i].size());
+        memcpy(datagram.data(), &h, sizeof(Header));
+        memcpy(datagram.data() + sizeof(Header), chunks[i].data(), chunks[i].size());
+        send(peer, datagram, true);
+    }
+    ++snapshots;
+    LOG(INFO) << "Replication: snapshot of " << state.size() << " updates in " << chunks.size()
+              << " datagrams to " << peer;
+}
+
+
+// Subscriber
+void Replication::resume()
+{
+    if (role != Subscriber)
+        return;
+    uint64_t t = now();
+    if (lastReceiveTime != 0 && t - lastReceiveTime < (uint64_t) RESUME_INTERVAL * 1000000000)
+        return;
+    Header h = header(Resume, isSynced ? expectedSeq : 0, 0);
+    std::vector<uint8_t> datagram((uint8_t*) &h, (uint8_t*) &h + sizeof(Header));
+    send(publisherPath, datagram);
+    lastResumeTime = t;
+}
+
+void Replication::receive()
+{
+    uint8_t buffer[DATAGRAM_SIZE];
+    for (;;)
+    {
+        sockaddr_un addr;
+        socklen_t addrLen = sizeof(addr);
+        ssize_t size = recvfrom(fd, buffer, sizeof(buffer), 0, (sockaddr*) &addr, &addrLen);
+        if (size < 0)
+            return; // EAGAIN
+        Header h;
+        if ((size_t) size < sizeof(Header))
+            continue;
+        memcpy(&h, buffer, sizeof(Header));
+        if (h.magic != MAGIC || h.version != VERSION)
+        {
+            LOG(WARNING) << "Replication: unknown datagram";
+            continue;
+        }
+        const uint8_t* data = buffer + sizeof(Header);
+        size_t dataSize = size - sizeof(Header);
+        if (role == Publisher && h.kind == Resume && addrLen > sizeof(sa_family_t))
+        {
+            handleResume(std::string(addr.sun_path), h.firstSeq);
+            continue;
+        }
+        if (role != Subscriber)
+            continue;
+        lastReceiveTime = now();
+        if (h.epoch != epoch)
+        {
+            // a new publisher: numbering starts again
+            epoch = h.epoch;
+            isSynced = false;
+        }
+        if (h.kind == Delta)
+            handleDelta(h, data, dataSize);
+        else if (h.kind == Snapshot)
+            handleSnapshot(h, data, dataSize);
+    }
+}
+
+void Replication::handleDelta (const Header& h, const uint8_t* data, size_t size)
+{
+    uint64_t t = now();
+    if (!isSynced || h.firstSeq > expectedSeq)
+    {
+        // a lost datagram or no snapshot yet, asked again after a second
+        if (t - lastResumeTime > 1000000000)
+        {
+            ++gaps;
+            Header r = header(Resume, isSynced ? expectedSeq : 0, 0);
+            std::vector<uint8_t> datagram((uint8_t*) &r, (uint8_t*) &r + sizeof(Header));
+            send(publisherPath, datagram);
+            lastResumeTime = t;
+        }
+        return;
+    }
+    if (h.firstSeq + h.count <= expectedSeq)
+        return; // resent
+    applyUpdates(data, size, expectedSeq - h.firstSeq);
+    expectedSeq = h.firstSeq + h.count;
+    Metrics::record(Metrics::Stages::Replication, t > h.sentTime ? t - h.sentTime : 0);
+}
+
+void Replication::handleSnapshot (const Header& h, const uint8_t* data, size_t size)
+{
+    if (h.chunk == 0)
+    {
+        isSynced = false;
+        expectedChunk = 0;
+    }
+    if (h.chunk != expectedChunk)
+    {
+        // a lost chunk: the next delta asks for a new snapshot
+        expectedChunk = 0;
+        return;
+    }
+    applyUpdates(data, size, 0);
+    lastResumeTime = now(); // the snapshot is in progress
+    ++expectedChunk;
+    if (expectedChunk == h.chunks)
+    {
+        expectedSeq = h.firstSeq;
+        isSynced = true;
+        ++snapshots;
+        LOG(INFO) << "Replication: snapshot is applied, next update " << expectedSeq;
+    }
+}
+
+void Replication::applyUpdates (const uint8_t* data, size_t size, size_t skip)
+{
+    size_t offset = 0;
+    for (size_t i = 0; offset < size; ++i)
+    {
+        Update update;
+        size_t used = decode(data + offset, size - offset, update);
+        if (used == 0)
+        {
+            LOG(WARNING) << "Replication: broken update";
+            return;
+        }
+        offset += used;
+        if (i < skip)
+            continue;
+        apply(update);
+        ++updates;
+    }
+}
+
+Replication::Counters Replication::getCounters()
+{
+    Counters ret;
+    ret.updates = updates.load();
+    ret.datagrams = datagrams.load();
+    ret.bytes = bytes.load();
+    ret.gaps = gaps.load();
+    ret.snapshots = snapshots.load();
+    std::lock_guard<std::mutex> lock(pendingLock);
+    ret.peers = peers.size();
+    ret.lastSeq = role == Publisher ? nextSeq - 1 : (expectedSeq ? expectedSeq - 1 : 0);
+    return ret;
+}
+
+
+// Encoding: operation, then the IPv4 address of users (the IPv6 one after an
+// operation with IPV6_FLAG) or dpid and in_port of SPRT
+size_t Replication::updateSize (uint8_t code)
+{
+    bool isIPv6 = code & IPV6_FLAG;
+    switch ((Operations) (code & ~IPV6_FLAG))
+    {
+    case Insert:
+    case Invalidate:
+    case Validate:
+    case Block:
+    case Remove:
+    case Evict:
+    case Reset:
+        return 1 + (isIPv6 ? IPV6_SIZE : sizeof(uint32_t));
+    case PortCompromised:
+        return isIPv6 ? 0 : 1 + sizeof(Dpid) + sizeof(InPort);
+    case DDoSDetected:
+    case DDoSFinished:
+        return isIPv6 ? 0 : 1;
+    default:
+        return 0;
+    }
+}
+
+size_t Replication::encode (const Update& update, uint8_t* out)
+{
+    out[0] = update.op;
+    if (update.op == PortCompromised)
+    {
+        memcpy(out + 1, &update.dpid, sizeof(Dpid));
+        memcpy(out + 1 + sizeof(Dpid), &update.inPort, sizeof(InPort));
+    }
+    else if (updateSize(update.op) > 1 && update.ipAddr.isV4())
+    {
+        uint32_t ipv4 = update.ipAddr.getV4();
+        memcpy(out + 1, &ipv4, sizeof(ipv4));
+    }
+    else if (updateSize(update.op) > 1)
+    {
+        out[0] |= IPV6_FLAG;
+        update.ipAddr.toOctets(out + 1);
+    }
+    return updateSize(out[0]);
+}
+
+size_t Replication::decode (const uint8_t* in, size_t size, Update& update)
+{
+    update.op = (Operations) (in[0] & ~IPV6_FLAG);
+    size_t used = updateSize(in[0]);
+    if (used == 0 || used > size)
+        return 0;
+    if (update.op == PortCompromised)
+    {
+        memcpy(&update.dpid, in + 1, sizeof(Dpid));
+        memcpy(&update.inPort, in + 1 + sizeof(Dpid), sizeof(InPort));
+    }
+    else if (in[0] & IPV6_FLAG)
+    {
+        update.ipAddr = IPAddress::fromOctets(in + 1);
+    }
+    else if (used > 1)
+    {
+        uint32_t ipv4;
+        memcpy(&ipv4, in + 1, sizeof(ipv4));
+        update.ipAddr = ipv4;
+    }
+    return used;
+}
+
+uint64_t Replication::now()
+{
+    // CLOCK_MONOTONIC is shared by the processes of a machine
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Replication::Header Replication::header (Kinds kind, uint64_t firstSeq, uint16_t count, uint16_t chunk, uint16_t chunks) const
+{
+    Header h;
+    h.magic = MAGIC;
+    h.version = VERSION;
+    h.kind = kind;
+    h.count = count;
+    h.firstSeq = firstSeq;
+    h.sentTime = now();
+    h.chunk = chunk;
+    h.chunks = chunks;
+    h.epoch = publisherEpoch;
+    return h;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "UserAddress.hh"
+
+// Delta stream of users' transitions, blocks and SPRT verdicts between
+// controllers over AF_UNIX datagrams. The publisher numbers updates and
+// sends them in batches, a subscriber applies them in order and asks the
+// publisher to resume from the first missing update: the publisher resends
+// the batches from its history or a snapshot followed by deltas.
+// Datagrams are in the host byte order: peers are on the same machine.
+class Replication {
+public:
+    typedef UserAddress IPAddress;
+    typedef uint64_t Dpid;
+    typedef uint32_t InPort;
+
+    enum Roles {
+        None,
+        Publisher,
+        Subscriber
+    };
+
+    enum Operations : uint8_t {
+        Insert = 1,     // Users::Transitions
+        Invalidate,
+        Validate,
+        Block,
+        Remove,
+        Evict,
+        PortCompromised,
+        DDoSDetected,
+        DDoSFinished,
+        Reset           // Users::Transitions::Reset
+    };
+
+    struct Update {
+        Operations op;
+        IPAddress ipAddr;
+        Dpid dpid;
+        InPort inPort;
+        Update (Operations op_ = Insert, IPAddress ipAddr_ = 0, Dpid dpid_ = 0, InPort inPort_ = 0) :
+            op(op_), ipAddr(ipAddr_), dpid(dpid_), inPort(inPort_) {}
+    };
+
+    typedef std::function<void(const Update&)> ApplyFunction;
+    typedef std::function<void(std::vector<Update>&)> SnapshotFunction;
+
+    struct Counters {
+        uint64_t updates;       // published or applied
+        uint64_t datagrams;
+        uint64_t bytes;
+        uint64_t gaps;          // resume requests of a subscriber
+        uint64_t snapshots;     // sent or received
+        uint64_t peers;
+        uint64_t lastSeq;       // last published or applied update
+    };
+
+    Replication();
+    ~Replication();
+
+    bool openPublisher (const std::string& path, SnapshotFunction snapshot_);
+    bool openSubscriber (const std::string& path, const std::string& publisherPath_, ApplyFunction apply_);
+    Roles getRole() const { return role; }
+    int getFd() const { return fd; }
+
+    // publisher, any thread
+    void publish (const Update& update);
+    void flush();
+    // the socket is readable
+    void receive();
+    // subscriber: first missing update, the publisher may have been restarted
+    void resume();
+
+    Counters getCounters();
+
+    static const size_t DATAGRAM_SIZE = 8192;
+    static const size_t HISTORY_SIZE = 4096;    // datagrams
+    static const time_t FLUSH_INTERVAL = 20;    // milliseconds
+    static const time_t RESUME_INTERVAL = 5;    // seconds without datagrams
+    static const size_t SEND_RETRIES = 10000;   // of 100 us while the peer's queue is full
+
+private:
+    enum Kinds : uint8_t {
+        Delta = 1,
+        Snapshot,
+        Resume  // firstSeq: the first missing update, 0 for a snapshot
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t kind;
+        uint16_t count;     // updates
+        uint64_t firstSeq;
+        uint64_t sentTime;  // steady clock, ns
+        uint16_t chunk;     // snapshot chunks
+        uint16_t chunks;
+        uint32_t epoch;     // of the publisher, updates are renumbered after a restart
+    };
+
+    struct Batch {
+        uint64_t firstSeq;
+        uint16_t count;
+        std::vector<uint8_t> datagram;
+    };
+
+    // of a user's operation: the address is IPv6
+    static const uint8_t IPV6_FLAG = 0x80;
+    static const size_t IPV6_SIZE = 16;
+    static const size_t MAX_UPDATE_SIZE = 1 + IPV6_SIZE;
+
+    static size_t updateSize (uint8_t code);
+    static size_t encode (const Update& update, uint8_t* out);
+    static size_t decode (const uint8_t* in, size_t size, Update& update);
+    static uint64_t now();
+    Header header (Kinds kind, uint64_t firstSeq, uint16_t count, uint16_t chunk = 0, uint16_t chunks = 1) const;
+
+    bool open (const std::string& path);
+    void flushPending();    // pendingLock is held
+    // false: the peer is gone
+    bool send (const std::string& peer, const std::vector<uint8_t>& datagram, bool wait = false);
+    void sendSnapshot (const std::string& peer);
+    void handleResume (const std::string& peer, uint64_t firstSeq);
+    void handleDelta (const Header& h, const uint8_t* data, size_t size);
+    void handleSnapshot (const Header& h, const uint8_t* data, size_t size);
+    void applyUpdates (const uint8_t* data, size_t size, size_t skip);
+
+    Roles role;
+    int fd;
+    std::string path;
+
+    // publisher
+    SnapshotFunction snapshot;
+    uint32_t publisherEpoch;
+    std::mutex pendingLock;
+    uint64_t nextSeq;
+    uint64_t pendingFirstSeq;
+    uint16_t pendingCount;
+    std::vector<uint8_t> pending;
+    std::deque<Batch> history;
+    std::vector<std::string> peers;
+
+    // subscriber
+    ApplyFunction apply;
+    std::string publisherPath;
+    bool isSynced;
+    uint64_t expectedSeq;
+    uint16_t expectedChunk;
+    uint32_t epoch;
+    uint64_t lastReceiveTime;
+    uint64_t lastResumeTime;
+
+    std::atomic<uint64_t> updates;
+    std::atomic<uint64_t> datagrams;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> gaps;
+    std::atomic<uint64_t> snapshots;
+
+    static const uint32_t MAGIC = 0x50524444; // "DDRP"
+    static const uint8_t VERSION = 2;   // IPv6 users
+};
@@ -0,0 +1,146 @@
+#include "SPRTdetection.hh"
+
+template <class Policy>
+bool BasicSPRTdetection<Policy>::isDDoS() {
+    return true;
+}
+
+
+template <class Policy>
+typename BasicSPRTdetection<Policy>::InPortTypes
+BasicSPRTdetection<Policy>::isCompromisedInPort (Dpid dpid, InPort in_port, uint64_t packet_count, size_t packet_count_max)
+{
+    ImapIterator dn;
+    getDi(dpid, in_port, dn);
+    countDin(dn, packet_count, packet_count_max);
+    return checkDin(dn);
+}
+
+
+template <class Policy>
+typename BasicSPRTdetection<Policy>::InPortTypes
+BasicSPRTdetection<Policy>::updateInPort (Dpid dpid, InPort in_port, size_t samples, size_t lowSamples)
+{
+    ImapIterator dn;
+    getDi(dpid, in_port, dn);
+    countDinSamples(dn, samples, lowSamples);
+    return checkDin(dn);
+}
+
+
+template <class Policy>
+typename BasicSPRTdetection<Policy>::InPortTypes
+BasicSPRTdetection<Policy>::checkDin (ImapIterator& dn)
+{
+    double din = dn->second.din;
+    if (din <= b)
+        return InPortTypes::Uncompromised;
+    if (din >= a)
+        return InPortTypes::Compromised;
+    // else
+    return InPortTypes::Unknown;
+}
+
+
+template <class Policy>
+bool BasicSPRTdetection<Policy>::getDi (Dpid dpid, InPort i, ImapIterator& dn)
+{
+    DmapIterator di;
+    if (searchDpid(dpid, di))
+    {
+        if (searchInPort(i, di, dn))
+            return true;
+        // or insert one level (InPort)
+        insertInPort(i, di, dn);
+        return false;
+    }
+    // or insert two levels (Dpid & InPort)
+    insertDpid(dpid, di);
+    insertInPort(i, di, dn);
+    return false;
+}
+
+
+template <class Policy>
+bool BasicSPRTdetection<Policy>::searchDpid (Dpid dpid, DmapIterator& di)
+{
+    DmapIterator it = d.find(dpid);
+    if (it != d.end())
+    {
+        di = it;
+        return true;
+    }
+    return false;
+}
+
+
+template <class Policy>
+bool BasicSPRTdetection<Policy>::searchInPort (InPort i, DmapIterator di, ImapIterator& dn)
+{
+    ImapIterator it = di->second.find(i);
+    if (it != di->second.end())
+    {
+        dn = it;
+        return true;
+    }
+    return false;
+}
+
+
+template <class Policy>
+bool BasicSPRTdetection<Policy>::insertDpid (Dpid dpid, DmapIterator& di)
+{
+    Imap imap;
+    std::pair<DmapIterator, bool> ret = d.insert(std::pair<Dpid, Imap>(dpid, imap));
+    di = ret.first;
+    return ret.second;
+}
+
+
+template <class Policy>
+bool BasicSPRTdetection<Policy>::insertInPort(InPort i, DmapIterator di, ImapIterator& dn)
+{
+    Dn d0;
+    std::pair<ImapIterator, bool> ret = di->second.insert(std::pair<InPort, Dn>(i, d0));
+    dn = ret.first;
+    return ret.second;
+}
+
+template <class Policy>
+void BasicSPRTdetection<Policy>::setCompromised (Dpid dpid, InPort in_port)
+{
+    ImapIterator dn;
+    getDi(dpid, in_port, dn);
+    if (dn->second.din < a)
+        dn->second.din = a;
+}
+
+
+template <class Policy>
+void BasicSPRTdetection<Policy>::reset (Dpid dpid, InPort in_port)
+{
+    ImapIterator dn;
+    if (getDi(dpid, in_port, dn))
+        dn->second = Dn();
+}
+
+
+template <class Policy>
+std::vector<std::pair<typename BasicSPRTdetection<Policy>::Dpid, typename BasicSPRTdetection<Policy>::InPort>>
+BasicSPRTdetection<Policy>::getCompromisedInPorts()
+{
+    std::vector<std::pair<Dpid, InPort>> ret;
+    for (auto& di : d)
+    {
+        for (auto& dn : di.second)
+        {
+            if (dn.second.din >= a)
+                ret.push_back(std::make_pair(di.first, dn.first));
+        }
+    }
+    return ret;
+}
+
+template class BasicSPRTdetection<StandardPolicy>;
+template class BasicSPRTdetection<StrictPolicy>;
+template class BasicSPRTdetection<RuntimePolicy>;
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "Policy.hh"
+
+// Detection of compromised in_ports of switches using SPRT on the packet
+// numbers of removed flows
+template <class Policy>
+class BasicSPRTdetection {
+public:
+    typedef uint64_t Dpid;
+    typedef uint32_t InPort;
+
+    struct Dn {
+        size_t n;
+        double din;
+        size_t ip_count;
+        Dn (size_t n_ = 0, double din_ = 1.0, size_t ip_count_ = 0) : n(n_), din(din_), ip_count(ip_count_) {}
+    };
+    typedef std::map<InPort, Dn> Imap;
+    typedef std::map<Dpid, Imap> Dmap;
+    typedef typename Imap::iterator ImapIterator;
+    typedef typename Dmap::iterator DmapIterator;
+
+    enum InPortTypes {
+        Uncompromised,
+        Compromised,
+        Unknown
+    };
+
+    BasicSPRTdetection (): a(countA()), b(countB()),
+        lowStep(log(config.lambda1 / config.lambda0)), highStep(log((1 - config.lambda1) / (1 - config.lambda0))) {}
+    bool isDDoS();
+    InPortTypes isCompromisedInPort (Dpid dpid, InPort in_port, uint64_t packet_count, size_t packet_count_max = Policy::C_MAX);
+    // samples of a batch in a single update, lowSamples of them with packet_count <= packet_count_max,
+    // the test is checked at the end of the batch
+    InPortTypes updateInPort (Dpid dpid, InPort in_port, size_t samples, size_t lowSamples);
+    // replication
+    void setCompromised (Dpid dpid, InPort in_port);
+    // the test of the in_port starts over after a decision (repeated SPRT)
+    void reset (Dpid dpid, InPort in_port);
+    std::vector<std::pair<Dpid, InPort>> getCompromisedInPorts();
+
+    struct SPRTconfig {
+        double alpha;
+        double beta;
+        double lambda0;
+        double lambda1;
+        SPRTconfig (double alpha_ = Policy::ALPHA, double beta_ = Policy::BETA,
+                    double lambda0_ = Policy::LAMBDA_0, double lambda1_ = Policy::LAMBDA_1) :
+            alpha(alpha_), beta(beta_), lambda0(lambda0_), lambda1(lambda1_) {}
+    };
+
+
+private:
+    SPRTconfig config;
+    double a;
+    double b;
+    // of a sample: log(lambda1 / lambda0) if packet_count <= cMax, log((1 - lambda1) / (1 - lambda0)) otherwise
+    double lowStep;
+    double highStep;
+
+    Dmap d;
+
+    void countDin(ImapIterator& dn, size_t c, size_t cMax = Policy::C_MAX)
+    {
+
+        ++(dn->second.n);
+        dn->second.din += (c <= cMax) ? lowStep : highStep;
+    }
+    void countDinSamples (ImapIterator& dn, size_t samples, size_t lowSamples)
+    {
+        dn->second.n += samples;
+        dn->second.din += lowSamples * lowStep + (samples - lowSamples) * highStep;
+    }
+    double countA() { return log ((1 - config.beta) / config.alpha); }
+    double countB() { return log (config.beta / (1 - config.alpha)); }
+    InPortTypes checkDin (ImapIterator& dn);
+
+    bool getDi (Dpid dpid, InPort i, ImapIterator& dn);
+    bool searchDpid (Dpid dpid, DmapIterator& di);
+    bool searchInPort (InPort i, DmapIterator di, ImapIterator& dn);
+    bool insertDpid (Dpid dpid, DmapIterator& di);
+    bool insertInPort(InPort i, DmapIterator di, ImapIterator& dn);
+};
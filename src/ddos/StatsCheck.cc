@@ -0,0 +1,92 @@
+#include "StatsCheck.hh"
+
+bool StatsCheck::parseMode (const std::string& name, Modes& mode_)
+{
+    if (name == "flows")
+        mode_ = Flows;
+    else if (name == "aggregate")
+        mode_ = Aggregate;
+    else
+        return false;
+    return true;
+}
+
+const char* StatsCheck::modeName (Modes mode_)
+{
+    return mode_ == Aggregate ? "aggregate" : "flows";
+}
+
+void StatsCheck::flowsRequested()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    ++counters.checks;
+}
+
+void StatsCheck::flowsReplied (size_t flows, size_t bytes)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    ++counters.replies;
+    counters.replyBytes += bytes;
+    counters.flows += flows;
+}
+
+void StatsCheck::aggregateRequested (Dpid dpid, IPAddress ipAddr)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    ++counters.checks;
+    pending[dpid].push_back(Pending {ipAddr, getBucketsNumber(), 0, 0, false});
+}
+
+bool StatsCheck::aggregateReplied (Dpid dpid, uint64_t flows, uint64_t packets, size_t validPacketNumber, size_t bytes,
+                                   Result& result)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    ++counters.replies;
+    counters.replyBytes += bytes;
+    auto it = pending.find(dpid);
+    if (it == pending.end() || it->second.empty())
+        return false; // requested before the switch was removed
+    Pending& user = it->second.front();
+    user.flows += flows;
+    user.lowPacketFlows += lowPacketFlows(flows, packets, validPacketNumber);
+    if (--user.buckets > 0)
+        return false;
+
+    bool isFailed = user.isFailed;
+    result = Result {user.ipAddr, user.flows, user.lowPacketFlows};
+    it->second.pop_front();
+    if (isFailed)
+        return false;
+    counters.flows += result.flows;
+    return true;
+}
+
+void StatsCheck::aggregateFailed (Dpid dpid)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = pending.find(dpid);
+    if (it == pending.end() || it->second.empty())
+        return;
+    Pending& user = it->second.front();
+    if (!user.isFailed)
+        ++counters.failed;
+    user.isFailed = true;
+    if (--user.buckets == 0)
+        it->second.pop_front();
+}
+
+void StatsCheck::remove (Dpid dpid)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = pending.find(dpid);
+    if (it == pending.end())
+        return;
+    counters.failed += it->second.size();
+    pending.erase(it);
+}
+
+StatsCheck::Counters StatsCheck::getCounters()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return counters;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "UserAddress.hh"
+
+// Checks of a user's flows by flow stats (an entry per flow) or by aggregate
+// stats: the user's flows are split by the low bits of eth_dst into buckets,
+// one aggregate request each, so the reply size does not depend on the flows.
+// A bucket of F flows and P packets has at most P / n flows of n packets or
+// more, so at least F - P / n flows below n packets; a lone flow is exact.
+class StatsCheck {
+public:
+    typedef UserAddress IPAddress;
+    typedef uint64_t Dpid;
+
+    enum Modes : uint8_t {
+        Flows,
+        Aggregate
+    };
+
+    struct Result {
+        IPAddress ipAddr;
+        size_t flows;
+        size_t lowPacketFlows;
+    };
+
+    struct Counters {
+        uint64_t checks;
+        uint64_t replies;   // messages
+        uint64_t replyBytes;
+        uint64_t flows;     // of the checked users
+        uint64_t failed;    // aggregate checks dropped by a switch error or disconnect
+        Counters(): checks(0), replies(0), replyBytes(0), flows(0), failed(0) {}
+    };
+
+    // OpenFlow 1.3 sizes
+    static const size_t MULTIPART_REPLY_SIZE = 16;  // ofp_header and ofp_multipart_reply
+    static const size_t AGGREGATE_REPLY_SIZE = MULTIPART_REPLY_SIZE + 24;
+    // typical flow stats entry of a maple flow: 48, match 56, apply-actions 24
+    static const size_t FLOW_STATS_SIZE = 128;
+    static const size_t MAX_BUCKETS_BITS = 6; // of the last octet of eth_dst
+
+    StatsCheck(): mode(Flows), bucketsBits(4) {}
+
+    void setMode (Modes mode_) { mode = mode_; }
+    Modes getMode() const { return mode; }
+    static bool parseMode (const std::string& name, Modes& mode_);
+    static const char* modeName (Modes mode_);
+
+    void setBucketsBits (size_t bucketsBits_) { bucketsBits = bucketsBits_ < MAX_BUCKETS_BITS ? bucketsBits_ : MAX_BUCKETS_BITS; }
+    size_t getBucketsNumber() const { return (size_t) 1 << bucketsBits; }
+    // the last octet of eth_dst: eth_dst & mask == bucket
+    uint32_t getBucketMask() const { return getBucketsNumber() - 1; }
+
+    static size_t lowPacketFlows (uint64_t flows, uint64_t packets, size_t validPacketNumber)
+    {
+        uint64_t validFlowsMax = packets / (validPacketNumber > 0 ? validPacketNumber : 1);
+        return flows > validFlowsMax ? flows - validFlowsMax : 0;
+    }
+
+    // Flows: a request and the flow stats of its reply messages
+    void flowsRequested();
+    void flowsReplied (size_t flows, size_t bytes);
+
+    // Aggregate: before the requests of the user's buckets, sent to the switch in order
+    void aggregateRequested (Dpid dpid, IPAddress ipAddr);
+    // reply to the oldest request of the switch, true with the user's result after its last bucket
+    bool aggregateReplied (Dpid dpid, uint64_t flows, uint64_t packets, size_t validPacketNumber, size_t bytes,
+                           Result& result);
+    // the oldest request of the switch has failed, the user's check is dropped
+    void aggregateFailed (Dpid dpid);
+    void remove (Dpid dpid);
+
+    Counters getCounters();
+    // the flow stats replies of the same checks
+    static uint64_t flowsModeBytes (const Counters& counters)
+    {
+        return counters.checks * MULTIPART_REPLY_SIZE + counters.flows * FLOW_STATS_SIZE;
+    }
+
+private:
+    struct Pending {
+        IPAddress ipAddr;
+        size_t buckets;     // replies left
+        size_t flows;
+        size_t lowPacketFlows;
+        bool isFailed;
+    };
+
+    Modes mode;
+    size_t bucketsBits;
+
+    std::mutex lock;
+    std::map<Dpid, std::deque<Pending>> pending;
+    Counters counters;
+};
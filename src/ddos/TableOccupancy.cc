@@ -0,0 +1,84 @@
+#include "TableOccupancy.hh"
+#include "Clock.hh"
+
+#include <glog/logging.h>
+
+void TableOccupancy::update (Dpid dpid, size_t activeCount, uint64_t lookupCount, uint64_t matchedCount)
+{
+    time_t now = Clock::now();
+    std::lock_guard<std::mutex> lock(tablesLock);
+    Table& table = tables[dpid];
+    if (table.updateTime != 0 && now > table.updateTime
+            && lookupCount >= table.lookupCount && matchedCount >= table.matchedCount)
+    {
+        uint64_t lookups = lookupCount - table.lookupCount;
+        uint64_t matches = matchedCount - table.matchedCount;
+        table.lookupRate = lookups / (double) (now - table.updateTime);
+        table.matchRate = lookups != 0 ? matches / (double) lookups : 1.;
+    }
+    table.activeCount = activeCount;
+    table.lookupCount = lookupCount;
+    table.matchedCount = matchedCount;
+    table.updateTime = now;
+
+    if (level(table) != Normal)
+    {
+        LOG(WARNING) << "Flow table of switch " << dpid << " is " << activeCount << " / " << capacity
+                     << ", lookups: " << table.lookupRate << "/s, matched: " << table.matchRate;
+    }
+}
+
+void TableOccupancy::remove (Dpid dpid)
+{
+    std::lock_guard<std::mutex> lock(tablesLock);
+    tables.erase(dpid);
+}
+
+double TableOccupancy::getOccupancy (Dpid dpid)
+{
+    std::lock_guard<std::mutex> lock(tablesLock);
+    auto it = tables.find(dpid);
+    if (it == tables.end())
+        return 0.;
+    return it->second.activeCount / (double) capacity;
+}
+
+TableOccupancy::Levels TableOccupancy::getLevel (Dpid dpid)
+{
+    std::lock_guard<std::mutex> lock(tablesLock);
+    auto it = tables.find(dpid);
+    if (it == tables.end())
+        return Normal;
+    return level(it->second);
+}
+
+bool TableOccupancy::isUnderPressure()
+{
+    std::lock_guard<std::mutex> lock(tablesLock);
+    for (auto& it : tables)
+    {
+        const Table& table = it.second;
+        if (level(table) == Exhausted)
+            return true;
+        if (table.lookupRate >= MISS_STORM_LOOKUP_RATE && table.matchRate < MISS_STORM_MATCH_RATE
+                && level(table) == NearCapacity)
+            return true;
+    }
+    return false;
+}
+
+std::map<TableOccupancy::Dpid, TableOccupancy::Table> TableOccupancy::getTables()
+{
+    std::lock_guard<std::mutex> lock(tablesLock);
+    return tables;
+}
+
+TableOccupancy::Levels TableOccupancy::level (const Table& table) const
+{
+    double occupancy = table.activeCount / (double) capacity;
+    if (occupancy >= EXHAUSTED)
+        return Exhausted;
+    if (occupancy >= NEAR_CAPACITY)
+        return NearCapacity;
+    return Normal;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <mutex>
+
+// Flow table occupancy of switches from table stats (OFPMP_TABLE)
+class TableOccupancy {
+public:
+    typedef uint64_t Dpid;
+
+    enum Levels {
+        Normal,
+        NearCapacity,
+        Exhausted
+    };
+
+    struct Table {
+        size_t activeCount;
+        uint64_t lookupCount;
+        uint64_t matchedCount;
+        double lookupRate;  // lookups per second
+        double matchRate;   // part of lookups matched since the last update
+        time_t updateTime;
+        Table(): activeCount(0), lookupCount(0), matchedCount(0), lookupRate(0.), matchRate(1.), updateTime(0) { }
+    };
+
+    TableOccupancy (size_t capacity_ = CAPACITY): capacity(capacity_) { }
+    void setCapacity (size_t capacity_) { capacity = capacity_ > 0 ? capacity_ : 1; }
+
+    void update (Dpid dpid, size_t activeCount, uint64_t lookupCount, uint64_t matchedCount);
+    void remove (Dpid dpid);
+
+    double getOccupancy (Dpid dpid);
+    Levels getLevel (Dpid dpid);
+    bool isUnderPressure();
+    std::map<Dpid, Table> getTables();
+
+    static const size_t CAPACITY = 10000; // flow entries
+    static constexpr double NEAR_CAPACITY = 0.75;
+    static constexpr double EXHAUSTED = 0.95;
+    // table-miss storm: many lookups and most of them miss
+    static constexpr double MISS_STORM_LOOKUP_RATE = 1000.;
+    static constexpr double MISS_STORM_MATCH_RATE = 0.5;
+
+private:
+    Levels level (const Table& table) const;
+
+    size_t capacity;
+    std::mutex tablesLock;
+    std::map<Dpid, Table> tables;
+};
@@ -0,0 +1,78 @@
+#include "UserAddress.hh"
+
+#include <cstring>
+
+#include <arpa/inet.h>
+
+UserAddress UserAddress::fromOctets (const uint8_t* octets, bool isPrefix64)
+{
+    UserAddress addr;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        addr.hi = addr.hi << 8 | octets[i];
+        addr.lo = addr.lo << 8 | octets[8 + i];
+    }
+    if (addr.isV4())
+    {
+        // ::ffff:a.b.c.d of an IPv6 packet is the IPv4 user
+        uint32_t ipv4;
+        memcpy(&ipv4, octets + 12, sizeof(ipv4));
+        return UserAddress(ipv4);
+    }
+    if (isPrefix64)
+        addr.lo = 0;
+    return addr;
+}
+
+void UserAddress::toOctets (uint8_t* octets) const
+{
+    for (size_t i = 0; i < 8; ++i)
+    {
+        octets[i] = hi >> (56 - 8 * i);
+        octets[8 + i] = lo >> (56 - 8 * i);
+    }
+    if (isV4())
+    {
+        uint32_t ipv4 = getV4();
+        memcpy(octets + 12, &ipv4, sizeof(ipv4));
+    }
+}
+
+void UserAddress::maskOctets (uint8_t* octets) const
+{
+    for (size_t i = 0; i < 16; ++i)
+        octets[i] = i < 8 || !isPrefix64() ? 0xff : 0;
+}
+
+bool UserAddress::parse (const std::string& text, UserAddress& addr, bool isPrefix64)
+{
+    in_addr ipv4;
+    if (inet_pton(AF_INET, text.c_str(), &ipv4) == 1)
+    {
+        addr = UserAddress(ipv4.s_addr);
+        return true;
+    }
+    in6_addr ipv6;
+    if (inet_pton(AF_INET6, text.c_str(), &ipv6) == 1)
+    {
+        addr = fromOctets(ipv6.s6_addr, isPrefix64);
+        return true;
+    }
+    return false;
+}
+
+std::string UserAddress::toString() const
+{
+    char text[INET6_ADDRSTRLEN + 3];
+    if (isV4())
+    {
+        in_addr ipv4;
+        ipv4.s_addr = getV4();
+        inet_ntop(AF_INET, &ipv4, text, sizeof(text));
+        return text;
+    }
+    in6_addr ipv6;
+    toOctets(ipv6.s6_addr);
+    inet_ntop(AF_INET6, &ipv6, text, sizeof(text));
+    return isPrefix64() ? std::string(text) + "/64" : std::string(text);
+}
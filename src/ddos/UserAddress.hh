@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Key of a user: an IPv6 source, the /64 prefix of one, or an IPv4 source
+// mapped to ::ffff:a.b.c.d. Two words are compared as a number, an IPv4
+// address (in_addr.s_addr, as the app has it) converts implicitly and
+// 0.0.0.0 is :: (no user).
+struct UserAddress {
+    uint64_t hi;    // bytes 0-7 of the IPv6 address, the network order as a number
+    uint64_t lo;    // bytes 8-15
+
+    UserAddress(): hi(0), lo(0) {}
+    UserAddress (uint32_t ipv4): hi(0), lo(ipv4 != 0 ? V4_MAPPED | ipv4 : 0) {}
+    UserAddress (uint64_t hi_, uint64_t lo_): hi(hi_), lo(lo_) {}
+
+    // 16 bytes in the network order, the interface ID is cleared for a /64 user
+    static UserAddress fromOctets (const uint8_t* octets, bool isPrefix64 = false);
+    void toOctets (uint8_t* octets) const;
+    // of a /64 user: a mask of the prefix, of others: all ones
+    void maskOctets (uint8_t* octets) const;
+    // "a.b.c.d" or an IPv6 address, false if neither
+    static bool parse (const std::string& text, UserAddress& addr, bool isPrefix64 = false);
+    std::string toString() const;
+
+    bool isV4() const { return hi == 0 && (lo >> 32) == V4_MAPPED >> 32; }
+    uint32_t getV4() const { return (uint32_t) lo; }
+    // the interface ID 0 is the subnet-router anycast address, not a source
+    bool isPrefix64() const { return lo == 0 && hi != 0; }
+    bool isMulticast() const { return hi >> 56 == 0xff; }
+
+    // 32 bits for multiplicative hashes: the IPv4 address itself for an IPv4 user
+    uint32_t fold() const
+    {
+        uint64_t h = (hi ^ ((lo >> 32) ^ (V4_MAPPED >> 32))) * 0x9E3779B97F4A7C15ULL;
+        return (uint32_t) lo ^ (uint32_t) (h >> 32);
+    }
+
+    bool operator== (const UserAddress& other) const { return hi == other.hi && lo == other.lo; }
+    bool operator!= (const UserAddress& other) const { return !(*this == other); }
+    bool operator< (const UserAddress& other) const { return hi < other.hi || (hi == other.hi && lo < other.lo); }
+
+    static const uint64_t V4_MAPPED = 0xffffULL << 32;
+};
+
+namespace std {
+template <>
+struct hash<UserAddress> {
+    size_t operator() (const UserAddress& addr) const { return addr.fold(); }
+};
+}
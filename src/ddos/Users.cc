@@ -1,23 +1,25 @@
 #include "Users.hh"
 
-#include <glog/logging.h>
+#include <algorithm>
+#include <thread>
 
-Users::Statistics Users::statistics;
+#include <glog/logging.h>
 
-Users::UsersTypes
-Users::get (IPAddressV4 ipAddr,
-            std::map<IPAddressV4, ValidUsersParams>::iterator &validUser,
-            std::map<IPAddressV4, InvalidUsersParams>::iterator &invalidUser)
+template <class Policy>
+typename BasicUsers<Policy>::UsersTypes
+BasicUsers<Policy>::get (IPAddress ipAddr,
+            typename std::map<IPAddress, ValidUsersParams>::iterator &validUser,
+            typename std::map<IPAddress, InvalidUsersParams>::iterator &invalidUser)
 {
 //    LOG(INFO) << "Users::get(" << AppObject::uint32_t_ip_to_string(ipAddr) << ")";
-    std::map<IPAddressV4, ValidUsersParams>::iterator itValidUser = validUsers.find(ipAddr);
+    typename std::map<IPAddress, ValidUsersParams>::iterator itValidUser = validUsers.find(ipAddr);
     if (itValidUser != validUsers.end())
     {
         validUser = itValidUser;
         return UsersTypes::Valid;
     }
 
-    std::map<IPAddressV4, InvalidUsersParams>::iterator itInvalidUser = invalidUsers.find(ipAddr);
+    typename std::map<IPAddress, InvalidUsersParams>::iterator itInvalidUser = invalidUsers.find(ipAddr);
     if (itInvalidUser != invalidUsers.end())
     {
         invalidUser = itInvalidUser;
@@ -27,66 +29,276 @@ Users::get (IPAddressV4 ipAddr,
     return UsersTypes::Unknown;
 }
 
-void Users::insert (IPAddressV4 ipAddr)
+template <class Policy>
+void BasicUsers<Policy>::insert (IPAddress ipAddr)
 {
 //    LOG(INFO) << "Users::insert(" << AppObject::uint32_t_ip_to_string(ipAddr) << ")";
+    reserveInvalidUser();
     InvalidUsersParams invalidUsersParams;
-    invalidUsers.insert (std::pair <IPAddressV4, InvalidUsersParams> (ipAddr, invalidUsersParams));
+    auto ret = invalidUsers.insert (std::pair <IPAddress, InvalidUsersParams> (ipAddr, invalidUsersParams));
+    if (layout == Columns && ret.second)
+    {
+        ret.first->second.row = columns.insert(ipAddr, UsersColumns::DDoS);
+        ret.first->second.sync(*this);
+    }
     statistics.update(Statistics::Actions::Insert,
                       InvalidUsersParams::InvalidUsersTypes::None,
                       InvalidUsersParams::InvalidUsersTypes::DDoS);
+    notifyTransition(ipAddr, Transitions::Insert);
 }
 
-void Users::invalidate(std::map<IPAddressV4, ValidUsersParams>::iterator it)
+template <class Policy>
+void BasicUsers<Policy>::invalidate(typename std::map<IPAddress, ValidUsersParams>::iterator it)
 {    
     LOG (INFO) << "Users::invalidate()";
+    reserveInvalidUser();
     InvalidUsersParams invalidUsersParams(it->second);
-    invalidUsers.insert(std::pair <IPAddressV4, InvalidUsersParams> (it->first, invalidUsersParams));
+    IPAddress ipAddr = it->first;
+    auto ret = invalidUsers.insert(std::pair <IPAddress, InvalidUsersParams> (ipAddr, invalidUsersParams));
+    ret.first->second.row = it->second.row;
+    ret.first->second.sync(*this);
     validUsers.erase(it);
     statistics.update(Statistics::Actions::Insert,
                       InvalidUsersParams::InvalidUsersTypes::None,
                       InvalidUsersParams::InvalidUsersTypes::Malicious);
+    notifyTransition(ipAddr, Transitions::Invalidate);
 }
 
-void Users::validate(std::map<IPAddressV4, InvalidUsersParams>::iterator it)
+template <class Policy>
+void BasicUsers<Policy>::validate(typename std::map<IPAddress, InvalidUsersParams>::iterator it)
 {
     LOG (INFO) << "Users::validate()";
     ValidUsersParams validUsersParams(it->second);
-    validUsers.insert(std::pair <IPAddressV4, ValidUsersParams> (it->first, validUsersParams));
-    invalidUsers.erase(it);
+    IPAddress ipAddr = it->first;
+    auto ret = validUsers.insert(std::pair <IPAddress, ValidUsersParams> (ipAddr, validUsersParams));
+    ret.first->second.row = it->second.row;
+    ret.first->second.sync(*this);
+    it->second.row = UsersColumns::NO_ROW; // the row is moved to the valid user
+    eraseInvalidUser(it);
     statistics.update(Statistics::Actions::Insert,
                       InvalidUsersParams::InvalidUsersTypes::Malicious,
                       InvalidUsersParams::InvalidUsersTypes::None);
+    notifyTransition(ipAddr, Transitions::Validate);
+}
+
+template <class Policy>
+void BasicUsers<Policy>::apply (IPAddress ipAddr, Transitions transition)
+{
+    auto validUser = validUsers.find(ipAddr);
+    auto invalidUser = invalidUsers.find(ipAddr);
+    bool isKnown = validUser != validUsers.end() || invalidUser != invalidUsers.end();
+    switch (transition)
+    {
+    case Transitions::Insert:
+        if (!isKnown)
+            insert(ipAddr);
+        break;
+    case Transitions::Validate:
+        if (!isKnown)
+        {
+            insert(ipAddr);
+            invalidUser = invalidUsers.find(ipAddr);
+        }
+        if (invalidUser != invalidUsers.end())
+            validate(invalidUser);
+        break;
+    case Transitions::Invalidate:
+    case Transitions::Block:
+        if (!isKnown)
+            insert(ipAddr);
+        if (validUser != validUsers.end())
+            invalidate(validUser);
+        invalidUser = invalidUsers.find(ipAddr);
+        if (invalidUser == invalidUsers.end())
+            break;
+        if (invalidUser->second.type == InvalidUsersParams::DDoS)
+        {
+            invalidUser->second.type = InvalidUsersParams::Malicious;
+            invalidUser->second.sync(*this);
+        }
+        if (transition == Transitions::Block && !invalidUser->second.isBlocked())
+            invalidUser->second.block(*this);
+        break;
+    case Transitions::Remove:
+    case Transitions::Evict:
+        if (invalidUser != invalidUsers.end())
+            eraseInvalidUser(invalidUser);
+        break;
+    case Transitions::Reset:
+        if (invalidUser == invalidUsers.end())
+            break;
+        statistics.update(Statistics::Actions::Reset, invalidUser->second.type, InvalidUsersParams::DDoS);
+        invalidUser->second.reset();
+        invalidUser->second.sync(*this);
+        break;
+    }
 }
 
-void Users::update()
+template <class Policy>
+void BasicUsers<Policy>::update()
 {
-    for (auto it = invalidUsers.begin(), end = invalidUsers.end(); it != end; ++it)
+    if (layout == Columns)
+    {
+        updateColumns();
+        return;
+    }
+    for (auto it = invalidUsers.begin(); it != invalidUsers.end(); )
     {
         if ((it->second).isObsolete())
         {
-            invalidUsers.erase(it);
             statistics.update(Statistics::Actions::Remove, (it->second).getType(), InvalidUsersParams::InvalidUsersTypes::None);
+            IPAddress ipAddr = it->first;
+            it = eraseInvalidUser(it);
+            notifyTransition(ipAddr, Transitions::Remove);
+        } else {
+            ++it;
+        }
+    }
+}
+
+template <class Policy>
+typename std::map<typename BasicUsers<Policy>::IPAddress, typename BasicUsers<Policy>::InvalidUsersParams>::iterator
+BasicUsers<Policy>::eraseInvalidUser (typename std::map<IPAddress, InvalidUsersParams>::iterator it)
+{
+    if (it->second.row != UsersColumns::NO_ROW)
+        removeRow(it->second.row);
+    // keep the clock hand valid
+    bool isClockHand = (clockHand == it);
+    typename std::map<IPAddress, InvalidUsersParams>::iterator next = invalidUsers.erase(it);
+    if (isClockHand)
+        clockHand = next;
+    return next;
+}
+
+template <class Policy>
+void BasicUsers<Policy>::updateColumns()
+{
+    std::vector<IPAddress> obsolete;
+    if (columns.obsoleteUsers(Clock::now(), obsoleteMask, obsolete) == 0)
+        return;
+    for (IPAddress ipAddr : obsolete)
+    {
+        // the user may be seen again since the sweep
+        auto it = invalidUsers.find(ipAddr);
+        if (it == invalidUsers.end() || !(it->second).isObsolete())
+            continue;
+        statistics.update(Statistics::Actions::Remove, (it->second).getType(), InvalidUsersParams::InvalidUsersTypes::None);
+        eraseInvalidUser(it);
+        notifyTransition(ipAddr, Transitions::Remove);
+    }
+}
+
+template <class Policy>
+void BasicUsers<Policy>::removeRow (size_t row)
+{
+    if (!columns.remove(row))
+        return;
+    // the last row is moved to row
+    IPAddress ipAddr = columns.getIPAddr(row);
+    if (columns.getType(row) == UsersColumns::Valid)
+    {
+        auto it = validUsers.find(ipAddr);
+        if (it != validUsers.end())
+            it->second.row = row;
+    } else {
+        auto it = invalidUsers.find(ipAddr);
+        if (it != invalidUsers.end())
+            it->second.row = row;
+    }
+}
+
+template <class Policy>
+void BasicUsers<Policy>::reserveInvalidUser()
+{
+    while (!invalidUsers.empty() && invalidUsers.size() >= maxInvalidUsers)
+    {
+        evictInvalidUser();
+    }
+}
+
+template <class Policy>
+void BasicUsers<Policy>::evictInvalidUser()
+{
+    // CLOCK: referenced users get a second chance, checked Malicious users
+    // are skipped while an unprotected victim is found within two turns
+    size_t maxSteps = 2 * invalidUsers.size();
+    for (size_t step = 0; step <= maxSteps; ++step)
+    {
+        if (clockHand == invalidUsers.end())
+            clockHand = invalidUsers.begin();
+        InvalidUsersParams& userParams = clockHand->second;
+        if (step < maxSteps && userParams.isEvictionProtected())
+        {
+            ++clockHand;
+            continue;
+        }
+        if (step < maxSteps && userParams.referenced)
+        {
+            userParams.referenced = false;
+            ++clockHand;
+            continue;
         }
+        // victim
+        typename InvalidUsersParams::InvalidUsersTypes type = userParams.getType();
+        if (type == InvalidUsersParams::InvalidUsersTypes::Malicious)
+        {
+            ++evictedNumbers.malicious;
+            if (userParams.typeIsChecked())
+                statistics.decreaseCheckedNumber();
+        }
+        else
+            ++evictedNumbers.ddos;
+        statistics.update(Statistics::Actions::Evict, type, InvalidUsersParams::InvalidUsersTypes::None);
+        IPAddress ipAddr = clockHand->first;
+        clockHand = eraseInvalidUser(clockHand);
+        notifyTransition(ipAddr, Transitions::Evict);
+        return;
     }
 }
 
 
 // Users::ValidUsersParams
-void Users::ValidUsersParams::checkType (const Params& params)
+template <class Policy>
+void BasicUsers<Policy>::ValidUsersParams::checkType (Users& users, const Params& params)
 {
     // Valid --> Malicious
     if (params.isInvalidConnNumber(connCounter)
             || (int)connCounter > avgConnNumber)
     {
-        statistics.update(Statistics::Actions::ChangeType, InvalidUsersParams::None, InvalidUsersParams::Malicious);
+        users.statistics.update(Statistics::Actions::ChangeType, InvalidUsersParams::None, InvalidUsersParams::Malicious);
         throw UsersExceptionTypes::IsInvalid;
     }
 }
 
-void Users::ValidUsersParams::increaseConnCounter (const Params& params)
+template <class Policy>
+void BasicUsers<Policy>::ValidUsersParams::increaseConnCounter (Users& users, const Params& params)
+{
+    try
+    {
+        updateConnCounter(users, params);
+    }
+    catch (UsersExceptionTypes)
+    {
+        sync(users);
+        throw;
+    }
+    sync(users);
+}
+
+template <class Policy>
+void BasicUsers<Policy>::ValidUsersParams::sync (Users& users)
+{
+    if (row == UsersColumns::NO_ROW)
+        return;
+    users.columns.setType(row, UsersColumns::Valid);
+    users.columns.setTimes(row, 0, 0, UsersColumns::NEVER, UsersColumns::NEVER);
+    users.columns.setConnNumbers(row, connCounter, avgConnNumber);
+}
+
+template <class Policy>
+void BasicUsers<Policy>::ValidUsersParams::updateConnCounter (Users& users, const Params& params)
 {
-    time_t now = time(NULL);
+    time_t now = Clock::now();
     size_t numberOfIntervals = (now - updateConnCounterTime) / UPDATE_VALID_AVG_CONN_TIMER_INTERVAL;
     if (numberOfIntervals > 0)
     {
@@ -108,10 +320,11 @@ void Users::ValidUsersParams::increaseConnCounter (const Params& params)
         return;
     }
     ++connCounter;
-    checkType(params);
+    checkType(users, params);
 }
 
-void Users::ValidUsersParams::updateIsChecked (const Params& params)
+template <class Policy>
+void BasicUsers<Policy>::ValidUsersParams::updateIsChecked (Users&, const Params& params)
 {
     size_t flowsCounter = usersCheck.getFlowsCounter();
     if (params.isValidConnNumber(flowsCounter))
@@ -129,28 +342,56 @@ void Users::ValidUsersParams::updateIsChecked (const Params& params)
 
 
 // Users::InvalidUsersParams
-void Users::InvalidUsersParams::checkType(const Params& params)
+template <class Policy>
+void BasicUsers<Policy>::InvalidUsersParams::checkType (Users& users, const Params& params)
 {
     // DDoS --> Malicious
-    if (type == DDoS && connCounter >= INVALID_DDOS_AVG_CONN_NUMBER)
+    if (type == DDoS && connCounter >= Policy::INVALID_DDOS_AVG_CONN_NUMBER)
     {
         type = Malicious;
-        statistics.update(Statistics::Actions::ChangeType, DDoS, Malicious);
+        users.statistics.update(Statistics::Actions::ChangeType, DDoS, Malicious);
     }
     // Malicious --> Valid
     if (params.isValidConnNumber(connCounter))
     {
-        statistics.update(Statistics::Actions::ChangeType, Malicious, None);
+        users.statistics.update(Statistics::Actions::ChangeType, Malicious, None);
         throw UsersExceptionTypes::IsValid;
     }
 }
 
-void Users::InvalidUsersParams::increaseConnCounter (const Params& params)
+template <class Policy>
+void BasicUsers<Policy>::InvalidUsersParams::increaseConnCounter (Users& users, const Params& params)
+{
+    try
+    {
+        updateConnCounter(users, params);
+    }
+    catch (UsersExceptionTypes)
+    {
+        sync(users);
+        throw;
+    }
+    sync(users);
+}
+
+template <class Policy>
+void BasicUsers<Policy>::InvalidUsersParams::sync (Users& users)
+{
+    if (row == UsersColumns::NO_ROW)
+        return;
+    users.columns.setType(row, type == Malicious ? UsersColumns::Malicious : UsersColumns::DDoS);
+    users.columns.setTimes(row, createTime, updateTime, hardTimeout, idleTimeout);
+    users.columns.setConnNumbers(row, connCounter, 0);
+}
+
+template <class Policy>
+void BasicUsers<Policy>::InvalidUsersParams::updateConnCounter (Users& users, const Params& params)
 {
-    time_t now = time(NULL);
+    time_t now = Clock::now();
+    referenced = true;
     if (isObsolete())
     {
-        statistics.update(Statistics::Actions::Reset, type, DDoS);
+        users.statistics.update(Statistics::Actions::Reset, type, DDoS);
         reset();
         return;
     }
@@ -160,15 +401,25 @@ void Users::InvalidUsersParams::increaseConnCounter (const Params& params)
         updateTime = now;
         updateConnCounterTime = updateConnCounterTime +
                 (now - updateConnCounterTime) / UPDATE_VALID_AVG_CONN_TIMER_INTERVAL * UPDATE_VALID_AVG_CONN_TIMER_INTERVAL;
-        statistics.update(Statistics::Actions::Update, type, type);
+        users.statistics.update(Statistics::Actions::Update, type, type);
         return;
     }
     ++connCounter;
-    statistics.update(Statistics::Actions::Update, type, type);
-    checkType(params);
+    users.statistics.update(Statistics::Actions::Update, type, type);
+    checkType(users, params);
 }
 
-void Users::InvalidUsersParams::updateIsChecked (const Params& params)
+template <class Policy>
+void BasicUsers<Policy>::InvalidUsersParams::block (Users& users)
+{
+    type = Malicious;
+    usersCheck.setIsChecked(true);
+    users.statistics.increaseCheckedNumber();
+    sync(users);
+}
+
+template <class Policy>
+void BasicUsers<Policy>::InvalidUsersParams::updateIsChecked (Users& users, const Params& params)
 {
     size_t flowsCounter = usersCheck.getFlowsCounter();
 //    LOG (INFO) << flowsCounter << "\t" << params.isInvalidConnNumber(flowsCounter);
@@ -178,7 +429,7 @@ void Users::InvalidUsersParams::updateIsChecked (const Params& params)
         {
             LOG (INFO) << "Invalid malicious user is checked!";
             usersCheck.setIsChecked(true); // invalid user
-            statistics.increaseCheckedNumber();
+            users.statistics.increaseCheckedNumber();
         } else {
             throw UsersExceptionTypes::IsValid;
         }
@@ -187,38 +438,40 @@ void Users::InvalidUsersParams::updateIsChecked (const Params& params)
 
 
 // Users::Statistics
-void Users::Statistics::update(Actions action,
-                               InvalidUsersParams::InvalidUsersTypes typeBefore,
-                               InvalidUsersParams::InvalidUsersTypes typeAfter)
+template <class Policy>
+void BasicUsers<Policy>::Statistics::update(Actions action,
+                               typename InvalidUsersParams::InvalidUsersTypes typeBefore,
+                               typename InvalidUsersParams::InvalidUsersTypes typeAfter)
 {
+    time_t now = Clock::now();
     switch (typeBefore)
     {
     case InvalidUsersParams::InvalidUsersTypes::None:
         if (typeAfter == InvalidUsersParams::InvalidUsersTypes::DDoS)
         {
             // None --> DDoS
-            invalidDDoSUsersParams.updateNumbers(action);
+            invalidDDoSUsersParams.updateNumbers(action, now);
         } else {
             // None --> Malicious
-            invalidMaliciousUsersParams.updateNumbers(action);
+            invalidMaliciousUsersParams.updateNumbers(action, now);
         }
         break;
     case InvalidUsersParams::InvalidUsersTypes::DDoS:
         if (action == ChangeType)
         {
             // DDoS --> Malicious
-            ++invalidMaliciousUsersParams.number;
+            invalidMaliciousUsersParams.number.fetch_add(1, std::memory_order_relaxed);
         }
-        invalidDDoSUsersParams.updateNumbers(action);
+        invalidDDoSUsersParams.updateNumbers(action, now);
         break;
     case InvalidUsersParams::InvalidUsersTypes::Malicious:
         if (action == Reset)
         {
             // Malicious --> DDoS
-           ++invalidDDoSUsersParams.number;
+           invalidDDoSUsersParams.number.fetch_add(1, std::memory_order_relaxed);
         }
 //        else if (action == ChangeType) { Malicious --> None }
-        invalidMaliciousUsersParams.updateNumbers(action);
+        invalidMaliciousUsersParams.updateNumbers(action, now);
         break;
     default:
         LOG(ERROR) << "Invalid InvalidUsersParams::InvalidUsersTypes!";
@@ -226,46 +479,54 @@ void Users::Statistics::update(Actions action,
     }
 }
 
-bool Users::Statistics::handle()
+template <class Policy>
+bool BasicUsers<Policy>::Statistics::handle (bool isEntropyAnomalous, time_t window)
 {
+    time_t now = Clock::now();
     size_t weight = 0;
+    /* Packet-ins */
+    if (isEntropyAnomalous)
+    {
+        weight += Policy::ENTROPY_WEIGHT;
+    }
+
     /* Invalid Malicious Users Params */
-    if (invalidMaliciousUsersParams.checkedNumber >= INVALID_MALICIOUS_USERS_CHECKED_NUMBER)
+    if (invalidMaliciousUsersParams.checkedNumber.load(std::memory_order_relaxed) >= Policy::INVALID_MALICIOUS_USERS_CHECKED_NUMBER)
     {
-        weight += INVALID_MALICIOUS_USERS_CHECKED_NUMBER_WEIGHT;
+        weight += Policy::INVALID_MALICIOUS_USERS_CHECKED_NUMBER_WEIGHT;
     }
-    UsersParams::NumberOfActions invalidMaliciousUsersNumberOfChanges = invalidMaliciousUsersParams.getNumberOfChanges();
-    if (invalidMaliciousUsersNumberOfChanges.changeType >= INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE)
+    typename UsersParams::NumberOfActions invalidMaliciousUsersNumberOfChanges = invalidMaliciousUsersParams.getNumberOfChanges(now, window);
+    if (invalidMaliciousUsersNumberOfChanges.changeType >= Policy::INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE)
     {
-        weight += INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE_WEIGHT;
+        weight += Policy::INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE_WEIGHT;
     }
 
     /* Invalid DDoS Users Params */
-    size_t invalidDDoSUsersNumber = invalidDDoSUsersParams.number;
-    UsersParams::NumberOfActions invalidDDoSUsersNumberOfChanges = invalidDDoSUsersParams.getNumberOfChanges();
+    size_t invalidDDoSUsersNumber = invalidDDoSUsersParams.number.load(std::memory_order_relaxed);
+    typename UsersParams::NumberOfActions invalidDDoSUsersNumberOfChanges = invalidDDoSUsersParams.getNumberOfChanges(now, window);
     size_t invalidDDoSUsersNumberOfInsert = invalidDDoSUsersNumberOfChanges.insert;
     if (!isStable &&
-            invalidDDoSUsersNumberOfInsert / (float) invalidDDoSUsersNumber < IS_STABLE_CRITERIA)
+            invalidDDoSUsersNumberOfInsert / (float) invalidDDoSUsersNumber < Policy::IS_STABLE_CRITERIA)
     {
         isStable = true;
     }
-    if (isStable && invalidDDoSUsersParams.number >= INVALID_DDOS_USERS_NUMBER)
+    if (isStable && invalidDDoSUsersNumber >= Policy::INVALID_DDOS_USERS_NUMBER)
     {
-        weight += INVALID_DDOS_USERS_NUMBER_WEIGHT;
+        weight += Policy::INVALID_DDOS_USERS_NUMBER_WEIGHT;
     }
-    if (isStable && invalidDDoSUsersNumberOfInsert >= INVALID_DDOS_USERS_NUMBER_OF_INSERT)
+    if (isStable && invalidDDoSUsersNumberOfInsert >= Policy::INVALID_DDOS_USERS_NUMBER_OF_INSERT)
     {
-        weight += INVALID_DDOS_USERS_NUMBER_OF_INSERT_WEIGHT;
+        weight += Policy::INVALID_DDOS_USERS_NUMBER_OF_INSERT_WEIGHT;
     }
     if (isStable &&
-            invalidDDoSUsersNumberOfChanges.changeType / (float) invalidDDoSUsersNumber <= INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER)
+            invalidDDoSUsersNumberOfChanges.changeType / (float) invalidDDoSUsersNumber <= Policy::INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER)
     {
-        weight += INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER_WEIGHT;
+        weight += Policy::INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER_WEIGHT;
     }
 
 //    LOG(INFO) << weight;
 
-    if (weight >= IS_DDOS_WEIGHT)
+    if (weight >= Policy::IS_DDOS_WEIGHT)
     {
         return true;
     }
@@ -274,36 +535,86 @@ bool Users::Statistics::handle()
 
 
 // Users::Statistics::UsersParams
-void Users::Statistics::UsersParams::updateNumbers(Actions action)
+template <class Policy>
+void BasicUsers<Policy>::Statistics::UsersParams::updateNumbers (Actions action, time_t now)
 {
     switch (action)
     {
     case Reset:
-        --number;
-        ++numberOfChanges.reset;
-        break;
     case ChangeType:
-        --number;
-        ++numberOfChanges.changeType;
+    case Remove:
+    case Evict:
+        number.fetch_sub(1, std::memory_order_relaxed);
         break;
     case Insert:
-        ++number;
-        ++numberOfChanges.insert;
+        number.fetch_add(1, std::memory_order_relaxed);
         break;
     case Update:
-        ++numberOfChanges.update;
-        break;
-    case Remove:
-        --number;
-        ++numberOfChanges.remove;
         break;
     default:
         LOG(ERROR) << "Invalid Statistics::Actions!";
-        break;
+        return;
     }
+
+    time_t stamp = now / BUCKET_INTERVAL;
+    Bucket& bucket = changes[stamp % BUCKETS_NUMBER];
+    // packet-in threads and the timers write: the first writer of a new
+    // stamp takes the bucket with a CAS and clears it, the others wait
+    for (;;)
+    {
+        time_t current = bucket.stamp.load(std::memory_order_acquire);
+        if (current == stamp)
+            break;
+        if (current > stamp)
+            return; // a late writer of a reused bucket
+        if (current == Bucket::CLEARING)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (bucket.stamp.compare_exchange_weak(current, Bucket::CLEARING, std::memory_order_acq_rel))
+        {
+            // readers skip the bucket while it is cleared
+            for (auto& count : bucket.counts)
+                count.store(0, std::memory_order_relaxed);
+            bucket.stamp.store(stamp, std::memory_order_release);
+            break;
+        }
+    }
+    bucket.counts[action].fetch_add(1, std::memory_order_relaxed);
 }
 
-void Users::ValidUsersParams::print()
+template <class Policy>
+typename BasicUsers<Policy>::Statistics::UsersParams::NumberOfActions
+BasicUsers<Policy>::Statistics::UsersParams::getNumberOfChanges (time_t now, time_t window) const
+{
+    NumberOfActions ret;
+    time_t last = now / BUCKET_INTERVAL;
+    time_t first = last - std::min<time_t>((window + BUCKET_INTERVAL - 1) / BUCKET_INTERVAL, BUCKETS_NUMBER) + 1;
+    for (const Bucket& bucket : changes)
+    {
+        time_t stamp = bucket.stamp.load(std::memory_order_acquire);
+        if (stamp < first || stamp > last)
+            continue;
+        uint32_t counts[ACTIONS_NUMBER];
+        for (size_t action = 0; action < ACTIONS_NUMBER; ++action)
+            counts[action] = bucket.counts[action].load(std::memory_order_relaxed);
+        // cleared meanwhile
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (bucket.stamp.load(std::memory_order_acquire) != stamp)
+            continue;
+        ret.reset += counts[Reset];
+        ret.insert += counts[Insert];
+        ret.changeType += counts[ChangeType];
+        ret.update += counts[Update];
+        ret.remove += counts[Remove];
+        ret.evict += counts[Evict];
+    }
+    return ret;
+}
+
+template <class Policy>
+void BasicUsers<Policy>::ValidUsersParams::print()
 {
     LOG(INFO) << "IsChecked:\t" << usersCheck.isChecked;
     LOG(INFO) << "ConnCounter:\t" << connCounter;
@@ -311,9 +622,14 @@ void Users::ValidUsersParams::print()
     LOG(INFO) << "UpdateConnCounterTime:\t" << updateConnCounterTime;
 }
 
-void Users::InvalidUsersParams::print()
+template <class Policy>
+void BasicUsers<Policy>::InvalidUsersParams::print()
 {
     LOG(INFO) << "IsChecked:\t" << usersCheck.isChecked;
     LOG(INFO) << "ConnCounter:\t" << connCounter;
     LOG(INFO) << "UpdateConnCounterTime:\t" << updateConnCounterTime;
 }
+
+template class BasicUsers<StandardPolicy>;
+template class BasicUsers<StrictPolicy>;
+template class BasicUsers<RuntimePolicy>;
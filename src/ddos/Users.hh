@@ -1,19 +1,30 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <map>
+#include <vector>
+#include <functional>
 
+#include "Policy.hh"
 #include "Params.hh"
+#include "UsersColumns.hh"
+#include "Clock.hh"
+#include "VerdictCache.hh"
 
-class Users {
-    typedef uint32_t IPAddressV4;
-    friend class Params;
+template <class Policy>
+class BasicUsers {
+    typedef UserAddress IPAddress;
+    // of the policy
+    typedef BasicUsers Users;
+    typedef BasicParams<Policy> Params;
+    friend class BasicParams<Policy>;
 
 public:
     static const time_t UPDATE_VALID_AVG_CONN_TIMER_INTERVAL = 120; // seconds
     static const time_t CLEAR_INVALID_USERS_TIMER_INTERVAL = 500;   // seconds
 
-    static constexpr double INVALID_FLOW_PERCENT = 0.5;
+    static const size_t MAX_INVALID_USERS = 500000; // default cap of invalidUsers
 
     enum UsersExceptionTypes {
         IsValid,
@@ -27,6 +38,23 @@ public:
         Unknown
     };
 
+    enum Layouts {
+        Map,
+        Columns // map and UsersColumns for sweeps
+    };
+
+    // state changes of a user for replication
+    enum Transitions {
+        Insert,     // Unknown --> DDoS
+        Invalidate, // Valid --> Malicious
+        Validate,   // DDoS or Malicious --> Valid
+        Block,      // Malicious is checked
+        Remove,     // obsolete
+        Evict,      // over maxInvalidUsers
+        Reset       // obsolete Invalid is seen again --> DDoS
+    };
+    typedef std::function<void(IPAddress, Transitions)> TransitionFunction;
+
     class ValidUsersParams;
     class InvalidUsersParams;
 
@@ -35,17 +63,17 @@ public:
         friend class InvalidUsersParams;
     public:
         UsersCheck (bool _isChecked = false) : isChecked(_isChecked), recheckCounter(0), flowsCounter(0), invalidFlowsCounter(0) {}
-        void updateFlowsCounter (bool isInvalidPacketNumber)
+        void updateFlowsCounter (size_t flowsNumber, size_t invalidFlowsNumber)
         {
-            ++flowsCounter;
-            if (isInvalidPacketNumber) ++invalidFlowsCounter;
+            flowsCounter += flowsNumber;
+            invalidFlowsCounter += invalidFlowsNumber;
 //            LOG(INFO) << invalidFlowsCounter << "\t" << flowsCounter;
         }
         bool getIsChecked() { return isChecked; }
         void reset() { setIsChecked(false); }
         size_t getFlowsCounter() { return flowsCounter; }
     private:
-        bool isInvalid() { return invalidFlowsCounter / (float) flowsCounter > INVALID_FLOW_PERCENT; }
+        bool isInvalid() { return invalidFlowsCounter / (float) flowsCounter > Policy::INVALID_FLOW_PERCENT; }
         void setIsChecked (bool _isChecked = true)
         {
             isChecked = _isChecked;
@@ -60,30 +88,36 @@ public:
     class InvalidUsersParams;
 
     class ValidUsersParams {
-        friend class Params;
+        friend class BasicParams<Policy>;
     public:
         ValidUsersParams (size_t _connCounter = 1, int _avgConnNumber = NON_AVG_CONN_NUMBER):
-            usersCheck(false), connCounter(_connCounter), avgConnNumber(_avgConnNumber), updateConnCounterTime(time(NULL)) { }
+            usersCheck(false), connCounter(_connCounter), avgConnNumber(_avgConnNumber), updateConnCounterTime(Clock::now()),
+            row(UsersColumns::NO_ROW) { }
         /* todo */
         ValidUsersParams (InvalidUsersParams invalidUsersParams,
                           size_t _connCounter = 1):
-            usersCheck(true), connCounter(_connCounter), avgConnNumber(invalidUsersParams.getConnCounter()), updateConnCounterTime(time(NULL)) { }
-        void increaseConnCounter (const Params& params);
+            usersCheck(true), connCounter(_connCounter), avgConnNumber(invalidUsersParams.getConnCounter()), updateConnCounterTime(Clock::now()),
+            row(UsersColumns::NO_ROW) { }
+        void increaseConnCounter (Users& users, const Params& params);
         bool typeIsChecked() { return usersCheck.getIsChecked(); }
         size_t getConnCounter() { return connCounter; }
-        void updatePacketNumber (const Params& params, uint64_t packetNumber)
+        void updateFlowsNumber (size_t flowsNumber, size_t invalidFlowsNumber)
         {
-            usersCheck.updateFlowsCounter (params.isInvalidPacketNumber(packetNumber));
+            usersCheck.updateFlowsCounter (flowsNumber, invalidFlowsNumber);
         }
-        void updateIsChecked (const Params& params);
+        void updateIsChecked (Users& users, const Params& params);
         void print();
 
     private:
-        void checkType (const Params& params);
+        friend class BasicUsers;
+        void checkType (Users& users, const Params& params);
+        void updateConnCounter (Users& users, const Params& params);
+        void sync (Users& users);
         UsersCheck usersCheck;
         size_t connCounter;
         int avgConnNumber;
         time_t updateConnCounterTime;
+        size_t row; // in Users::columns
 
         static const int NON_AVG_CONN_NUMBER = -1;
         static const size_t RECHECK_NUMBER = 5;
@@ -97,23 +131,25 @@ public:
             None // Null or Valid
         };
         InvalidUsersParams (size_t _connCounter = 1,
-                            time_t _hardTimeout = HARD_TIMEOUT,
-                            time_t _idleTimeout = IDLE_TIMEOUT)
-            : type(DDoS), usersCheck(false), connCounter(_connCounter), hardTimeout(_hardTimeout), idleTimeout(_idleTimeout)
+                            time_t _hardTimeout = Policy::HARD_TIMEOUT,
+                            time_t _idleTimeout = Policy::IDLE_TIMEOUT)
+            : type(DDoS), usersCheck(false), connCounter(_connCounter), hardTimeout(_hardTimeout), idleTimeout(_idleTimeout),
+              referenced(true), row(UsersColumns::NO_ROW)
         {
-            createTime = updateTime = updateConnCounterTime = time(NULL);
+            createTime = updateTime = updateConnCounterTime = Clock::now();
         }
         InvalidUsersParams (ValidUsersParams validUsersParams,
-                            time_t _hardTimeout = HARD_TIMEOUT,
-                            time_t _idleTimeout = IDLE_TIMEOUT)
-            : type(Malicious), usersCheck(true), connCounter(validUsersParams.getConnCounter()), hardTimeout(_hardTimeout), idleTimeout(_idleTimeout)
+                            time_t _hardTimeout = Policy::HARD_TIMEOUT,
+                            time_t _idleTimeout = Policy::IDLE_TIMEOUT)
+            : type(Malicious), usersCheck(true), connCounter(validUsersParams.getConnCounter()), hardTimeout(_hardTimeout), idleTimeout(_idleTimeout),
+              referenced(true), row(UsersColumns::NO_ROW)
         {
-            createTime = updateTime = updateConnCounterTime = time(NULL);
+            createTime = updateTime = updateConnCounterTime = Clock::now();
         }
-        void increaseConnCounter (const Params& params);
+        void increaseConnCounter (Users& users, const Params& params);
         bool isObsolete()
         {
-            time_t now = time(NULL);
+            time_t now = Clock::now();
             if (now - updateTime >= idleTimeout || now - createTime >= hardTimeout)
                 return true;
             return false;
@@ -121,22 +157,30 @@ public:
         InvalidUsersTypes getType() { return type; }
         bool typeIsChecked() { return usersCheck.getIsChecked(); }
         size_t getConnCounter() { return connCounter; }
-        void updatePacketNumber (const Params& params, uint64_t packetNumber)
+        void updateFlowsNumber (size_t flowsNumber, size_t invalidFlowsNumber)
         {
-            usersCheck.updateFlowsCounter (params.isInvalidPacketNumber(packetNumber));
+            usersCheck.updateFlowsCounter (flowsNumber, invalidFlowsNumber);
         }
-        void updateIsChecked (const Params& params);
+        void updateIsChecked (Users& users, const Params& params);
         void print();
 
+        bool isBlocked() { return type == Malicious && usersCheck.getIsChecked(); }
+        // Blocked users are evicted last
+        bool isEvictionProtected() { return isBlocked(); }
+
     private:
-        void checkType (const Params& params);
-        void reset (time_t _hardTimeout = HARD_TIMEOUT,
-                    time_t _idleTimeout = IDLE_TIMEOUT)
+        friend class BasicUsers;
+        void checkType (Users& users, const Params& params);
+        void updateConnCounter (Users& users, const Params& params);
+        void sync (Users& users);
+        void block (Users& users);
+        void reset (time_t _hardTimeout = Policy::HARD_TIMEOUT,
+                    time_t _idleTimeout = Policy::IDLE_TIMEOUT)
         {
             connCounter = 1;
             hardTimeout = _hardTimeout;
             idleTimeout = _idleTimeout;
-            createTime = updateTime = updateConnCounterTime = time(NULL);
+            createTime = updateTime = updateConnCounterTime = Clock::now();
             type = DDoS;
             usersCheck.reset();
         }
@@ -148,9 +192,8 @@ public:
         time_t createTime;
         time_t updateTime;
         time_t updateConnCounterTime;
-        static const size_t INVALID_DDOS_AVG_CONN_NUMBER = 2;
-        static const time_t HARD_TIMEOUT = 6000;    // seconds
-        static const time_t IDLE_TIMEOUT = 600;     // seconds
+        bool referenced; // CLOCK reference bit
+        size_t row; // in Users::columns
     };
 
     class Statistics {
@@ -160,99 +203,147 @@ public:
             Insert,
             ChangeType,
             Update,
-            Remove
+            Remove,
+            Evict,
+            ACTIONS_NUMBER
         };
+        // changes are counted in a ring of buckets, handle() sums the last window
+        static const time_t BUCKET_INTERVAL = 1;    // seconds
+        static const size_t BUCKETS_NUMBER = 60;
+        static const time_t WINDOW = 30;            // seconds, thresholds of the policy are per window
+
         class UsersParams {
         public:
-            UsersParams() : number(0), checkedNumber(0), numberOfChanges() { }
-            void reset()
-            {
-                // numbers are not reset
-                numberOfChanges.clear();
-            }
-            void updateNumbers(Actions action);
-            size_t number;
-            size_t checkedNumber;
+            UsersParams() : number(0), checkedNumber(0) { }
+            void updateNumbers (Actions action, time_t now);
+            // changed by packet-in threads, read by handle()
+            std::atomic<size_t> number;
+            std::atomic<size_t> checkedNumber;
             struct NumberOfActions {
                 size_t reset;
                 size_t insert;
                 size_t changeType;
                 size_t update;
                 size_t remove;
-                NumberOfActions(): reset(0), insert(0), changeType(0), update(0), remove(0) { }
-                void clear()
+                size_t evict;
+                NumberOfActions(): reset(0), insert(0), changeType(0), update(0), remove(0), evict(0) { }
+            };
+            // of the buckets of the last window seconds up to now, any thread
+            NumberOfActions getNumberOfChanges (time_t now, time_t window = WINDOW) const;
+        private:
+            struct Bucket {
+                static const time_t UNUSED = -1;
+                static const time_t CLEARING = -2;
+                std::atomic<time_t> stamp; // now / BUCKET_INTERVAL of the counts
+                std::atomic<uint32_t> counts[ACTIONS_NUMBER];
+                Bucket(): stamp(UNUSED)
                 {
-                    reset = insert = changeType = update = remove = 0;
+                    for (auto& count : counts)
+                        count.store(0, std::memory_order_relaxed);
                 }
             };
-            NumberOfActions getNumberOfChanges()
-            {
-                return numberOfChanges;
-            }
-        private:
-             NumberOfActions numberOfChanges;
+            // a stale bucket is cleared by the first writer of its new stamp
+            Bucket changes[BUCKETS_NUMBER];
         };
-        void reset()
-        {
-            // isStable flag is not reset
-            invalidDDoSUsersParams.reset();
-            invalidMaliciousUsersParams.reset();
-        }
         void update (Actions action,
-                     InvalidUsersParams::InvalidUsersTypes typeBefore,
-                     InvalidUsersParams::InvalidUsersTypes typeAfter);
-        void increaseCheckedNumber(InvalidUsersParams::InvalidUsersTypes type = InvalidUsersParams::Malicious) {
-            ++invalidMaliciousUsersParams.checkedNumber;
+                     typename InvalidUsersParams::InvalidUsersTypes typeBefore,
+                     typename InvalidUsersParams::InvalidUsersTypes typeAfter);
+        void increaseCheckedNumber(typename InvalidUsersParams::InvalidUsersTypes type = InvalidUsersParams::Malicious) {
+            invalidMaliciousUsersParams.checkedNumber.fetch_add(1, std::memory_order_relaxed);
         }
-        void decreaseCheckedNumber(InvalidUsersParams::InvalidUsersTypes type = InvalidUsersParams::Malicious) {
-            --invalidMaliciousUsersParams.checkedNumber;
+        void decreaseCheckedNumber(typename InvalidUsersParams::InvalidUsersTypes type = InvalidUsersParams::Malicious) {
+            invalidMaliciousUsersParams.checkedNumber.fetch_sub(1, std::memory_order_relaxed);
         }
-        bool handle();
+        // rates of the last window seconds, the same for any frequency of calls
+        bool handle (bool isEntropyAnomalous = false, time_t window = WINDOW);
         Statistics(): isStable(true) { } /* false by default */
      private:
         UsersParams invalidDDoSUsersParams;
         UsersParams invalidMaliciousUsersParams;
         bool isStable;
-        static const size_t IS_DDOS_WEIGHT = 100;
+    };
 
-        static const size_t INVALID_MALICIOUS_USERS_CHECKED_NUMBER = 1;
-        static const size_t INVALID_MALICIOUS_USERS_CHECKED_NUMBER_WEIGHT = 100;
+    UsersTypes get (IPAddress,
+                typename std::map<IPAddress, ValidUsersParams>::iterator &,
+                typename std::map<IPAddress, InvalidUsersParams>::iterator &);
+    void insert (IPAddress ipAddr);
+    void invalidate (typename std::map<IPAddress, ValidUsersParams>::iterator);
+    void validate (typename std::map<IPAddress, InvalidUsersParams>::iterator);
+    void update();
+
+    // Transitions
+    void onTransition (TransitionFunction f) { transitionFunctions.push_back(f); }
+    void notifyTransition (IPAddress ipAddr, Transitions transition)
+    {
+        // cached verdicts of the user are stale, Unknown and evicted users are not
+        // looked up again before the TTL of the cache
+        if (transition != Transitions::Insert && transition != Transitions::Evict)
+            VerdictCache::invalidate(ipAddr);
+        for (auto& f : transitionFunctions)
+            f(ipAddr, transition);
+    }
+    // state of a peer, Users without handlers only
+    void apply (IPAddress ipAddr, Transitions transition);
 
-        static const size_t INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE = 5;
-        static const size_t INVALID_MALICIOUS_USERS_NUMBER_OF_CHANGE_TYPE_WEIGHT = 30;
+    Statistics& getStatistics()
+    {
+        return statistics;
+    }
 
-        static constexpr float IS_STABLE_CRITERIA = 0.2f;
+    template <class Function>
+    void forEachValidUser (Function f)
+    {
+        for (auto& it : validUsers)
+            f(it.first, it.second);
+    }
 
-        static const size_t INVALID_DDOS_USERS_NUMBER = 100;
-        static const size_t INVALID_DDOS_USERS_NUMBER_WEIGHT = 30;
+    template <class Function>
+    void forEachInvalidUser (Function f)
+    {
+        for (auto& it : invalidUsers)
+            f(it.first, it.second);
+    }
 
-        static const size_t INVALID_DDOS_USERS_NUMBER_OF_INSERT = 50;
-        static const size_t INVALID_DDOS_USERS_NUMBER_OF_INSERT_WEIGHT = 70;
+    size_t getValidUsersNumber() { return validUsers.size(); }
+    size_t getInvalidUsersNumber() { return invalidUsers.size(); }
 
-        static constexpr float INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER = 0.6f;
-        static const size_t INVALID_DDOS_USERS_NUMBER_OF_CHANGE_TYPE_NUMBER_WEIGHT = 30;
+    // Eviction of invalid users (CLOCK)
+    struct EvictedNumbers {
+        size_t ddos;
+        size_t malicious;
+        EvictedNumbers(): ddos(0), malicious(0) { }
     };
+    void setMaxInvalidUsers (size_t maxInvalidUsers_) { maxInvalidUsers = maxInvalidUsers_ > 0 ? maxInvalidUsers_ : 1; }
+    size_t getMaxInvalidUsers() { return maxInvalidUsers; }
+    EvictedNumbers getEvictedNumbers() { return evictedNumbers; }
 
-    UsersTypes get (IPAddressV4,
-                std::map<IPAddressV4, ValidUsersParams>::iterator &,
-                std::map<IPAddressV4, InvalidUsersParams>::iterator &);
-    void insert (IPAddressV4 ipAddr);
-    void invalidate (std::map<IPAddressV4, ValidUsersParams>::iterator);
-    void validate (std::map<IPAddressV4, InvalidUsersParams>::iterator);
-    void update();
+    BasicUsers(): maxInvalidUsers(MAX_INVALID_USERS), clockHand(invalidUsers.end()), layout(Map) { }
 
-    Statistics getStatistics()
-    {
-        return statistics;
-    }
-    void resetStatistics() {
-        statistics.reset();
-    }
+    // before the first user only
+    void setLayout (Layouts layout_) { layout = layout_; }
+    void setWorkerPool (WorkerPool* pool) { columns.setWorkerPool(pool); }
+    Layouts getLayout() { return layout; }
 
 private:
-    std::map<IPAddressV4, ValidUsersParams> validUsers;
+    std::map<IPAddress, ValidUsersParams> validUsers;
 //        std::mutex validUsersLock; /* todo */
-    std::map<IPAddressV4, InvalidUsersParams> invalidUsers;
+    std::map<IPAddress, InvalidUsersParams> invalidUsers;
 //        std::mutex invalidUsersLock; /* todo */
-    static Statistics statistics;
+    Statistics statistics;
+
+    typename std::map<IPAddress, InvalidUsersParams>::iterator eraseInvalidUser (typename std::map<IPAddress, InvalidUsersParams>::iterator it);
+    void reserveInvalidUser();
+    void evictInvalidUser();
+
+    size_t maxInvalidUsers;
+    typename std::map<IPAddress, InvalidUsersParams>::iterator clockHand;
+    EvictedNumbers evictedNumbers;
+
+    std::vector<TransitionFunction> transitionFunctions;
+
+    void updateColumns();
+    void removeRow (size_t row);
+    Layouts layout;
+    UsersColumns columns;
+    std::vector<uint8_t> obsoleteMask;
 };
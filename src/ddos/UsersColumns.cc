@@ -0,0 +1,167 @@
+#include "UsersColumns.hh"
+
+// Sweeps are plain loops over arrays without branches: the compiler
+// vectorizes them (see CMakeLists.txt)
+
+const int64_t UsersColumns::NEVER;
+
+size_t UsersColumns::insert (IPAddress ipAddr, Types type)
+{
+    std::lock_guard<std::mutex> lock(rowsLock);
+    ipAddrs.push_back(ipAddr);
+    types.push_back(type);
+    createTimes.push_back(0);
+    updateTimes.push_back(0);
+    hardTimeouts.push_back(NEVER);
+    idleTimeouts.push_back(NEVER);
+    connCounters.push_back(0);
+    avgConnNumbers.push_back(0);
+    return ipAddrs.size() - 1;
+}
+
+bool UsersColumns::remove (size_t row)
+{
+    std::lock_guard<std::mutex> lock(rowsLock);
+    size_t last = ipAddrs.size() - 1;
+    bool moved = row != last;
+    if (moved)
+    {
+        ipAddrs[row] = ipAddrs[last];
+        types[row] = types[last];
+        createTimes[row] = createTimes[last];
+        updateTimes[row] = updateTimes[last];
+        hardTimeouts[row] = hardTimeouts[last];
+        idleTimeouts[row] = idleTimeouts[last];
+        connCounters[row] = connCounters[last];
+        avgConnNumbers[row] = avgConnNumbers[last];
+    }
+    ipAddrs.pop_back();
+    types.pop_back();
+    createTimes.pop_back();
+    updateTimes.pop_back();
+    hardTimeouts.pop_back();
+    idleTimeouts.pop_back();
+    connCounters.pop_back();
+    avgConnNumbers.pop_back();
+    return moved;
+}
+
+size_t UsersColumns::obsoleteUsers (time_t now, std::vector<uint8_t>& mask, std::vector<IPAddress>& obsolete) const
+{
+    std::lock_guard<std::mutex> lock(rowsLock);
+    size_t n = ipAddrs.size();
+    mask.resize(n);
+    size_t ret = 0;
+    if (!isParallel())
+    {
+        ret = obsoleteMask(now, mask.data(), 0, n);
+    } else {
+        // chunk results are merged in the chunk order
+        std::vector<size_t> counts(WorkerPool::chunksNumber(n, WorkerPool::CHUNK_SIZE));
+        uint8_t* m = mask.data();
+        pool->parallelFor(n, WorkerPool::CHUNK_SIZE, [&](size_t chunk, size_t begin, size_t end)
+        {
+            counts[chunk] = obsoleteMask(now, m, begin, end);
+        });
+        for (size_t c : counts)
+            ret += c;
+    }
+
+    obsolete.clear();
+    if (ret == 0)
+        return 0;
+    obsolete.reserve(ret);
+    for (size_t row = 0; row < n; ++row)
+    {
+        if (mask[row])
+            obsolete.push_back(ipAddrs[row]);
+    }
+    return ret;
+}
+
+int64_t UsersColumns::sumAvgConnNumber (size_t& number) const
+{
+    std::lock_guard<std::mutex> lock(rowsLock);
+    size_t n = ipAddrs.size();
+    if (!isParallel())
+        return sumAvgConnNumber(number, 0, n);
+
+    size_t chunks = WorkerPool::chunksNumber(n, WorkerPool::CHUNK_SIZE);
+    std::vector<int64_t> sums(chunks);
+    std::vector<size_t> numbers(chunks);
+    pool->parallelFor(n, WorkerPool::CHUNK_SIZE, [&](size_t chunk, size_t begin, size_t end)
+    {
+        sums[chunk] = sumAvgConnNumber(numbers[chunk], begin, end);
+    });
+    int64_t sum = 0;
+    number = 0;
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+        sum += sums[chunk];
+        number += numbers[chunk];
+    }
+    return sum;
+}
+
+size_t UsersColumns::countConnCounters (size_t k, Types type) const
+{
+    std::lock_guard<std::mutex> lock(rowsLock);
+    size_t n = ipAddrs.size();
+    if (!isParallel())
+        return countConnCounters(k, type, 0, n);
+
+    std::vector<size_t> counts(WorkerPool::chunksNumber(n, WorkerPool::CHUNK_SIZE));
+    pool->parallelFor(n, WorkerPool::CHUNK_SIZE, [&](size_t chunk, size_t begin, size_t end)
+    {
+        counts[chunk] = countConnCounters(k, type, begin, end);
+    });
+    size_t ret = 0;
+    for (size_t c : counts)
+        ret += c;
+    return ret;
+}
+
+size_t UsersColumns::obsoleteMask (time_t now, uint8_t* m, size_t begin, size_t end) const
+{
+    // InvalidUsersParams::isObsolete()
+    const int64_t* create = createTimes.data();
+    const int64_t* update = updateTimes.data();
+    const int64_t* hard = hardTimeouts.data();
+    const int64_t* idle = idleTimeouts.data();
+    for (size_t i = begin; i < end; ++i)
+    {
+        m[i] = (uint8_t) ((now - update[i] >= idle[i]) | (now - create[i] >= hard[i]));
+    }
+    size_t obsolete = 0;
+    for (size_t i = begin; i < end; ++i)
+        obsolete += m[i];
+    return obsolete;
+}
+
+int64_t UsersColumns::sumAvgConnNumber (size_t& number, size_t begin, size_t end) const
+{
+    // Params::updateValidAvgConnNumber()
+    const uint8_t* t = types.data();
+    const int32_t* avg = avgConnNumbers.data();
+    int64_t sum = 0;
+    size_t valid = 0;
+    for (size_t i = begin; i < end; ++i)
+    {
+        int64_t isValid = t[i] == Valid;
+        sum += isValid * avg[i];
+        valid += isValid;
+    }
+    number = valid;
+    return sum;
+}
+
+size_t UsersColumns::countConnCounters (size_t k, Types type, size_t begin, size_t end) const
+{
+    // users of type with connCounter >= k (k1 or k2 of Params)
+    const uint8_t* t = types.data();
+    const uint32_t* conn = connCounters.data();
+    size_t ret = 0;
+    for (size_t i = begin; i < end; ++i)
+        ret += (t[i] == type) & (conn[i] >= k);
+    return ret;
+}
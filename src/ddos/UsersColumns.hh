@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <vector>
+
+#include "UserAddress.hh"
+#include "WorkerPool.hh"
+
+// Column-oriented copy of the users' state for periodic sweeps: one row
+// per user, separate arrays of timestamps, counters and type tags. Rows are
+// written by packet-in threads and swept by the timers: every access takes
+// rowsLock, a sweep holds it while its chunks run on the pool
+class UsersColumns {
+    typedef UserAddress IPAddress;
+
+public:
+    enum Types : uint8_t {
+        Valid,
+        DDoS,
+        Malicious
+    };
+
+    static const size_t NO_ROW = (size_t) -1;
+    static const int64_t NEVER = INT64_MAX / 2; // timeout of valid users
+
+    size_t insert (IPAddress ipAddr, Types type);
+    bool remove (size_t row); // true if the last row is moved to row
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(rowsLock);
+        return ipAddrs.size();
+    }
+    IPAddress getIPAddr (size_t row) const
+    {
+        std::lock_guard<std::mutex> lock(rowsLock);
+        return ipAddrs[row];
+    }
+    Types getType (size_t row) const
+    {
+        std::lock_guard<std::mutex> lock(rowsLock);
+        return (Types) types[row];
+    }
+
+    void setType (size_t row, Types type)
+    {
+        std::lock_guard<std::mutex> lock(rowsLock);
+        types[row] = type;
+    }
+    void setTimes (size_t row, time_t createTime, time_t updateTime, time_t hardTimeout, time_t idleTimeout)
+    {
+        std::lock_guard<std::mutex> lock(rowsLock);
+        createTimes[row] = createTime;
+        updateTimes[row] = updateTime;
+        hardTimeouts[row] = hardTimeout;
+        idleTimeouts[row] = idleTimeout;
+    }
+    void setConnNumbers (size_t row, size_t connCounter, int avgConnNumber)
+    {
+        std::lock_guard<std::mutex> lock(rowsLock);
+        connCounters[row] = connCounter;
+        avgConnNumbers[row] = avgConnNumber;
+    }
+
+    // Sweeps, chunks run on the pool if it is set
+    void setWorkerPool (WorkerPool* pool_) { pool = pool_; }
+    // addresses of the obsolete rows, rows are moved once the lock is released
+    size_t obsoleteUsers (time_t now, std::vector<uint8_t>& mask, std::vector<IPAddress>& obsolete) const;
+    int64_t sumAvgConnNumber (size_t& number) const;
+    size_t countConnCounters (size_t k, Types type) const;
+
+    UsersColumns(): pool(nullptr) {}
+
+private:
+    size_t obsoleteMask (time_t now, uint8_t* mask, size_t begin, size_t end) const;
+    int64_t sumAvgConnNumber (size_t& number, size_t begin, size_t end) const;
+    size_t countConnCounters (size_t k, Types type, size_t begin, size_t end) const;
+    // rowsLock is held
+    bool isParallel() const { return pool != nullptr && ipAddrs.size() > WorkerPool::CHUNK_SIZE; }
+
+    WorkerPool* pool;
+    mutable std::mutex rowsLock;
+    std::vector<IPAddress> ipAddrs;
+    std::vector<uint8_t> types;
+    std::vector<int64_t> createTimes;
+    std::vector<int64_t> updateTimes;
+    std::vector<int64_t> hardTimeouts;
+    std::vector<int64_t> idleTimeouts;
+    std::vector<uint32_t> connCounters;
+    std::vector<int32_t> avgConnNumbers;
+};
@@ -0,0 +1,44 @@
+#include "VerdictCache.hh"
+
+std::atomic<bool> VerdictCache::enabled(false);
+std::atomic<uint64_t> VerdictCache::epoch(0);
+std::atomic<uint64_t> VerdictCache::stripes[STRIPES_NUMBER];
+std::mutex VerdictCache::cachesLock;
+std::vector<VerdictCache::Cache*> VerdictCache::caches;
+
+VerdictCache::Cache::Cache(): entries(ENTRIES_NUMBER), sweepTime(0), hits(0), misses(0), flushes(0), flushedConns(0)
+{
+    for (Entry& entry : entries)
+    {
+        entry.ipAddr = 0;
+        entry.users = nullptr;
+        entry.pendingConns = 0;
+    }
+}
+
+VerdictCache::Cache& VerdictCache::local()
+{
+    // caches live as long as the process: RUNOS threads are not recycled
+    static thread_local Cache* cache = nullptr;
+    if (cache == nullptr)
+    {
+        cache = new Cache;
+        std::lock_guard<std::mutex> lock(cachesLock);
+        caches.push_back(cache);
+    }
+    return *cache;
+}
+
+VerdictCache::Counters VerdictCache::getCounters()
+{
+    Counters ret;
+    std::lock_guard<std::mutex> lock(cachesLock);
+    for (Cache* cache : caches)
+    {
+        ret.hits += cache->hits.load(std::memory_order_relaxed);
+        ret.misses += cache->misses.load(std::memory_order_relaxed);
+        ret.flushes += cache->flushes.load(std::memory_order_relaxed);
+        ret.flushedConns += cache->flushedConns.load(std::memory_order_relaxed);
+    }
+    return ret;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <vector>
+
+#include "UserAddress.hh"
+#include "Policy.hh"
+
+// Per-thread direct-mapped cache of the verdicts of repeat packet-ins by
+// source: a hit skips the users' maps, its connection is counted later
+// in a batch. An entry is stale when the global epoch (DDoS flips) or the
+// epoch of the source's stripe (its transitions) is bumped, or after TTL.
+// The batches go into the users of the entry from its thread: the users
+// are to be owned by that thread (the switch partitions of the app).
+class VerdictCache {
+    typedef UserAddress IPAddress;
+
+public:
+    struct Entry {
+        IPAddress ipAddr;     // 0: empty
+        IPAddress dstIPAddr;  // of the last miss
+        Users* users;           // of the switch partition
+        const Params* params;
+        uint64_t epoch;
+        uint64_t stripeEpoch;
+        time_t time;
+        uint8_t verdict;        // Classifier::Verdicts
+        bool isVictimShort;     // short timeouts toward an attacked destination
+        bool isVictim;          // dstIPAddr is attacked
+        uint32_t pendingConns;  // hits not counted in users
+    };
+
+    struct Counters {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t flushes;
+        uint64_t flushedConns;
+        Counters(): hits(0), misses(0), flushes(0), flushedConns(0) {}
+    };
+
+    static const size_t ENTRIES_BITS = 12;
+    static const size_t ENTRIES_NUMBER = 1 << ENTRIES_BITS; // per thread
+    static const size_t STRIPES_BITS = 12;
+    static const size_t STRIPES_NUMBER = 1 << STRIPES_BITS;
+    static const time_t TTL = 1;                    // seconds
+    static const uint32_t FLUSH_CONNS_NUMBER = 8;   // pending connections of an entry
+
+    static void setEnabled (bool enabled_) { enabled.store(enabled_, std::memory_order_relaxed); }
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // invalidation, any thread
+    static void invalidate() { epoch.fetch_add(1, std::memory_order_release); }
+    static void invalidate (IPAddress ipAddr) { stripes[stripe(ipAddr)].fetch_add(1, std::memory_order_release); }
+    static uint64_t getEpoch() { return epoch.load(std::memory_order_acquire); }
+    static uint64_t getStripeEpoch (IPAddress ipAddr) { return stripes[stripe(ipAddr)].load(std::memory_order_acquire); }
+
+    // the cache of the calling thread
+    class Cache {
+    public:
+        Entry& slot (IPAddress ipAddr) { return entries[hash(ipAddr) & (ENTRIES_NUMBER - 1)]; }
+        bool isHit (const Entry& entry, const Users& users, IPAddress ipAddr, time_t now) const
+        {
+            return entry.ipAddr == ipAddr && entry.users == &users && now - entry.time < TTL
+                    && entry.epoch == getEpoch() && entry.stripeEpoch == getStripeEpoch(ipAddr);
+        }
+
+        // entries with pending connections older than TTL, once per TTL
+        template <class Function>
+        void sweep (time_t now, Function flush)
+        {
+            if (now - sweepTime < TTL)
+                return;
+            sweepTime = now;
+            for (Entry& entry : entries)
+            {
+                if (entry.pendingConns > 0 && now - entry.time >= TTL)
+                    flush(entry);
+            }
+        }
+
+        // the owner thread while it uses the cache, sweepAll() from a timer
+        std::mutex lock;
+
+        void hit() { increase(hits); }
+        void miss() { increase(misses); }
+        void flushed (uint32_t conns) { increase(flushes); increase(flushedConns, conns); }
+
+    private:
+        friend class VerdictCache;
+        Cache();
+        static void increase (std::atomic<uint64_t>& counter, uint64_t value = 1)
+        {
+            // writers hold the lock of the cache
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        std::vector<Entry> entries;
+        time_t sweepTime;
+        std::atomic<uint64_t> hits;
+        std::atomic<uint64_t> misses;
+        std::atomic<uint64_t> flushes;
+        std::atomic<uint64_t> flushedConns;
+    };
+    static Cache& local();
+
+    // stale entries of the caches of every thread, a thread without
+    // packet-ins does not sweep its own: flush takes the pending connections
+    // to the owner of the users and zeroes them
+    template <class Function>
+    static void sweepAll (time_t now, Function flush)
+    {
+        std::lock_guard<std::mutex> guard(cachesLock);
+        for (Cache* cache : caches)
+        {
+            std::lock_guard<std::mutex> cacheGuard(cache->lock);
+            cache->sweep(now, [&](Entry& entry)
+            {
+                cache->flushed(entry.pendingConns);
+                flush(entry);
+            });
+        }
+    }
+
+    // sums of the threads
+    static Counters getCounters();
+
+private:
+    static uint32_t hash (IPAddress ipAddr) { return ipAddr.fold() * 2654435761u >> (32 - ENTRIES_BITS); }
+    static size_t stripe (IPAddress ipAddr) { return (ipAddr.fold() * 2246822519u) >> (32 - STRIPES_BITS); }
+
+    static std::atomic<bool> enabled;
+    static std::atomic<uint64_t> epoch;
+    static std::atomic<uint64_t> stripes[STRIPES_NUMBER];
+
+    static std::mutex cachesLock;
+    static std::vector<Cache*> caches;
+};
@@ -0,0 +1,118 @@
+#include "WorkerPool.hh"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool (size_t threadsNumber): pending(0), stopped(false)
+{
+    for (size_t i = 0; i <= threadsNumber; ++i)
+        queues.emplace_back(new Queue);
+    for (size_t i = 0; i < threadsNumber; ++i)
+        threads.emplace_back(&WorkerPool::work, this, i);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(wakeLock);
+        stopped = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : threads)
+        t.join();
+}
+
+size_t WorkerPool::parallelFor (size_t n, size_t chunkSize, ChunkFunction f)
+{
+    size_t chunks = chunksNumber(n, chunkSize);
+    if (chunks == 0)
+        return 0;
+
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->f = f;
+    job->remaining.store(chunks);
+    pending += chunks; // before the tasks are visible
+
+    // round-robin over all queues
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+        Task task;
+        task.job = job;
+        task.chunk = chunk;
+        task.begin = chunk * chunkSize;
+        task.end = std::min(n, task.begin + chunkSize);
+        Queue& queue = *queues[chunk % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.lock);
+        queue.tasks.push_back(task);
+    }
+    {
+        std::lock_guard<std::mutex> lock(wakeLock);
+    }
+    wake.notify_all();
+
+    // help
+    size_t self = queues.size() - 1;
+    Task task;
+    while (job->remaining.load() != 0 && pop(self, task))
+        run(task);
+
+    std::unique_lock<std::mutex> lock(job->doneLock);
+    job->done.wait(lock, [&job] { return job->remaining.load() == 0; });
+    return chunks;
+}
+
+void WorkerPool::work (size_t self)
+{
+    Task task;
+    for (;;)
+    {
+        if (pop(self, task))
+        {
+            run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wakeLock);
+        wake.wait(lock, [this] { return stopped || pending.load() != 0; });
+        if (stopped)
+            return;
+    }
+}
+
+bool WorkerPool::pop (size_t self, Task& task)
+{
+    {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.lock);
+        if (!own.tasks.empty())
+        {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            --pending;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i)
+    {
+        Queue& victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.lock);
+        if (!victim.tasks.empty())
+        {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            --pending;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkerPool::run (Task& task)
+{
+    task.job->f(task.chunk, task.begin, task.end);
+    std::shared_ptr<Job> job = task.job;
+    task.job.reset();
+    if (--job->remaining == 0)
+    {
+        std::lock_guard<std::mutex> lock(job->doneLock);
+        job->done.notify_all();
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small work-stealing pool for maintenance sweeps: every worker pops
+// chunks from the back of its own queue and steals from the front of
+// the others, the calling thread helps until its chunks are done
+class WorkerPool {
+public:
+    typedef std::function<void (size_t chunk, size_t begin, size_t end)> ChunkFunction;
+
+    explicit WorkerPool (size_t threadsNumber);
+    ~WorkerPool();
+
+    // f for every chunk of [0, n), returns the number of chunks
+    size_t parallelFor (size_t n, size_t chunkSize, ChunkFunction f);
+    size_t size() const { return threads.size() + 1; }
+
+    static size_t chunksNumber (size_t n, size_t chunkSize) { return (n + chunkSize - 1) / chunkSize; }
+
+    static const size_t CHUNK_SIZE = 1 << 16; // rows
+
+private:
+    struct Job {
+        ChunkFunction f;
+        std::atomic<size_t> remaining;
+        std::mutex doneLock;
+        std::condition_variable done;
+    };
+
+    struct Task {
+        std::shared_ptr<Job> job;
+        size_t chunk;
+        size_t begin;
+        size_t end;
+    };
+
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    void work (size_t self);
+    bool pop (size_t self, Task& task);
+    void run (Task& task);
+
+    std::vector<std::unique_ptr<Queue>> queues; // the last one is the caller's
+    std::vector<std::thread> threads;
+    std::mutex wakeLock;
+    std::condition_variable wake;
+    std::atomic<size_t> pending;
+    bool stopped;
+};
@@ -0,0 +1,280 @@
+// Benchmark of the users' keys (UserAddress.hh): the same synthetic packet-ins
+// are classified with IPv4 sources, IPv6 sources and their /64 prefixes. A
+// packet-in is handled as by the app: the key is made of the packet's address,
+// then entropy, top sources and Classifier::processMiss; every few packet-ins
+// a flow of the source is removed for its user's check, virtual time.
+//
+//   ddos-address-bench [options]
+//     --users N            sources (100000)
+//     --attackers-percent P  sources with single-packet flows (10)
+//     --packet-ins N       packet-ins (5000000)
+//     --rate N             packet-ins per second of the virtual time (2000)
+//     --flows-per-check N  packet-ins per removed flow (8)
+//     --verdict-cache      verdicts of repeat sources are cached (VerdictCache)
+//     --repeat N           runs of every key, the fastest is reported (3)
+
+#include "../Classifier.hh"
+#include "../Clock.hh"
+#include "../Entropy.hh"
+#include "../FanIn.hh"
+#include "../HeavyHitters.hh"
+#include "../Params.hh"
+#include "../UserAddress.hh"
+#include "../Users.hh"
+#include "../VerdictCache.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+
+#include <glog/logging.h>
+
+namespace {
+
+enum Keys {
+    IPv4,
+    IPv6,
+    IPv6Prefix64,
+    KEYS_NUMBER
+};
+
+const char* keyName (Keys key)
+{
+    static const char* names[] = {"ipv4", "ipv6", "ipv6 /64"};
+    return names[key];
+}
+
+struct Options {
+    size_t users;
+    size_t attackersPercent;
+    size_t packetIns;
+    size_t rate;
+    size_t flowsPerCheck;
+    bool isVerdictCache;
+    size_t repeat;
+    Options(): users(100000), attackersPercent(10), packetIns(5000000), rate(2000), flowsPerCheck(8),
+               isVerdictCache(false), repeat(3) {}
+};
+
+struct Result {
+    double seconds;
+    size_t validUsers;
+    size_t invalidUsers;
+    size_t blockedUsers;
+    size_t drops;       // Block verdicts
+};
+
+const time_t START_TIME = 1000000;
+const time_t DETECT_DDOS_INTERVAL = 30;         // seconds, as the app
+const size_t DESTINATIONS_NUMBER = 256;
+const size_t HOSTS_PER_PREFIX = 4;              // addresses of a /64 in the IPv6 sources
+
+// the same sequence for every key
+uint64_t next (uint64_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+bool isAttacker (const Options& options, size_t source)
+{
+    return source % 100 < options.attackersPercent;
+}
+
+// addresses of packets: IPv4 in_addr.s_addr or IPv6 octets, as the handler reads them
+struct Addresses {
+    std::vector<uint32_t> ipv4;
+    std::vector<uint8_t> ipv6; // 16 bytes each
+};
+
+Addresses makeAddresses (size_t number, uint64_t seed)
+{
+    Addresses ret;
+    ret.ipv4.resize(number);
+    ret.ipv6.resize(number * 16);
+    uint64_t state = seed;
+    for (size_t i = 0; i < number; ++i)
+    {
+        // 10.0.0.0/8 and 2001:db8::/32, HOSTS_PER_PREFIX sources share a /64
+        ret.ipv4[i] = htonl(0x0a000000 | (uint32_t) (i + 1));
+        uint8_t* octets = &ret.ipv6[i * 16];
+        uint64_t prefix = 0x20010db800000000ULL | (i / HOSTS_PER_PREFIX + 1);
+        uint64_t iid = next(state) | 1;
+        for (size_t b = 0; b < 8; ++b)
+        {
+            octets[b] = prefix >> (56 - 8 * b);
+            octets[8 + b] = iid >> (56 - 8 * b);
+        }
+    }
+    return ret;
+}
+
+UserAddress makeKey (Keys key, const Addresses& addresses, size_t i)
+{
+    if (key == IPv4)
+        return addresses.ipv4[i];
+    return UserAddress::fromOctets(&addresses.ipv6[i * 16], key == IPv6Prefix64);
+}
+
+Result runOnce (const Options& options, Keys key, const Addresses& sources, const Addresses& destinations)
+{
+    Users users;
+    Params params;
+    params.init();
+    Entropy entropy;
+    FanIn fanIn;
+    HeavyHitters packetInHitters;
+    Classifier classifier(fanIn, packetInHitters);
+    size_t validPacketNumber = params.getValidPacketNumber().cur;
+
+    Result result = Result();
+    uint64_t state = 88172645463325252ull;
+    time_t now = START_TIME;
+    time_t updateValidAvgConnTime = now;
+    time_t clearInvalidUsersTime = now;
+    time_t detectDDoSTime = now;
+    Clock::setVirtualTime(now);
+    VerdictCache::invalidate();
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < options.packetIns; ++i)
+    {
+        if (i % options.rate == 0 && i > 0)
+        {
+            Clock::setVirtualTime(++now);
+            if (now - updateValidAvgConnTime >= Users::UPDATE_VALID_AVG_CONN_TIMER_INTERVAL)
+            {
+                params.updateValidAvgConnNumber(users);
+                updateValidAvgConnTime = now;
+            }
+            if (now - clearInvalidUsersTime >= Users::CLEAR_INVALID_USERS_TIMER_INTERVAL)
+            {
+                users.update();
+                clearInvalidUsersTime = now;
+            }
+            if (now - detectDDoSTime >= DETECT_DDOS_INTERVAL)
+            {
+                classifier.setDDoS(users.getStatistics().handle(entropy.evaluate()));
+                detectDDoSTime = now;
+            }
+        }
+
+        uint64_t r = next(state);
+        size_t source = r % options.users;
+        UserAddress ipAddr = makeKey(key, sources, source);
+        UserAddress dstIPAddr = makeKey(key == IPv4 ? IPv4 : IPv6, destinations, (r >> 32) % DESTINATIONS_NUMBER);
+        entropy.update(ipAddr, dstIPAddr);
+        packetInHitters.update(ipAddr);
+        Classifier::Verdict verdict = classifier.processMiss(users, params, ipAddr, dstIPAddr);
+        if (verdict.verdict == Classifier::Block)
+        {
+            ++result.drops;
+            continue;
+        }
+
+        if (i % options.flowsPerCheck != 0 && !verdict.isTypeChanged)
+            continue;
+        // a flow of the source is removed: 1 packet of an attacker, 1-10 of others
+        uint64_t packets = isAttacker(options, source) ? 1 : 1 + (r >> 16) % 10;
+        try
+        {
+            Classifier::checkUser(users, params, ipAddr, 1, packets < validPacketNumber);
+        }
+        catch (Users::UsersExceptionTypes)
+        {
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.validUsers = users.getValidUsersNumber();
+    result.invalidUsers = users.getInvalidUsersNumber();
+    users.forEachInvalidUser([&](const UserAddress&, Users::InvalidUsersParams& userParams)
+    {
+        result.blockedUsers += userParams.isBlocked();
+    });
+    Clock::setVirtualTime(0);
+    return result;
+}
+
+// runs are deterministic but for the time
+Result run (const Options& options, Keys key, const Addresses& sources, const Addresses& destinations)
+{
+    Result result = runOnce(options, key, sources, destinations);
+    for (size_t i = 1; i < options.repeat; ++i)
+        result.seconds = std::min(result.seconds, runOnce(options, key, sources, destinations).seconds);
+    return result;
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: ddos-address-bench [--users N] [--attackers-percent P] [--packet-ins N] [--rate N]\n"
+                    "                          [--flows-per-check N] [--verdict-cache] [--repeat N]\n");
+    exit(2);
+}
+
+bool parse (int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--users" && hasValue)
+            options.users = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--attackers-percent" && hasValue)
+            options.attackersPercent = std::min(100ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--packet-ins" && hasValue)
+            options.packetIns = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--rate" && hasValue)
+            options.rate = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--flows-per-check" && hasValue)
+            options.flowsPerCheck = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--verdict-cache")
+            options.isVerdictCache = true;
+        else if (arg == "--repeat" && hasValue)
+            options.repeat = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else
+            return false;
+    }
+    return true;
+}
+
+}
+
+int main (int argc, char** argv)
+{
+    Options options;
+    if (!parse(argc, argv, options))
+        usage();
+
+    google::InitGoogleLogging(argv[0]);
+    // the classifier logs its verdicts, fan-in the attacked destinations
+    FLAGS_minloglevel = google::ERROR;
+    VerdictCache::setEnabled(options.isVerdictCache);
+
+    Addresses sources = makeAddresses(options.users, 0x9E3779B97F4A7C15ull);
+    Addresses destinations = makeAddresses(DESTINATIONS_NUMBER, 0xBF58476D1CE4E5B9ull);
+
+    printf("%zu users (%zu%% attackers), %zu packet-ins, %zu per second, a check per %zu packet-ins%s\n"
+           "UserAddress: %zu bytes\n\n",
+           options.users, options.attackersPercent, options.packetIns, options.rate, options.flowsPerCheck,
+           options.isVerdictCache ? ", verdict cache" : "", sizeof(UserAddress));
+    printf("key        ns/packet-in  x ipv4  valid     invalid   blocked   drops\n");
+    double ipv4Seconds = 0;
+    for (size_t k = 0; k < KEYS_NUMBER; ++k)
+    {
+        Result result = run(options, (Keys) k, sources, destinations);
+        if (k == IPv4)
+            ipv4Seconds = result.seconds;
+        printf("%-10s %-13.1f %-7.2f %-9zu %-9zu %-9zu %zu\n", keyName((Keys) k),
+               result.seconds * 1e9 / std::max<size_t>(options.packetIns, 1), result.seconds / ipv4Seconds,
+               result.validUsers, result.invalidUsers, result.blockedUsers, result.drops);
+    }
+    return 0;
+}
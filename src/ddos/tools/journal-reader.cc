@@ -0,0 +1,308 @@
+// Offline reader of the ddos protection journal: filters the records of
+// the segments and prints or aggregates them.
+//
+//   ddos-journal-reader [options] <journal dir | segment files>
+//     --type NAME      keep records of the type (repeated), see JournalFormat::typeName
+//     --ip ADDR        keep records of the user, A.B.C.D or an IPv6 address
+//     --dpid N         keep records of the switch
+//     --from T --to T  keep records in [from, to), seconds since the epoch
+//     --count          records by type
+//     --top N          top N users by records
+//     --timeline S     records by type in buckets of S seconds
+//     --print          print the records (default without an aggregation)
+
+#include "../JournalFormat.hh"
+#include "../UserAddress.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace JournalFormat;
+
+namespace {
+
+struct Filter {
+    uint32_t types;     // bit per type, 0: all
+    bool hasIPAddr;
+    UserAddress ipAddr;
+    bool hasDpid;
+    uint64_t dpid;
+    uint64_t from;      // ns
+    uint64_t to;
+    Filter(): types(0), hasIPAddr(false), hasDpid(false), dpid(0), from(0), to(UINT64_MAX) {}
+
+    bool match (const Record& r) const
+    {
+        if (types != 0 && !(types & (1u << r.type)))
+            return false;
+        if (hasIPAddr && (r.ipAddrHi != ipAddr.hi || r.ipAddrLo != ipAddr.lo))
+            return false;
+        if (hasDpid && r.dpid != dpid)
+            return false;
+        return r.time >= from && r.time < to;
+    }
+};
+
+struct Aggregates {
+    uint64_t counts[TYPES_NUMBER];
+    std::unordered_map<UserAddress, uint64_t> users;
+    std::map<uint64_t, std::vector<uint64_t>> timeline;
+    Aggregates(): counts() {}
+};
+
+struct Options {
+    Filter filter;
+    bool print;
+    bool count;
+    size_t top;
+    uint64_t bucket;    // ns
+    std::vector<std::string> paths;
+    Options(): print(false), count(false), top(0), bucket(0) {}
+};
+
+std::string timeToString (uint64_t ns)
+{
+    time_t seconds = ns / 1000000000;
+    tm t;
+    gmtime_r(&seconds, &t);
+    char buffer[64];
+    size_t n = strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &t);
+    snprintf(buffer + n, sizeof(buffer) - n, ".%09lluZ", (unsigned long long) (ns % 1000000000));
+    return buffer;
+}
+
+int typeByName (const char* name)
+{
+    for (int type = Empty + 1; type < TYPES_NUMBER; ++type)
+    {
+        if (strcmp(typeName(type), name) == 0)
+            return type;
+    }
+    return -1;
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: ddos-journal-reader [--type NAME]... [--ip ADDR] [--dpid N] [--from T] [--to T]\n"
+                    "                           [--count] [--top N] [--timeline S] [--print] <dir | segments>\n");
+    exit(2);
+}
+
+bool parse (int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--type" && hasValue)
+        {
+            int type = typeByName(argv[++i]);
+            if (type < 0)
+            {
+                fprintf(stderr, "unknown type: %s\n", argv[i]);
+                return false;
+            }
+            options.filter.types |= 1u << type;
+        }
+        else if (arg == "--ip" && hasValue)
+        {
+            if (!UserAddress::parse(argv[++i], options.filter.ipAddr))
+            {
+                fprintf(stderr, "bad address: %s\n", argv[i]);
+                return false;
+            }
+            options.filter.hasIPAddr = true;
+        }
+        else if (arg == "--dpid" && hasValue)
+        {
+            options.filter.hasDpid = true;
+            options.filter.dpid = strtoull(argv[++i], nullptr, 0);
+        }
+        else if (arg == "--from" && hasValue)
+            options.filter.from = strtoull(argv[++i], nullptr, 10) * 1000000000ull;
+        else if (arg == "--to" && hasValue)
+            options.filter.to = strtoull(argv[++i], nullptr, 10) * 1000000000ull;
+        else if (arg == "--count")
+            options.count = true;
+        else if (arg == "--top" && hasValue)
+            options.top = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--timeline" && hasValue)
+            options.bucket = strtoull(argv[++i], nullptr, 10) * 1000000000ull;
+        else if (arg == "--print")
+            options.print = true;
+        else if (!arg.empty() && arg[0] == '-')
+            return false;
+        else
+            options.paths.push_back(arg);
+    }
+    if (!options.count && options.top == 0 && options.bucket == 0)
+        options.print = true;
+    return !options.paths.empty();
+}
+
+// segments of a directory in the order of writing
+std::vector<std::string> segments (const std::vector<std::string>& paths)
+{
+    std::vector<std::string> ret;
+    for (const std::string& path : paths)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            std::vector<std::pair<unsigned long long, std::string>> found;
+            if (DIR* d = opendir(path.c_str()))
+            {
+                while (dirent* entry = readdir(d))
+                {
+                    unsigned long long index;
+                    if (sscanf(entry->d_name, "journal-%llu.bin", &index) == 1)
+                        found.push_back(std::make_pair(index, segmentName(path, index)));
+                }
+                closedir(d);
+            }
+            std::sort(found.begin(), found.end());
+            for (auto& f : found)
+                ret.push_back(f.second);
+        } else {
+            ret.push_back(path);
+        }
+    }
+    return ret;
+}
+
+// records scanned
+uint64_t read (const std::string& name, const Options& options, Aggregates& aggregates)
+{
+    int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        fprintf(stderr, "%s: %s\n", name.c_str(), strerror(errno));
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(SegmentHeader))
+    {
+        close(fd);
+        return 0;
+    }
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: %s\n", name.c_str(), strerror(errno));
+        return 0;
+    }
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+    const SegmentHeader& header = *static_cast<const SegmentHeader*>(base);
+    if (header.magic != MAGIC || header.version != VERSION || header.recordSize != sizeof(Record))
+    {
+        if (header.magic == MAGIC)
+            fprintf(stderr, "%s: journal version %u, the reader has %u\n", name.c_str(), header.version, VERSION);
+        else
+            fprintf(stderr, "%s: not a journal segment\n", name.c_str());
+        munmap(base, st.st_size);
+        return 0;
+    }
+    // a segment of a crashed controller is not cut: empty records are skipped
+    uint64_t recordsNumber = std::min<uint64_t>(header.recordsNumber, (st.st_size - sizeof(SegmentHeader)) / sizeof(Record));
+    const Record* records = reinterpret_cast<const Record*>(static_cast<const uint8_t*>(base) + sizeof(SegmentHeader));
+
+    for (uint64_t i = 0; i < recordsNumber; ++i)
+    {
+        const Record& r = records[i];
+        if (r.type == Empty || r.type >= TYPES_NUMBER || !options.filter.match(r))
+            continue;
+        ++aggregates.counts[r.type];
+        UserAddress ipAddr(r.ipAddrHi, r.ipAddrLo);
+        if (options.top != 0 && ipAddr != 0)
+            ++aggregates.users[ipAddr];
+        if (options.bucket != 0)
+        {
+            std::vector<uint64_t>& bucket = aggregates.timeline[r.time / options.bucket];
+            if (bucket.empty())
+                bucket.resize(TYPES_NUMBER);
+            ++bucket[r.type];
+        }
+        if (options.print)
+        {
+            if (r.type == PortCompromised)
+                printf("%s %s dpid=%llu in_port=%u\n", timeToString(r.time).c_str(), typeName(r.type),
+                       (unsigned long long) r.dpid, r.inPort);
+            else if (ipAddr != 0)
+                printf("%s %s %s\n", timeToString(r.time).c_str(), typeName(r.type), ipAddr.toString().c_str());
+            else
+                printf("%s %s\n", timeToString(r.time).c_str(), typeName(r.type));
+        }
+    }
+    munmap(base, st.st_size);
+    return recordsNumber;
+}
+
+}
+
+int main (int argc, char** argv)
+{
+    Options options;
+    if (!parse(argc, argv, options))
+        usage();
+
+    auto start = std::chrono::steady_clock::now();
+    Aggregates aggregates;
+    uint64_t scanned = 0;
+    std::vector<std::string> names = segments(options.paths);
+    for (const std::string& name : names)
+        scanned += read(name, options, aggregates);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (options.count)
+    {
+        for (int type = Empty + 1; type < TYPES_NUMBER; ++type)
+            printf("%-18s %llu\n", typeName(type), (unsigned long long) aggregates.counts[type]);
+    }
+    if (options.top != 0)
+    {
+        std::vector<std::pair<uint64_t, UserAddress>> users;
+        users.reserve(aggregates.users.size());
+        for (auto& u : aggregates.users)
+            users.push_back(std::make_pair(u.second, u.first));
+        size_t k = std::min(options.top, users.size());
+        std::partial_sort(users.begin(), users.begin() + k, users.end(),
+                          [](const std::pair<uint64_t, UserAddress>& a, const std::pair<uint64_t, UserAddress>& b)
+                          { return a.first > b.first; });
+        for (size_t i = 0; i < k; ++i)
+            printf("%-40s %llu\n", users[i].second.toString().c_str(), (unsigned long long) users[i].first);
+    }
+    if (options.bucket != 0)
+    {
+        printf("%-32s", "time");
+        for (int type = Empty + 1; type < TYPES_NUMBER; ++type)
+            printf(" %s", typeName(type));
+        printf("\n");
+        for (auto& b : aggregates.timeline)
+        {
+            printf("%-32s", timeToString(b.first * options.bucket).c_str());
+            for (int type = Empty + 1; type < TYPES_NUMBER; ++type)
+                printf(" %llu", (unsigned long long) b.second[type]);
+            printf("\n");
+        }
+    }
+    fprintf(stderr, "%zu segments, %llu records in %.3f s (%.1f M records/s)\n", names.size(),
+            (unsigned long long) scanned, seconds, seconds > 0 ? scanned / seconds / 1e6 : 0.);
+    return 0;
+}
@@ -0,0 +1,184 @@
+// Benchmark of the non-IP packet-in tracker (L2Flood.hh) under virtual time:
+// hosts on the in_ports of a switch send ARP at a low rate, an attack is
+// added on its own in_port. Reports the cost of a packet-in and the verdicts
+// of the hosts and of the attack.
+//
+//   ddos-l2-flood-bench [options]
+//     --hosts N            hosts (2000)
+//     --in-ports N         in_ports of the hosts (48)
+//     --host-rate N        packet-ins per second of all hosts (500)
+//     --attack-rate N      packet-ins per second of the attack (5000)
+//     --seconds N          virtual time (120)
+//     --mac-rate N         L2Flood macRate (20)
+//     --port-rate N        L2Flood portRate (200)
+
+#include "../Clock.hh"
+#include "../L2Flood.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <glog/logging.h>
+
+namespace {
+
+enum Attacks {
+    None,
+    ArpStorm,   // a single MAC
+    RandomMacs, // a new MAC per packet-in
+    ATTACKS_NUMBER
+};
+
+const char* attackName (Attacks attack)
+{
+    static const char* names[] = {"none", "arp storm", "random MACs"};
+    return names[attack];
+}
+
+struct Options {
+    size_t hosts;
+    size_t inPorts;
+    size_t hostRate;
+    size_t attackRate;
+    size_t seconds;
+    size_t macRate;
+    size_t portRate;
+    Options(): hosts(2000), inPorts(48), hostRate(500), attackRate(5000), seconds(120),
+               macRate(L2Flood::MAC_RATE), portRate(L2Flood::PORT_RATE) {}
+};
+
+struct Counts {
+    size_t packetIns;
+    size_t verdicts[L2Flood::Verdicts::DropPort + 1];
+    Counts(): packetIns(0), verdicts() {}
+    size_t dropped() const { return packetIns - verdicts[L2Flood::Verdicts::Forward]; }
+};
+
+struct Result {
+    double seconds;
+    Counts hosts;
+    Counts attack;
+    L2Flood::Counters counters;
+    size_t blockedPorts;
+};
+
+const time_t START_TIME = 1000000;
+const L2Flood::Dpid DPID = 1;
+
+uint64_t next (uint64_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+Result run (const Options& options, Attacks attack)
+{
+    L2Flood l2Flood(options.macRate, options.portRate);
+    Result result = Result();
+    uint64_t state = 88172645463325252ull;
+    L2Flood::InPort attackInPort = options.inPorts + 1;
+    size_t rate = options.hostRate + (attack != None ? options.attackRate : 0);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t second = 0; second < options.seconds; ++second)
+    {
+        Clock::setVirtualTime(START_TIME + second);
+        for (size_t i = 0; i < rate; ++i)
+        {
+            uint64_t r = next(state);
+            // the attack is interleaved with the hosts
+            bool isAttack = attack != None && r % rate < options.attackRate;
+            L2Flood::Verdicts verdict;
+            if (isAttack)
+            {
+                L2Flood::MacAddress mac = attack == ArpStorm ? 0x02aaaaaaaaaaULL : (r >> 16) | 0x020000000000ULL;
+                verdict = l2Flood.update(DPID, attackInPort, mac & 0xffffffffffffULL);
+                ++result.attack.packetIns;
+                ++result.attack.verdicts[verdict];
+            }
+            else
+            {
+                size_t host = (r >> 8) % options.hosts;
+                verdict = l2Flood.update(DPID, 1 + host % options.inPorts, 0x001122000000ULL + host);
+                ++result.hosts.packetIns;
+                ++result.hosts.verdicts[verdict];
+            }
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.counters = l2Flood.getCounters();
+    result.blockedPorts = l2Flood.getBlockedPorts().size();
+    Clock::setVirtualTime(0);
+    return result;
+}
+
+void print (Attacks attack, const Result& result)
+{
+    size_t packetIns = result.hosts.packetIns + result.attack.packetIns;
+    printf("%-12s %-13.1f %-10zu %-10zu %-10zu %-10zu %-10zu %-11zu %zu\n", attackName(attack),
+           result.seconds * 1e9 / std::max<size_t>(packetIns, 1), packetIns,
+           result.hosts.dropped(), result.attack.dropped(),
+           result.attack.verdicts[L2Flood::Verdicts::DropMac],
+           result.attack.verdicts[L2Flood::Verdicts::LimitPort],
+           result.attack.verdicts[L2Flood::Verdicts::DropPort],
+           result.counters.compromisedPorts);
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: ddos-l2-flood-bench [--hosts N] [--in-ports N] [--host-rate N] [--attack-rate N]\n"
+                    "                           [--seconds N] [--mac-rate N] [--port-rate N]\n");
+    exit(2);
+}
+
+bool parse (int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--hosts" && hasValue)
+            options.hosts = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--in-ports" && hasValue)
+            options.inPorts = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--host-rate" && hasValue)
+            options.hostRate = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--attack-rate" && hasValue)
+            options.attackRate = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--seconds" && hasValue)
+            options.seconds = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--mac-rate" && hasValue)
+            options.macRate = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--port-rate" && hasValue)
+            options.portRate = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else
+            return false;
+    }
+    return true;
+}
+
+}
+
+int main (int argc, char** argv)
+{
+    Options options;
+    if (!parse(argc, argv, options))
+        usage();
+
+    google::InitGoogleLogging(argv[0]);
+    // compromised in_ports are logged
+    FLAGS_minloglevel = google::ERROR;
+
+    printf("%zu hosts on %zu in_ports, %zu packet-ins per second, attack %zu per second, %zu s\n\n",
+           options.hosts, options.inPorts, options.hostRate, options.attackRate, options.seconds);
+    printf("attack       ns/packet-in  packet-ins hosts     attack    drop-mac   limit-port drop-port   compromised\n");
+    printf("                                      dropped   dropped\n");
+    for (size_t a = 0; a < ATTACKS_NUMBER; ++a)
+        print((Attacks) a, run(options, (Attacks) a));
+    return 0;
+}
@@ -0,0 +1,334 @@
+// Benchmark of the detection policies (Policy.hh): the same synthetic load
+// runs through Users, Params and SPRTdetection of every policy under virtual
+// time. Connections of sources are packet-ins (blocked users are dropped by
+// the switch), every few connections a flow of the source is removed for its
+// user's check and a SPRT sample of its in_port, a type change is followed by
+// a check of the user's flows, the timers of the app are fired by the virtual time.
+//
+//   ddos-policy-bench [options]
+//     --users N            sources (100000)
+//     --attackers-percent P  sources with single-packet flows and more connections (10)
+//     --connections N      packet-ins (5000000)
+//     --rate N             packet-ins per second of the virtual time (2000)
+//     --flows-per-check N  connections per removed flow (8)
+//     --in-ports N         in_ports of the sources (48)
+//     --runtime-profile P  profile of the runtime policy (standard)
+//     --repeat N           runs of every policy, the fastest is reported (3)
+
+#include "../Clock.hh"
+#include "../Params.hh"
+#include "../Policy.hh"
+#include "../SPRTdetection.hh"
+#include "../UserAddress.hh"
+#include "../Users.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace {
+
+typedef UserAddress IPAddress;
+
+struct Options {
+    size_t users;
+    size_t attackersPercent;
+    size_t connections;
+    size_t rate;
+    size_t flowsPerCheck;
+    size_t inPorts;
+    std::string runtimeProfile;
+    size_t repeat;
+    Options(): users(100000), attackersPercent(10), connections(5000000), rate(2000), flowsPerCheck(8),
+               inPorts(48), runtimeProfile(StandardPolicy::name()), repeat(3) {}
+};
+
+struct Result {
+    double seconds;
+    double sprtSeconds;
+    size_t sprtSamples;
+    size_t typeChanges;     // of connections
+    size_t droppedConnections; // of blocked users
+    size_t validUsers;
+    size_t invalidUsers;
+    size_t blockedUsers;
+    size_t blockedAttackers;
+    size_t compromisedInPorts;
+    size_t ddosChecks;      // positive Statistics::handle
+};
+
+const time_t START_TIME = 1000000;
+const time_t DETECT_DDOS_INTERVAL = 30;         // seconds, as the app
+const size_t SPRT_DPID = 1;
+
+const size_t CHECK_FLOWS = 8;                   // of flow stats after a type change
+
+// the same sequence for every policy
+uint64_t next (uint64_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+bool isAttacker (const Options& options, size_t source)
+{
+    return source % 100 < options.attackersPercent;
+}
+
+// attackers have half of the connections
+size_t pickSource (const Options& options, uint64_t& state)
+{
+    uint64_t r = next(state);
+    size_t attackers = options.users * options.attackersPercent / 100;
+    if (attackers > 0 && (r & 1))
+    {
+        size_t i = (r >> 1) % attackers;
+        return i / options.attackersPercent * 100 + i % options.attackersPercent;
+    }
+    return (r >> 1) % options.users;
+}
+
+template <class Policy>
+void checkUser (BasicUsers<Policy>& users, const BasicParams<Policy>& params, IPAddress ipAddr,
+                size_t flows, size_t invalidFlows)
+{
+    typedef BasicUsers<Policy> Users;
+    typename std::map<IPAddress, typename Users::ValidUsersParams>::iterator validUser;
+    typename std::map<IPAddress, typename Users::InvalidUsersParams>::iterator invalidUser;
+    switch (users.get(ipAddr, validUser, invalidUser))
+    {
+    case Users::UsersTypes::Invalid:
+        try
+        {
+            invalidUser->second.updateFlowsNumber(flows, invalidFlows);
+            invalidUser->second.updateIsChecked(users, params);
+        }
+        catch (typename Users::UsersExceptionTypes)
+        {
+            users.validate(invalidUser);
+        }
+        break;
+    case Users::UsersTypes::Valid:
+        try
+        {
+            validUser->second.updateFlowsNumber(flows, invalidFlows);
+            validUser->second.updateIsChecked(users, params);
+        }
+        catch (typename Users::UsersExceptionTypes)
+        {
+            users.invalidate(validUser);
+        }
+        break;
+    case Users::UsersTypes::Unknown:
+        break;
+    }
+}
+
+template <class Policy>
+Result runOnce (const Options& options)
+{
+    typedef BasicUsers<Policy> Users;
+    Users users;
+    BasicParams<Policy> params;
+    BasicSPRTdetection<Policy> detection;
+    params.init();
+    size_t validPacketNumber = params.getValidPacketNumber().cur;
+
+    Result result = Result();
+    uint64_t state = 88172645463325252ull;
+    time_t now = START_TIME;
+    time_t updateValidAvgConnTime = now;
+    time_t clearInvalidUsersTime = now;
+    time_t detectDDoSTime = now;
+    Clock::setVirtualTime(now);
+
+    std::vector<std::pair<uint32_t, uint64_t>> samples; // in_port, packets
+    samples.reserve(options.connections / options.flowsPerCheck + 1);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < options.connections; ++i)
+    {
+        if (i % options.rate == 0 && i > 0)
+        {
+            Clock::setVirtualTime(++now);
+            if (now - updateValidAvgConnTime >= Users::UPDATE_VALID_AVG_CONN_TIMER_INTERVAL)
+            {
+                params.updateValidAvgConnNumber(users);
+                updateValidAvgConnTime = now;
+            }
+            if (now - clearInvalidUsersTime >= Users::CLEAR_INVALID_USERS_TIMER_INTERVAL)
+            {
+                users.update();
+                clearInvalidUsersTime = now;
+            }
+            if (now - detectDDoSTime >= DETECT_DDOS_INTERVAL)
+            {
+                auto& statistics = users.getStatistics();
+                result.ddosChecks += statistics.handle(false);
+                detectDDoSTime = now;
+            }
+        }
+
+        size_t source = pickSource(options, state);
+        IPAddress ipAddr = (uint32_t) (source + 1);
+        typename std::map<IPAddress, typename Users::ValidUsersParams>::iterator validUser;
+        typename std::map<IPAddress, typename Users::InvalidUsersParams>::iterator invalidUser;
+        bool isTypeChanged = false;
+        switch (users.get(ipAddr, validUser, invalidUser))
+        {
+        case Users::UsersTypes::Valid:
+            try
+            {
+                validUser->second.increaseConnCounter(users, params);
+            }
+            catch (typename Users::UsersExceptionTypes)
+            {
+                isTypeChanged = true;
+            }
+            break;
+        case Users::UsersTypes::Invalid:
+            // dropped by the switch
+            if (invalidUser->second.isBlocked())
+            {
+                ++result.droppedConnections;
+                continue;
+            }
+            try
+            {
+                invalidUser->second.increaseConnCounter(users, params);
+            }
+            catch (typename Users::UsersExceptionTypes)
+            {
+                isTypeChanged = true;
+            }
+            break;
+        case Users::UsersTypes::Unknown:
+            users.insert(ipAddr);
+            break;
+        }
+        // flows of the user are checked as by the stats reply
+        if (isTypeChanged)
+        {
+            ++result.typeChanges;
+            checkUser(users, params, ipAddr, CHECK_FLOWS, isAttacker(options, source) ? CHECK_FLOWS : CHECK_FLOWS / 4);
+        }
+
+        if (i % options.flowsPerCheck != 0)
+            continue;
+        // a flow of the source is removed: 1 packet of an attacker, 1-10 of others
+        uint64_t packets = isAttacker(options, source) ? 1 : 1 + next(state) % 10;
+        checkUser(users, params, ipAddr, 1, packets < validPacketNumber);
+        samples.push_back(std::make_pair(source % options.inPorts, packets));
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (auto& sample : samples)
+        detection.isCompromisedInPort(SPRT_DPID, sample.first, sample.second, validPacketNumber);
+    result.sprtSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.sprtSamples = samples.size();
+    result.compromisedInPorts = detection.getCompromisedInPorts().size();
+
+    result.validUsers = users.getValidUsersNumber();
+    result.invalidUsers = users.getInvalidUsersNumber();
+    users.forEachInvalidUser([&](const IPAddress& ipAddr, typename Users::InvalidUsersParams& userParams)
+    {
+        if (!userParams.isBlocked())
+            return;
+        ++result.blockedUsers;
+        result.blockedAttackers += isAttacker(options, ipAddr.getV4() - 1);
+    });
+    Clock::setVirtualTime(0);
+    return result;
+}
+
+// runs are deterministic but for the time
+template <class Policy>
+Result run (const Options& options)
+{
+    Result result = runOnce<Policy>(options);
+    for (size_t i = 1; i < options.repeat; ++i)
+    {
+        Result next = runOnce<Policy>(options);
+        result.seconds = std::min(result.seconds, next.seconds);
+        result.sprtSeconds = std::min(result.sprtSeconds, next.sprtSeconds);
+    }
+    return result;
+}
+
+void print (const char* name, const Options& options, const Result& result)
+{
+    printf("%-18s %-10.1f %-10.1f %-9zu %-9zu %-9zu %-9zu %-9zu %-11zu %-11zu %zu\n", name,
+           result.seconds * 1e9 / options.connections,
+           result.sprtSamples ? result.sprtSeconds * 1e9 / result.sprtSamples : 0.,
+           result.droppedConnections, result.typeChanges, result.validUsers, result.invalidUsers, result.blockedUsers, result.blockedAttackers,
+           result.compromisedInPorts, result.ddosChecks);
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: ddos-policy-bench [--users N] [--attackers-percent P] [--connections N] [--rate N]\n"
+                    "                         [--flows-per-check N] [--in-ports N] [--runtime-profile P] [--repeat N]\n");
+    exit(2);
+}
+
+bool parse (int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--users" && hasValue)
+            options.users = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--attackers-percent" && hasValue)
+            options.attackersPercent = std::min(100ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--connections" && hasValue)
+            options.connections = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--rate" && hasValue)
+            options.rate = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--flows-per-check" && hasValue)
+            options.flowsPerCheck = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--in-ports" && hasValue)
+            options.inPorts = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--runtime-profile" && hasValue)
+            options.runtimeProfile = argv[++i];
+        else if (arg == "--repeat" && hasValue)
+            options.repeat = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else
+            return false;
+    }
+    return true;
+}
+
+}
+
+int main (int argc, char** argv)
+{
+    Options options;
+    if (!parse(argc, argv, options))
+        usage();
+    if (!RuntimePolicy::load(options.runtimeProfile))
+    {
+        fprintf(stderr, "unknown profile: %s\n", options.runtimeProfile.c_str());
+        return 2;
+    }
+
+    google::InitGoogleLogging(argv[0]);
+    // users log their checks
+    FLAGS_minloglevel = google::WARNING;
+
+    printf("%zu users (%zu%% attackers), %zu connections, %zu per second, a check per %zu connections\n\n",
+           options.users, options.attackersPercent, options.connections, options.rate, options.flowsPerCheck);
+    printf("policy             ns/conn    ns/sample  dropped   changes   valid     invalid   blocked   attackers   compromised ddos\n");
+    print(StandardPolicy::name(), options, run<StandardPolicy>(options));
+    print(StrictPolicy::name(), options, run<StrictPolicy>(options));
+    std::string runtimeName = std::string(RuntimePolicy::name()) + " (" + RuntimePolicy::getProfile() + ")";
+    print(runtimeName.c_str(), options, run<RuntimePolicy>(options));
+    return 0;
+}
@@ -0,0 +1,876 @@
+// Offline replay of a pcap capture through the classification pipeline of
+// the ddos protection under virtual time: the first packet of a flow is a
+// packet-in for Classifier::processMiss, an expired flow is a flow-removed
+// with its packet number for SPRT and the user's check, timers of the app
+// are fired by the capture's time. The capture is read at full speed.
+//
+//   ddos-replay [options] <capture.pcap>
+//     --in-ports N         sources are spread over N in_ports of one switch (1)
+//     --attackers A.B.C.D/N  attacking sources for the detection report (repeated)
+//     --interval S         timeline row every S seconds of the capture (10)
+//     --users-layout L     map or columns
+//     --max-invalid-users N
+//     --flow-table N       flow table capacity of the switch
+//     --verdict-cache      verdicts of repeat sources are cached (VerdictCache)
+//     --stats-check M      users' checks by flows or aggregate stats (StatsCheck)
+//     --stats-check-buckets-bits N  aggregate requests per check are 2^N (4)
+//     --flow-removed-queue N  capacity of the queue of flow-removed batches
+//     --policy P           thresholds of a profile, a DDOS_POLICY=runtime build only (Policy.hh)
+//     --verbose            logs of the classifier
+
+#include "../Classifier.hh"
+#include "../Clock.hh"
+#include "../Entropy.hh"
+#include "../FanIn.hh"
+#include "../FlowRemovedQueue.hh"
+#include "../HeavyHitters.hh"
+#include "../Metrics.hh"
+#include "../Params.hh"
+#include "../Policy.hh"
+#include "../SPRTdetection.hh"
+#include "../StatsCheck.hh"
+#include "../TableOccupancy.hh"
+#include "../Users.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+namespace {
+
+typedef uint32_t IPAddressV4;
+typedef SPRTdetection::Dpid Dpid;
+typedef SPRTdetection::InPort InPort;
+
+// pcap file format
+const uint32_t PCAP_MAGIC = 0xa1b2c3d4;
+const uint32_t PCAP_MAGIC_NS = 0xa1b23c4d;
+const uint32_t LINKTYPE_ETHERNET = 1;
+const uint32_t LINKTYPE_RAW = 101;
+const uint32_t LINKTYPE_LINUX_SLL = 113;
+const uint32_t LINKTYPE_IPV4 = 228;
+
+struct PcapHeader {
+    uint32_t magic;
+    uint16_t versionMajor;
+    uint16_t versionMinor;
+    int32_t thisZone;
+    uint32_t sigFigs;
+    uint32_t snapLen;
+    uint32_t linkType;
+};
+struct PcapRecord {
+    uint32_t sec;
+    uint32_t subSec;
+    uint32_t inclLen;
+    uint32_t origLen;
+};
+
+// timeouts of DecisionHandler and intervals of the app's timers, seconds
+const time_t NORMAL_IDLE_TIMEOUT = 60;
+const time_t NORMAL_HARD_TIMEOUT = 30 * 60;
+const time_t SHORT_IDLE_TIMEOUT = 10;
+const time_t SHORT_HARD_TIMEOUT = 5 * 60;
+const time_t TIGHT_IDLE_TIMEOUT = 2;
+const time_t TIGHT_HARD_TIMEOUT = 60;
+const time_t DROP_HARD_TIMEOUT = 60;
+const time_t ENTROPY_TIMER_INTERVAL = 2;
+const time_t TABLE_STATS_TIMER_INTERVAL = 10;
+
+const Dpid DPID = 1;
+const uint64_t MAX_DDOS_EVENTS = 20; // flips of the DDoS state in the events
+
+struct Options {
+    size_t inPorts;
+    std::vector<std::pair<IPAddressV4, IPAddressV4>> attackers; // network, mask (host byte order)
+    time_t interval;
+    bool columns;
+    size_t maxInvalidUsers;
+    size_t flowTable;
+    bool verdictCache;
+    StatsCheck::Modes statsCheckMode;
+    size_t statsCheckBucketsBits;
+    size_t flowRemovedQueue;
+    bool verbose;
+    std::string policy;
+    std::string capture;
+    Options(): inPorts(1), interval(10), columns(false), maxInvalidUsers(Users::MAX_INVALID_USERS),
+               flowTable(TableOccupancy::CAPACITY), verdictCache(false), statsCheckMode(StatsCheck::Modes::Flows),
+               statsCheckBucketsBits(4), flowRemovedQueue(FlowRemovedQueue::CAPACITY), verbose(false) {}
+};
+
+struct Flow {
+    IPAddressV4 src;
+    InPort inPort;
+    uint64_t packets;
+    time_t createTime;
+    time_t lastTime;
+    time_t idleTimeout; // 0: none
+    time_t hardTimeout;
+};
+
+struct Row {
+    time_t time;
+    uint64_t packets;
+    uint64_t packetIns;
+    uint64_t flowRemoved;
+    size_t flows;
+    size_t validUsers;
+    size_t invalidUsers;
+    bool isDDoS;
+};
+
+struct Event {
+    time_t time;
+    std::string what;
+};
+
+// The switch and the app of the replay
+class Replay {
+public:
+    Replay (const Options& options_)
+        : options(options_), classifier(fanIn, packetInHitters), tableOccupancy(options_.flowTable),
+          startTime(0), now(0), lookups(0), matched(0),
+          packets(0), packetIns(0), flowRemovedNumber(0), usersChecks(0), unknownUsers(0),
+          flowStatsBytes(0), aggregateStatsBytes(0), lowPacketFlows(0), estimatedLowPacketFlows(0), verdicts(),
+          lastRow(), ddosFlips(0), firstAttackTime(0), firstAttackerBlockTime(0)
+    {
+        users.setMaxInvalidUsers(options.maxInvalidUsers);
+        VerdictCache::setEnabled(options.verdictCache);
+        statsCheck.setMode(options.statsCheckMode);
+        statsCheck.setBucketsBits(options.statsCheckBucketsBits);
+        flowRemovedQueue.setCapacity(options.flowRemovedQueue);
+        if (options.columns)
+            users.setLayout(Users::Layouts::Columns);
+        params.init();
+    }
+
+    void packet (time_t time, IPAddressV4 src, IPAddressV4 dst);
+    void finish();
+    void report (double seconds);
+
+private:
+    void advance (time_t time);
+    void expire();
+    void removeFlow (std::unordered_map<uint64_t, Flow>::iterator it);
+    void flowRemoved (const Flow& flow);
+    void processFlowRemoved (bool isFull);
+    void usersStatistics (IPAddressV4 ipAddr);
+    void detectDDoS();
+    void setDDoS (bool value);
+    void mitigate();
+    void addRow();
+    bool isAttacker (IPAddressV4 ipAddr) const;
+    InPort inPort (IPAddressV4 src) const { return 1 + (src * 2654435761u >> 16) % options.inPorts; }
+    static uint64_t key (IPAddressV4 src, IPAddressV4 dst) { return (uint64_t) src << 32 | dst; }
+    static std::string ipToString (IPAddressV4 ipAddr);
+
+    Options options;
+
+    Users users;
+    Params params;
+    FanIn fanIn;
+    HeavyHitters packetInHitters;
+    Classifier classifier;
+    SPRTdetection detection;
+    Entropy entropy;
+    TableOccupancy tableOccupancy;
+    StatsCheck statsCheck;
+    FlowRemovedQueue flowRemovedQueue;
+
+    std::unordered_map<uint64_t, Flow> flows;
+    std::unordered_map<IPAddressV4, std::vector<uint64_t>> sourceFlows;
+    time_t startTime;
+    time_t now;
+    time_t nextExpire;
+    time_t nextUpdateValidAvgConn;
+    time_t nextClearInvalidUsers;
+    time_t nextEntropy;
+    time_t nextTableStats;
+    time_t nextRow;
+    uint64_t lookups;
+    uint64_t matched;
+
+    uint64_t packets;
+    uint64_t packetIns;
+    uint64_t flowRemovedNumber;
+    uint64_t usersChecks;
+    uint64_t unknownUsers;
+    // replies of the users' checks in both modes
+    uint64_t flowStatsBytes;
+    uint64_t aggregateStatsBytes;
+    uint64_t lowPacketFlows;
+    uint64_t estimatedLowPacketFlows;
+    uint64_t verdicts[Classifier::Verdicts::VERDICTS_NUMBER];
+    Row lastRow;
+    std::vector<Row> rows;
+    std::vector<Event> events;
+
+    // detection report
+    std::unordered_set<IPAddressV4> sources;
+    std::unordered_set<IPAddressV4> blocked;
+    std::unordered_set<InPort> compromisedInPorts;
+    uint64_t ddosFlips;
+    time_t firstAttackTime;
+    time_t firstAttackerBlockTime;
+};
+
+std::string Replay::ipToString (IPAddressV4 ipAddr)
+{
+    char buffer[INET_ADDRSTRLEN];
+    in_addr addr;
+    addr.s_addr = ipAddr;
+    inet_ntop(AF_INET, &addr, buffer, sizeof(buffer));
+    return buffer;
+}
+
+bool Replay::isAttacker (IPAddressV4 ipAddr) const
+{
+    IPAddressV4 host = ntohl(ipAddr);
+    for (auto& net : options.attackers)
+    {
+        if ((host & net.second) == net.first)
+            return true;
+    }
+    return false;
+}
+
+void Replay::packet (time_t time, IPAddressV4 src, IPAddressV4 dst)
+{
+    if (startTime == 0)
+    {
+        startTime = now = time;
+        nextExpire = time + 1;
+        nextUpdateValidAvgConn = time + Users::UPDATE_VALID_AVG_CONN_TIMER_INTERVAL;
+        nextClearInvalidUsers = time + Users::CLEAR_INVALID_USERS_TIMER_INTERVAL;
+        nextEntropy = time + ENTROPY_TIMER_INTERVAL;
+        nextTableStats = time + TABLE_STATS_TIMER_INTERVAL;
+        nextRow = time + options.interval;
+        Clock::setVirtualTime(time);
+    }
+    if (time > now)
+        advance(time);
+    ++packets;
+    ++lookups;
+
+    if (sources.insert(src).second && firstAttackTime == 0 && isAttacker(src))
+        firstAttackTime = now;
+
+    auto it = flows.find(key(src, dst));
+    if (it != flows.end())
+    {
+        ++matched;
+        ++it->second.packets;
+        it->second.lastTime = now;
+        return;
+    }
+
+    // packet-in
+    ++packetIns;
+    entropy.update(src, dst);
+    packetInHitters.update(src);
+    Classifier::Verdict verdict;
+    {
+        Metrics::Timer timer(Metrics::Stages::ProcessMiss);
+        verdict = classifier.processMiss(users, params, src, dst);
+    }
+    ++verdicts[verdict.verdict];
+    if (verdict.isTypeChanged)
+        usersStatistics(src);
+    for (const UserAddress& ipAddr : verdict.flushedTypeChanged)
+        usersStatistics(ipAddr.getV4());
+
+    Flow flow {src, inPort(src), 0, now, now, 0, 0};
+    switch (verdict.verdict)
+    {
+    case Classifier::Verdicts::Block:
+        flow.hardTimeout = DROP_HARD_TIMEOUT;
+        if (blocked.insert(src).second && firstAttackerBlockTime == 0 && isAttacker(src))
+        {
+            firstAttackerBlockTime = now;
+            events.push_back(Event {now, "first attacker blocked: " + ipToString(src)});
+        }
+        break;
+    default:
+        switch (tableOccupancy.getLevel(DPID))
+        {
+        case TableOccupancy::Levels::Exhausted:
+            flow.idleTimeout = TIGHT_IDLE_TIMEOUT;
+            flow.hardTimeout = TIGHT_HARD_TIMEOUT;
+            break;
+        case TableOccupancy::Levels::NearCapacity:
+            flow.idleTimeout = SHORT_IDLE_TIMEOUT;
+            flow.hardTimeout = SHORT_HARD_TIMEOUT;
+            break;
+        default:
+            bool isShort = verdict.verdict != Classifier::Verdicts::Forward;
+            flow.idleTimeout = isShort ? SHORT_IDLE_TIMEOUT : NORMAL_IDLE_TIMEOUT;
+            flow.hardTimeout = isShort ? SHORT_HARD_TIMEOUT : NORMAL_HARD_TIMEOUT;
+            break;
+        }
+        break;
+    }
+    uint64_t k = key(src, dst);
+    flows.insert(std::make_pair(k, flow));
+    sourceFlows[src].push_back(k);
+}
+
+// timers of the app and of the switch up to the time
+void Replay::advance (time_t time)
+{
+    while (now < time)
+    {
+        time_t next = std::min({time, nextExpire, nextUpdateValidAvgConn, nextClearInvalidUsers,
+                                nextEntropy, nextTableStats, nextRow});
+        now = next;
+        Clock::setVirtualTime(now);
+        if (now >= nextExpire)
+        {
+            expire();
+            nextExpire = now + 1;
+        }
+        if (now >= nextUpdateValidAvgConn)
+        {
+            params.updateValidAvgConnNumber(users);
+            packetInHitters.decay();
+            nextUpdateValidAvgConn = now + Users::UPDATE_VALID_AVG_CONN_TIMER_INTERVAL;
+        }
+        if (now >= nextClearInvalidUsers)
+        {
+            users.update();
+            nextClearInvalidUsers = now + Users::CLEAR_INVALID_USERS_TIMER_INTERVAL;
+        }
+        if (now >= nextEntropy)
+        {
+            if (entropy.evaluate() && users.getStatistics().handle(true))
+                setDDoS(true);
+            nextEntropy = now + ENTROPY_TIMER_INTERVAL;
+        }
+        if (now >= nextTableStats)
+        {
+            tableOccupancy.update(DPID, flows.size(), lookups, matched);
+            if (tableOccupancy.isUnderPressure())
+                setDDoS(true);
+            nextTableStats = now + TABLE_STATS_TIMER_INTERVAL;
+        }
+        if (now >= nextRow)
+        {
+            addRow();
+            nextRow = now + options.interval;
+        }
+        // the app's timer of flow-removed batches is shorter than a step
+        if (!flowRemovedQueue.isEmpty())
+            processFlowRemoved(false);
+    }
+}
+
+void Replay::expire()
+{
+    // a removed flow can detect DDoS and delete more flows by mitigation
+    std::vector<uint64_t> expired;
+    for (auto& it : flows)
+    {
+        const Flow& flow = it.second;
+        if ((flow.idleTimeout != 0 && now - flow.lastTime >= flow.idleTimeout)
+                || (flow.hardTimeout != 0 && now - flow.createTime >= flow.hardTimeout))
+            expired.push_back(it.first);
+    }
+    for (uint64_t k : expired)
+    {
+        auto it = flows.find(k);
+        if (it != flows.end())
+            removeFlow(it);
+    }
+}
+
+void Replay::removeFlow (std::unordered_map<uint64_t, Flow>::iterator it)
+{
+    Flow flow = it->second;
+    std::vector<uint64_t>& keys = sourceFlows[flow.src];
+    auto k = std::find(keys.begin(), keys.end(), it->first);
+    if (k != keys.end())
+    {
+        *k = keys.back();
+        keys.pop_back();
+    }
+    if (keys.empty())
+        sourceFlows.erase(flow.src);
+    flows.erase(it);
+    flowRemoved(flow);
+}
+
+// ControllerDDoSProtection::flowRemoved
+void Replay::flowRemoved (const Flow& flow)
+{
+    if (flow.packets == 0)
+        return; // useless
+    ++flowRemovedNumber;
+    Metrics::Timer timer(Metrics::Stages::FlowRemoved);
+    // the source address stands for eth_src
+    FlowRemovedQueue::Event event {DPID, flow.inPort, true, true, true, flow.src, flow.packets, false, 0};
+    if (!flowRemovedQueue.push(event))
+    {
+        processFlowRemoved(true);
+        flowRemovedQueue.push(event);
+    }
+}
+
+// ControllerDDoSProtection::processFlowRemoved
+void Replay::processFlowRemoved (bool isFull)
+{
+    Metrics::Timer timer(Metrics::Stages::FlowRemovedBatch);
+    FlowRemovedQueue::Batch batch = flowRemovedQueue.take(params.getValidPacketNumber().cur,
+        [this](uint64_t ethSrc)
+        {
+            return FlowRemovedQueue::Host {true, (IPAddressV4) ethSrc, inPort((IPAddressV4) ethSrc)};
+        }, isFull);
+
+    bool isCompromised = false;
+    for (const FlowRemovedQueue::PortSamples& port : batch.ports)
+    {
+        if (detection.updateInPort(port.dpid, port.inPort, port.samples, port.lowSamples)
+                == SPRTdetection::InPortTypes::Compromised)
+        {
+            if (compromisedInPorts.insert(port.inPort).second)
+                events.push_back(Event {now, "in_port " + std::to_string(port.inPort) + " is compromised"});
+            isCompromised = true;
+        }
+    }
+    if (isCompromised)
+        setDDoS(detection.isDDoS());
+
+    for (const FlowRemovedQueue::UserFlows& user : batch.users)
+    {
+        try
+        {
+            Classifier::checkUser(users, params, user.ipAddr, user.flows, user.invalidFlows);
+        }
+        catch (Users::UsersExceptionTypes)
+        {
+            ++unknownUsers; // evicted
+        }
+    }
+}
+
+// getUsersStatistics and usersStatisticsArrived (or aggregateStatsArrived):
+// packet numbers of the user's flows, the replies of both modes are counted
+void Replay::usersStatistics (IPAddressV4 ipAddr)
+{
+    ++usersChecks;
+    Metrics::Timer timer(Metrics::Stages::UsersStatisticsArrived);
+    size_t validPacketNumber = params.getValidPacketNumber().cur;
+    std::vector<uint64_t> packetNumbers;
+    std::vector<uint64_t> bucketFlows(statsCheck.getBucketsNumber());
+    std::vector<uint64_t> bucketPackets(statsCheck.getBucketsNumber());
+    size_t entries = 0;
+    auto it = sourceFlows.find(ipAddr);
+    if (it != sourceFlows.end())
+    {
+        for (uint64_t k : it->second)
+        {
+            auto flow = flows.find(k);
+            if (flow == flows.end())
+                continue;
+            ++entries;
+            // the destination address stands for eth_dst, hosts of Mininet have MACs of their IPs
+            uint32_t bucket = ntohl((IPAddressV4) k) & statsCheck.getBucketMask();
+            ++bucketFlows[bucket];
+            bucketPackets[bucket] += flow->second.packets;
+            lowPacketFlows += flow->second.packets < validPacketNumber;
+            if (flow->second.packets != 0)
+                packetNumbers.push_back(flow->second.packets);
+        }
+    }
+    const size_t segmentEntries = (65535 - StatsCheck::MULTIPART_REPLY_SIZE) / StatsCheck::FLOW_STATS_SIZE;
+    flowStatsBytes += (entries / segmentEntries + 1) * StatsCheck::MULTIPART_REPLY_SIZE
+            + entries * StatsCheck::FLOW_STATS_SIZE;
+    aggregateStatsBytes += statsCheck.getBucketsNumber() * StatsCheck::AGGREGATE_REPLY_SIZE;
+    size_t estimated = 0;
+    for (size_t bucket = 0; bucket < bucketFlows.size(); ++bucket)
+        estimated += StatsCheck::lowPacketFlows(bucketFlows[bucket], bucketPackets[bucket], validPacketNumber);
+    estimatedLowPacketFlows += estimated;
+
+    try
+    {
+        if (statsCheck.getMode() == StatsCheck::Modes::Aggregate)
+        {
+            if (entries == 0)
+                return;
+            Classifier::checkUser(users, params, ipAddr, entries, estimated);
+        } else {
+            if (packetNumbers.empty())
+                return; // no flow stats
+            Classifier::checkUser(users, params, ipAddr, packetNumbers);
+        }
+    }
+    catch (Users::UsersExceptionTypes)
+    {
+        ++unknownUsers;
+    }
+    detectDDoS();
+}
+
+// ControllerDDoSProtection::detectDDoSTimeout
+void Replay::detectDDoS()
+{
+    Metrics::Timer timer(Metrics::Stages::DetectDDoS);
+    users.update();
+    Users::Statistics& statistics = users.getStatistics();
+    setDDoS(statistics.handle(entropy.isAnomalous()) || tableOccupancy.isUnderPressure());
+}
+
+void Replay::setDDoS (bool value)
+{
+    if (!classifier.setDDoS(value))
+        return;
+    if (++ddosFlips <= MAX_DDOS_EVENTS)
+        events.push_back(Event {now, classifier.isDDoS() ? "DDoS is detected" : "DDoS is finished"});
+    if (classifier.isDDoS())
+        mitigate();
+}
+
+// ControllerDDoSProtection::mitigate: flows of invalid users are deleted,
+// blocked users are dropped by the next packet-in
+void Replay::mitigate()
+{
+    Metrics::Timer timer(Metrics::Stages::Mitigation);
+    std::vector<IPAddressV4> deleted;
+    users.forEachInvalidUser([&](const UserAddress& ipAddr, Users::InvalidUsersParams& userParams)
+    {
+        if (userParams.isBlocked() || !userParams.typeIsChecked())
+            deleted.push_back(ipAddr.getV4());
+    });
+    for (IPAddressV4 ipAddr : deleted)
+    {
+        auto it = sourceFlows.find(ipAddr);
+        if (it == sourceFlows.end())
+            continue;
+        std::vector<uint64_t> keys = it->second;
+        for (uint64_t k : keys)
+        {
+            auto flow = flows.find(k);
+            if (flow != flows.end())
+                removeFlow(flow);
+        }
+    }
+}
+
+void Replay::addRow()
+{
+    Row row {now - startTime, packets - lastRow.packets, packetIns - lastRow.packetIns,
+             flowRemovedNumber - lastRow.flowRemoved, flows.size(),
+             users.getValidUsersNumber(), users.getInvalidUsersNumber(), classifier.isDDoS()};
+    rows.push_back(row);
+    lastRow.packets = packets;
+    lastRow.packetIns = packetIns;
+    lastRow.flowRemoved = flowRemovedNumber;
+}
+
+// the switch is stopped: remaining flows are removed
+void Replay::finish()
+{
+    if (startTime == 0)
+        return;
+    addRow();
+    while (!flows.empty())
+        removeFlow(flows.begin());
+    if (!flowRemovedQueue.isEmpty())
+        processFlowRemoved(false);
+    Clock::setVirtualTime(0);
+}
+
+void Replay::report (double seconds)
+{
+    printf("time     packets   packet-ins  flow-removed  flows     valid     invalid   ddos\n");
+    for (const Row& row : rows)
+    {
+        printf("%-8lld %-9llu %-11llu %-13llu %-9zu %-9zu %-9zu %s\n", (long long) row.time,
+               (unsigned long long) row.packets, (unsigned long long) row.packetIns,
+               (unsigned long long) row.flowRemoved, row.flows, row.validUsers, row.invalidUsers,
+               row.isDDoS ? "yes" : "no");
+    }
+
+    printf("\nevents\n");
+    for (const Event& event : events)
+        printf("  %-8lld %s\n", (long long) (event.time - startTime), event.what.c_str());
+    if (ddosFlips > MAX_DDOS_EVENTS)
+        printf("  DDoS state is changed %llu times\n", (unsigned long long) ddosFlips);
+
+    printf("\nverdicts\n");
+    for (size_t v = 0; v < Classifier::Verdicts::VERDICTS_NUMBER; ++v)
+        printf("  %-20s %llu\n", Classifier::verdictName((Classifier::Verdicts) v), (unsigned long long) verdicts[v]);
+
+    printf("\nthroughput\n");
+    printf("  policy: %s\n", std::is_same<ActivePolicy, RuntimePolicy>::value ? RuntimePolicy::getProfile() : ActivePolicy::name());
+    printf("  capture: %lld s, replay: %.3f s (x%.0f)\n", (long long) (now - startTime), seconds,
+           seconds > 0 ? (now - startTime) / seconds : 0.);
+    printf("  packets: %llu (%.2f M/s)\n", (unsigned long long) packets, seconds > 0 ? packets / seconds / 1e6 : 0.);
+    printf("  packet-ins: %llu (%.2f M/s)\n", (unsigned long long) packetIns, seconds > 0 ? packetIns / seconds / 1e6 : 0.);
+    printf("  flow-removed: %llu, users' checks: %llu, unknown users: %llu\n", (unsigned long long) flowRemovedNumber,
+           (unsigned long long) usersChecks, (unsigned long long) unknownUsers);
+    FlowRemovedQueue::Counters queueCounters = flowRemovedQueue.getCounters();
+    printf("  flow-removed batches: %llu, %.1f events per batch, max depth %llu, full %llu, host lookups %llu\n",
+           (unsigned long long) queueCounters.batches,
+           queueCounters.batches ? (double) queueCounters.pushed / queueCounters.batches : 0.,
+           (unsigned long long) queueCounters.maxDepth, (unsigned long long) queueCounters.fullBatches,
+           (unsigned long long) queueCounters.hostLookups);
+    printf("  users' checks (%s): replies by flow stats %llu bytes, by aggregate stats %llu bytes (%zu buckets)\n",
+           StatsCheck::modeName(statsCheck.getMode()), (unsigned long long) flowStatsBytes,
+           (unsigned long long) aggregateStatsBytes, statsCheck.getBucketsNumber());
+    printf("  low-packet flows of the checks: %llu, estimated by aggregate stats %llu\n",
+           (unsigned long long) lowPacketFlows, (unsigned long long) estimatedLowPacketFlows);
+    if (VerdictCache::isEnabled())
+    {
+        VerdictCache::Counters c = VerdictCache::getCounters();
+        printf("  verdict cache: %llu hits, %llu misses, %llu connections in %llu flushes\n", (unsigned long long) c.hits,
+               (unsigned long long) c.misses, (unsigned long long) c.flushedConns, (unsigned long long) c.flushes);
+    }
+
+    printf("\nlatency, ns\n");
+    Metrics::Snapshot snapshot = Metrics::snapshot();
+    for (size_t s = 0; s < Metrics::Stages::STAGES_NUMBER; ++s)
+    {
+        const Metrics::Histogram& h = snapshot.stages[s];
+        if (h.count == 0)
+            continue;
+        printf("  %-24s count %-10llu mean %-8llu p50 %-8llu p99 %-8llu p999 %llu\n",
+               Metrics::stageName((Metrics::Stages) s), (unsigned long long) h.count,
+               (unsigned long long) (h.sum / h.count), (unsigned long long) h.percentile(0.5),
+               (unsigned long long) h.percentile(0.99), (unsigned long long) h.percentile(0.999));
+    }
+
+    if (options.attackers.empty())
+        return;
+    size_t attackers = 0;
+    size_t blockedAttackers = 0;
+    size_t blockedValid = 0;
+    for (IPAddressV4 ipAddr : sources)
+    {
+        bool isAttacking = isAttacker(ipAddr);
+        bool isBlocked = blocked.count(ipAddr) != 0;
+        attackers += isAttacking;
+        blockedAttackers += isAttacking && isBlocked;
+        blockedValid += !isAttacking && isBlocked;
+    }
+    printf("\ndetection\n");
+    printf("  attackers: %zu of %zu sources, blocked: %zu (%.1f%%), valid sources blocked: %zu\n",
+           attackers, sources.size(), blockedAttackers, attackers ? 100. * blockedAttackers / attackers : 0.,
+           blockedValid);
+    if (firstAttackTime != 0 && firstAttackerBlockTime != 0)
+        printf("  first attacker is blocked in %lld s\n", (long long) (firstAttackerBlockTime - firstAttackTime));
+}
+
+bool parseNetwork (const char* arg, std::pair<IPAddressV4, IPAddressV4>& net)
+{
+    std::string s = arg;
+    size_t slash = s.find('/');
+    int prefix = slash == std::string::npos ? 32 : atoi(s.c_str() + slash + 1);
+    in_addr addr;
+    if (prefix < 0 || prefix > 32 || inet_pton(AF_INET, s.substr(0, slash).c_str(), &addr) != 1)
+        return false;
+    net.second = prefix == 0 ? 0 : ~0u << (32 - prefix);
+    net.first = ntohl(addr.s_addr) & net.second;
+    return true;
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: ddos-replay [--in-ports N] [--attackers A.B.C.D/N]... [--interval S]\n"
+                    "                   [--users-layout map|columns] [--max-invalid-users N] [--flow-table N]\n"
+                    "                   [--verdict-cache] [--stats-check flows|aggregate] [--stats-check-buckets-bits N]\n"
+                    "                   [--flow-removed-queue N] [--policy P] [--verbose] <capture.pcap>\n");
+    exit(2);
+}
+
+bool parse (int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--in-ports" && hasValue)
+            options.inPorts = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--attackers" && hasValue)
+        {
+            std::pair<IPAddressV4, IPAddressV4> net;
+            if (!parseNetwork(argv[++i], net))
+            {
+                fprintf(stderr, "bad network: %s\n", argv[i]);
+                return false;
+            }
+            options.attackers.push_back(net);
+        }
+        else if (arg == "--interval" && hasValue)
+            options.interval = std::max(1l, strtol(argv[++i], nullptr, 10));
+        else if (arg == "--users-layout" && hasValue)
+            options.columns = std::string(argv[++i]) == "columns";
+        else if (arg == "--max-invalid-users" && hasValue)
+            options.maxInvalidUsers = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--flow-table" && hasValue)
+            options.flowTable = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--verdict-cache")
+            options.verdictCache = true;
+        else if (arg == "--stats-check" && hasValue)
+        {
+            if (!StatsCheck::parseMode(argv[++i], options.statsCheckMode))
+                return false;
+        }
+        else if (arg == "--stats-check-buckets-bits" && hasValue)
+            options.statsCheckBucketsBits = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--flow-removed-queue" && hasValue)
+            options.flowRemovedQueue = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--policy" && hasValue)
+            options.policy = argv[++i];
+        else if (arg == "--verbose")
+            options.verbose = true;
+        else if (!arg.empty() && arg[0] == '-')
+            return false;
+        else
+            options.capture = arg;
+    }
+    return !options.capture.empty();
+}
+
+// IPv4 source and destination of a frame
+bool parseFrame (const uint8_t* p, size_t len, uint32_t linkType, IPAddressV4& src, IPAddressV4& dst)
+{
+    size_t offset = 0;
+    uint16_t etherType = 0x0800;
+    switch (linkType)
+    {
+    case LINKTYPE_ETHERNET:
+        if (len < 14)
+            return false;
+        etherType = p[12] << 8 | p[13];
+        offset = 14;
+        while ((etherType == 0x8100 || etherType == 0x88a8) && len >= offset + 4)
+        {
+            etherType = p[offset + 2] << 8 | p[offset + 3];
+            offset += 4;
+        }
+        break;
+    case LINKTYPE_LINUX_SLL:
+        if (len < 16)
+            return false;
+        etherType = p[14] << 8 | p[15];
+        offset = 16;
+        break;
+    case LINKTYPE_RAW:
+    case LINKTYPE_IPV4:
+        break;
+    default:
+        return false;
+    }
+    if (etherType != 0x0800 || len < offset + 20 || (p[offset] >> 4) != 4)
+        return false;
+    // network byte order as the app keeps it
+    memcpy(&src, p + offset + 12, sizeof(src));
+    memcpy(&dst, p + offset + 16, sizeof(dst));
+    return src != 0 && dst != 0;
+}
+
+}
+
+int main (int argc, char** argv)
+{
+    Options options;
+    if (!parse(argc, argv, options))
+        usage();
+
+    google::InitGoogleLogging(argv[0]);
+    // the classifier logs every packet-in
+    if (!options.verbose)
+        FLAGS_minloglevel = google::WARNING;
+
+    // before the users, params and SPRT are created
+    if (!options.policy.empty() && options.policy != ActivePolicy::name())
+    {
+        if (!std::is_same<ActivePolicy, RuntimePolicy>::value)
+        {
+            fprintf(stderr, "the %s policy is built in, --policy needs DDOS_POLICY=runtime\n", ActivePolicy::name());
+            return 2;
+        }
+        if (!RuntimePolicy::load(options.policy))
+        {
+            fprintf(stderr, "unknown policy: %s\n", options.policy.c_str());
+            return 2;
+        }
+    }
+
+    int fd = open(options.capture.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "%s: %s\n", options.capture.c_str(), strerror(errno));
+        return 1;
+    }
+    if ((size_t) st.st_size < sizeof(PcapHeader))
+    {
+        fprintf(stderr, "%s: not a pcap file\n", options.capture.c_str());
+        return 1;
+    }
+    const uint8_t* base = static_cast<const uint8_t*>(mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: %s\n", options.capture.c_str(), strerror(errno));
+        return 1;
+    }
+    madvise(const_cast<uint8_t*>(base), st.st_size, MADV_SEQUENTIAL);
+
+    PcapHeader header;
+    memcpy(&header, base, sizeof(header));
+    bool isSwapped = header.magic == __builtin_bswap32(PCAP_MAGIC) || header.magic == __builtin_bswap32(PCAP_MAGIC_NS);
+    uint32_t magic = isSwapped ? __builtin_bswap32(header.magic) : header.magic;
+    if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS)
+    {
+        fprintf(stderr, "%s: not a pcap file (pcapng is not supported)\n", options.capture.c_str());
+        return 1;
+    }
+    auto order = [isSwapped](uint32_t v) { return isSwapped ? __builtin_bswap32(v) : v; };
+    uint32_t linkType = order(header.linkType) & 0xffff;
+
+    Replay replay(options);
+    uint64_t skipped = 0;
+    auto start = std::chrono::steady_clock::now();
+    size_t offset = sizeof(PcapHeader);
+    while (offset + sizeof(PcapRecord) <= (size_t) st.st_size)
+    {
+        PcapRecord record;
+        memcpy(&record, base + offset, sizeof(record));
+        offset += sizeof(record);
+        size_t len = order(record.inclLen);
+        if (offset + len > (size_t) st.st_size)
+            break; // truncated capture
+        IPAddressV4 src, dst;
+        if (parseFrame(base + offset, len, linkType, src, dst))
+            replay.packet(std::max<time_t>(order(record.sec), 1), src, dst);
+        else
+            ++skipped;
+        offset += len;
+    }
+    replay.finish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    munmap(const_cast<uint8_t*>(base), st.st_size);
+
+    replay.report(seconds);
+    if (skipped != 0)
+        printf("\n%llu frames without IPv4 are skipped\n", (unsigned long long) skipped);
+    return 0;
+}
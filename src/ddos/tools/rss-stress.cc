@@ -0,0 +1,103 @@
+// Stress of the cap of invalid users (Users::setMaxInvalidUsers): a spoofed
+// flood of unique sources, every packet-in has a source never seen before
+// and inserts an unknown user as the packet-in handler does. The resident
+// set size of the process is sampled while the flood goes on, it stays flat
+// once the cap is reached and grows with the sources otherwise.
+//
+//   ddos-rss-stress [options]
+//     --max-invalid-users N  cap of invalid users (100000), 0: no cap
+//     --packet-ins N       unique sources (5000000)
+//     --samples N          RSS samples (10)
+
+#include "../Users.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+namespace {
+
+struct Options {
+    size_t maxInvalidUsers;
+    size_t packetIns;
+    size_t samples;
+    Options(): maxInvalidUsers(100000), packetIns(5000000), samples(10) {}
+};
+
+// resident pages of /proc/self/statm in MB
+double getRss()
+{
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm == nullptr)
+        return 0;
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    if (fscanf(statm, "%lu %lu", &size, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+    return resident * (double) sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: ddos-rss-stress [--max-invalid-users N] [--packet-ins N] [--samples N]\n");
+    exit(2);
+}
+
+bool parse (int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--max-invalid-users" && hasValue)
+            options.maxInvalidUsers = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--packet-ins" && hasValue)
+            options.packetIns = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--samples" && hasValue)
+            options.samples = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else
+            return false;
+    }
+    return true;
+}
+
+}
+
+int main (int argc, char** argv)
+{
+    Options options;
+    if (!parse(argc, argv, options))
+        usage();
+
+    google::InitGoogleLogging(argv[0]);
+
+    Users users;
+    users.setMaxInvalidUsers(options.maxInvalidUsers > 0 ? options.maxInvalidUsers : std::numeric_limits<size_t>::max());
+
+    printf("%zu unique sources, max invalid users %s\n\n", options.packetIns,
+           options.maxInvalidUsers > 0 ? std::to_string(options.maxInvalidUsers).c_str() : "none");
+    printf("packet-ins  invalid   evicted   rss-mb\n");
+    printf("%-11d %-9zu %-9d %.1f\n", 0, users.getInvalidUsersNumber(), 0, getRss());
+    size_t sampleInterval = std::max<size_t>(options.packetIns / options.samples, 1);
+    for (size_t i = 0; i < options.packetIns; ++i)
+    {
+        // 1.0.0.0 and up, never 0
+        uint32_t ipAddr = 0x01000000 + i;
+        users.insert(ipAddr);
+
+        if ((i + 1) % sampleInterval == 0)
+        {
+            Users::EvictedNumbers evicted = users.getEvictedNumbers();
+            printf("%-11zu %-9zu %-9zu %.1f\n", i + 1, users.getInvalidUsersNumber(),
+                   evicted.ddos + evicted.malicious, getRss());
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+// Benchmark of the maintenance sweeps of Users by layout: the obsolescence
+// sweep of Users::update (no user is obsolete, every row is checked) and the
+// average of the valid users' connections of Params::updateValidAvgConnNumber
+// run over the same users as a walk of the maps (Users::Map) and as sweeps
+// of UsersColumns (Users::Columns) on the calling thread and on a WorkerPool.
+//
+//   ddos-sweep-bench [options]
+//     --users N            users (10000000)
+//     --valid-percent P    valid users (10)
+//     --threads N          threads of the WorkerPool, 0: no pool (4)
+//     --repeat N           sweeps of every layout, the fastest is reported (5)
+
+#include "../Params.hh"
+#include "../UserAddress.hh"
+#include "../Users.hh"
+#include "../WorkerPool.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <glog/logging.h>
+
+namespace {
+
+typedef UserAddress IPAddress;
+
+struct Options {
+    size_t users;
+    size_t validPercent;
+    size_t threads;
+    size_t repeat;
+    Options(): users(10000000), validPercent(10), threads(4), repeat(5) {}
+};
+
+struct Result {
+    double update;  // ms
+    double average; // ms
+    size_t invalidUsers;
+    size_t validUsers;
+};
+
+void usage()
+{
+    fprintf(stderr, "usage: ddos-sweep-bench [--users N] [--valid-percent P] [--threads N] [--repeat N]\n");
+    exit(2);
+}
+
+bool parse (int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--users" && hasValue)
+            options.users = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--valid-percent" && hasValue)
+            options.validPercent = std::min(100ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--threads" && hasValue)
+            options.threads = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--repeat" && hasValue)
+            options.repeat = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else
+            return false;
+    }
+    return true;
+}
+
+double elapsed (std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+Result run (const Options& options, Users::Layouts layout, WorkerPool* pool)
+{
+    // the users are freed before the next layout: both of them do not fit at 10M
+    std::unique_ptr<Users> users(new Users);
+    users->setMaxInvalidUsers(std::numeric_limits<size_t>::max());
+    users->setLayout(layout);
+    users->setWorkerPool(pool);
+    for (size_t i = 0; i < options.users; ++i)
+    {
+        // spread over the IPv4 space as the sources of a flood are
+        IPAddress ipAddr = (uint32_t) (0x01000000 + i * 2654435761u % 0xdf000000u);
+        users->insert(ipAddr);
+        if (i % 100 < options.validPercent)
+        {
+            std::map<IPAddress, Users::ValidUsersParams>::iterator validUser;
+            std::map<IPAddress, Users::InvalidUsersParams>::iterator invalidUser;
+            users->get(ipAddr, validUser, invalidUser);
+            users->validate(invalidUser);
+        }
+    }
+
+    Params params;
+    params.init();
+    Result result;
+    result.update = std::numeric_limits<double>::max();
+    result.average = std::numeric_limits<double>::max();
+    for (size_t r = 0; r < options.repeat; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        users->update();
+        result.update = std::min(result.update, elapsed(start));
+
+        start = std::chrono::steady_clock::now();
+        params.updateValidAvgConnNumber(*users);
+        result.average = std::min(result.average, elapsed(start));
+    }
+    result.invalidUsers = users->getInvalidUsersNumber();
+    result.validUsers = users->getValidUsersNumber();
+    return result;
+}
+
+void print (const char* name, const Result& result, const Result& map)
+{
+    printf("%-17s %-9zu %-9zu %-11.2f %-9.1f %-11.2f %.1f\n", name, result.invalidUsers, result.validUsers,
+           result.update, map.update / result.update, result.average, map.average / result.average);
+}
+
+}
+
+int main (int argc, char** argv)
+{
+    Options options;
+    if (!parse(argc, argv, options))
+        usage();
+
+    google::InitGoogleLogging(argv[0]);
+    // Users logs every validation
+    FLAGS_minloglevel = google::ERROR;
+
+    printf("%zu users, %zu%% valid, best of %zu sweeps\n\n", options.users, options.validPercent, options.repeat);
+    printf("layout            invalid   valid     update-ms   speedup   average-ms  speedup\n");
+    Result map = run(options, Users::Layouts::Map, nullptr);
+    print("map", map, map);
+    Result columns = run(options, Users::Layouts::Columns, nullptr);
+    print("columns", columns, map);
+    if (options.threads > 0)
+    {
+        WorkerPool pool(options.threads);
+        Result pooled = run(options, Users::Layouts::Columns, &pool);
+        std::string name = "columns/" + std::to_string(pool.size());
+        print(name.c_str(), pooled, map);
+    }
+    return 0;
+}
@@ -0,0 +1,1314 @@
+// Fleet of simulated OpenFlow 1.3 switches for end-to-end load tests of
+// the controller: every switch is a thread with its own control channel,
+// it generates the traffic of its users, looks the packets up in the flow
+// tables installed by the controller, sends packet-ins for misses, expires
+// flows with flow-removed and answers flow, table and port multiparts.
+//
+//   ddos-switch-fleet [options]
+//     --controller A.B.C.D:PORT  (127.0.0.1:6653)
+//     --switches N         simulated switches (1)
+//     --ports N            user ports of a switch (4)
+//     --valid N            valid users per switch: pings of 6-10 packets to servers (mininet/scapy/valid_user.sh)
+//     --malicious N        malicious users per switch: 1-3 packets to random hosts (malicious_user.sh)
+//     --ddos N             DDoS users per switch: spoofed source of every packet (ddos_user.py)
+//     --speed X            rates of the users are multiplied (1)
+//     --duration S         traffic after the handshake (30)
+//     --warmup S           pause after the handshake (1)
+//     --flow-table N       flow entries of a switch, OFPFMFC_TABLE_FULL above (10000)
+//
+// Reports the packet-in rate, decision latency (packet-in to the flow-mod
+// or packet-out of the flow) and the control channel messages by type.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// OpenFlow 1.3 wire format
+namespace ofp {
+    const uint8_t VERSION = 4;
+    enum Types {
+        HELLO = 0, ERROR = 1, ECHO_REQUEST = 2, ECHO_REPLY = 3, EXPERIMENTER = 4,
+        FEATURES_REQUEST = 5, FEATURES_REPLY = 6, GET_CONFIG_REQUEST = 7, GET_CONFIG_REPLY = 8, SET_CONFIG = 9,
+        PACKET_IN = 10, FLOW_REMOVED = 11, PORT_STATUS = 12, PACKET_OUT = 13, FLOW_MOD = 14,
+        GROUP_MOD = 15, PORT_MOD = 16, TABLE_MOD = 17, MULTIPART_REQUEST = 18, MULTIPART_REPLY = 19,
+        BARRIER_REQUEST = 20, BARRIER_REPLY = 21, QUEUE_GET_CONFIG_REQUEST = 22, QUEUE_GET_CONFIG_REPLY = 23,
+        ROLE_REQUEST = 24, ROLE_REPLY = 25, GET_ASYNC_REQUEST = 26, GET_ASYNC_REPLY = 27, SET_ASYNC = 28,
+        METER_MOD = 29, TYPES_NUMBER = 30
+    };
+    enum MultipartTypes {
+        MP_DESC = 0, MP_FLOW = 1, MP_AGGREGATE = 2, MP_TABLE = 3, MP_PORT_STATS = 4,
+        MP_GROUP_FEATURES = 8, MP_METER_FEATURES = 11, MP_TABLE_FEATURES = 12, MP_PORT_DESC = 13,
+        MP_TYPES_NUMBER = 16
+    };
+    enum FlowModCommands { FC_ADD = 0, FC_MODIFY = 1, FC_MODIFY_STRICT = 2, FC_DELETE = 3, FC_DELETE_STRICT = 4 };
+    enum Instructions { IT_GOTO_TABLE = 1, IT_APPLY_ACTIONS = 4, IT_WRITE_ACTIONS = 3 };
+    enum OxmFields {
+        IN_PORT = 0, ETH_DST = 3, ETH_SRC = 4, ETH_TYPE = 5, IP_PROTO = 10, IPV4_SRC = 11, IPV4_DST = 12,
+        UDP_SRC = 15, UDP_DST = 16
+    };
+    const uint16_t OXM_CLASS_BASIC = 0x8000;
+    const uint16_t AT_OUTPUT = 0;
+    const uint32_t PORT_CONTROLLER = 0xfffffffd;
+    const uint32_t NO_BUFFER = 0xffffffff;
+    const uint8_t TABLE_ALL = 0xff;
+    const uint16_t FF_SEND_FLOW_REM = 1;
+    const uint16_t MP_REPLY_MORE = 1;
+    enum PacketInReasons { R_NO_MATCH = 0, R_ACTION = 1 };
+    enum FlowRemovedReasons { RR_IDLE_TIMEOUT = 0, RR_HARD_TIMEOUT = 1, RR_DELETE = 2 };
+    const uint16_t ET_BAD_REQUEST = 1, BRC_BAD_TYPE = 1, BRC_BAD_MULTIPART = 2;
+    const uint16_t ET_FLOW_MOD_FAILED = 5, FMFC_TABLE_FULL = 1;
+    const size_t HEADER_SIZE = 8;
+    const size_t MAX_MESSAGE = 65535;
+
+    const char* typeName (uint8_t type)
+    {
+        static const char* names[] = {
+            "hello", "error", "echo_request", "echo_reply", "experimenter", "features_request",
+            "features_reply", "get_config_request", "get_config_reply", "set_config", "packet_in",
+            "flow_removed", "port_status", "packet_out", "flow_mod", "group_mod", "port_mod", "table_mod",
+            "multipart_request", "multipart_reply", "barrier_request", "barrier_reply",
+            "queue_get_config_request", "queue_get_config_reply", "role_request", "role_reply",
+            "get_async_request", "get_async_reply", "set_async", "meter_mod"
+        };
+        return type < TYPES_NUMBER ? names[type] : "unknown";
+    }
+}
+
+uint16_t get16 (const uint8_t* p) { return p[0] << 8 | p[1]; }
+uint32_t get32 (const uint8_t* p) { return (uint32_t) get16(p) << 16 | get16(p + 2); }
+uint64_t get64 (const uint8_t* p) { return (uint64_t) get32(p) << 32 | get32(p + 4); }
+
+// big-endian writer
+class Buffer {
+public:
+    void u8 (uint8_t v) { data.push_back((char) v); }
+    void u16 (uint16_t v) { u8(v >> 8); u8(v); }
+    void u32 (uint32_t v) { u16(v >> 16); u16(v); }
+    void u64 (uint64_t v) { u32(v >> 32); u32(v); }
+    void bytes (const void* p, size_t n) { data.append(static_cast<const char*>(p), n); }
+    void pad (size_t n) { data.append(n, '\0'); }
+    void set16 (size_t offset, uint16_t v) { data[offset] = (char) (v >> 8); data[offset + 1] = (char) v; }
+    size_t size() const { return data.size(); }
+    // ofp_header with the length set by finish()
+    size_t begin (uint8_t type, uint32_t xid)
+    {
+        size_t offset = data.size();
+        u8(ofp::VERSION); u8(type); u16(0); u32(xid);
+        return offset;
+    }
+    void finish (size_t offset) { set16(offset + 2, data.size() - offset); }
+
+    std::string data;
+};
+
+// Fields of a generated packet as OXM values
+struct Packet {
+    uint32_t inPort;
+    uint8_t ethDst[6];
+    uint8_t ethSrc[6];
+    uint32_t ipv4Src;   // network byte order
+    uint32_t ipv4Dst;
+    uint16_t udpSrc;
+    uint16_t udpDst;
+
+    static const uint16_t SIZE = 64;
+
+    // value of the field, 0: the packet has no such field
+    size_t field (uint8_t f, uint8_t* value) const
+    {
+        switch (f)
+        {
+        case ofp::IN_PORT: value[0] = inPort >> 24; value[1] = inPort >> 16; value[2] = inPort >> 8; value[3] = inPort; return 4;
+        case ofp::ETH_DST: memcpy(value, ethDst, 6); return 6;
+        case ofp::ETH_SRC: memcpy(value, ethSrc, 6); return 6;
+        case ofp::ETH_TYPE: value[0] = 0x08; value[1] = 0x00; return 2;
+        case ofp::IP_PROTO: value[0] = 17; return 1;
+        case ofp::IPV4_SRC: memcpy(value, &ipv4Src, 4); return 4;
+        case ofp::IPV4_DST: memcpy(value, &ipv4Dst, 4); return 4;
+        case ofp::UDP_SRC: value[0] = udpSrc >> 8; value[1] = udpSrc; return 2;
+        case ofp::UDP_DST: value[0] = udpDst >> 8; value[1] = udpDst; return 2;
+        default: return 0;
+        }
+    }
+
+    // Ethernet, IPv4 and UDP
+    void encode (Buffer& b) const
+    {
+        b.bytes(ethDst, 6);
+        b.bytes(ethSrc, 6);
+        b.u16(0x0800);
+        size_t ip = b.size();
+        b.u8(0x45); b.u8(0); b.u16(SIZE - 14); b.u32(0); b.u8(64); b.u8(17); b.u16(0);
+        b.bytes(&ipv4Src, 4);
+        b.bytes(&ipv4Dst, 4);
+        uint32_t sum = 0;
+        for (size_t i = 0; i < 20; i += 2)
+            sum += get16(reinterpret_cast<const uint8_t*>(b.data.data()) + ip + i);
+        while (sum >> 16)
+            sum = (sum & 0xffff) + (sum >> 16);
+        b.set16(ip + 10, ~sum);
+        b.u16(udpSrc); b.u16(udpDst); b.u16(SIZE - 34); b.u16(0);
+        b.pad(SIZE - 42);
+    }
+};
+
+struct Oxm {
+    uint8_t field;
+    bool hasMask;
+    uint8_t length; // of the value
+    uint8_t value[16];
+    uint8_t mask[16];
+};
+
+struct Match {
+    std::vector<Oxm> fields;
+    std::string raw; // OXM TLVs as received
+
+    // ofp_match at p, the padded length or 0
+    size_t parse (const uint8_t* p, size_t len)
+    {
+        if (len < 4 || get16(p) != 1)
+            return 0;
+        size_t matchLength = get16(p + 2);
+        size_t padded = (matchLength + 7) / 8 * 8;
+        if (matchLength < 4 || padded > len)
+            return 0;
+        raw.assign(reinterpret_cast<const char*>(p + 4), matchLength - 4);
+        fields.clear();
+        for (size_t i = 4; i + 4 <= matchLength; )
+        {
+            uint16_t oxmClass = get16(p + i);
+            uint8_t fieldAndMask = p[i + 2];
+            uint8_t oxmLength = p[i + 3];
+            if (i + 4 + oxmLength > matchLength)
+                return 0;
+            if (oxmClass == ofp::OXM_CLASS_BASIC)
+            {
+                Oxm oxm;
+                oxm.field = fieldAndMask >> 1;
+                oxm.hasMask = fieldAndMask & 1;
+                oxm.length = oxm.hasMask ? oxmLength / 2 : oxmLength;
+                if (oxm.length <= sizeof(oxm.value))
+                {
+                    memcpy(oxm.value, p + i + 4, oxm.length);
+                    if (oxm.hasMask)
+                        memcpy(oxm.mask, p + i + 4 + oxm.length, oxm.length);
+                    fields.push_back(oxm);
+                }
+            } else {
+                // experimenter fields are not generated: never matched
+                Oxm oxm;
+                oxm.field = 0xff;
+                oxm.hasMask = false;
+                oxm.length = 0;
+                fields.push_back(oxm);
+            }
+            i += 4 + oxmLength;
+        }
+        return padded;
+    }
+
+    void encode (Buffer& b) const
+    {
+        b.u16(1);
+        b.u16(4 + raw.size());
+        b.bytes(raw.data(), raw.size());
+        b.pad((8 - (4 + raw.size()) % 8) % 8);
+    }
+
+    bool matches (const Packet& packet) const
+    {
+        uint8_t value[16];
+        for (const Oxm& oxm : fields)
+        {
+            if (packet.field(oxm.field, value) != oxm.length || oxm.length == 0)
+                return false;
+            for (size_t i = 0; i < oxm.length; ++i)
+            {
+                uint8_t m = oxm.hasMask ? oxm.mask[i] : 0xff;
+                if ((value[i] & m) != (oxm.value[i] & m))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // every field of the filter is in the match, as wide or narrower
+    // (non-strict flow-mod, flow and aggregate stats)
+    bool covers (const Match& filter) const
+    {
+        for (const Oxm& f : filter.fields)
+        {
+            bool found = false;
+            for (const Oxm& oxm : fields)
+            {
+                if (oxm.field != f.field || oxm.length != f.length)
+                    continue;
+                found = true;
+                for (size_t i = 0; i < f.length && found; ++i)
+                {
+                    uint8_t filterMask = f.hasMask ? f.mask[i] : 0xff;
+                    uint8_t mask = oxm.hasMask ? oxm.mask[i] : 0xff;
+                    found = (mask & filterMask) == filterMask && (oxm.value[i] & filterMask) == (f.value[i] & filterMask);
+                }
+                if (found)
+                    break;
+            }
+            if (!found)
+                return false;
+        }
+        return true;
+    }
+
+    const Oxm* find (uint8_t field) const
+    {
+        for (const Oxm& oxm : fields)
+        {
+            if (oxm.field == field && !oxm.hasMask)
+                return &oxm;
+        }
+        return nullptr;
+    }
+};
+
+struct FlowEntry {
+    uint8_t tableId;
+    uint16_t priority;
+    uint16_t idleTimeout;
+    uint16_t hardTimeout;
+    uint16_t flags;
+    uint64_t cookie;
+    Match match;
+    std::string instructions; // raw
+    int gotoTable;          // -1: none
+    bool toController;
+    uint64_t packets;
+    uint64_t bytes;
+    Clock::time_point createTime;
+    Clock::time_point lastTime;
+    bool hasSrc;            // exact ipv4_src: indexed by the source
+    uint32_t src;
+};
+
+enum Profiles {
+    Valid,
+    Malicious,
+    DDoS
+};
+
+struct User {
+    Profiles profile;
+    uint32_t ipAddr;    // network byte order
+    uint8_t mac[6];
+    uint32_t inPort;
+    uint32_t dst;       // current destination
+    uint8_t dstMac[6];
+    int left;           // packets to the destination
+    Clock::time_point next;
+};
+
+struct Options {
+    std::string host;
+    uint16_t port;
+    size_t switches;
+    size_t ports;
+    size_t valid;
+    size_t malicious;
+    size_t ddos;
+    double speed;
+    double duration;
+    double warmup;
+    size_t flowTable;
+    Options(): host("127.0.0.1"), port(6653), switches(1), ports(4), valid(10), malicious(2), ddos(2),
+               speed(1.), duration(30.), warmup(1.), flowTable(10000) {}
+};
+
+// counters of a switch, summed at the end
+struct Counters {
+    uint64_t generated;
+    uint64_t matched;
+    uint64_t dropped;
+    uint64_t packetIns;
+    uint64_t flowRemoved;
+    uint64_t tableFull;
+    uint64_t received[ofp::TYPES_NUMBER];
+    uint64_t sent[ofp::TYPES_NUMBER];
+    uint64_t multipartRequests[ofp::MP_TYPES_NUMBER];
+    uint64_t multipartReplyBytes[ofp::MP_TYPES_NUMBER];
+    uint64_t receivedBytes;
+    uint64_t sentBytes;
+    size_t flows;           // at the end
+    size_t maxFlows;
+    std::vector<uint32_t> latencies; // us
+    Counters(): generated(0), matched(0), dropped(0), packetIns(0), flowRemoved(0), tableFull(0),
+                received(), sent(), multipartRequests(), multipartReplyBytes(), receivedBytes(0), sentBytes(0), flows(0), maxFlows(0) {}
+};
+
+std::atomic<bool> stopped(false);
+
+class Switch {
+public:
+    Switch (const Options& options_, uint64_t dpid_)
+        : options(options_), dpid(dpid_), fd(-1), xid(1), isReady(false), random(dpid_) {}
+
+    void run();
+    Counters counters;
+
+private:
+    bool connect();
+    bool receive();
+    void handle (const uint8_t* msg, size_t len);
+    void handleFlowMod (const uint8_t* msg, size_t len);
+    void handleMultipart (const uint8_t* msg, size_t len);
+    void handlePacketOut (const uint8_t* msg, size_t len);
+    void sendError (const uint8_t* msg, size_t len, uint16_t type, uint16_t code);
+    void send (Buffer& b);
+    void flush();
+
+    void createUsers();
+    void generate (Clock::time_point now);
+    void nextPacket (User& user, Packet& packet, Clock::time_point now);
+    void process (const Packet& packet, Clock::time_point now);
+    FlowEntry* lookup (uint8_t tableId, const Packet& packet);
+    void decided (uint32_t src, uint32_t dst, Clock::time_point now);
+    void expire (Clock::time_point now);
+    void remove (std::list<FlowEntry>::iterator it, uint8_t reason, Clock::time_point now);
+    void encodeFlowRemoved (Buffer& b, const FlowEntry& entry, uint8_t reason, Clock::time_point now);
+
+    static uint64_t flowKey (uint32_t src, uint32_t dst) { return (uint64_t) src << 32 | dst; }
+    uint32_t randomAddress() { return htonl(0x0b000000 + random() % 0xe0000000u); } // 11.0.0.0 and up
+    void randomMac (uint8_t* mac) { uint64_t r = random(); memcpy(mac, &r, 6); mac[0] &= 0xfe; }
+
+    Options options;
+    uint64_t dpid;
+    int fd;
+    uint32_t xid;
+    bool isReady;
+    std::mt19937_64 random;
+    std::vector<uint8_t> input;
+    Buffer output;
+
+    std::list<FlowEntry> flows;
+    std::unordered_map<uint32_t, std::vector<FlowEntry*>> bySource;
+    std::vector<FlowEntry*> wildcards;
+    uint64_t lookups;
+
+    std::vector<User> users;
+    std::unordered_map<uint64_t, Clock::time_point> pending; // packet-ins without decision
+};
+
+bool Switch::connect()
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    inet_pton(AF_INET, options.host.c_str(), &addr.sin_addr);
+    for (int attempt = 0; attempt < 50 && !stopped; ++attempt)
+    {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+        {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            return true;
+        }
+        close(fd);
+        fd = -1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    fprintf(stderr, "switch %llu: cannot connect to %s:%u: %s\n", (unsigned long long) dpid,
+            options.host.c_str(), options.port, strerror(errno));
+    return false;
+}
+
+void Switch::send (Buffer& b)
+{
+    output.data.append(b.data);
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(b.data.data());
+    for (size_t offset = 0; offset + ofp::HEADER_SIZE <= b.size(); offset += get16(p + offset + 2))
+    {
+        ++counters.sent[std::min<uint8_t>(p[offset + 1], ofp::TYPES_NUMBER - 1)];
+        if (get16(p + offset + 2) == 0)
+            break;
+    }
+    counters.sentBytes += b.size();
+    if (output.size() >= 64 * 1024)
+        flush();
+}
+
+void Switch::flush()
+{
+    size_t offset = 0;
+    while (offset < output.size() && fd >= 0)
+    {
+        ssize_t n = ::send(fd, output.data.data() + offset, output.size() - offset, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "switch %llu: %s\n", (unsigned long long) dpid, strerror(errno));
+            close(fd);
+            fd = -1;
+            break;
+        }
+        offset += n;
+    }
+    output.data.clear();
+}
+
+bool Switch::receive()
+{
+    uint8_t buffer[64 * 1024];
+    ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+    {
+        fprintf(stderr, "switch %llu: the controller closed the connection\n", (unsigned long long) dpid);
+        return false;
+    }
+    if (n < 0)
+        return true;
+    counters.receivedBytes += n;
+    input.insert(input.end(), buffer, buffer + n);
+    size_t offset = 0;
+    while (input.size() - offset >= ofp::HEADER_SIZE)
+    {
+        size_t len = get16(&input[offset + 2]);
+        if (len < ofp::HEADER_SIZE)
+            return false;
+        if (input.size() - offset < len)
+            break;
+        handle(&input[offset], len);
+        offset += len;
+    }
+    input.erase(input.begin(), input.begin() + offset);
+    return true;
+}
+
+void Switch::handle (const uint8_t* msg, size_t len)
+{
+    uint8_t type = msg[1];
+    uint32_t requestXid = get32(msg + 4);
+    ++counters.received[std::min<uint8_t>(type, ofp::TYPES_NUMBER - 1)];
+    Buffer b;
+    switch (type)
+    {
+    case ofp::HELLO:
+    case ofp::SET_CONFIG:
+    case ofp::SET_ASYNC:
+    case ofp::ECHO_REPLY:
+    case ofp::PORT_MOD:
+    case ofp::TABLE_MOD:
+    case ofp::GROUP_MOD:
+    case ofp::METER_MOD:
+        break;
+    case ofp::ECHO_REQUEST:
+    {
+        size_t offset = b.begin(ofp::ECHO_REPLY, requestXid);
+        b.bytes(msg + ofp::HEADER_SIZE, len - ofp::HEADER_SIZE);
+        b.finish(offset);
+        send(b);
+        break;
+    }
+    case ofp::FEATURES_REQUEST:
+    {
+        size_t offset = b.begin(ofp::FEATURES_REPLY, requestXid);
+        b.u64(dpid);
+        b.u32(0);       // n_buffers: packets are sent in packet-ins
+        b.u8(254);      // n_tables
+        b.u8(0);        // auxiliary_id
+        b.pad(2);
+        b.u32(0x1 | 0x2 | 0x4); // flow, table and port stats
+        b.u32(0);
+        b.finish(offset);
+        send(b);
+        isReady = true;
+        break;
+    }
+    case ofp::GET_CONFIG_REQUEST:
+    {
+        size_t offset = b.begin(ofp::GET_CONFIG_REPLY, requestXid);
+        b.u16(0);
+        b.u16(0xffff); // miss_send_len: whole packets
+        b.finish(offset);
+        send(b);
+        break;
+    }
+    case ofp::BARRIER_REQUEST:
+    {
+        size_t offset = b.begin(ofp::BARRIER_REPLY, requestXid);
+        b.finish(offset);
+        send(b);
+        break;
+    }
+    case ofp::ROLE_REQUEST:
+    {
+        size_t offset = b.begin(ofp::ROLE_REPLY, requestXid);
+        b.bytes(msg + ofp::HEADER_SIZE, std::min<size_t>(16, len - ofp::HEADER_SIZE));
+        b.pad(16 - std::min<size_t>(16, len - ofp::HEADER_SIZE));
+        b.finish(offset);
+        send(b);
+        break;
+    }
+    case ofp::GET_ASYNC_REQUEST:
+    {
+        size_t offset = b.begin(ofp::GET_ASYNC_REPLY, requestXid);
+        b.u32(0x7); b.u32(0x7); // packet-in reasons
+        b.u32(0x7); b.u32(0x7); // port status reasons
+        b.u32(0xf); b.u32(0xf); // flow removed reasons
+        b.finish(offset);
+        send(b);
+        break;
+    }
+    case ofp::FLOW_MOD:
+        handleFlowMod(msg, len);
+        break;
+    case ofp::PACKET_OUT:
+        handlePacketOut(msg, len);
+        break;
+    case ofp::MULTIPART_REQUEST:
+        handleMultipart(msg, len);
+        break;
+    default:
+        sendError(msg, len, ofp::ET_BAD_REQUEST, ofp::BRC_BAD_TYPE);
+        break;
+    }
+}
+
+void Switch::sendError (const uint8_t* msg, size_t len, uint16_t type, uint16_t code)
+{
+    Buffer b;
+    size_t offset = b.begin(ofp::ERROR, get32(msg + 4));
+    b.u16(type);
+    b.u16(code);
+    b.bytes(msg, std::min<size_t>(len, 64));
+    b.finish(offset);
+    send(b);
+}
+
+void Switch::handleFlowMod (const uint8_t* msg, size_t len)
+{
+    if (len < 56)
+        return;
+    FlowEntry entry;
+    entry.cookie = get64(msg + 8);
+    uint64_t cookieMask = get64(msg + 16);
+    entry.tableId = msg[24];
+    uint8_t command = msg[25];
+    entry.idleTimeout = get16(msg + 26);
+    entry.hardTimeout = get16(msg + 28);
+    entry.priority = get16(msg + 30);
+    entry.flags = get16(msg + 44);
+    size_t matchLength = entry.match.parse(msg + 48, len - 48);
+    if (matchLength == 0)
+        return;
+    entry.instructions.assign(reinterpret_cast<const char*>(msg + 48 + matchLength), len - 48 - matchLength);
+    Clock::time_point now = Clock::now();
+
+    if (command == ofp::FC_DELETE || command == ofp::FC_DELETE_STRICT)
+    {
+        for (auto it = flows.begin(); it != flows.end(); )
+        {
+            auto current = it++;
+            bool isTable = entry.tableId == ofp::TABLE_ALL || current->tableId == entry.tableId;
+            bool isCookie = (current->cookie & cookieMask) == (entry.cookie & cookieMask);
+            bool isMatch = command == ofp::FC_DELETE_STRICT
+                    ? current->priority == entry.priority && current->match.raw == entry.match.raw
+                    : current->match.covers(entry.match);
+            if (isTable && isCookie && isMatch)
+                remove(current, ofp::RR_DELETE, now);
+        }
+        return;
+    }
+    if (command != ofp::FC_ADD)
+        return; // the app adds and deletes only
+
+    // instructions: goto-table, output to the controller
+    entry.gotoTable = -1;
+    entry.toController = false;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(entry.instructions.data());
+    for (size_t i = 0; i + 4 <= entry.instructions.size(); )
+    {
+        uint16_t type = get16(p + i);
+        uint16_t length = get16(p + i + 2);
+        if (length < 4 || i + length > entry.instructions.size())
+            break;
+        if (type == ofp::IT_GOTO_TABLE)
+            entry.gotoTable = p[i + 4];
+        else if (type == ofp::IT_APPLY_ACTIONS || type == ofp::IT_WRITE_ACTIONS)
+        {
+            for (size_t a = i + 8; a + 8 <= i + length; )
+            {
+                uint16_t actionLength = get16(p + a + 2);
+                if (actionLength < 8)
+                    break;
+                if (get16(p + a) == ofp::AT_OUTPUT && get32(p + a + 4) == ofp::PORT_CONTROLLER)
+                    entry.toController = true;
+                a += actionLength;
+            }
+        }
+        i += length;
+    }
+    entry.packets = entry.bytes = 0;
+    entry.createTime = entry.lastTime = now;
+    const Oxm* src = entry.match.find(ofp::IPV4_SRC);
+    entry.hasSrc = src != nullptr;
+    if (entry.hasSrc)
+        memcpy(&entry.src, src->value, 4);
+
+    // an identical entry is replaced
+    std::vector<FlowEntry*>& bucket = entry.hasSrc ? bySource[entry.src] : wildcards;
+    for (FlowEntry* e : bucket)
+    {
+        if (e->tableId == entry.tableId && e->priority == entry.priority && e->match.raw == entry.match.raw)
+        {
+            *e = entry;
+            return;
+        }
+    }
+    if (flows.size() >= options.flowTable)
+    {
+        ++counters.tableFull;
+        sendError(msg, len, ofp::ET_FLOW_MOD_FAILED, ofp::FMFC_TABLE_FULL);
+        return;
+    }
+    flows.push_back(entry);
+    bucket.push_back(&flows.back());
+    counters.maxFlows = std::max(counters.maxFlows, flows.size());
+
+    // decision latency of the packet-ins covered by the flow
+    const Oxm* dst = entry.match.find(ofp::IPV4_DST);
+    if (entry.hasSrc && dst != nullptr)
+    {
+        uint32_t dstAddr;
+        memcpy(&dstAddr, dst->value, 4);
+        decided(entry.src, dstAddr, now);
+    }
+    else if (entry.hasSrc)
+    {
+        for (auto it = pending.begin(); it != pending.end(); )
+        {
+            if ((uint32_t) (it->first >> 32) == entry.src)
+            {
+                counters.latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(now - it->second).count());
+                it = pending.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void Switch::handlePacketOut (const uint8_t* msg, size_t len)
+{
+    if (len < 24)
+        return;
+    size_t actionsLength = get16(msg + 16);
+    size_t data = 24 + actionsLength;
+    // the decision for a packet without a flow
+    if (data + 34 <= len && get16(msg + data + 12) == 0x0800)
+    {
+        uint32_t src, dst;
+        memcpy(&src, msg + data + 26, 4);
+        memcpy(&dst, msg + data + 30, 4);
+        decided(src, dst, Clock::now());
+    }
+}
+
+void Switch::decided (uint32_t src, uint32_t dst, Clock::time_point now)
+{
+    auto it = pending.find(flowKey(src, dst));
+    if (it == pending.end())
+        return;
+    counters.latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(now - it->second).count());
+    pending.erase(it);
+}
+
+void Switch::handleMultipart (const uint8_t* msg, size_t len)
+{
+    if (len < 16)
+        return;
+    uint32_t requestXid = get32(msg + 4);
+    uint16_t type = get16(msg + 8);
+    ++counters.multipartRequests[std::min<uint16_t>(type, ofp::MP_TYPES_NUMBER - 1)];
+    Clock::time_point now = Clock::now();
+
+    // bodies of the reply, split into messages with REPLY_MORE
+    std::vector<std::string> bodies;
+    switch (type)
+    {
+    case ofp::MP_DESC:
+    {
+        Buffer body;
+        char field[256];
+        const char* values[] = {"runos", "ddos-switch-fleet", "1.0", "simulated"};
+        for (const char* value : values)
+        {
+            memset(field, 0, sizeof(field));
+            strncpy(field, value, sizeof(field) - 1);
+            body.bytes(field, 256);
+        }
+        memset(field, 0, sizeof(field));
+        snprintf(field, 32, "%llu", (unsigned long long) dpid);
+        body.bytes(field, 32);
+        memset(field, 0, sizeof(field));
+        body.bytes(field, 256);
+        bodies.push_back(body.data);
+        break;
+    }
+    case ofp::MP_PORT_DESC:
+        for (uint32_t port = 1; port <= options.ports; ++port)
+        {
+            Buffer body;
+            body.u32(port);
+            body.pad(4);
+            uint8_t mac[6] = {0x02, 0, (uint8_t) (dpid >> 8), (uint8_t) dpid, 0, (uint8_t) port};
+            body.bytes(mac, 6);
+            body.pad(2);
+            char name[16] = {0};
+            snprintf(name, sizeof(name), "s%llu-eth%u", (unsigned long long) dpid, port);
+            body.bytes(name, 16);
+            body.u32(0);            // config
+            body.u32(4);            // state: live
+            body.u32(0x800); body.u32(0x800); body.u32(0x800); body.u32(0); // 10Gb full duplex
+            body.u32(10000000); body.u32(10000000);
+            bodies.push_back(body.data);
+        }
+        break;
+    case ofp::MP_TABLE:
+    {
+        size_t active = 0;
+        for (const FlowEntry& entry : flows)
+            active += entry.tableId == 0;
+        Buffer body;
+        body.u8(0);
+        body.pad(3);
+        body.u32(active);
+        body.u64(lookups);
+        body.u64(counters.matched);
+        bodies.push_back(body.data);
+        // other tables are reported by the entries in them
+        for (uint8_t tableId = 1; tableId < 8; ++tableId)
+        {
+            size_t count = 0;
+            for (const FlowEntry& entry : flows)
+                count += entry.tableId == tableId;
+            if (count == 0)
+                continue;
+            Buffer other;
+            other.u8(tableId);
+            other.pad(3);
+            other.u32(count);
+            other.u64(0);
+            other.u64(0);
+            bodies.push_back(other.data);
+        }
+        break;
+    }
+    case ofp::MP_FLOW:
+    {
+        if (len < 16 + 32)
+            return;
+        const uint8_t* request = msg + 16;
+        uint8_t tableId = request[0];
+        uint64_t cookie = get64(request + 16);
+        uint64_t cookieMask = get64(request + 24);
+        Match filter;
+        if (filter.parse(request + 32, len - 16 - 32) == 0)
+            return;
+        for (const FlowEntry& entry : flows)
+        {
+            if ((tableId != ofp::TABLE_ALL && entry.tableId != tableId)
+                    || (entry.cookie & cookieMask) != (cookie & cookieMask) || !entry.match.covers(filter))
+                continue;
+            Buffer body;
+            body.u16(0);
+            body.u8(entry.tableId);
+            body.pad(1);
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(now - entry.createTime).count();
+            body.u32(duration / 1000000000);
+            body.u32(duration % 1000000000);
+            body.u16(entry.priority);
+            body.u16(entry.idleTimeout);
+            body.u16(entry.hardTimeout);
+            body.u16(entry.flags);
+            body.pad(4);
+            body.u64(entry.cookie);
+            body.u64(entry.packets);
+            body.u64(entry.bytes);
+            entry.match.encode(body);
+            body.bytes(entry.instructions.data(), entry.instructions.size());
+            body.set16(0, body.size());
+            bodies.push_back(body.data);
+        }
+        break;
+    }
+    case ofp::MP_AGGREGATE:
+    {
+        if (len < 16 + 32)
+            return;
+        const uint8_t* request = msg + 16;
+        uint8_t tableId = request[0];
+        uint64_t cookie = get64(request + 16);
+        uint64_t cookieMask = get64(request + 24);
+        Match filter;
+        if (filter.parse(request + 32, len - 16 - 32) == 0)
+            return;
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+        uint32_t flowCount = 0;
+        for (const FlowEntry& entry : flows)
+        {
+            if ((tableId != ofp::TABLE_ALL && entry.tableId != tableId)
+                    || (entry.cookie & cookieMask) != (cookie & cookieMask) || !entry.match.covers(filter))
+                continue;
+            packets += entry.packets;
+            bytes += entry.bytes;
+            ++flowCount;
+        }
+        Buffer body;
+        body.u64(packets);
+        body.u64(bytes);
+        body.u32(flowCount);
+        body.pad(4);
+        bodies.push_back(body.data);
+        break;
+    }
+    case ofp::MP_PORT_STATS:
+    case ofp::MP_GROUP_FEATURES:
+    case ofp::MP_METER_FEATURES:
+    case ofp::MP_TABLE_FEATURES:
+        break; // empty reply
+    default:
+        sendError(msg, len, ofp::ET_BAD_REQUEST, ofp::BRC_BAD_MULTIPART);
+        return;
+    }
+
+    // a message is at most 64 KiB
+    size_t i = 0;
+    do {
+        Buffer b;
+        size_t offset = b.begin(ofp::MULTIPART_REPLY, requestXid);
+        b.u16(type);
+        b.u16(0);
+        b.pad(4);
+        while (i < bodies.size() && b.size() + bodies[i].size() <= ofp::MAX_MESSAGE)
+            b.data.append(bodies[i++]);
+        if (i < bodies.size())
+            b.set16(offset + 10, ofp::MP_REPLY_MORE);
+        b.finish(offset);
+        counters.multipartReplyBytes[std::min<uint16_t>(type, ofp::MP_TYPES_NUMBER - 1)] += b.size() - offset;
+        send(b);
+    } while (i < bodies.size());
+}
+
+void Switch::createUsers()
+{
+    size_t counts[] = {options.valid, options.malicious, options.ddos};
+    uint32_t host = 1;
+    Clock::time_point now = Clock::now();
+    for (int profile = Valid; profile <= DDoS; ++profile)
+    {
+        for (size_t i = 0; i < counts[profile]; ++i, ++host)
+        {
+            User user;
+            user.profile = (Profiles) profile;
+            // 10.<dpid>.<host>: users of a switch do not overlap with other switches
+            user.ipAddr = htonl(0x0a000000 | (dpid & 0xff) << 16 | (host & 0xffff));
+            uint8_t mac[6] = {0, 0, (uint8_t) (dpid >> 8), (uint8_t) dpid, (uint8_t) (host >> 8), (uint8_t) host};
+            memcpy(user.mac, mac, 6);
+            user.inPort = 1 + (host - 1) % options.ports;
+            user.left = 0;
+            user.next = now + std::chrono::microseconds(random() % 1000000);
+            users.push_back(user);
+        }
+    }
+}
+
+// the next packet of the user and its time
+void Switch::nextPacket (User& user, Packet& packet, Clock::time_point now)
+{
+    packet.inPort = user.inPort;
+    packet.udpSrc = 1024 + random() % 60000;
+    packet.udpDst = 5001;
+    double interval = 1.;  // seconds
+    switch (user.profile)
+    {
+    case Valid:
+        // ping -c 6..10 of a server, sleep 2
+        if (user.left == 0)
+        {
+            user.dst = htonl(0x0a0000f0 + random() % 10);
+            uint8_t mac[6] = {0, 0, 0, 0, 0, (uint8_t) (0xf0 + ntohl(user.dst) % 16)};
+            memcpy(user.dstMac, mac, 6);
+            user.left = 6 + random() % 5;
+        }
+        interval = --user.left == 0 ? 3. : 1.;
+        packet.udpSrc = 40000 + (user.ipAddr >> 24);
+        break;
+    case Malicious:
+        // ping -c 2..3 of random hosts, sleep 2
+        if (user.left == 0)
+        {
+            user.dst = randomAddress();
+            randomMac(user.dstMac);
+            user.left = 1 + random() % 3;
+        }
+        interval = --user.left == 0 ? 2. : 1.;
+        break;
+    case DDoS:
+        // fuzzed source and destination of every packet, inter=0.2
+        user.ipAddr = randomAddress();
+        randomMac(user.mac);
+        user.dst = randomAddress();
+        memset(user.dstMac, 0xff, 6);
+        interval = 0.2;
+        break;
+    }
+    memcpy(packet.ethSrc, user.mac, 6);
+    memcpy(packet.ethDst, user.dstMac, 6);
+    packet.ipv4Src = user.ipAddr;
+    packet.ipv4Dst = user.dst;
+    user.next = now + std::chrono::microseconds((int64_t) (interval * 1e6 / options.speed));
+}
+
+void Switch::generate (Clock::time_point now)
+{
+    for (User& user : users)
+    {
+        // a late user catches up at most a second of its packets
+        int burst = 0;
+        while (user.next <= now && burst++ < 1000)
+        {
+            Packet packet;
+            nextPacket(user, packet, user.next);
+            ++counters.generated;
+            process(packet, now);
+        }
+        if (user.next <= now)
+            user.next = now;
+    }
+}
+
+FlowEntry* Switch::lookup (uint8_t tableId, const Packet& packet)
+{
+    FlowEntry* best = nullptr;
+    auto bucket = bySource.find(packet.ipv4Src);
+    if (bucket != bySource.end())
+    {
+        for (FlowEntry* e : bucket->second)
+        {
+            if (e->tableId == tableId && (best == nullptr || e->priority > best->priority) && e->match.matches(packet))
+                best = e;
+        }
+    }
+    for (FlowEntry* e : wildcards)
+    {
+        if (e->tableId == tableId && (best == nullptr || e->priority > best->priority) && e->match.matches(packet))
+            best = e;
+    }
+    return best;
+}
+
+void Switch::process (const Packet& packet, Clock::time_point now)
+{
+    ++lookups;
+    uint8_t tableId = 0;
+    FlowEntry* entry = nullptr;
+    for (int hops = 0; hops < 8; ++hops)
+    {
+        entry = lookup(tableId, packet);
+        if (entry == nullptr)
+            break;
+        entry->packets += 1;
+        entry->bytes += Packet::SIZE;
+        entry->lastTime = now;
+        if (entry->gotoTable < 0)
+            break;
+        tableId = entry->gotoTable;
+    }
+    if (entry != nullptr && !entry->toController)
+    {
+        ++counters.matched;
+        return;
+    }
+    // packet-in: the table-miss entry or no entry
+    ++counters.packetIns;
+    Buffer b;
+    size_t offset = b.begin(ofp::PACKET_IN, xid++);
+    b.u32(ofp::NO_BUFFER);
+    b.u16(Packet::SIZE);
+    b.u8(entry == nullptr ? ofp::R_NO_MATCH : ofp::R_ACTION);
+    b.u8(tableId);
+    b.u64(entry == nullptr ? 0 : entry->cookie);
+    // match: in_port
+    b.u16(1);
+    b.u16(4 + 8);
+    b.u16(ofp::OXM_CLASS_BASIC);
+    b.u8(ofp::IN_PORT << 1);
+    b.u8(4);
+    b.u32(packet.inPort);
+    b.pad(4);
+    b.pad(2);
+    packet.encode(b);
+    b.finish(offset);
+    send(b);
+    pending.insert(std::make_pair(flowKey(packet.ipv4Src, packet.ipv4Dst), now));
+}
+
+void Switch::expire (Clock::time_point now)
+{
+    for (auto it = flows.begin(); it != flows.end(); )
+    {
+        auto current = it++;
+        if (current->idleTimeout != 0 && now - current->lastTime >= std::chrono::seconds(current->idleTimeout))
+            remove(current, ofp::RR_IDLE_TIMEOUT, now);
+        else if (current->hardTimeout != 0 && now - current->createTime >= std::chrono::seconds(current->hardTimeout))
+            remove(current, ofp::RR_HARD_TIMEOUT, now);
+    }
+    // packet-ins without a decision in 10 seconds are lost
+    for (auto it = pending.begin(); it != pending.end(); )
+    {
+        if (now - it->second >= std::chrono::seconds(10))
+            it = pending.erase(it);
+        else
+            ++it;
+    }
+}
+
+void Switch::remove (std::list<FlowEntry>::iterator it, uint8_t reason, Clock::time_point now)
+{
+    if (it->flags & ofp::FF_SEND_FLOW_REM)
+    {
+        Buffer b;
+        encodeFlowRemoved(b, *it, reason, now);
+        send(b);
+        ++counters.flowRemoved;
+    }
+    std::vector<FlowEntry*>& bucket = it->hasSrc ? bySource[it->src] : wildcards;
+    auto e = std::find(bucket.begin(), bucket.end(), &*it);
+    if (e != bucket.end())
+    {
+        *e = bucket.back();
+        bucket.pop_back();
+    }
+    if (it->hasSrc && bucket.empty())
+        bySource.erase(it->src);
+    flows.erase(it);
+}
+
+void Switch::encodeFlowRemoved (Buffer& b, const FlowEntry& entry, uint8_t reason, Clock::time_point now)
+{
+    size_t offset = b.begin(ofp::FLOW_REMOVED, xid++);
+    b.u64(entry.cookie);
+    b.u16(entry.priority);
+    b.u8(reason);
+    b.u8(entry.tableId);
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(now - entry.createTime).count();
+    b.u32(duration / 1000000000);
+    b.u32(duration % 1000000000);
+    b.u16(entry.idleTimeout);
+    b.u16(entry.hardTimeout);
+    b.u64(entry.packets);
+    b.u64(entry.bytes);
+    entry.match.encode(b);
+    b.finish(offset);
+}
+
+void Switch::run()
+{
+    lookups = 0;
+    if (!connect())
+        return;
+    Buffer hello;
+    size_t offset = hello.begin(ofp::HELLO, xid++);
+    hello.finish(offset);
+    send(hello);
+    flush();
+
+    createUsers();
+    Clock::time_point start = Clock::now();
+    Clock::time_point trafficStart = Clock::time_point::max();
+    Clock::time_point lastExpire = start;
+    while (!stopped && fd >= 0)
+    {
+        pollfd p {fd, POLLIN, 0};
+        int ready = poll(&p, 1, 1);
+        if (ready > 0 && !receive())
+            break;
+        Clock::time_point now = Clock::now();
+        if (isReady && trafficStart == Clock::time_point::max())
+        {
+            trafficStart = now + std::chrono::milliseconds((int64_t) (options.warmup * 1000));
+            for (User& user : users)
+                user.next = trafficStart + (user.next - start);
+        }
+        if (now >= trafficStart)
+        {
+            if (now - trafficStart >= std::chrono::milliseconds((int64_t) (options.duration * 1000)))
+                break;
+            generate(now);
+        }
+        if (now - lastExpire >= std::chrono::milliseconds(100))
+        {
+            expire(now);
+            lastExpire = now;
+        }
+        flush();
+    }
+    counters.flows = flows.size();
+    if (fd >= 0)
+        close(fd);
+}
+
+bool parse (int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        const char* value = argv[++i];
+        if (arg == "--controller")
+        {
+            std::string s = value;
+            size_t colon = s.find(':');
+            options.host = s.substr(0, colon);
+            if (colon != std::string::npos)
+                options.port = atoi(s.c_str() + colon + 1);
+        }
+        else if (arg == "--switches")
+            options.switches = std::max(1l, atol(value));
+        else if (arg == "--ports")
+            options.ports = std::max(1l, atol(value));
+        else if (arg == "--valid")
+            options.valid = atol(value);
+        else if (arg == "--malicious")
+            options.malicious = atol(value);
+        else if (arg == "--ddos")
+            options.ddos = atol(value);
+        else if (arg == "--speed")
+            options.speed = std::max(0.001, atof(value));
+        else if (arg == "--duration")
+            options.duration = atof(value);
+        else if (arg == "--warmup")
+            options.warmup = atof(value);
+        else if (arg == "--flow-table")
+            options.flowTable = atol(value);
+        else
+            return false;
+    }
+    return true;
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: ddos-switch-fleet [--controller A.B.C.D:PORT] [--switches N] [--ports N]\n"
+                    "                         [--valid N] [--malicious N] [--ddos N] [--speed X]\n"
+                    "                         [--duration S] [--warmup S] [--flow-table N]\n");
+    exit(2);
+}
+
+}
+
+int main (int argc, char** argv)
+{
+    Options options;
+    if (!parse(argc, argv, options))
+        usage();
+
+    std::vector<std::unique_ptr<Switch>> switches;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < options.switches; ++i)
+        switches.emplace_back(new Switch(options, i + 1));
+    auto start = std::chrono::steady_clock::now();
+    for (auto& sw : switches)
+        threads.emplace_back(&Switch::run, sw.get());
+    for (auto& t : threads)
+        t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Counters total;
+    for (auto& sw : switches)
+    {
+        const Counters& c = sw->counters;
+        total.generated += c.generated;
+        total.matched += c.matched;
+        total.packetIns += c.packetIns;
+        total.flowRemoved += c.flowRemoved;
+        total.tableFull += c.tableFull;
+        total.receivedBytes += c.receivedBytes;
+        total.sentBytes += c.sentBytes;
+        total.flows += c.flows;
+        total.maxFlows = std::max(total.maxFlows, c.maxFlows);
+        for (size_t t = 0; t < ofp::TYPES_NUMBER; ++t)
+        {
+            total.received[t] += c.received[t];
+            total.sent[t] += c.sent[t];
+        }
+        for (size_t t = 0; t < ofp::MP_TYPES_NUMBER; ++t)
+        {
+            total.multipartRequests[t] += c.multipartRequests[t];
+            total.multipartReplyBytes[t] += c.multipartReplyBytes[t];
+        }
+        total.latencies.insert(total.latencies.end(), c.latencies.begin(), c.latencies.end());
+    }
+
+    double traffic = std::max(0.001, std::min(seconds, options.duration));
+    printf("switches: %zu, users per switch: %zu valid, %zu malicious, %zu ddos, speed x%g\n",
+           options.switches, options.valid, options.malicious, options.ddos, options.speed);
+    printf("packets: %llu generated, %llu matched flows (%.1f%%)\n", (unsigned long long) total.generated,
+           (unsigned long long) total.matched, total.generated ? 100. * total.matched / total.generated : 0.);
+    printf("packet-ins: %llu (%.0f/s)\n", (unsigned long long) total.packetIns, total.packetIns / traffic);
+    printf("flows: %zu at the end, max %zu per switch, %llu flow-removed, %llu table-full errors\n",
+           total.flows, total.maxFlows, (unsigned long long) total.flowRemoved, (unsigned long long) total.tableFull);
+
+    std::vector<uint32_t>& l = total.latencies;
+    std::sort(l.begin(), l.end());
+    auto percentile = [&l](double p) { return l.empty() ? 0u : l[std::min(l.size() - 1, (size_t) (p * l.size()))]; };
+    printf("decisions: %zu of %llu packet-ins, latency us: p50 %u, p90 %u, p99 %u, p999 %u, max %u\n",
+           l.size(), (unsigned long long) total.packetIns, percentile(0.5), percentile(0.9), percentile(0.99),
+           percentile(0.999), l.empty() ? 0u : l.back());
+
+    printf("\ncontrol channel: %.1f MB received, %.1f MB sent\n", total.receivedBytes / 1e6, total.sentBytes / 1e6);
+    printf("  %-26s %-12s %s\n", "message", "received", "sent");
+    for (size_t t = 0; t < ofp::TYPES_NUMBER; ++t)
+    {
+        if (total.received[t] == 0 && total.sent[t] == 0)
+            continue;
+        printf("  %-26s %-12llu %llu\n", ofp::typeName(t), (unsigned long long) total.received[t],
+               (unsigned long long) total.sent[t]);
+    }
+    printf("  multipart requests:");
+    for (size_t t = 0; t < ofp::MP_TYPES_NUMBER; ++t)
+    {
+        if (total.multipartRequests[t] != 0)
+            printf(" type %zu: %llu (%llu reply bytes)", t, (unsigned long long) total.multipartRequests[t],
+                   (unsigned long long) total.multipartReplyBytes[t]);
+    }
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,653 @@
+// Traffic generator of the mininet/scapy user profiles at line rate:
+// packets are written to an AF_PACKET TX ring (PACKET_MMAP, TPACKET_V2)
+// of an interface of a Mininet host, a veth pair or a namespace, one
+// ring per thread, and paced by the clock.
+//
+//   ddos-traffic-gen --interface IFACE --profile valid|malicious|ddos [options]
+//     --rate PPS           packets per second of all threads (1000)
+//     --flow-rate FPS      new flows per second, default of the profile:
+//                          valid 6-10 packets per flow (valid_user.sh),
+//                          malicious 2-3 packets (malicious_user.sh),
+//                          ddos 1 packet with a spoofed source (ddos_user.py)
+//     --duration S         0: until interrupted (10)
+//     --threads N          rings and sending threads (1)
+//     --src A.B.C.D        source of valid and malicious users (address of the interface)
+//     --src-mac MAC        (address of the interface)
+//     --dst-net A.B.C.D/N  destinations (10.0.0.0/28: hosts of mininet/topo.py)
+//     --spoof-net A.B.C.D/N  spoofed sources of ddos (0.0.0.0/0)
+//     --proto icmp|udp     echo requests like ping, or udp (icmp)
+//     --size BYTES         frame size without FCS (64)
+//     --ring-frames N      frames of a ring (4096)
+//     --batch N            frames of a send() (64)
+//     --qdisc-bypass       PACKET_QDISC_BYPASS
+//     --stats S            print rates every S seconds (1)
+//
+// Destination MACs follow autoSetMacs of Mininet (low 24 bits of the
+// address), ddos packets are broadcast as in ddos_user.py.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+enum Profiles {
+    Valid,
+    Malicious,
+    DDoS
+};
+
+struct Network {
+    uint32_t addr;  // host byte order
+    uint32_t mask;
+    uint32_t size() const { return ~mask; }
+};
+
+struct Options {
+    std::string interface;
+    Profiles profile;
+    bool hasProfile;
+    double rate;
+    double flowRate;    // 0: of the profile
+    double duration;
+    size_t threads;
+    uint32_t src;       // host byte order, 0: of the interface
+    uint8_t srcMac[6];
+    bool hasSrcMac;
+    Network dstNet;
+    Network spoofNet;
+    bool isUdp;
+    size_t size;
+    size_t ringFrames;
+    size_t batch;
+    bool qdiscBypass;
+    double stats;
+    Options(): profile(Valid), hasProfile(false), rate(1000.), flowRate(0.), duration(10.), threads(1), src(0),
+               srcMac(), hasSrcMac(false), dstNet{0x0a000000, 0xfffffff0}, spoofNet{0, 0}, isUdp(false),
+               size(64), ringFrames(4096), batch(64), qdiscBypass(false), stats(1.) {}
+};
+
+// packets per flow of the profiles
+const size_t MIN_PACKETS[] = {6, 2, 1};
+const size_t MAX_PACKETS[] = {10, 3, 1};
+
+const size_t FRAME_SIZE = 2048;     // of a ring, TPACKET_ALIGNMENT
+const size_t BLOCK_SIZE = 1 << 16;
+const size_t HEADERS_SIZE = 14 + 20 + 8;
+const size_t MAX_LAG = 10;          // milliseconds of packets sent late, older are skipped
+
+std::atomic<bool> stopped(false);
+
+uint32_t checksumAdd (uint32_t sum, const uint8_t* p, size_t len)
+{
+    for (size_t i = 0; i + 1 < len; i += 2)
+        sum += p[i] << 8 | p[i + 1];
+    if (len & 1)
+        sum += p[len - 1] << 8;
+    return sum;
+}
+
+uint16_t checksumFinish (uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum;
+}
+
+void put16 (uint8_t* p, uint16_t v) { p[0] = v >> 8; p[1] = v; }
+void put32 (uint8_t* p, uint32_t v) { put16(p, v >> 16); put16(p + 2, v); }
+
+// counters of a thread, read by the main thread
+struct Counters {
+    std::atomic<uint64_t> packets;
+    std::atomic<uint64_t> flows;
+    std::atomic<uint64_t> ringFull;     // waits for a free frame
+    std::atomic<uint64_t> skipped;      // packets of the lag above MAX_LAG
+    std::atomic<uint64_t> wrongFormat;  // frames rejected by the kernel
+    Counters(): packets(0), flows(0), ringFull(0), skipped(0), wrongFormat(0) {}
+};
+
+class Sender {
+public:
+    Sender (const Options& options_, size_t id_)
+        : options(options_), id(id_), fd(-1), ring(nullptr), ringSize(0), frame(0),
+          state(0x9e3779b97f4a7c15ull * (id_ + 1) ^ (uint64_t) Clock::now().time_since_epoch().count()),
+          left(0), sequence(0) {}
+    ~Sender();
+
+    bool open (int ifindex);
+    void run();
+    Counters counters;
+
+private:
+    uint64_t random()
+    {
+        // xorshift64*
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545f4914f6cdd1dull;
+    }
+    // hosts of the network: no network and broadcast addresses below /30
+    uint32_t randomIn (const Network& net)
+    {
+        if (net.size() < 3 || net.mask == 0)
+            return net.addr | (uint32_t) (random() % ((uint64_t) net.size() + 1));
+        return net.addr + 1 + (uint32_t) (random() % (net.size() - 1));
+    }
+    void newFlow();
+    void encode (uint8_t* data);
+    tpacket2_hdr* nextFrame();
+    void kick();
+
+    const Options& options;
+    size_t id;
+    int fd;
+    uint8_t* ring;
+    size_t ringSize;
+    size_t frame;
+    uint64_t state;
+
+    // current flow
+    uint32_t src;
+    uint32_t dst;
+    uint8_t srcMac[6];
+    uint8_t dstMac[6];
+    uint16_t port;      // udp source or echo identifier
+    size_t left;
+    uint16_t sequence;
+    std::vector<uint8_t> payload;
+    uint32_t payloadSum;
+};
+
+Sender::~Sender()
+{
+    if (ring != nullptr)
+        munmap(ring, ringSize);
+    if (fd >= 0)
+        close(fd);
+}
+
+bool Sender::open (int ifindex)
+{
+    fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "socket: %s\n", strerror(errno));
+        return false;
+    }
+    int version = TPACKET_V2;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+    {
+        fprintf(stderr, "PACKET_VERSION: %s\n", strerror(errno));
+        return false;
+    }
+    if (options.qdiscBypass)
+    {
+        int one = 1;
+        if (setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one)) < 0)
+            fprintf(stderr, "PACKET_QDISC_BYPASS: %s\n", strerror(errno));
+    }
+    tpacket_req req;
+    req.tp_frame_size = FRAME_SIZE;
+    req.tp_block_size = BLOCK_SIZE;
+    size_t framesPerBlock = BLOCK_SIZE / FRAME_SIZE;
+    req.tp_block_nr = std::max<size_t>(1, (options.ringFrames + framesPerBlock - 1) / framesPerBlock);
+    req.tp_frame_nr = req.tp_block_nr * framesPerBlock;
+    if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0)
+    {
+        fprintf(stderr, "PACKET_TX_RING: %s\n", strerror(errno));
+        return false;
+    }
+    ringSize = (size_t) req.tp_block_nr * req.tp_block_size;
+    void* p = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        fprintf(stderr, "mmap of the ring: %s\n", strerror(errno));
+        return false;
+    }
+    ring = static_cast<uint8_t*>(p);
+
+    sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = 0; // transmit only
+    addr.sll_ifindex = ifindex;
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        fprintf(stderr, "bind to %s: %s\n", options.interface.c_str(), strerror(errno));
+        return false;
+    }
+
+    // the payload is the same for all packets, its checksum is summed once
+    size_t payloadSize = std::max(options.size, (size_t) 60) - HEADERS_SIZE;
+    payload.resize(payloadSize);
+    for (size_t i = 0; i < payloadSize; ++i)
+        payload[i] = 0x10 + i; // ping pattern
+    payloadSum = checksumAdd(0, payload.data(), payload.size());
+    return true;
+}
+
+void Sender::newFlow()
+{
+    switch (options.profile)
+    {
+    case Valid:
+    case Malicious:
+        src = options.src;
+        memcpy(srcMac, options.srcMac, 6);
+        break;
+    case DDoS:
+    {
+        src = randomIn(options.spoofNet);
+        uint64_t r = random();
+        memcpy(srcMac, &r, 6);
+        srcMac[0] = (srcMac[0] & 0xfe) | 0x02; // unicast, locally administered
+        break;
+    }
+    }
+    do {
+        dst = randomIn(options.dstNet);
+    } while (dst == src && options.dstNet.size() > 0);
+    if (options.profile == DDoS)
+        memset(dstMac, 0xff, 6);
+    else
+    {
+        uint8_t mac[6] = {0, 0, 0, (uint8_t) (dst >> 16), (uint8_t) (dst >> 8), (uint8_t) dst};
+        memcpy(dstMac, mac, 6);
+    }
+    port = 1024 + random() % 64000;
+    sequence = 1;
+    if (options.flowRate > 0)
+        left = std::max<size_t>(1, (size_t) (options.rate / options.flowRate + 0.5));
+    else
+        left = MIN_PACKETS[options.profile] + random() % (MAX_PACKETS[options.profile] - MIN_PACKETS[options.profile] + 1);
+    ++counters.flows;
+}
+
+// Ethernet, IPv4, and ICMP echo request or UDP of the current flow
+void Sender::encode (uint8_t* data)
+{
+    if (left == 0)
+        newFlow();
+    --left;
+
+    memcpy(data, dstMac, 6);
+    memcpy(data + 6, srcMac, 6);
+    put16(data + 12, ETH_P_IP);
+
+    uint8_t* ip = data + 14;
+    size_t ipLength = 20 + 8 + payload.size();
+    ip[0] = 0x45;
+    ip[1] = 0;
+    put16(ip + 2, ipLength);
+    put16(ip + 4, sequence);
+    put16(ip + 6, 0x4000);  // don't fragment
+    ip[8] = 64;
+    ip[9] = options.isUdp ? 17 : 1;
+    put16(ip + 10, 0);
+    put32(ip + 12, src);
+    put32(ip + 16, dst);
+    put16(ip + 10, checksumFinish(checksumAdd(0, ip, 20)));
+
+    uint8_t* l4 = ip + 20;
+    if (options.isUdp)
+    {
+        put16(l4, port);
+        put16(l4 + 2, 5001);
+        put16(l4 + 4, 8 + payload.size());
+        put16(l4 + 6, 0);   // no checksum
+    } else {
+        l4[0] = 8;          // echo request
+        l4[1] = 0;
+        put16(l4 + 2, 0);
+        put16(l4 + 4, port);
+        put16(l4 + 6, sequence);
+        put16(l4 + 2, checksumFinish(checksumAdd(payloadSum, l4, 8)));
+    }
+    memcpy(l4 + 8, payload.data(), payload.size());
+    ++sequence;
+}
+
+// a free frame of the ring, nullptr when stopped
+tpacket2_hdr* Sender::nextFrame()
+{
+    size_t frames = ringSize / FRAME_SIZE;
+    tpacket2_hdr* hdr = reinterpret_cast<tpacket2_hdr*>(ring + frame * FRAME_SIZE);
+    bool isFull = false;
+    for (;;)
+    {
+        uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+        if (status == TP_STATUS_AVAILABLE)
+            break;
+        if (status & TP_STATUS_WRONG_FORMAT)
+        {
+            ++counters.wrongFormat;
+            __atomic_store_n(&hdr->tp_status, TP_STATUS_AVAILABLE, __ATOMIC_RELEASE);
+            break;
+        }
+        if (!isFull)
+        {
+            ++counters.ringFull;
+            isFull = true;
+        }
+        kick();
+        pollfd p {fd, POLLOUT, 0};
+        poll(&p, 1, 10);
+        if (stopped)
+            return nullptr;
+    }
+    frame = (frame + 1) % frames;
+    return hdr;
+}
+
+void Sender::kick()
+{
+    if (send(fd, nullptr, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != ENOBUFS && errno != EINTR)
+    {
+        fprintf(stderr, "send on %s: %s\n", options.interface.c_str(), strerror(errno));
+        stopped = true;
+    }
+}
+
+void Sender::run()
+{
+    double rate = options.rate / options.threads;
+    size_t frameLength = std::max(options.size, (size_t) 60);
+    const size_t dataOffset = TPACKET2_HDRLEN - sizeof(sockaddr_ll);
+
+    Clock::time_point start = Clock::now();
+    uint64_t sent = 0;
+    uint64_t skipped = 0;
+    uint64_t total = options.duration > 0 ? (uint64_t) (rate * options.duration) : UINT64_MAX;
+    while (!stopped && sent + skipped < total)
+    {
+        // packets due by the clock
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        uint64_t due = std::min<uint64_t>((uint64_t) (elapsed * rate), total) - sent - skipped;
+        uint64_t maxLag = std::max<uint64_t>(options.batch, rate * MAX_LAG / 1000);
+        if (due > maxLag)
+        {
+            skipped += due - maxLag;
+            counters.skipped += due - maxLag;
+            due = maxLag;
+        }
+        if (due == 0)
+        {
+            // sleep to the next packet, spin the last 50 us
+            double wait = (sent + skipped + 1) / rate - elapsed;
+            if (wait > 100e-6)
+            {
+                timespec ts {0, (long) ((wait - 50e-6) * 1e9)};
+                if (wait > 1.)
+                    ts = {1, 0};
+                nanosleep(&ts, nullptr);
+            }
+            continue;
+        }
+
+        size_t n = std::min<uint64_t>(due, options.batch);
+        for (size_t i = 0; i < n; ++i)
+        {
+            tpacket2_hdr* hdr = nextFrame();
+            if (hdr == nullptr)
+                break;
+            uint8_t* data = reinterpret_cast<uint8_t*>(hdr) + dataOffset;
+            memset(data, 0, frameLength);
+            encode(data);
+            hdr->tp_len = frameLength;
+            __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+            ++sent;
+        }
+        counters.packets = sent;
+        kick();
+    }
+    // the kernel sends the rest of the ring
+    if (!stopped)
+        send(fd, nullptr, 0, 0);
+    counters.packets = sent;
+}
+
+bool parseNetwork (const char* s, Network& net)
+{
+    std::string str = s;
+    size_t slash = str.find('/');
+    int bits = slash == std::string::npos ? 32 : atoi(str.c_str() + slash + 1);
+    in_addr addr;
+    if (inet_pton(AF_INET, str.substr(0, slash).c_str(), &addr) != 1 || bits < 0 || bits > 32)
+        return false;
+    net.mask = bits == 0 ? 0 : 0xffffffffu << (32 - bits);
+    net.addr = ntohl(addr.s_addr) & net.mask;
+    return true;
+}
+
+bool parseMac (const char* s, uint8_t* mac)
+{
+    unsigned b[6];
+    if (sscanf(s, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+        return false;
+    for (int i = 0; i < 6; ++i)
+        mac[i] = b[i];
+    return true;
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: ddos-traffic-gen --interface IFACE --profile valid|malicious|ddos [--rate PPS]\n"
+                    "                        [--flow-rate FPS] [--duration S] [--threads N] [--src A.B.C.D]\n"
+                    "                        [--src-mac MAC] [--dst-net A.B.C.D/N] [--spoof-net A.B.C.D/N]\n"
+                    "                        [--proto icmp|udp] [--size BYTES] [--ring-frames N] [--batch N]\n"
+                    "                        [--qdisc-bypass] [--stats S]\n");
+    exit(2);
+}
+
+bool parse (int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--qdisc-bypass")
+        {
+            options.qdiscBypass = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        const char* value = argv[++i];
+        if (arg == "--interface")
+            options.interface = value;
+        else if (arg == "--profile")
+        {
+            std::string profile = value;
+            if (profile == "valid")
+                options.profile = Valid;
+            else if (profile == "malicious")
+                options.profile = Malicious;
+            else if (profile == "ddos")
+                options.profile = DDoS;
+            else
+                return false;
+            options.hasProfile = true;
+        }
+        else if (arg == "--rate")
+            options.rate = atof(value);
+        else if (arg == "--flow-rate")
+            options.flowRate = atof(value);
+        else if (arg == "--duration")
+            options.duration = atof(value);
+        else if (arg == "--threads")
+            options.threads = std::max(1l, atol(value));
+        else if (arg == "--src")
+        {
+            in_addr addr;
+            if (inet_pton(AF_INET, value, &addr) != 1)
+                return false;
+            options.src = ntohl(addr.s_addr);
+        }
+        else if (arg == "--src-mac")
+        {
+            if (!parseMac(value, options.srcMac))
+                return false;
+            options.hasSrcMac = true;
+        }
+        else if (arg == "--dst-net")
+        {
+            if (!parseNetwork(value, options.dstNet))
+                return false;
+        }
+        else if (arg == "--spoof-net")
+        {
+            if (!parseNetwork(value, options.spoofNet))
+                return false;
+        }
+        else if (arg == "--proto")
+            options.isUdp = std::string(value) == "udp";
+        else if (arg == "--size")
+            options.size = std::min(1500l, std::max(60l, atol(value)));
+        else if (arg == "--ring-frames")
+            options.ringFrames = std::max(32l, atol(value));
+        else if (arg == "--batch")
+            options.batch = std::max(1l, atol(value));
+        else if (arg == "--stats")
+            options.stats = atof(value);
+        else
+            return false;
+    }
+    return !options.interface.empty() && options.hasProfile && options.rate > 0;
+}
+
+// address and MAC of the interface for valid and malicious users
+bool interfaceAddresses (Options& options)
+{
+    int s = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, options.interface.c_str(), IFNAMSIZ - 1);
+    if (options.src == 0)
+    {
+        if (ioctl(s, SIOCGIFADDR, &ifr) < 0)
+        {
+            fprintf(stderr, "%s has no address, use --src: %s\n", options.interface.c_str(), strerror(errno));
+            close(s);
+            return false;
+        }
+        options.src = ntohl(reinterpret_cast<sockaddr_in*>(&ifr.ifr_addr)->sin_addr.s_addr);
+    }
+    if (!options.hasSrcMac)
+    {
+        if (ioctl(s, SIOCGIFHWADDR, &ifr) < 0)
+        {
+            fprintf(stderr, "%s: %s\n", options.interface.c_str(), strerror(errno));
+            close(s);
+            return false;
+        }
+        memcpy(options.srcMac, ifr.ifr_hwaddr.sa_data, 6);
+    }
+    close(s);
+    return true;
+}
+
+void stop (int)
+{
+    stopped = true;
+}
+
+}
+
+int main (int argc, char** argv)
+{
+    Options options;
+    if (!parse(argc, argv, options))
+        usage();
+    int ifindex = if_nametoindex(options.interface.c_str());
+    if (ifindex == 0)
+    {
+        fprintf(stderr, "%s: %s\n", options.interface.c_str(), strerror(errno));
+        return 1;
+    }
+    if (options.profile != DDoS && !interfaceAddresses(options))
+        return 1;
+
+    std::vector<std::unique_ptr<Sender>> senders;
+    for (size_t i = 0; i < options.threads; ++i)
+    {
+        senders.emplace_back(new Sender(options, i));
+        if (!senders.back()->open(ifindex))
+            return 1;
+    }
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (auto& sender : senders)
+        threads.emplace_back(&Sender::run, sender.get());
+
+    // rates of the interval while the threads run
+    std::atomic<size_t> running(threads.size());
+    std::thread reporter([&]() {
+        uint64_t lastPackets = 0, lastFlows = 0;
+        Clock::time_point last = start;
+        while (running > 0 && options.stats > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds((int64_t) (options.stats * 1000)));
+            if (running == 0)
+                break;
+            uint64_t packets = 0, flows = 0;
+            for (auto& sender : senders)
+            {
+                packets += sender->counters.packets;
+                flows += sender->counters.flows;
+            }
+            Clock::time_point now = Clock::now();
+            double seconds = std::chrono::duration<double>(now - last).count();
+            fprintf(stderr, "%.0f pps, %.0f new flows/s\n", (packets - lastPackets) / seconds, (flows - lastFlows) / seconds);
+            lastPackets = packets;
+            lastFlows = flows;
+            last = now;
+        }
+    });
+    for (auto& t : threads)
+        t.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    running = 0;
+    reporter.join();
+
+    uint64_t packets = 0, flows = 0, ringFull = 0, skipped = 0, wrongFormat = 0;
+    for (auto& sender : senders)
+    {
+        packets += sender->counters.packets;
+        flows += sender->counters.flows;
+        ringFull += sender->counters.ringFull;
+        skipped += sender->counters.skipped;
+        wrongFormat += sender->counters.wrongFormat;
+    }
+    printf("%llu packets, %llu flows in %.3f s: %.0f pps, %.0f new flows/s (%.1f Mbit/s)\n",
+           (unsigned long long) packets, (unsigned long long) flows, seconds, packets / seconds, flows / seconds,
+           packets * std::max(options.size, (size_t) 60) * 8 / seconds / 1e6);
+    printf("ring full %llu times, %llu packets skipped behind the clock, %llu rejected by the kernel\n",
+           (unsigned long long) ringFull, (unsigned long long) skipped, (unsigned long long) wrongFormat);
+    return 0;
+}